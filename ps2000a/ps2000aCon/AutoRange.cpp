@@ -0,0 +1,173 @@
+﻿/******************************************************************************
+ *
+ * Filename: AutoRange.cpp
+ *
+ * Description:
+ *   Автоматический выбор диапазона аналоговых каналов (см. AutoRange.h).
+ *
+ ******************************************************************************/
+#include <string.h>
+#include "AutoRange.h"
+#include "Simd.h"
+
+/****************************************************************************
+* ResetSegment
+* Сбрасывает статистику сегмента канала
+****************************************************************************/
+static void ResetSegment(AUTO_RANGE_CHANNEL * channel)
+{
+	channel->minValue = INT16_MAX;
+	channel->maxValue = INT16_MIN;
+	channel->overflow = 0;
+}
+
+/****************************************************************************
+* AutoRangeInit
+* Параметры
+* - rangesMv, firstRange, lastRange - шкалы диапазонов и допустимые диапазоны устройства
+* - maxValue - отсчёт АЦП полной шкалы (ps2000aMaximumValue)
+* - upper, lower, holdSegments - пороги переключения (см. AutoRange.h)
+*
+* Возвращает 0 при недопустимых порогах
+****************************************************************************/
+int16_t AutoRangeInit(AUTO_RANGE * autoRange, const uint16_t * rangesMv, int16_t firstRange, int16_t lastRange, int16_t maxValue,
+	double upper, double lower, int16_t holdSegments)
+{
+	int16_t ch;
+
+	memset(autoRange, 0, sizeof(AUTO_RANGE));
+
+	autoRange->rangesMv = rangesMv;
+	autoRange->firstRange = firstRange;
+	autoRange->lastRange = lastRange;
+	autoRange->maxValue = maxValue;
+	autoRange->upper = upper;
+	autoRange->lower = lower;
+	autoRange->holdSegments = holdSegments > 0 ? holdSegments : 1;
+
+	for (ch = 0; ch < PS2000A_MAX_CHANNELS; ch++)
+	{
+		ResetSegment(&autoRange->channels[ch]);
+	}
+
+	return maxValue > 0 && firstRange <= lastRange && lower > 0.0 && lower < upper && upper <= 1.0;
+}
+
+/****************************************************************************
+* AutoRangeSetChannel
+* Задаёт текущие настройки канала (например, после выбора диапазона вручную)
+****************************************************************************/
+void AutoRangeSetChannel(AUTO_RANGE * autoRange, int16_t channel, int16_t enabled, int16_t range)
+{
+	AUTO_RANGE_CHANNEL * state = &autoRange->channels[channel];
+
+	state->enabled = enabled;
+	state->range = range;
+	state->quiet = 0;
+	ResetSegment(state);
+
+	if (channel >= autoRange->channelCount)
+	{
+		autoRange->channelCount = channel + 1;
+	}
+}
+
+/****************************************************************************
+* AutoRangeObserve
+* Учитывает отсчёты канала в статистике текущего сегмента
+* (для агрегированных данных передаются и максимумы, и минимумы)
+****************************************************************************/
+void AutoRangeObserve(AUTO_RANGE * autoRange, int16_t channel, const int16_t * values, int32_t nValues)
+{
+	AUTO_RANGE_CHANNEL * state = &autoRange->channels[channel];
+
+	if (values != NULL && nValues > 0)
+	{
+		SimdMinMax16(values, nValues, &state->minValue, &state->maxValue);
+	}
+}
+
+/****************************************************************************
+* AutoRangeOverflow
+* Учитывает флаги перегрузки драйвера (бит 0 - канал A, бит 1 - канал B, ...)
+****************************************************************************/
+void AutoRangeOverflow(AUTO_RANGE * autoRange, int16_t overflow)
+{
+	int16_t ch;
+
+	for (ch = 0; ch < autoRange->channelCount; ch++)
+	{
+		if (overflow & (1 << ch))
+		{
+			autoRange->channels[ch].overflow = 1;
+		}
+	}
+}
+
+/****************************************************************************
+* AutoRangeUpdate
+* Завершает сегмент канала и выбирает диапазон для следующего
+*
+* Возвращает новый диапазон (или текущий, если переключение не нужно)
+****************************************************************************/
+int16_t AutoRangeUpdate(AUTO_RANGE * autoRange, int16_t channel)
+{
+	AUTO_RANGE_CHANNEL * state = &autoRange->channels[channel];
+	int32_t peak;
+	double peakMv;
+	int16_t range = state->range;
+	int16_t lower;
+
+	if (!state->enabled || state->minValue > state->maxValue)		// Канал выключен или сегмент пуст
+	{
+		ResetSegment(state);
+		return range;
+	}
+
+	peak = state->maxValue > -(int32_t) state->minValue ? state->maxValue : -(int32_t) state->minValue;
+	peakMv = (double) peak * autoRange->rangesMv[range] / autoRange->maxValue;
+
+	if (state->overflow)
+	{
+		// Истинная амплитуда неизвестна - на один диапазон выше за сегмент
+		range = range < autoRange->lastRange ? range + 1 : range;
+		state->quiet = 0;
+	}
+	else if (peak >= autoRange->upper * autoRange->maxValue)
+	{
+		while (range < autoRange->lastRange && peakMv >= autoRange->upper * autoRange->rangesMv[range])
+		{
+			range++;
+		}
+
+		state->quiet = 0;
+	}
+	else
+	{
+		lower = autoRange->firstRange;
+
+		while (lower < range && peakMv > autoRange->lower * autoRange->rangesMv[lower])
+		{
+			lower++;
+		}
+
+		if (lower < range && ++state->quiet >= autoRange->holdSegments)
+		{
+			range = lower;
+		}
+		else if (lower == range)
+		{
+			state->quiet = 0;
+		}
+	}
+
+	if (range != state->range)
+	{
+		state->range = range;
+		state->quiet = 0;
+		autoRange->switches++;
+	}
+
+	ResetSegment(state);
+	return range;
+}
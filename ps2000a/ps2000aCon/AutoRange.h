@@ -0,0 +1,48 @@
+﻿/******************************************************************************
+ *
+ * Filename: AutoRange.h
+ *
+ * Description:
+ *   Автоматический выбор диапазона аналоговых каналов.
+ *   За сегмент сбора (блок или часть потока) по каждому каналу накапливаются
+ *   пиковое значение и признак перегрузки. По окончании сегмента диапазон
+ *   увеличивается, если была перегрузка или пик превысил upper от шкалы,
+ *   и уменьшается, если пик помещается в lower от шкалы меньшего диапазона
+ *   holdSegments сегментов подряд. Разница между upper и lower и задержка
+ *   перед уменьшением не дают диапазону переключаться на каждом сегменте.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include "ps2000aApi.h"
+
+typedef struct tAutoRangeChannel
+{
+	int16_t		enabled;
+	int16_t		range;			// Текущий диапазон (PS2000A_RANGE)
+	int16_t		minValue;		// Экстремумы текущего сегмента, отсчёты АЦП
+	int16_t		maxValue;
+	int16_t		overflow;		// В сегменте была перегрузка
+	int16_t		quiet;			// Сегментов подряд, в которых сигнал помещался в меньший диапазон
+}AUTO_RANGE_CHANNEL;
+
+typedef struct tAutoRange
+{
+	const uint16_t *	rangesMv;		// Шкала каждого диапазона, мВ
+	int16_t				firstRange;
+	int16_t				lastRange;
+	int16_t				maxValue;		// Отсчёт АЦП полной шкалы
+	double				upper;			// Доля шкалы, выше которой диапазон увеличивается
+	double				lower;			// Доля шкалы меньшего диапазона, ниже которой он выбирается
+	int16_t				holdSegments;	// Сегментов подряд перед уменьшением диапазона
+	int16_t				channelCount;
+	AUTO_RANGE_CHANNEL	channels[PS2000A_MAX_CHANNELS];
+	int32_t				switches;		// Всего переключений диапазона
+}AUTO_RANGE;
+
+int16_t AutoRangeInit(AUTO_RANGE * autoRange, const uint16_t * rangesMv, int16_t firstRange, int16_t lastRange, int16_t maxValue,
+	double upper, double lower, int16_t holdSegments);
+void AutoRangeSetChannel(AUTO_RANGE * autoRange, int16_t channel, int16_t enabled, int16_t range);
+void AutoRangeObserve(AUTO_RANGE * autoRange, int16_t channel, const int16_t * values, int32_t nValues);
+void AutoRangeOverflow(AUTO_RANGE * autoRange, int16_t overflow);
+int16_t AutoRangeUpdate(AUTO_RANGE * autoRange, int16_t channel);
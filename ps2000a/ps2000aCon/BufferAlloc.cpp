@@ -0,0 +1,309 @@
+﻿/******************************************************************************
+ *
+ * Filename: BufferAlloc.cpp
+ *
+ * Description:
+ *   Выделение больших буферов отсчётов (см. BufferAlloc.h).
+ *   Перед данными лежит заголовок BUFFER_BLOCK (64 байта, выравнивание
+ *   данных для векторных ядер сохраняется) с размером и способом выделения.
+ *
+ ******************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include "windows.h"
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "BufferAlloc.h"
+
+#define BUFFER_HEAP		0x80000000		// Выделен calloc
+
+typedef struct tBufferBlock
+{
+	size_t		size;			// Размер выделенной области вместе с заголовком
+	uint32_t	flags;			// BUFFER_ALLOC_FLAGS, которые удалось выполнить, или BUFFER_HEAP
+	uint8_t		reserved[64 - sizeof(size_t) - sizeof(uint32_t)];
+}BUFFER_BLOCK;
+
+/****************************************************************************
+* Prefault
+* Обращается к каждой странице, чтобы ОС выделила её сейчас, а не при
+* первой записи драйвера
+****************************************************************************/
+static void Prefault(uint8_t * base, size_t size)
+{
+	size_t offset;
+
+	for (offset = 0; offset < size; offset += 4096)
+	{
+		((volatile uint8_t *) base)[offset] = 0;
+	}
+}
+
+#ifdef _WIN32
+/****************************************************************************
+* EnableLockMemory
+* Включает право SeLockMemoryPrivilege, без которого недоступны большие
+* страницы (право должно быть выдано пользователю в локальной политике)
+****************************************************************************/
+static BOOL EnableLockMemory(void)
+{
+	static int16_t enabled = -1;
+	TOKEN_PRIVILEGES privileges;
+	HANDLE token;
+
+	if (enabled >= 0)
+	{
+		return enabled;
+	}
+
+	enabled = 0;
+
+	if (OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+	{
+		privileges.PrivilegeCount = 1;
+		privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+		if (LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+			AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) && GetLastError() == ERROR_SUCCESS)
+		{
+			enabled = 1;
+		}
+
+		CloseHandle(token);
+	}
+
+	return enabled;
+}
+
+/****************************************************************************
+* MapRegion
+* Выделяет область size байт, по возможности большими страницами и на
+* узле NUMA вызывающего потока
+****************************************************************************/
+static uint8_t * MapRegion(size_t * size, uint32_t flags, uint32_t * done)
+{
+	DWORD type = MEM_RESERVE | MEM_COMMIT;
+	UCHAR node = 0;
+	BOOL local = (flags & BUFFER_LOCAL_NODE) && GetNumaProcessorNode((UCHAR) GetCurrentProcessorNumber(), &node);
+	size_t largePage = GetLargePageMinimum();
+	uint8_t * base = NULL;
+
+	if ((flags & BUFFER_LARGE_PAGES) && largePage && EnableLockMemory())
+	{
+		size_t rounded = (*size + largePage - 1) / largePage * largePage;
+
+		base = (uint8_t *) (local ? VirtualAllocExNuma(GetCurrentProcess(), NULL, rounded, type | MEM_LARGE_PAGES, PAGE_READWRITE, node) :
+			VirtualAlloc(NULL, rounded, type | MEM_LARGE_PAGES, PAGE_READWRITE));
+
+		if (base != NULL)
+		{
+			*size = rounded;
+			*done |= BUFFER_LARGE_PAGES | BUFFER_LOCKED;		// Большие страницы не вытесняются
+		}
+	}
+
+	if (base == NULL)
+	{
+		base = (uint8_t *) (local ? VirtualAllocExNuma(GetCurrentProcess(), NULL, *size, type, PAGE_READWRITE, node) :
+			VirtualAlloc(NULL, *size, type, PAGE_READWRITE));
+	}
+
+	if (base != NULL && local)
+	{
+		*done |= BUFFER_LOCAL_NODE;
+	}
+
+	return base;
+}
+
+/****************************************************************************
+* LockRegion
+* Закрепляет область в памяти, при нехватке квоты увеличивает рабочий набор
+****************************************************************************/
+static BOOL LockRegion(uint8_t * base, size_t size)
+{
+	SIZE_T minimum, maximum;
+
+	if (VirtualLock(base, size))
+	{
+		return TRUE;
+	}
+
+	return GetProcessWorkingSetSize(GetCurrentProcess(), &minimum, &maximum) &&
+		SetProcessWorkingSetSize(GetCurrentProcess(), minimum + size, maximum + size) &&
+		VirtualLock(base, size);
+}
+
+/****************************************************************************
+* UnmapRegion
+****************************************************************************/
+static void UnmapRegion(uint8_t * base, size_t size, uint32_t flags)
+{
+	if ((flags & BUFFER_LOCKED) && !(flags & BUFFER_LARGE_PAGES))
+	{
+		VirtualUnlock(base, size);
+	}
+
+	VirtualFree(base, 0, MEM_RELEASE);
+}
+#else
+/****************************************************************************
+* MapRegion
+* Выделяет область size байт, по возможности большими страницами. Узел
+* NUMA задаётся первым обращением: без libnuma страницы, к которым
+* вызывающий поток обращается в Prefault, размещаются на его узле
+****************************************************************************/
+static uint8_t * MapRegion(size_t * size, uint32_t flags, uint32_t * done)
+{
+	const size_t hugePage = 2 << 20;
+	void * base = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+	if (flags & BUFFER_LARGE_PAGES)
+	{
+		size_t rounded = (*size + hugePage - 1) / hugePage * hugePage;
+
+		base = mmap(NULL, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+		if (base != MAP_FAILED)
+		{
+			*size = rounded;
+			*done |= BUFFER_LARGE_PAGES;
+		}
+	}
+#endif
+
+	if (base == MAP_FAILED)
+	{
+		base = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+#ifdef MADV_HUGEPAGE
+		// Нет зарезервированных больших страниц - прозрачные большие страницы
+		if (base != MAP_FAILED && (flags & BUFFER_LARGE_PAGES) && madvise(base, *size, MADV_HUGEPAGE) == 0)
+		{
+			*done |= BUFFER_LARGE_PAGES;
+		}
+#endif
+	}
+
+	if (base != MAP_FAILED && (flags & BUFFER_LOCAL_NODE))
+	{
+		*done |= BUFFER_LOCAL_NODE | BUFFER_PREFAULT;
+	}
+
+	return base != MAP_FAILED ? (uint8_t *) base : NULL;
+}
+
+/****************************************************************************
+* LockRegion
+* Закрепляет область в памяти (ограничено RLIMIT_MEMLOCK)
+****************************************************************************/
+static int16_t LockRegion(uint8_t * base, size_t size)
+{
+	return mlock(base, size) == 0;
+}
+
+/****************************************************************************
+* UnmapRegion
+****************************************************************************/
+static void UnmapRegion(uint8_t * base, size_t size, uint32_t flags)
+{
+	if (flags & BUFFER_LOCKED)
+	{
+		munlock(base, size);
+	}
+
+	munmap(base, size);
+}
+#endif
+
+/****************************************************************************
+* BufferAlloc
+* Выделяет обнулённый буфер size байт
+* Параметры
+* - flags - BUFFER_ALLOC_FLAGS
+*
+* Возвращает NULL, если память выделить не удалось
+****************************************************************************/
+void * BufferAlloc(size_t size, uint32_t flags)
+{
+	BUFFER_BLOCK * block;
+	uint32_t done = 0;
+	size_t total = size + sizeof(BUFFER_BLOCK);
+	uint8_t * base;
+
+	if (flags == 0 || size < BUFFER_ALLOC_THRESHOLD)
+	{
+		if ((block = (BUFFER_BLOCK *) calloc(1, total)) == NULL)
+		{
+			return NULL;
+		}
+
+		block->size = total;
+		block->flags = BUFFER_HEAP;
+		return block + 1;
+	}
+
+	if ((base = MapRegion(&total, flags, &done)) == NULL)
+	{
+		return NULL;
+	}
+
+	if ((flags & BUFFER_LOCKED) && !(done & BUFFER_LOCKED) && LockRegion(base, total))
+	{
+		done |= BUFFER_LOCKED;
+	}
+
+	// Закреплённые страницы уже выделены, остальные выделяются первым обращением
+	if ((flags & BUFFER_PREFAULT) || (done & BUFFER_PREFAULT))
+	{
+		if (!(done & BUFFER_LOCKED))
+		{
+			Prefault(base, total);
+		}
+
+		done |= BUFFER_PREFAULT;
+	}
+
+	block = (BUFFER_BLOCK *) base;
+	block->size = total;
+	block->flags = done;
+	return block + 1;
+}
+
+/****************************************************************************
+* BufferAllocFlags
+* Возвращает BUFFER_ALLOC_FLAGS, которые удалось выполнить для буфера
+****************************************************************************/
+uint32_t BufferAllocFlags(const void * buffer)
+{
+	const BUFFER_BLOCK * block = (const BUFFER_BLOCK *) buffer - 1;
+
+	return buffer == NULL || block->flags == BUFFER_HEAP ? 0 : block->flags;
+}
+
+/****************************************************************************
+* BufferFree
+* Освобождает буфер BufferAlloc (NULL допускается)
+****************************************************************************/
+void BufferFree(void * buffer)
+{
+	BUFFER_BLOCK * block = (BUFFER_BLOCK *) buffer - 1;
+
+	if (buffer == NULL)
+	{
+		return;
+	}
+
+	if (block->flags == BUFFER_HEAP)
+	{
+		free(block);
+	}
+	else
+	{
+		UnmapRegion((uint8_t *) block, block->size, block->flags);
+	}
+}
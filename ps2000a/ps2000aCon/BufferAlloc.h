@@ -0,0 +1,34 @@
+﻿/******************************************************************************
+ *
+ * Filename: BufferAlloc.h
+ *
+ * Description:
+ *   Выделение больших буферов отсчётов.
+ *   Буферы в сотни мегабайт, в которые драйвер пишет во время сбора, при
+ *   обычном malloc порождают промахи TLB и первые обращения к страницам
+ *   прямо в цикле сбора. BufferAlloc по флагам выделяет их большими
+ *   страницами, на узле NUMA процессора вызывающего потока (поэтому буферы
+ *   устройства выделяются в его рабочем потоке), закрепляет в памяти и
+ *   заранее обращается к каждой странице. Недоступная возможность
+ *   (нет права на большие страницы, мал рабочий набор) пропускается,
+ *   буфер всё равно выделяется. Без флагов и для буферов меньше
+ *   BUFFER_ALLOC_THRESHOLD - обычный calloc.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUFFER_ALLOC_THRESHOLD	(1 << 20)		// Меньшие буферы выделяются calloc
+
+typedef enum
+{
+	BUFFER_LARGE_PAGES	= 0x01,		// Большие страницы (Windows: MEM_LARGE_PAGES, Linux: MAP_HUGETLB или MADV_HUGEPAGE)
+	BUFFER_LOCKED		= 0x02,		// Закрепить в физической памяти (VirtualLock / mlock)
+	BUFFER_LOCAL_NODE	= 0x04,		// Узел NUMA процессора вызывающего потока
+	BUFFER_PREFAULT		= 0x08		// Обратиться к каждой странице при выделении
+}BUFFER_ALLOC_FLAGS;
+
+void * BufferAlloc(size_t size, uint32_t flags);
+uint32_t BufferAllocFlags(const void * buffer);
+void BufferFree(void * buffer);
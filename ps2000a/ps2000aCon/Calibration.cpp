@@ -0,0 +1,161 @@
+﻿/******************************************************************************
+ *
+ * Filename: Calibration.cpp
+ *
+ * Description:
+ *   Преобразование отсчётов АЦП в милливольты по таблице (см. Calibration.h).
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Calibration.h"
+#include "FileOpen.h"
+
+/****************************************************************************
+* CalibrationLoad
+* Читает файл поправок (отсутствующий файл - без поправок)
+*
+* Возвращает количество загруженных поправок
+****************************************************************************/
+int32_t CalibrationLoad(CALIBRATION * calibration, const char * fileName)
+{
+	char line[128];
+	char serial[16];
+	char channel;
+	int range;
+	double gain;
+	double offsetMv;
+	int32_t capacity = 0;
+	CALIBRATION_ENTRY * entries;
+	FILE * fp;
+
+	memset(calibration, 0, sizeof(CALIBRATION));
+
+	if ((fp = FileOpen(fileName, "r")) == NULL)
+	{
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		if (line[0] == '#' ||
+#ifdef _MSC_VER
+			sscanf_s(line, "%15s %c %d %lf %lf", serial, (unsigned) sizeof(serial), &channel, 1, &range, &gain, &offsetMv) != 5)
+#else
+			sscanf(line, "%15s %c %d %lf %lf", serial, &channel, &range, &gain, &offsetMv) != 5)
+#endif
+		{
+			continue;
+		}
+
+		if (calibration->count == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 16;
+
+			if ((entries = (CALIBRATION_ENTRY *) realloc(calibration->entries, capacity * sizeof(CALIBRATION_ENTRY))) == NULL)
+			{
+				break;
+			}
+
+			calibration->entries = entries;
+		}
+
+		memcpy(calibration->entries[calibration->count].serial, serial, sizeof(serial));
+		calibration->entries[calibration->count].channel = (int16_t) ((channel | 0x20) - 'a');
+		calibration->entries[calibration->count].range = (int16_t) range;
+		calibration->entries[calibration->count].gain = gain;
+		calibration->entries[calibration->count].offsetMv = offsetMv;
+		calibration->count++;
+	}
+
+	fclose(fp);
+	return calibration->count;
+}
+
+/****************************************************************************
+* CalibrationFind
+* Поправка для канала и диапазона устройства (без поправки - коэффициент 1, смещение 0).
+* Поправка для конкретного серийного номера предпочтительнее общей
+****************************************************************************/
+void CalibrationFind(const CALIBRATION * calibration, const char * serial, int16_t channel, int16_t range, double * gain, double * offsetMv)
+{
+	int32_t i;
+	int16_t exact = 0;
+
+	*gain = 1.0;
+	*offsetMv = 0.0;
+
+	for (i = 0; i < calibration->count && !exact; i++)
+	{
+		const CALIBRATION_ENTRY * entry = &calibration->entries[i];
+
+		if (entry->channel != channel || entry->range != range)
+		{
+			continue;
+		}
+
+		exact = strcmp(entry->serial, serial) == 0;
+
+		if (exact || strcmp(entry->serial, "*") == 0)
+		{
+			*gain = entry->gain;
+			*offsetMv = entry->offsetMv;
+		}
+	}
+}
+
+/****************************************************************************
+* CalibrationFree
+****************************************************************************/
+void CalibrationFree(CALIBRATION * calibration)
+{
+	free(calibration->entries);
+	memset(calibration, 0, sizeof(CALIBRATION));
+}
+
+/****************************************************************************
+* ConversionBuild
+* Заполняет таблицу преобразования
+* Параметры
+* - adcOffset - отсчёт АЦП, соответствующий нулю на входе АЦП
+* - mvPerCountPositive, mvPerCountNegative - мВ на отсчёт выше и ниже adcOffset
+* - analogueOffsetMv - смещение канала (добавляется к сигналу до АЦП)
+* - gain, offsetMv - поправка пользователя
+*
+* Возвращает 0, если не удалось выделить память
+****************************************************************************/
+int16_t ConversionBuild(CONVERSION_TABLE * table, int16_t adcOffset, double mvPerCountPositive, double mvPerCountNegative,
+	double analogueOffsetMv, double gain, double offsetMv)
+{
+	int32_t raw;
+	int32_t counts;
+
+	if (table->mv == NULL && (table->mv = (float *) malloc(CONVERSION_TABLE_SIZE * sizeof(float))) == NULL)
+	{
+		return 0;
+	}
+
+	for (raw = INT16_MIN; raw <= INT16_MAX; raw++)
+	{
+		counts = raw - adcOffset;
+		table->mv[(uint16_t) raw] = (float) (gain * (counts * (counts >= 0 ? mvPerCountPositive : mvPerCountNegative) - analogueOffsetMv) + offsetMv);
+	}
+
+	table->adcOffset = adcOffset;
+	table->mvPerCountPositive = mvPerCountPositive;
+	table->mvPerCountNegative = mvPerCountNegative;
+	table->gain = gain;
+	table->offsetMv = offsetMv;
+
+	return 1;
+}
+
+/****************************************************************************
+* ConversionFree
+****************************************************************************/
+void ConversionFree(CONVERSION_TABLE * table)
+{
+	free(table->mv);
+	table->mv = NULL;
+}
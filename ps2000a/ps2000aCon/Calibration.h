@@ -0,0 +1,67 @@
+﻿/******************************************************************************
+ *
+ * Filename: Calibration.h
+ *
+ * Description:
+ *   Преобразование отсчётов АЦП в милливольты по таблице.
+ *   Для каждого канала коэффициенты берутся из ps2000aGetScalingValues
+ *   (или из идеальной шкалы диапазона, если драйвер их не сообщает;
+ *   положительная и отрицательная полуволны масштабируются по
+ *   ps2000aMaximumValue и ps2000aMinimumValue), учитывается смещение канала
+ *   и поправки пользователя из файла калибровки. Результат заранее
+ *   вычисляется для всех 65536 значений отсчёта, поэтому преобразование -
+ *   одно обращение к таблице на отсчёт. Таблица пересчитывается при смене
+ *   диапазона или смещения канала.
+ *
+ *   Файл калибровки - текст, строка на поправку:
+ *     серийный_номер канал диапазон коэффициент смещение_мВ
+ *   например "AX123/456 A 7 1.0021 -0.8" (* вместо номера - любое устройство,
+ *   строки с # - комментарии). Напряжение входа = коэффициент * измеренное + смещение.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+
+#define CONVERSION_TABLE_SIZE	65536
+
+typedef struct tCalibrationEntry
+{
+	char		serial[16];			// Серийный номер устройства, "*" - любое
+	int16_t		channel;
+	int16_t		range;
+	double		gain;
+	double		offsetMv;
+}CALIBRATION_ENTRY;
+
+typedef struct tCalibration
+{
+	CALIBRATION_ENTRY *	entries;
+	int32_t				count;
+}CALIBRATION;
+
+typedef struct tConversionTable
+{
+	float *		mv;					// Напряжение входа, мВ, по отсчёту АЦП (индекс - отсчёт как uint16_t)
+	int16_t		adcOffset;			// Параметры ConversionBuild, по которым построена таблица
+	double		mvPerCountPositive;
+	double		mvPerCountNegative;
+	double		gain;
+	double		offsetMv;
+}CONVERSION_TABLE;
+
+int32_t CalibrationLoad(CALIBRATION * calibration, const char * fileName);
+void CalibrationFind(const CALIBRATION * calibration, const char * serial, int16_t channel, int16_t range, double * gain, double * offsetMv);
+void CalibrationFree(CALIBRATION * calibration);
+
+int16_t ConversionBuild(CONVERSION_TABLE * table, int16_t adcOffset, double mvPerCountPositive, double mvPerCountNegative,
+	double analogueOffsetMv, double gain, double offsetMv);
+void ConversionFree(CONVERSION_TABLE * table);
+
+/****************************************************************************
+* ConversionLookup
+* Напряжение входа, мВ, для одного отсчёта
+****************************************************************************/
+static inline float ConversionLookup(const CONVERSION_TABLE * table, int16_t raw)
+{
+	return table->mv[(uint16_t) raw];
+}
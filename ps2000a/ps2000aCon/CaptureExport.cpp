@@ -0,0 +1,636 @@
+﻿/******************************************************************************
+ *
+ * Filename: CaptureExport.cpp
+ *
+ * Description:
+ *   Параллельная выгрузка файла захвата в текстовую таблицу (см. CaptureExport.h).
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "windows.h"
+#include "Calibration.h"
+#include "CaptureExport.h"
+#include "CaptureFile.h"
+#include "CsvFormat.h"
+#include "DigitalPack.h"
+#include "EdgeList.h"
+#include "FileOpen.h"
+
+#define EXPORT_VALUE_TEXT	12			// Наибольшая длина текста одного значения с ", "
+#define EXPORT_MISSING_TEXT	", , , , "	// Поля канала, у которого в блоке нет ни одного фрагмента
+#define EXPORT_DIGITAL_ROW	33			// Строка цифровых каналов: 16 раз "0 " или "1 " и перевод строки
+
+// Отсчёты, переданные одним обратным вызовом: фрагменты буферов с общим firstSample
+typedef struct tExportBlock
+{
+	uint64_t	firstSample;
+	uint32_t	nSamples;
+	int64_t		offsets[PS2000A_MAX_CHANNEL_BUFFERS];	// Смещение заголовка фрагмента буфера в файле, -1 - нет фрагмента
+	uint32_t	capacity;			// Наибольшее nSamples фрагментов блока
+	int16_t		mvTables[PS2000A_MAX_CHANNELS];		// Таблицы милливольт каналов (номер в EXPORT_CONTEXT::mvTables)
+}EXPORT_BLOCK;
+
+// Текст милливольт канала для сочетания диапазона, смещения и шкалы
+typedef struct tExportMvTable
+{
+	int16_t			channel;
+	int16_t			range;
+	float			analogueOffset;
+	CAPTURE_SCALE	scale;
+	CSV_TABLE		text;
+}EXPORT_MV_TABLE;
+
+typedef struct tExportContext
+{
+	const char *	captureName;
+	CAPTURE_HEADER	header;
+	EXPORT_BLOCK *	blocks;
+	int32_t			nBlocks;
+	int16_t			channels[PS2000A_MAX_CHANNELS];		// Номера включённых каналов
+	int16_t			nChannels;
+	CSV_TABLE		adcText;
+	EXPORT_MV_TABLE *	mvTables;
+	int16_t			nMvTables;
+	CONVERSION_TABLE	conversion;		// Рабочая таблица для построения текста милливольт
+}EXPORT_CONTEXT;
+
+typedef struct tExportTask
+{
+	EXPORT_CONTEXT *	context;
+	int32_t				firstBlock;
+	int32_t				nBlocks;
+	uint64_t			nSamples;
+	char *				text;
+	size_t				length;
+	int16_t				ok;
+	HANDLE				thread;
+}EXPORT_TASK;
+
+/****************************************************************************
+* BuildMvText
+* Таблица текста милливольт канала для действующих диапазона, смещения и
+* шкалы (строится при первом использовании этого сочетания). Значения те же,
+* что adc_to_mv при сборе: по шкале из файла, а для файлов без шкал - по
+* номинальной шкале диапазона
+*
+* Возвращает номер таблицы в context->mvTables, -1 при нехватке памяти
+****************************************************************************/
+static int16_t BuildMvText(EXPORT_CONTEXT * context, const uint16_t * rangesMv, int16_t ch, const CAPTURE_RANGES * ranges)
+{
+	EXPORT_MV_TABLE * table;
+	const CAPTURE_SCALE * scale = &ranges->scale[ch];
+	int16_t range = ranges->range[ch];
+	float analogueOffset = ranges->analogueOffset[ch];
+	float offset = analogueOffset * 1000.0f;
+	int32_t offsetMv = (int32_t) (offset < 0.0f ? offset - 0.5f : offset + 0.5f);
+	int32_t raw;
+	float mv;
+	int16_t t;
+
+	for (t = 0; t < context->nMvTables; t++)
+	{
+		table = &context->mvTables[t];
+
+		if (table->channel == ch && table->range == range && table->analogueOffset == analogueOffset &&
+			memcmp(&table->scale, scale, sizeof(CAPTURE_SCALE)) == 0)
+		{
+			return t;
+		}
+	}
+
+	if (scale->mvPerCountPositive > 0.0 &&
+		!ConversionBuild(&context->conversion, scale->adcOffset, scale->mvPerCountPositive, scale->mvPerCountNegative,
+			analogueOffset * 1000.0, scale->gain, scale->offsetMv))
+	{
+		return -1;
+	}
+
+	if ((table = (EXPORT_MV_TABLE *) realloc(context->mvTables, (context->nMvTables + 1) * sizeof(EXPORT_MV_TABLE))) == NULL)
+	{
+		return -1;
+	}
+
+	context->mvTables = table;
+	table = &context->mvTables[context->nMvTables];
+	table->channel = ch;
+	table->range = range;
+	table->analogueOffset = analogueOffset;
+	table->scale = *scale;
+
+	if (!CsvTableInit(&table->text))
+	{
+		return -1;
+	}
+
+	for (raw = INT16_MIN; raw <= INT16_MAX; raw++)
+	{
+		if (scale->mvPerCountPositive > 0.0)
+		{
+			mv = ConversionLookup(&context->conversion, (int16_t) raw);
+			CsvTableSet(&table->text, (int16_t) raw, (int32_t) (mv < 0.0f ? mv - 0.5f : mv + 0.5f));
+		}
+		else
+		{
+			CsvTableSet(&table->text, (int16_t) raw, (raw * rangesMv[range]) / context->header.maxValue - offsetMv);
+		}
+	}
+
+	return context->nMvTables++;
+}
+
+/****************************************************************************
+* IndexCapture
+* Строит список блоков отсчётов файла захвата по его оглавлению (для файлов
+* без оглавления CaptureReadIndex строит его просмотром заголовков фрагментов)
+****************************************************************************/
+static int16_t IndexCapture(EXPORT_CONTEXT * context, const uint16_t * rangesMv)
+{
+	CAPTURE_FILE capture;
+	CAPTURE_CHUNK chunk;
+	CAPTURE_RANGES ranges;
+	CAPTURE_INDEX_ENTRY * entries = NULL;
+	const CAPTURE_INDEX_ENTRY * entry;
+	uint32_t count = 0;
+	uint32_t e;
+	int32_t capacity = 0;
+	int16_t ok = 1;
+	int16_t ch;
+	EXPORT_BLOCK * block = NULL;
+
+	if (!CaptureOpen(&capture, context->captureName))
+	{
+		return 0;
+	}
+
+	if (!CaptureReadIndex(&capture, &entries, &count))
+	{
+		free(entries);
+		CaptureClose(&capture);
+		return 0;
+	}
+
+	context->header = capture.header;
+	memcpy(ranges.range, capture.header.range, sizeof(ranges.range));
+	memcpy(ranges.analogueOffset, capture.header.analogueOffset, sizeof(ranges.analogueOffset));
+	memcpy(ranges.scale, capture.header.scale, sizeof(ranges.scale));
+
+	for (ch = 0; ch < capture.header.channelCount && ch < PS2000A_MAX_CHANNELS; ch++)
+	{
+		if (capture.header.enabled[ch])
+		{
+			context->channels[context->nChannels++] = ch;
+		}
+	}
+
+	for (e = 0; e < count && ok; e++)
+	{
+		entry = &entries[e];
+
+		// В старых файлах фрагмент содержит только диапазоны (смещения остаются прежними)
+		// или диапазоны и смещения без шкал (милливольты - по номинальной шкале)
+		if (entry->type == CAPTURE_CHUNK_RANGE)
+		{
+			ok = CaptureSeek(capture.fp, entry->offset) && fread(&chunk, sizeof(CAPTURE_CHUNK), 1, capture.fp) == 1;
+
+			if (ok && chunk.payloadSize >= sizeof(ranges.range))
+			{
+				if (chunk.payloadSize < sizeof(ranges))
+				{
+					memset(ranges.scale, 0, sizeof(ranges.scale));
+				}
+
+				ok = fread(&ranges, chunk.payloadSize >= sizeof(ranges) ? sizeof(ranges) : chunk.payloadSize, 1, capture.fp) == 1;
+			}
+
+			continue;
+		}
+
+		if (entry->type != CAPTURE_CHUNK_ANALOGUE || entry->channel < 0 || entry->channel >= PS2000A_MAX_CHANNEL_BUFFERS)
+		{
+			continue;
+		}
+
+		if (block == NULL || block->firstSample != entry->firstSample)
+		{
+			if (context->nBlocks == capacity)
+			{
+				EXPORT_BLOCK * blocks;
+
+				capacity = capacity ? capacity * 2 : 1024;
+
+				if ((blocks = (EXPORT_BLOCK *) realloc(context->blocks, capacity * sizeof(EXPORT_BLOCK))) == NULL)
+				{
+					ok = 0;
+					break;
+				}
+
+				context->blocks = blocks;
+			}
+
+			block = &context->blocks[context->nBlocks++];
+			block->firstSample = entry->firstSample;
+			block->nSamples = entry->nSamples;
+			block->capacity = 0;
+			memset(block->offsets, 0xff, sizeof(block->offsets));
+			for (ch = 0; ch < context->nChannels && ok; ch++)
+			{
+				int16_t channel = context->channels[ch];
+
+				ok = ranges.range[channel] >= 0 && ranges.range[channel] < PS2000A_MAX_RANGES &&
+					(block->mvTables[channel] = BuildMvText(context, rangesMv, channel, &ranges)) >= 0;
+			}
+		}
+
+		block->offsets[entry->channel] = entry->offset;
+		block->capacity = entry->nSamples > block->capacity ? entry->nSamples : block->capacity;
+		block->nSamples = entry->nSamples < block->nSamples ? entry->nSamples : block->nSamples;
+	}
+
+	free(entries);
+	CaptureClose(&capture);
+	return ok && context->header.maxValue > 0;
+}
+
+/****************************************************************************
+* ReadBlock
+* Читает буферы включённых каналов блока
+* Параметры
+* - packed, capacity - буфер сжатых данных потока
+****************************************************************************/
+static int16_t ReadBlock(const EXPORT_CONTEXT * context, const EXPORT_BLOCK * block, FILE * fp, int16_t ** values,
+	uint8_t ** packed, uint32_t * capacity)
+{
+	CAPTURE_CHUNK chunk;
+	int16_t ch, buffer;
+
+	for (ch = 0; ch < context->nChannels; ch++)
+	{
+		for (buffer = context->channels[ch] * 2; buffer <= context->channels[ch] * 2 + 1; buffer++)
+		{
+			if (block->offsets[buffer] < 0)		// Без минимумов (PS2000A_RATIO_MODE_NONE) выводятся сами отсчёты
+			{
+				continue;
+			}
+
+			if (values[buffer] == NULL || !CaptureSeek(fp, block->offsets[buffer]) || fread(&chunk, sizeof(CAPTURE_CHUNK), 1, fp) != 1 ||
+				chunk.nSamples < block->nSamples || chunk.nSamples > block->capacity ||
+				!CaptureReadPayload(fp, &chunk, block->offsets[buffer] + sizeof(CAPTURE_CHUNK), context->header.sampleShift, values[buffer], packed, capacity))
+			{
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+/****************************************************************************
+* FormatBlock
+* Записывает строки блока в text; поля канала без фрагментов в блоке
+* остаются пустыми
+*
+* Возвращает указатель на конец текста
+****************************************************************************/
+static char * FormatBlock(const EXPORT_CONTEXT * context, const EXPORT_BLOCK * block, int16_t ** values, char * text)
+{
+	uint32_t i;
+	int16_t ch;
+
+	for (i = 0; i < block->nSamples; i++)
+	{
+		for (ch = 0; ch < context->nChannels; ch++)
+		{
+			int16_t channel = context->channels[ch];
+			const CSV_TABLE * mvText = &context->mvTables[block->mvTables[channel]].text;
+			const int16_t * maxValues = block->offsets[channel * 2] >= 0 ? values[channel * 2] : values[channel * 2 + 1];
+			const int16_t * minValues = block->offsets[channel * 2 + 1] >= 0 ? values[channel * 2 + 1] : maxValues;
+
+			if (block->offsets[channel * 2] < 0 && block->offsets[channel * 2 + 1] < 0)
+			{
+				memcpy(text, EXPORT_MISSING_TEXT, sizeof(EXPORT_MISSING_TEXT) - 1);
+				text += sizeof(EXPORT_MISSING_TEXT) - 1;
+				continue;
+			}
+
+			text = CsvAppend(text, &context->adcText, maxValues[i]);
+			text = CsvAppend(text, mvText, maxValues[i]);
+			text = CsvAppend(text, &context->adcText, minValues[i]);
+			text = CsvAppend(text, mvText, minValues[i]);
+		}
+
+		*text++ = '\n';
+	}
+
+	return text;
+}
+
+/****************************************************************************
+* ExportThread
+* Читает и форматирует блоки задания в его буфер
+****************************************************************************/
+static DWORD WINAPI ExportThread(LPVOID parameter)
+{
+	EXPORT_TASK * task = (EXPORT_TASK *) parameter;
+	const EXPORT_CONTEXT * context = task->context;
+	int16_t * values[PS2000A_MAX_CHANNEL_BUFFERS] = { NULL };
+	uint32_t capacity = 0;
+	uint8_t * packed = NULL;
+	uint32_t packedCapacity = 0;
+	int32_t b;
+	int16_t buffer;
+	char * text;
+	FILE * fp;
+
+	task->ok = 0;
+	task->text = (char *) malloc(task->nSamples * (context->nChannels * 4 * EXPORT_VALUE_TEXT + 1) + CSV_SLOT_SIZE);
+
+	if (task->text == NULL || (fp = FileOpen(context->captureName, "rb")) == NULL)
+	{
+		return 0;
+	}
+
+	text = task->text;
+	task->ok = 1;
+
+	for (b = task->firstBlock; b < task->firstBlock + task->nBlocks && task->ok; b++)
+	{
+		const EXPORT_BLOCK * block = &context->blocks[b];
+
+		if (block->capacity > capacity)
+		{
+			capacity = block->capacity;
+
+			for (buffer = 0; buffer < PS2000A_MAX_CHANNEL_BUFFERS; buffer++)
+			{
+				free(values[buffer]);
+				values[buffer] = (int16_t *) malloc(capacity * sizeof(int16_t));
+			}
+		}
+
+		if ((task->ok = ReadBlock(context, block, fp, values, &packed, &packedCapacity)) != 0)
+		{
+			text = FormatBlock(context, block, values, text);
+		}
+	}
+
+	task->length = text - task->text;
+
+	for (buffer = 0; buffer < PS2000A_MAX_CHANNEL_BUFFERS; buffer++)
+	{
+		free(values[buffer]);
+	}
+
+	free(packed);
+	fclose(fp);
+	return 0;
+}
+
+/****************************************************************************
+* CaptureExportCsv
+* Выгружает файл захвата captureName в текстовую таблицу csvName
+* Параметры
+* - rangesMv - шкала каждого диапазона, мВ
+* - nThreads - количество потоков, 0 - по числу процессоров
+* - rows - количество записанных строк
+*
+* Возвращает 1 при успехе
+****************************************************************************/
+int16_t CaptureExportCsv(const char * captureName, const char * csvName, const uint16_t * rangesMv, int16_t nThreads, uint64_t * rows)
+{
+	EXPORT_CONTEXT * context;
+	EXPORT_TASK * tasks = NULL;
+	int32_t nTasks = 0;
+	int32_t b, t, wave;
+	int16_t ch;
+	int16_t ok = 0;
+	FILE * fp = NULL;
+	SYSTEM_INFO systemInfo;
+
+	*rows = 0;
+
+	if (nThreads <= 0)
+	{
+		GetSystemInfo(&systemInfo);
+		nThreads = (int16_t) systemInfo.dwNumberOfProcessors;
+	}
+
+	nThreads = nThreads < 1 ? 1 : nThreads > EXPORT_MAX_THREADS ? EXPORT_MAX_THREADS : nThreads;
+
+	if ((context = (EXPORT_CONTEXT *) calloc(1, sizeof(EXPORT_CONTEXT))) == NULL)
+	{
+		return 0;
+	}
+
+	context->captureName = captureName;
+
+	if (CsvTableInit(&context->adcText) && IndexCapture(context, rangesMv) &&
+		(tasks = (EXPORT_TASK *) calloc(context->nBlocks + 1, sizeof(EXPORT_TASK))) != NULL &&
+		(fp = FileOpen(csvName, "w")) != NULL)
+	{
+		// Соседние блоки объединяются в задания примерно по EXPORT_TASK_SAMPLES отсчётов
+		for (b = 0; b < context->nBlocks; b++)
+		{
+			if (nTasks == 0 || tasks[nTasks - 1].nSamples >= EXPORT_TASK_SAMPLES)
+			{
+				tasks[nTasks].context = context;
+				tasks[nTasks].firstBlock = b;
+				nTasks++;
+			}
+
+			tasks[nTasks - 1].nBlocks++;
+			tasks[nTasks - 1].nSamples += context->blocks[b].nSamples;
+		}
+
+		for (ch = 0; ch < context->nChannels; ch++)
+		{
+			fprintf(fp, "Max ADC   Max mV   Min ADC   Min mV");
+		}
+
+		fprintf(fp, "\n");
+		ok = 1;
+
+		// Потоки запускаются волнами по nThreads заданий, буферы записываются по порядку
+		// по мере завершения, пока остальные задания волны ещё форматируются
+		for (wave = 0; wave < nTasks && ok; wave += nThreads)
+		{
+			for (t = wave; t < wave + nThreads && t < nTasks; t++)
+			{
+				tasks[t].thread = CreateThread(NULL, 0, ExportThread, &tasks[t], 0, NULL);
+
+				if (tasks[t].thread == NULL)
+				{
+					ExportThread(&tasks[t]);
+				}
+			}
+
+			for (t = wave; t < wave + nThreads && t < nTasks; t++)
+			{
+				if (tasks[t].thread != NULL)
+				{
+					WaitForSingleObject(tasks[t].thread, INFINITE);
+					CloseHandle(tasks[t].thread);
+				}
+
+				ok = ok && tasks[t].ok && (tasks[t].length == 0 || fwrite(tasks[t].text, tasks[t].length, 1, fp) == 1);
+				*rows += tasks[t].ok ? tasks[t].nSamples : 0;
+
+				free(tasks[t].text);
+				tasks[t].text = NULL;
+			}
+		}
+	}
+
+	if (fp != NULL)
+	{
+		fclose(fp);
+	}
+
+	free(tasks);
+	free(context->blocks);
+	CsvTableFree(&context->adcText);
+
+	for (t = 0; t < context->nMvTables; t++)
+	{
+		CsvTableFree(&context->mvTables[t].text);
+	}
+
+	free(context->mvTables);
+	ConversionFree(&context->conversion);
+	free(context);
+	return ok;
+}
+
+/****************************************************************************
+* WriteDigitalRows
+* Записывает строки nSamples слов портов: каналы распаковываются по байту на
+* отсчёт в values[0..15], затем собираются в строки text
+****************************************************************************/
+static int16_t WriteDigitalRows(FILE * fp, const uint16_t * words, int32_t nSamples, uint8_t ** values, char * text)
+{
+	char * row = text;
+	int32_t i;
+	int16_t bit;
+
+	for (bit = 0; bit < 16; bit++)
+	{
+		DigitalUnpackChannel(words, nSamples, bit, values[bit]);
+	}
+
+	for (i = 0; i < nSamples; i++)
+	{
+		for (bit = 15; bit >= 0; bit--)
+		{
+			*row++ = (char) ('0' + values[bit][i]);
+			*row++ = ' ';
+		}
+
+		*row++ = '\n';
+	}
+
+	return row == text || fwrite(text, row - text, 1, fp) == 1;
+}
+
+/****************************************************************************
+* CaptureExportDigital
+* Выгружает цифровые фрагменты файла захвата captureName в текстовый файл
+* textName в формате digiblock.txt; если поток записан списком переходов,
+* слова восстанавливаются из него
+* Параметры
+* - rows - количество записанных строк
+*
+* Возвращает 1 при успехе
+****************************************************************************/
+int16_t CaptureExportDigital(const char * captureName, const char * textName, uint64_t * rows)
+{
+	CAPTURE_FILE capture;
+	CAPTURE_CHUNK chunk;
+	EDGE_LIST edges;
+	void * payload = NULL;
+	uint32_t payloadCapacity = 0;
+	uint8_t * values[16] = { NULL };
+	char * text = NULL;
+	uint32_t capacity = 0;
+	uint64_t sample;
+	int32_t nSamples;
+	int16_t bit;
+	int16_t ok = 1;
+	FILE * fp;
+
+	*rows = 0;
+
+	if (!EdgeListLoad(&edges, captureName))
+	{
+		return 0;
+	}
+
+	if (!CaptureOpen(&capture, captureName))
+	{
+		EdgeListFree(&edges);
+		return 0;
+	}
+
+	if ((fp = FileOpen(textName, "w")) == NULL)
+	{
+		CaptureClose(&capture);
+		EdgeListFree(&edges);
+		return 0;
+	}
+
+	if (edges.nRecords > 0)
+	{
+		capacity = EXPORT_TASK_SAMPLES;
+		ok = (payload = malloc(capacity * sizeof(uint16_t))) != NULL && (text = (char *) malloc((size_t) capacity * EXPORT_DIGITAL_ROW)) != NULL;
+
+		for (bit = 0; bit < 16; bit++)
+		{
+			ok = (values[bit] = (uint8_t *) malloc(capacity)) != NULL && ok;
+		}
+
+		for (sample = 0; ok && sample < edges.nSamples; sample += nSamples)
+		{
+			nSamples = EdgeListDecode(&edges, sample, EXPORT_TASK_SAMPLES, (uint16_t *) payload);
+			ok = nSamples > 0 && WriteDigitalRows(fp, (const uint16_t *) payload, nSamples, values, text);
+			*rows += ok ? nSamples : 0;
+		}
+	}
+
+	while (ok && edges.nRecords == 0 && CaptureReadChunk(&capture, &chunk, &payload, &payloadCapacity))
+	{
+		if (chunk.type != CAPTURE_CHUNK_DIGITAL || chunk.payloadSize < chunk.nSamples * sizeof(uint16_t))
+		{
+			continue;
+		}
+
+		if (chunk.nSamples > capacity)
+		{
+			capacity = chunk.nSamples;
+			free(text);
+			ok = (text = (char *) malloc((size_t) capacity * EXPORT_DIGITAL_ROW)) != NULL;
+
+			for (bit = 0; bit < 16; bit++)
+			{
+				free(values[bit]);
+				ok = (values[bit] = (uint8_t *) malloc(capacity)) != NULL && ok;
+			}
+		}
+
+		if (ok && (ok = WriteDigitalRows(fp, (const uint16_t *) payload, (int32_t) chunk.nSamples, values, text)) != 0)
+		{
+			*rows += chunk.nSamples;
+		}
+	}
+
+	for (bit = 0; bit < 16; bit++)
+	{
+		free(values[bit]);
+	}
+
+	free(text);
+	free(payload);
+	fclose(fp);
+	CaptureClose(&capture);
+	EdgeListFree(&edges);
+	return ok;
+}
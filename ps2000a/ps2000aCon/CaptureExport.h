@@ -0,0 +1,31 @@
+﻿/******************************************************************************
+ *
+ * Filename: CaptureExport.h
+ *
+ * Description:
+ *   Выгрузка аналоговых данных файла захвата в текстовую таблицу в формате
+ *   stream.txt ("%d, %d, %d, %d, " - максимум АЦП и мВ, минимум АЦП и мВ
+ *   для каждого включённого канала).
+ *   Сначала по оглавлению файла (CAPTURE_CHUNK_INDEX) строится список блоков
+ *   отсчётов, затем блоки делятся на задания, каждое задание читается и
+ *   форматируется в свой буфер отдельным потоком, а буферы записываются в
+ *   файл по порядку. Длина строки зависит от значений, поэтому смещения
+ *   заданий в файле заранее неизвестны и запись идёт последовательно.
+ *   Милливольты - по шкалам и смещениям каналов из заголовка (с поправками
+ *   калибровки, как в stream.txt при сборе), с учётом смены диапазона
+ *   (CAPTURE_CHUNK_RANGE); для файлов без шкал - по номинальной шкале диапазона.
+ *   Цифровые фрагменты выгружаются в формате digiblock.txt: 16 значений
+ *   "0 " или "1 " в строке (D15 - D8, затем D7 - D0), каналы извлекаются
+ *   из упакованных слов векторной распаковкой (см. DigitalPack.h).
+ *   Поток, записанный списком переходов (CAPTURE_CHUNK_EDGES), сначала
+ *   восстанавливается в слова по EXPORT_TASK_SAMPLES отсчётов (см. EdgeList.h).
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+
+#define EXPORT_TASK_SAMPLES		65536		// Отсчётов в задании одного потока
+#define EXPORT_MAX_THREADS		32
+
+int16_t CaptureExportCsv(const char * captureName, const char * csvName, const uint16_t * rangesMv, int16_t nThreads, uint64_t * rows);
+int16_t CaptureExportDigital(const char * captureName, const char * textName, uint64_t * rows);
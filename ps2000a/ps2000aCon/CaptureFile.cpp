@@ -0,0 +1,587 @@
+﻿/******************************************************************************
+ *
+ * Filename: CaptureFile.cpp
+ *
+ * Description:
+ *   Запись и чтение двоичного файла захвата (см. CaptureFile.h).
+ *
+ ******************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#ifdef _MSC_VER
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "CaptureFile.h"
+#include "FileOpen.h"
+#include "Simd.h"
+#include "TimeAlign.h"
+#include "WaveCodec.h"
+
+/****************************************************************************
+* CaptureTell
+* Текущее смещение от начала файла (файлы захвата бывают больше 2 ГБ)
+****************************************************************************/
+static int64_t CaptureTell(FILE * fp)
+{
+#ifdef _MSC_VER
+	return _ftelli64(fp);
+#else
+	return (int64_t) ftello(fp);
+#endif
+}
+
+/****************************************************************************
+* CaptureTruncate
+* Укорачивает файл до size байт
+****************************************************************************/
+static int16_t CaptureTruncate(FILE * fp, int64_t size)
+{
+	if (fflush(fp) != 0)
+	{
+		return 0;
+	}
+
+#ifdef _MSC_VER
+	return _chsize_s(_fileno(fp), size) == 0;
+#else
+	return ftruncate(fileno(fp), (off_t) size) == 0;
+#endif
+}
+
+/****************************************************************************
+* Reserve
+* Увеличивает буфер до size байт
+****************************************************************************/
+static int16_t Reserve(uint8_t ** buffer, uint32_t * capacity, uint32_t size)
+{
+	if (size > *capacity)
+	{
+		uint8_t * resized = (uint8_t *) realloc(*buffer, size);
+
+		if (!resized)
+		{
+			return 0;
+		}
+
+		*buffer = resized;
+		*capacity = size;
+	}
+
+	return 1;
+}
+
+/****************************************************************************
+* IndexedChunk
+* Фрагменты, которые попадают в оглавление: данные и смены диапазона
+****************************************************************************/
+static int16_t IndexedChunk(uint32_t type)
+{
+	return type == CAPTURE_CHUNK_ANALOGUE || type == CAPTURE_CHUNK_DIGITAL || type == CAPTURE_CHUNK_EDGES ||
+		type == CAPTURE_CHUNK_RANGE;
+}
+
+/****************************************************************************
+* FindIndex
+* Ищет оглавление в конце файла (оно действительно, только если это
+* последний фрагмент)
+* Параметры
+* - fileSize - размер файла
+* - indexOffset, chunk - смещение и заголовок фрагмента оглавления;
+*   после успешного вызова файл установлен на начало оглавления
+*
+* Возвращает 1, если оглавление найдено
+****************************************************************************/
+static int16_t FindIndex(CAPTURE_FILE * capture, int64_t * fileSize, int64_t * indexOffset, CAPTURE_CHUNK * chunk)
+{
+	if (capture->fp == NULL || fseek(capture->fp, 0, SEEK_END) != 0 || (*fileSize = CaptureTell(capture->fp)) < (int64_t) sizeof(int64_t))
+	{
+		return 0;
+	}
+
+	return CaptureSeek(capture->fp, *fileSize - sizeof(int64_t)) && fread(indexOffset, sizeof(int64_t), 1, capture->fp) == 1 &&
+		*indexOffset >= (int64_t) capture->header.headerSize && *indexOffset < *fileSize && CaptureSeek(capture->fp, *indexOffset) &&
+		fread(chunk, sizeof(CAPTURE_CHUNK), 1, capture->fp) == 1 && chunk->type == CAPTURE_CHUNK_INDEX &&
+		*indexOffset + (int64_t) sizeof(CAPTURE_CHUNK) + chunk->payloadSize == *fileSize &&
+		chunk->payloadSize == chunk->nSamples * sizeof(CAPTURE_INDEX_ENTRY) + sizeof(int64_t);
+}
+
+/****************************************************************************
+* AddIndexEntry
+* Добавляет фрагмент данных в оглавление записываемого файла
+*
+* Возвращает 0, если не удалось выделить память (оглавление помечается
+* неполным)
+****************************************************************************/
+static int16_t AddIndexEntry(CAPTURE_FILE * capture, const CAPTURE_CHUNK * chunk, int64_t offset)
+{
+	CAPTURE_INDEX_ENTRY * entry;
+
+	if (capture->indexLost)
+	{
+		return 0;
+	}
+
+	if (capture->indexCount == capture->indexCapacity)
+	{
+		uint32_t capacity = capture->indexCapacity ? capture->indexCapacity * 2 : 1024;
+		CAPTURE_INDEX_ENTRY * index = (CAPTURE_INDEX_ENTRY *) realloc(capture->index, capacity * sizeof(CAPTURE_INDEX_ENTRY));
+
+		if (!index)
+		{
+			capture->indexLost = 1;
+			return 0;
+		}
+
+		capture->index = index;
+		capture->indexCapacity = capacity;
+	}
+
+	entry = &capture->index[capture->indexCount++];
+	entry->firstSample = chunk->firstSample;
+	entry->offset = offset;
+	entry->nSamples = chunk->nSamples;
+	entry->type = chunk->type;
+	entry->channel = chunk->channel;
+	entry->flags = chunk->flags;
+	return 1;
+}
+
+/****************************************************************************
+* CaptureCreate
+* создаёт файл захвата и записывает заголовок
+* (magic, version и headerSize заполняются автоматически)
+*
+* Возвращает 1 при успехе, 0 если файл не удалось создать
+****************************************************************************/
+int16_t CaptureCreate(CAPTURE_FILE * capture, const char * fileName, const CAPTURE_HEADER * header)
+{
+	memset(capture, 0, sizeof(CAPTURE_FILE));
+
+	capture->header = *header;
+	memcpy(capture->header.magic, CAPTURE_MAGIC, sizeof(capture->header.magic));
+	capture->header.version = CAPTURE_VERSION;
+	capture->header.headerSize = sizeof(CAPTURE_HEADER);
+
+	if ((capture->fp = FileOpen(fileName, "wb")) == NULL)
+	{
+		return 0;
+	}
+
+	if (fwrite(&capture->header, sizeof(CAPTURE_HEADER), 1, capture->fp) != 1)
+	{
+		CaptureClose(capture);
+		return 0;
+	}
+
+	capture->bytesWritten = sizeof(CAPTURE_HEADER);
+	return 1;
+}
+
+/****************************************************************************
+* CaptureWriteChunk
+* дописывает фрагмент в конец файла
+* Параметры
+* - type, channel - тип фрагмента и номер буфера
+* - firstSample - номер первого отсчёта фрагмента от начала сбора
+* - payload, nSamples, payloadSize - данные фрагмента
+* Аналоговые фрагменты при capture->compress сжимаются, если это
+* уменьшает их размер, иначе при заданном header.sampleShift хранятся
+* по байту на отсчёт, если все отсчёты фрагмента кратны шагу АЦП
+****************************************************************************/
+int16_t CaptureWriteChunk(CAPTURE_FILE * capture, CAPTURE_CHUNK_TYPE type, int16_t channel, uint64_t firstSample,
+	const void * payload, uint32_t nSamples, uint32_t payloadSize)
+{
+	CAPTURE_CHUNK chunk;
+
+	if (capture->fp == NULL)
+	{
+		return 0;
+	}
+
+	chunk.type = type;
+	chunk.channel = channel;
+	chunk.flags = 0;
+	chunk.firstSample = firstSample;
+	chunk.nSamples = nSamples;
+	chunk.payloadSize = payloadSize;
+
+	if (type == CAPTURE_CHUNK_ANALOGUE && capture->compress && payloadSize == nSamples * sizeof(int16_t) &&
+		Reserve(&capture->packed, &capture->packedCapacity, WaveCodecBound(nSamples)))
+	{
+		int64_t started = TimeAlignNow();
+		uint32_t packedSize = WaveCodecEncode((const int16_t *) payload, nSamples, capture->packed);
+
+		capture->packTime += TimeAlignNow() - started;
+
+		if (packedSize < payloadSize)
+		{
+			chunk.flags = CAPTURE_FLAG_PACKED;
+			chunk.payloadSize = packedSize;
+			payload = capture->packed;
+		}
+
+		capture->rawBytes += payloadSize;
+		capture->packedBytes += chunk.payloadSize;
+	}
+	else if (type == CAPTURE_CHUNK_ANALOGUE && capture->header.sampleShift > 0 && payloadSize == nSamples * sizeof(int16_t) &&
+		Reserve(&capture->packed, &capture->packedCapacity, nSamples))
+	{
+		int64_t started = TimeAlignNow();
+
+		if (SimdPack8((const int16_t *) payload, nSamples, capture->header.sampleShift, (int8_t *) capture->packed))
+		{
+			chunk.flags = CAPTURE_FLAG_INT8;
+			chunk.payloadSize = nSamples;
+			payload = capture->packed;
+		}
+
+		capture->packTime += TimeAlignNow() - started;
+		capture->rawBytes += payloadSize;
+		capture->packedBytes += chunk.payloadSize;
+	}
+
+	if (fwrite(&chunk, sizeof(CAPTURE_CHUNK), 1, capture->fp) != 1 ||
+		(chunk.payloadSize && fwrite(payload, chunk.payloadSize, 1, capture->fp) != 1))
+	{
+		return 0;
+	}
+
+	if (IndexedChunk(type))
+	{
+		AddIndexEntry(capture, &chunk, (int64_t) capture->bytesWritten);
+	}
+
+	capture->bytesWritten += sizeof(CAPTURE_CHUNK) + chunk.payloadSize;
+	return 1;
+}
+
+/****************************************************************************
+* CaptureOpen
+* открывает файл захвата для чтения и проверяет заголовок
+*
+* Возвращает 1 при успехе, 0 если файл не найден, не является файлом захвата
+* или записан более новой версией (её фрагменты могут быть непонятны)
+****************************************************************************/
+int16_t CaptureOpen(CAPTURE_FILE * capture, const char * fileName)
+{
+	uint32_t prefix[4];		// magic (8 байт), version и headerSize
+
+	memset(capture, 0, sizeof(CAPTURE_FILE));
+
+	if ((capture->fp = FileOpen(fileName, "rb")) == NULL)
+	{
+		return 0;
+	}
+
+	if (fread(prefix, sizeof(prefix), 1, capture->fp) != 1 || memcmp(prefix, CAPTURE_MAGIC, 8) != 0 ||
+		prefix[2] > CAPTURE_VERSION || prefix[3] < sizeof(prefix))
+	{
+		CaptureClose(capture);
+		return 0;
+	}
+
+	// Заголовок более старой версии может быть короче - недостающие поля остаются нулевыми
+	rewind(capture->fp);
+
+	if (fread(&capture->header, prefix[3] < sizeof(CAPTURE_HEADER) ? prefix[3] : sizeof(CAPTURE_HEADER), 1, capture->fp) != 1 ||
+		fseek(capture->fp, (long) prefix[3], SEEK_SET) != 0)
+	{
+		CaptureClose(capture);
+		return 0;
+	}
+
+	return 1;
+}
+
+/****************************************************************************
+* CaptureAppend
+* открывает существующий файл захвата для дописывания фрагментов.
+* Новые фрагменты записываются на место оглавления, а CaptureClose
+* записывает новое оглавление со старыми и новыми фрагментами
+*
+* Возвращает 1 при успехе, 0 если файл не найден или не является файлом захвата
+****************************************************************************/
+int16_t CaptureAppend(CAPTURE_FILE * capture, const char * fileName)
+{
+	CAPTURE_INDEX_ENTRY * entries;
+	CAPTURE_CHUNK chunk;
+	uint32_t count;
+	int64_t fileSize = -1;
+	int64_t indexOffset;
+
+	if (!CaptureOpen(capture, fileName))
+	{
+		return 0;
+	}
+
+	if (!CaptureReadIndex(capture, &entries, &count))
+	{
+		free(entries);
+		CaptureClose(capture);
+		return 0;
+	}
+
+	if (!FindIndex(capture, &fileSize, &indexOffset, &chunk))
+	{
+		indexOffset = fileSize;
+	}
+
+	if (indexOffset < (int64_t) capture->header.headerSize)
+	{
+		free(entries);
+		CaptureClose(capture);
+		return 0;
+	}
+
+	capture->index = entries;
+	capture->indexCount = capture->indexCapacity = count;
+	capture->bytesWritten = (uint64_t) indexOffset;
+	fclose(capture->fp);
+
+	if ((capture->fp = FileOpen(fileName, "r+b")) == NULL || !CaptureSeek(capture->fp, indexOffset))
+	{
+		CaptureClose(capture);
+		return 0;
+	}
+
+	capture->appended = 1;
+	return 1;
+}
+
+/****************************************************************************
+* CaptureReadChunk
+* читает следующий фрагмент файла
+* Параметры
+* - chunk - заголовок фрагмента
+* - payload, capacity - буфер данных, при необходимости увеличивается через realloc
+*   (освобождается вызывающей стороной)
+*
+* Сжатые фрагменты распаковываются: chunk описывает уже распакованные данные
+*
+* Возвращает 1 при успехе, 0 в конце файла или при ошибке чтения
+****************************************************************************/
+int16_t CaptureReadChunk(CAPTURE_FILE * capture, CAPTURE_CHUNK * chunk, void ** payload, uint32_t * capacity)
+{
+	uint32_t size;
+
+	if (capture->fp == NULL || fread(chunk, sizeof(CAPTURE_CHUNK), 1, capture->fp) != 1)
+	{
+		return 0;
+	}
+
+	size = (chunk->flags & (CAPTURE_FLAG_PACKED | CAPTURE_FLAG_INT8)) ? chunk->nSamples * sizeof(int16_t) : chunk->payloadSize;
+
+	if (size > *capacity)
+	{
+		void * buffer = realloc(*payload, size);
+
+		if (!buffer)
+		{
+			return 0;
+		}
+
+		*payload = buffer;
+		*capacity = size;
+	}
+
+	if (chunk->flags & (CAPTURE_FLAG_PACKED | CAPTURE_FLAG_INT8))
+	{
+		if (!CaptureReadPayload(capture->fp, chunk, CaptureTell(capture->fp), capture->header.sampleShift, (int16_t *) *payload,
+			&capture->packed, &capture->packedCapacity))
+		{
+			return 0;
+		}
+
+		chunk->flags &= ~(CAPTURE_FLAG_PACKED | CAPTURE_FLAG_INT8);
+		chunk->payloadSize = size;
+		return 1;
+	}
+
+	if (chunk->payloadSize && fread(*payload, chunk->payloadSize, 1, capture->fp) != 1)
+	{
+		return 0;
+	}
+
+	return 1;
+}
+
+/****************************************************************************
+* CaptureReadPayload
+* Читает отсчёты аналогового фрагмента, при необходимости распаковывая их
+* Параметры
+* - chunk, payloadOffset - заголовок фрагмента и смещение его данных
+* - sampleShift - sampleShift заголовка файла
+* - samples - не менее chunk->nSamples отсчётов
+* - packed, capacity - буфер сжатых данных, при необходимости увеличивается
+*   через realloc (освобождается вызывающей стороной)
+*
+* Возвращает 1 при успехе, 0 при ошибке чтения или повреждённых данных
+****************************************************************************/
+int16_t CaptureReadPayload(FILE * fp, const CAPTURE_CHUNK * chunk, int64_t payloadOffset, int16_t sampleShift,
+	int16_t * samples, uint8_t ** packed, uint32_t * capacity)
+{
+	if (!CaptureSeek(fp, payloadOffset))
+	{
+		return 0;
+	}
+
+	if (chunk->flags & CAPTURE_FLAG_INT8)
+	{
+		if (sampleShift <= 0 || sampleShift > 8 || chunk->payloadSize < chunk->nSamples ||
+			!Reserve(packed, capacity, chunk->nSamples) || fread(*packed, 1, chunk->nSamples, fp) != chunk->nSamples)
+		{
+			return 0;
+		}
+
+		SimdUnpack8((const int8_t *) *packed, chunk->nSamples, sampleShift, samples);
+		return 1;
+	}
+
+	if (!(chunk->flags & CAPTURE_FLAG_PACKED))
+	{
+		return chunk->payloadSize >= chunk->nSamples * sizeof(int16_t) &&
+			fread(samples, sizeof(int16_t), chunk->nSamples, fp) == chunk->nSamples;
+	}
+
+	return Reserve(packed, capacity, chunk->payloadSize) &&
+		fread(*packed, chunk->payloadSize, 1, fp) == 1 &&
+		WaveCodecDecode(*packed, chunk->payloadSize, samples, chunk->nSamples);
+}
+
+/****************************************************************************
+* CaptureSeek
+* Переход к смещению offset от начала файла (файлы захвата бывают больше 2 ГБ)
+****************************************************************************/
+int16_t CaptureSeek(FILE * fp, int64_t offset)
+{
+#ifdef _MSC_VER
+	return _fseeki64(fp, offset, SEEK_SET) == 0;
+#else
+	return fseeko(fp, (off_t) offset, SEEK_SET) == 0;
+#endif
+}
+
+/****************************************************************************
+* CaptureReadChunkHeader
+* читает заголовок следующего фрагмента и пропускает его данные
+* Параметры
+* - payloadOffset - смещение данных фрагмента от начала файла
+*   (для последующего чтения через CaptureSeek)
+*
+* Возвращает 1 при успехе, 0 в конце файла или при ошибке чтения
+****************************************************************************/
+int16_t CaptureReadChunkHeader(CAPTURE_FILE * capture, CAPTURE_CHUNK * chunk, int64_t * payloadOffset)
+{
+	if (capture->fp == NULL || fread(chunk, sizeof(CAPTURE_CHUNK), 1, capture->fp) != 1)
+	{
+		return 0;
+	}
+
+	*payloadOffset = CaptureTell(capture->fp);
+
+	return *payloadOffset >= 0 && CaptureSeek(capture->fp, *payloadOffset + chunk->payloadSize);
+}
+
+/****************************************************************************
+* CaptureReadIndex
+* читает оглавление файла; у файлов без оглавления (записанных прежними
+* версиями или прерванных) оно строится просмотром заголовков фрагментов.
+* После вызова чтение фрагментов начинается с первого
+* Параметры
+* - entries, count - оглавление (освобождается вызывающей стороной через free)
+*
+* Возвращает 1 при успехе
+****************************************************************************/
+int16_t CaptureReadIndex(CAPTURE_FILE * capture, CAPTURE_INDEX_ENTRY ** entries, uint32_t * count)
+{
+	CAPTURE_CHUNK chunk;
+	CAPTURE_FILE scan;
+	int64_t fileSize, indexOffset, payloadOffset;
+	int16_t ok = 0;
+
+	*entries = NULL;
+	*count = 0;
+
+	if (capture->fp == NULL)
+	{
+		return 0;
+	}
+
+	if (FindIndex(capture, &fileSize, &indexOffset, &chunk))
+	{
+		*entries = (CAPTURE_INDEX_ENTRY *) malloc(chunk.nSamples ? chunk.nSamples * sizeof(CAPTURE_INDEX_ENTRY) : 1);
+		ok = *entries != NULL && fread(*entries, sizeof(CAPTURE_INDEX_ENTRY), chunk.nSamples, capture->fp) == chunk.nSamples;
+		*count = ok ? chunk.nSamples : 0;
+	}
+
+	if (!ok)
+	{
+		free(*entries);
+		memset(&scan, 0, sizeof(CAPTURE_FILE));
+		scan.fp = capture->fp;
+		ok = CaptureSeek(capture->fp, capture->header.headerSize);
+
+		while (ok && CaptureReadChunkHeader(&scan, &chunk, &payloadOffset))
+		{
+			if (IndexedChunk(chunk.type))
+			{
+				ok = AddIndexEntry(&scan, &chunk, payloadOffset - sizeof(CAPTURE_CHUNK));
+			}
+		}
+
+		*entries = scan.index;
+		*count = scan.indexCount;
+	}
+
+	return CaptureSeek(capture->fp, capture->header.headerSize) && ok;
+}
+
+/****************************************************************************
+* CaptureClose
+* закрывает файл захвата, дописывая оглавление записанных фрагментов
+* (после CaptureAppend файл укорачивается до записанного: без нового
+* оглавления в конце не должно остаться байт старого)
+****************************************************************************/
+void CaptureClose(CAPTURE_FILE * capture)
+{
+	CAPTURE_CHUNK chunk;
+	int64_t indexOffset = (int64_t) capture->bytesWritten;
+
+	// Неполное оглавление не записывается: без него читатели просматривают заголовки фрагментов
+	if (capture->fp != NULL && capture->indexCount && !capture->indexLost)
+	{
+		memset(&chunk, 0, sizeof(CAPTURE_CHUNK));
+		chunk.type = CAPTURE_CHUNK_INDEX;
+		chunk.nSamples = capture->indexCount;
+		chunk.payloadSize = capture->indexCount * sizeof(CAPTURE_INDEX_ENTRY) + sizeof(int64_t);
+
+		if (fwrite(&chunk, sizeof(CAPTURE_CHUNK), 1, capture->fp) == 1 &&
+			fwrite(capture->index, sizeof(CAPTURE_INDEX_ENTRY), capture->indexCount, capture->fp) == capture->indexCount &&
+			fwrite(&indexOffset, sizeof(indexOffset), 1, capture->fp) == 1)
+		{
+			capture->bytesWritten += sizeof(CAPTURE_CHUNK) + chunk.payloadSize;
+		}
+	}
+
+	if (capture->fp != NULL && capture->appended && !CaptureTruncate(capture->fp, (int64_t) capture->bytesWritten))
+	{
+		printf("CaptureClose: cannot truncate the appended file to %lld bytes\n", (long long) capture->bytesWritten);
+	}
+
+	if (capture->fp != NULL)
+	{
+		fclose(capture->fp);
+		capture->fp = NULL;
+	}
+
+	free(capture->index);
+	free(capture->packed);
+	capture->index = NULL;
+	capture->indexCount = capture->indexCapacity = 0;
+	capture->indexLost = 0;
+	capture->appended = 0;
+	capture->packed = NULL;
+	capture->packedCapacity = 0;
+}
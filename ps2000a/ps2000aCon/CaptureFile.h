@@ -0,0 +1,156 @@
+﻿/******************************************************************************
+ *
+ * Filename: CaptureFile.h
+ *
+ * Description:
+ *   Двоичный формат файла захвата.
+ *   Файл начинается с заголовка CAPTURE_HEADER (настройки устройства на
+ *   момент сбора), за которым следуют фрагменты: заголовок CAPTURE_CHUNK и
+ *   данные фрагмента. Аналоговые фрагменты содержат отсчёты int16_t одного
+ *   буфера, цифровые - упакованные 16-разрядные слова портов
+ *   (порт 1 в старшем байте, порт 0 в младшем).
+ *   Аналоговые фрагменты могут храниться сжатыми (CAPTURE_FLAG_PACKED,
+ *   см. WaveCodec.h) или по байту на отсчёт (CAPTURE_FLAG_INT8 - 8-разрядный
+ *   АЦП даёт отсчёты, кратные 1 << sampleShift); CaptureReadChunk
+ *   распаковывает их сам. Последним
+ *   фрагментом записывается оглавление CAPTURE_CHUNK_INDEX для перехода
+ *   к нужному отсчёту без просмотра всего файла.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include "ps2000aApi.h"
+
+#define CAPTURE_MAGIC		"PS2KCAP"
+#define CAPTURE_VERSION		4			// 2 - добавлено analogueOffset, 3 - сжатые фрагменты и оглавление, 4 - sampleShift и шкалы каналов
+
+typedef enum
+{
+	CAPTURE_CHUNK_ANALOGUE	= 1,		// int16_t отсчёты буфера channel (channel * 2 - максимумы, channel * 2 + 1 - минимумы)
+	CAPTURE_CHUNK_DIGITAL	= 2,		// uint16_t слова цифровых портов D15..D0
+	CAPTURE_CHUNK_EDGES		= 3,		// EDGE_RECORD - только отсчёты, на которых меняется состояние портов (см. EdgeList.h)
+	CAPTURE_CHUNK_TIMESTAMP	= 4,		// int64_t время ПК (нс, монотонные часы) обратного вызова, передавшего отсчёты фрагмента
+	CAPTURE_CHUNK_ALIGNMENT	= 5,		// CAPTURE_ALIGNMENT - привязка отсчётов к общей шкале времени (см. TimeAlign.h)
+	CAPTURE_CHUNK_GAP		= 6,		// CAPTURE_GAP - разрыв записи из-за потери связи или перезапуска сбора при смене диапазона, firstSample - первый отсчёт после разрыва
+	CAPTURE_CHUNK_RANGE		= 7,		// CAPTURE_RANGES - диапазоны, смещения и шкалы каналов, начиная с отсчёта firstSample
+										// (до первого такого фрагмента действуют значения заголовка; в старых
+										// файлах - без шкал или только int16_t range[PS2000A_MAX_CHANNELS])
+	CAPTURE_CHUNK_INDEX		= 8			// CAPTURE_INDEX_ENTRY[nSamples] фрагментов данных и диапазонов, затем int64_t смещение
+										// заголовка этого фрагмента (последние 8 байт файла)
+}CAPTURE_CHUNK_TYPE;
+
+#define CAPTURE_FLAG_PACKED	0x0001		// Данные фрагмента сжаты WaveCodecEncode, nSamples - число отсчётов
+#define CAPTURE_FLAG_INT8	0x0002		// int8_t отсчёты, сдвинутые вправо на sampleShift заголовка
+
+#pragma pack(push, 1)
+
+// Шкала отсчётов канала (см. ConversionBuild): напряжение входа, мВ =
+// gain * ((отсчёт - adcOffset) * мВ на отсчёт - смещение канала, мВ) + offsetMv
+typedef struct tCaptureScale
+{
+	int16_t		adcOffset;
+	double		mvPerCountPositive;	// мВ на отсчёт выше adcOffset, 0 - номинальная шкала диапазона
+	double		mvPerCountNegative;	// мВ на отсчёт ниже adcOffset
+	double		gain;				// Поправка пользователя из файла калибровки
+	double		offsetMv;
+}CAPTURE_SCALE;
+
+typedef struct tCaptureHeader
+{
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	headerSize;			// Размер заголовка в файле (у старых версий заголовок короче)
+	int16_t		channelCount;
+	int16_t		digitalPorts;
+	int16_t		maxValue;
+	int16_t		enabled[PS2000A_MAX_CHANNELS];
+	int16_t		range[PS2000A_MAX_CHANNELS];
+	uint32_t	timebase;
+	double		sampleInterval;		// Интервал между сохранёнными отсчётами, нс
+	uint32_t	downsampleRatio;
+	int32_t		ratioMode;
+	float		analogueOffset[PS2000A_MAX_CHANNELS];	// Смещение каналов, В: напряжение входа = отсчёт в мВ - смещение
+	int16_t		sampleShift;		// Шаг АЦП 1 << sampleShift: аналоговые фрагменты хранятся по байту на отсчёт,
+										// если все их отсчёты кратны шагу (0 - не упаковывать)
+	CAPTURE_SCALE	scale[PS2000A_MAX_CHANNELS];		// Шкалы каналов, по которым считались мВ при сборе
+}CAPTURE_HEADER;
+
+typedef struct tCaptureChunk
+{
+	uint32_t	type;				// CAPTURE_CHUNK_TYPE
+	int16_t		channel;			// Номер буфера для аналоговых фрагментов, 0 для цифровых
+	int16_t		flags;
+	uint64_t	firstSample;		// Номер первого отсчёта фрагмента от начала сбора
+	uint32_t	nSamples;
+	uint32_t	payloadSize;		// Размер данных фрагмента в байтах
+}CAPTURE_CHUNK;
+
+typedef struct tCaptureAlignment
+{
+	int16_t		reference;			// Номер опорного устройства
+	int16_t		syncPulses;			// Количество синхроимпульсов, использованных для привязки (0 - только по времени ПК)
+	double		offset;				// Выровненный номер отсчёта = offset + scale * номер отсчёта
+	double		scale;				// Отсчётов опорного устройства на отсчёт этого устройства
+	double		drift;				// Уход частоты дискретизации относительно часов ПК, ppm
+	double		error;				// Оценка погрешности привязки, нс
+}CAPTURE_ALIGNMENT;
+
+typedef struct tCaptureGap
+{
+	int64_t		lostAt;				// Время ПК (нс) потери связи или остановки сбора
+	int64_t		resumedAt;			// Время ПК (нс) возобновления сбора
+	uint32_t	status;				// PICO_STATUS, по которому обнаружена потеря связи (PICO_OK - смена диапазона)
+}CAPTURE_GAP;
+
+typedef struct tCaptureRanges
+{
+	int16_t		range[PS2000A_MAX_CHANNELS];
+	float		analogueOffset[PS2000A_MAX_CHANNELS];	// Смещение, действующее с этим диапазоном, В
+	CAPTURE_SCALE	scale[PS2000A_MAX_CHANNELS];
+}CAPTURE_RANGES;
+
+typedef struct tCaptureIndexEntry
+{
+	uint64_t	firstSample;
+	int64_t		offset;				// Смещение заголовка фрагмента от начала файла
+	uint32_t	nSamples;
+	uint32_t	type;
+	int16_t		channel;
+	int16_t		flags;
+}CAPTURE_INDEX_ENTRY;
+
+#pragma pack(pop)
+
+typedef struct tCaptureFile
+{
+	FILE *					fp;
+	CAPTURE_HEADER			header;
+	uint64_t				bytesWritten;
+	int16_t					compress;		// Сжимать аналоговые фрагменты при записи (иначе - упаковывать
+											// по байту на отсчёт, если задан header.sampleShift)
+	uint8_t *				packed;			// Буфер сжатых данных
+	uint32_t				packedCapacity;
+	CAPTURE_INDEX_ENTRY *	index;			// Оглавление записываемого файла
+	uint32_t				indexCount;
+	uint32_t				indexCapacity;
+	int16_t					indexLost;		// Запись не поместилась в оглавление - оно не записывается,
+											// читатели строят его просмотром заголовков фрагментов
+	int16_t					appended;		// Открыт CaptureAppend: запись идёт поверх прежнего оглавления
+	uint64_t				rawBytes;		// Аналоговые данные до сжатия или упаковки, байт
+	uint64_t				packedBytes;	// Они же в файле, байт
+	int64_t					packTime;		// Время сжатия или упаковки, нс
+}CAPTURE_FILE;
+
+int16_t CaptureCreate(CAPTURE_FILE * capture, const char * fileName, const CAPTURE_HEADER * header);
+int16_t CaptureWriteChunk(CAPTURE_FILE * capture, CAPTURE_CHUNK_TYPE type, int16_t channel, uint64_t firstSample,
+	const void * payload, uint32_t nSamples, uint32_t payloadSize);
+int16_t CaptureOpen(CAPTURE_FILE * capture, const char * fileName);
+int16_t CaptureAppend(CAPTURE_FILE * capture, const char * fileName);
+int16_t CaptureReadChunk(CAPTURE_FILE * capture, CAPTURE_CHUNK * chunk, void ** payload, uint32_t * capacity);
+int16_t CaptureReadChunkHeader(CAPTURE_FILE * capture, CAPTURE_CHUNK * chunk, int64_t * payloadOffset);
+int16_t CaptureSeek(FILE * fp, int64_t offset);
+int16_t CaptureReadIndex(CAPTURE_FILE * capture, CAPTURE_INDEX_ENTRY ** entries, uint32_t * count);
+int16_t CaptureReadPayload(FILE * fp, const CAPTURE_CHUNK * chunk, int64_t payloadOffset, int16_t sampleShift,
+	int16_t * samples, uint8_t ** packed, uint32_t * capacity);
+void CaptureClose(CAPTURE_FILE * capture);
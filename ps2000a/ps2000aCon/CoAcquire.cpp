@@ -0,0 +1,324 @@
+﻿/******************************************************************************
+ *
+ * Filename: CoAcquire.cpp
+ *
+ * Description:
+ *   Сбор данных сопрограммами C++20 (см. CoAcquire.h).
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include "windows.h"
+#include "CoAcquire.h"
+#include "PicoStatus.h"
+
+/****************************************************************************
+* CoResume
+* задание пула: продолжает приостановленную сопрограмму
+****************************************************************************/
+static void CoResume(void * address)
+{
+	std::coroutine_handle<>::from_address(address).resume();
+}
+
+/****************************************************************************
+* CoSchedule
+* ставит продолжение сопрограммы в пул планировщика
+****************************************************************************/
+static void CoSchedule(CO_SCHEDULER * scheduler, std::coroutine_handle<> coroutine)
+{
+	WorkerPoolSubmit(&scheduler->pool, &scheduler->group, CoResume, coroutine.address());
+}
+
+/****************************************************************************
+* FinalAwaiter::await_suspend
+* по завершении сопрограммы продолжает ожидающую её; кадр сопрограммы,
+* запущенной CoSpawn, освобождается, и планировщику сообщается о завершении
+****************************************************************************/
+std::coroutine_handle<> CO_TASK::FinalAwaiter::await_suspend(std::coroutine_handle<promise_type> frame) noexcept
+{
+	CO_SCHEDULER * scheduler = frame.promise().scheduler;
+
+	if (frame.promise().continuation)
+	{
+		return frame.promise().continuation;
+	}
+
+	frame.destroy();
+
+	if (scheduler != NULL)
+	{
+		WorkGroupDone(&scheduler->pool, &scheduler->group);
+	}
+
+	return std::noop_coroutine();
+}
+
+/****************************************************************************
+* CoBlockReady
+* обратный вызов драйвера о готовности блока, запущенного CoRunBlock
+****************************************************************************/
+static void __stdcall CoBlockReady(int16_t handle, PICO_STATUS status, void * pParameter)
+{
+	CO_BLOCK_READY * ready = (CO_BLOCK_READY *) pParameter;
+
+	ready->status = status;
+	CoSchedule(ready->scheduler, ready->awaiting);
+}
+
+/****************************************************************************
+* CO_BLOCK_READY::await_suspend
+* запускает блок; сопрограмма продолжится из обратного вызова, а если
+* ps2000aRunBlock вернул ошибку - сразу
+****************************************************************************/
+bool CO_BLOCK_READY::await_suspend(std::coroutine_handle<> coroutine)
+{
+	PICO_STATUS runStatus;
+	int32_t timeIndisposed;
+
+	awaiting = coroutine;
+
+	// После успешного ps2000aRunBlock сопрограмма может уже выполняться в другом потоке - поля не трогаем
+	runStatus = ps2000aRunBlock(handle, preTrigger, postTrigger, timebase, oversample, &timeIndisposed, segmentIndex, CoBlockReady, this);
+
+	if (runStatus != PICO_OK)
+	{
+		status = runStatus;
+		return false;
+	}
+
+	return true;
+}
+
+/****************************************************************************
+* CoStreamReady
+* обратный вызов ps2000aGetStreamingLatestValues - запоминает фрагмент
+****************************************************************************/
+static void __stdcall CoStreamReady(int16_t handle, int32_t noOfSamples, uint32_t startIndex, int16_t overflow,
+	uint32_t triggerAt, int16_t triggered, int16_t autoStop, void * pParameter)
+{
+	CO_STREAM * stream = (CO_STREAM *) pParameter;
+
+	stream->noOfSamples = noOfSamples;
+	stream->startIndex = startIndex;
+	stream->overflow = overflow;
+	stream->triggerAt = triggerAt;
+	stream->triggered = triggered;
+	stream->autoStop = autoStop;
+}
+
+/****************************************************************************
+* CoPollThread
+* опрашивает устройства сопрограмм, ждущих фрагмента потокового сбора, и
+* продолжает те, для которых фрагмент получен, завершён сбор или произошла ошибка
+****************************************************************************/
+static DWORD WINAPI CoPollThread(LPVOID parameter)
+{
+	CO_SCHEDULER * scheduler = (CO_SCHEDULER *) parameter;
+	CO_STREAM * streams;
+	CO_STREAM * stream;
+	CO_STREAM * pending;
+	int16_t resumed;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> wait(scheduler->lock);
+			scheduler->signal.wait(wait, [scheduler] { return scheduler->stopping || scheduler->waiting != NULL; });
+
+			if (scheduler->waiting == NULL)
+			{
+				break;
+			}
+
+			streams = scheduler->waiting;
+			scheduler->waiting = NULL;
+		}
+
+		pending = NULL;
+		resumed = 0;
+
+		while (streams != NULL)
+		{
+			stream = streams;
+			streams = streams->next;
+
+			stream->noOfSamples = 0;
+			stream->autoStop = 0;
+			stream->status = ps2000aGetStreamingLatestValues(stream->handle, CoStreamReady, stream);
+
+			if (stream->status == PICO_BUSY || (stream->status == PICO_OK && stream->noOfSamples == 0 && !stream->autoStop))
+			{
+				stream->next = pending;
+				pending = stream;
+				continue;
+			}
+
+			CoSchedule(scheduler, stream->awaiting);
+			resumed++;
+		}
+
+		if (pending != NULL)
+		{
+			std::lock_guard<std::mutex> guard(scheduler->lock);
+
+			while (pending != NULL)
+			{
+				stream = pending;
+				pending = pending->next;
+				stream->next = scheduler->waiting;
+				scheduler->waiting = stream;
+			}
+		}
+
+		if (resumed == 0)
+		{
+			Sleep(1);
+		}
+	}
+
+	return 0;
+}
+
+/****************************************************************************
+* CO_CHUNK_READY::await_suspend
+* передаёт сопрограмму потоку опроса планировщика
+****************************************************************************/
+void CO_CHUNK_READY::await_suspend(std::coroutine_handle<> coroutine)
+{
+	CO_SCHEDULER * scheduler = stream->scheduler;
+
+	stream->awaiting = coroutine;
+
+	std::lock_guard<std::mutex> guard(scheduler->lock);
+	stream->next = scheduler->waiting;
+	scheduler->waiting = stream;
+	scheduler->signal.notify_one();
+}
+
+/****************************************************************************
+* CoSchedulerInit
+* запускает пул из nThreads потоков (0 - по числу процессоров) и поток опроса
+*
+* Возвращает 0, если не удалось запустить планировщик
+****************************************************************************/
+int16_t CoSchedulerInit(CO_SCHEDULER * scheduler, int16_t nThreads)
+{
+	scheduler->waiting = NULL;
+	scheduler->stopping = 0;
+	scheduler->poller = NULL;
+	WorkGroupInit(&scheduler->group);
+
+	if (!WorkerPoolInit(&scheduler->pool, nThreads))
+	{
+		return 0;
+	}
+
+	if ((scheduler->poller = CreateThread(NULL, 0, CoPollThread, scheduler, 0, NULL)) == NULL)
+	{
+		WorkerPoolFree(&scheduler->pool);
+		return 0;
+	}
+
+	return 1;
+}
+
+/****************************************************************************
+* CoSpawn
+* запускает сопрограмму в пуле планировщика; её кадр освобождается по завершении
+****************************************************************************/
+void CoSpawn(CO_SCHEDULER * scheduler, CO_TASK && task)
+{
+	std::coroutine_handle<CO_TASK::promise_type> frame = task.frame;
+
+	task.frame = nullptr;
+	frame.promise().scheduler = scheduler;
+
+	WorkGroupAdd(&scheduler->group);
+	CoSchedule(scheduler, frame);
+}
+
+/****************************************************************************
+* CoSchedulerWait
+* ждёт завершения всех запущенных сопрограмм, помогая пулу их выполнять
+****************************************************************************/
+void CoSchedulerWait(CO_SCHEDULER * scheduler)
+{
+	WorkerPoolWait(&scheduler->pool, &scheduler->group);
+}
+
+/****************************************************************************
+* CoSchedulerFree
+* останавливает поток опроса и пул (сопрограммы должны быть завершены)
+****************************************************************************/
+void CoSchedulerFree(CO_SCHEDULER * scheduler)
+{
+	if (scheduler->poller != NULL)
+	{
+		{
+			std::lock_guard<std::mutex> guard(scheduler->lock);
+			scheduler->stopping = 1;
+			scheduler->signal.notify_all();
+		}
+
+		WaitForSingleObject(scheduler->poller, INFINITE);
+		CloseHandle(scheduler->poller);
+		scheduler->poller = NULL;
+	}
+
+	WorkerPoolFree(&scheduler->pool);
+}
+
+/****************************************************************************
+* CoRunBlock
+* co_await CoRunBlock(...) запускает блок (параметры ps2000aRunBlock)
+* и продолжает сопрограмму, когда он собран
+****************************************************************************/
+CO_BLOCK_READY CoRunBlock(CO_SCHEDULER * scheduler, int16_t handle, int32_t preTrigger, int32_t postTrigger,
+	uint32_t timebase, int16_t oversample, uint32_t segmentIndex)
+{
+	CO_BLOCK_READY ready;
+
+	ready.scheduler = scheduler;
+	ready.handle = handle;
+	ready.preTrigger = preTrigger;
+	ready.postTrigger = postTrigger;
+	ready.timebase = timebase;
+	ready.oversample = oversample;
+	ready.segmentIndex = segmentIndex;
+	ready.status = PICO_OK;
+
+	return ready;
+}
+
+/****************************************************************************
+* CoStreamInit
+* готовит ожидание фрагментов потокового сбора устройства handle
+* (ps2000aRunStreaming вызывается сопрограммой)
+****************************************************************************/
+void CoStreamInit(CO_STREAM * stream, CO_SCHEDULER * scheduler, int16_t handle)
+{
+	stream->scheduler = scheduler;
+	stream->handle = handle;
+	stream->noOfSamples = 0;
+	stream->startIndex = 0;
+	stream->overflow = 0;
+	stream->triggerAt = 0;
+	stream->triggered = 0;
+	stream->autoStop = 0;
+	stream->status = PICO_OK;
+	stream->next = NULL;
+}
+
+/****************************************************************************
+* CoNextChunk
+* co_await CoNextChunk(stream) продолжает сопрограмму, когда получен
+* следующий фрагмент, завершён сбор (stream->autoStop) или произошла ошибка
+****************************************************************************/
+CO_CHUNK_READY CoNextChunk(CO_STREAM * stream)
+{
+	CO_CHUNK_READY ready;
+
+	ready.stream = stream;
+
+	return ready;
+}
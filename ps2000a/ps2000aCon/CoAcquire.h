@@ -0,0 +1,136 @@
+﻿/******************************************************************************
+ *
+ * Filename: CoAcquire.h
+ *
+ * Description:
+ *   Сбор данных сопрограммами C++20.
+ *   Последовательность действий с устройством (запуск блока, анализ, смена
+ *   диапазона, повтор) записывается одной сопрограммой CO_TASK без циклов
+ *   ожидания: co_await CoRunBlock(...) приостанавливает её до обратного
+ *   вызова драйвера о готовности блока, co_await CoNextChunk(...) - до
+ *   следующего фрагмента потокового сбора.
+ *   Обратные вызовы только ставят возобновление сопрограммы в пул потоков
+ *   планировщика (см. WorkerPool.h), поэтому сопрограммы многих устройств
+ *   выполняются несколькими потоками. Фрагменты потокового сбора для всех
+ *   ожидающих сопрограмм опрашивает один поток планировщика.
+ *   Сопрограмма может продолжиться не в том потоке, в котором была
+ *   приостановлена, поэтому thread_local переменные в ней не используются:
+ *   настройки передаются параметрами (их значения вычисляются в потоке,
+ *   создающем сопрограмму).
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <condition_variable>
+#include "ps2000aApi.h"
+#include "WorkerPool.h"
+
+typedef struct tCoStream CO_STREAM;
+
+typedef struct tCoScheduler
+{
+	WORKER_POOL				pool;
+	WORK_GROUP				group;			// Запущенные сопрограммы и их возобновления в очереди пула
+	std::mutex				lock;
+	std::condition_variable	signal;			// Появилась сопрограмма, ждущая фрагмента, или планировщик останавливается
+	CO_STREAM *				waiting;		// Сопрограммы, ждущие фрагмента потокового сбора
+	int16_t					stopping;
+	HANDLE					poller;
+}CO_SCHEDULER;
+
+// Потоковый сбор одного устройства: после co_await CoNextChunk отсчёты фрагмента -
+// startIndex .. startIndex + noOfSamples - 1 буферов, зарегистрированных ps2000aSetDataBuffers
+// (до следующего co_await CoNextChunk драйвер их не перезаписывает)
+struct tCoStream
+{
+	CO_SCHEDULER *			scheduler;
+	int16_t					handle;
+	int32_t					noOfSamples;
+	uint32_t				startIndex;
+	int16_t					overflow;
+	uint32_t				triggerAt;
+	int16_t					triggered;
+	int16_t					autoStop;
+	PICO_STATUS				status;
+	std::coroutine_handle<>	awaiting;
+	CO_STREAM *				next;
+};
+
+// Сопрограмма сбора: завершается co_return PICO_STATUS, запускается CoSpawn
+// или co_await из другой сопрограммы
+struct CO_TASK
+{
+	struct promise_type;
+
+	struct FinalAwaiter
+	{
+		bool await_ready() noexcept { return false; }
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> frame) noexcept;
+		void await_resume() noexcept {}
+	};
+
+	struct promise_type
+	{
+		std::coroutine_handle<>	continuation;			// Сопрограмма, ожидающая эту
+		CO_SCHEDULER *			scheduler = NULL;		// Для запущенной CoSpawn - планировщик, которому сообщается о завершении
+		PICO_STATUS				result = PICO_OK;
+
+		CO_TASK get_return_object() { return CO_TASK(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		FinalAwaiter final_suspend() noexcept { return {}; }
+		void return_value(PICO_STATUS status) { result = status; }
+		void unhandled_exception() { std::terminate(); }
+	};
+
+	std::coroutine_handle<promise_type> frame;
+
+	explicit CO_TASK(std::coroutine_handle<promise_type> coroutine) : frame(coroutine) {}
+	CO_TASK(CO_TASK && other) noexcept : frame(other.frame) { other.frame = nullptr; }
+	CO_TASK(const CO_TASK &) = delete;
+	CO_TASK & operator=(const CO_TASK &) = delete;
+	~CO_TASK() { if (frame) frame.destroy(); }
+
+	bool await_ready() { return false; }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) { frame.promise().continuation = awaiting; return frame; }
+	PICO_STATUS await_resume() { return frame.promise().result; }
+};
+
+// co_await CoRunBlock(...) - PICO_STATUS ps2000aRunBlock или обратного вызова о готовности блока
+struct CO_BLOCK_READY
+{
+	CO_SCHEDULER *			scheduler;
+	int16_t					handle;
+	int32_t					preTrigger;
+	int32_t					postTrigger;
+	uint32_t				timebase;
+	int16_t					oversample;
+	uint32_t				segmentIndex;
+	PICO_STATUS				status;
+	std::coroutine_handle<>	awaiting;
+
+	bool await_ready() { return false; }
+	bool await_suspend(std::coroutine_handle<> coroutine);
+	PICO_STATUS await_resume() { return status; }
+};
+
+// co_await CoNextChunk(stream) - PICO_STATUS ps2000aGetStreamingLatestValues, фрагмент - в stream
+struct CO_CHUNK_READY
+{
+	CO_STREAM *				stream;
+
+	bool await_ready() { return false; }
+	void await_suspend(std::coroutine_handle<> coroutine);
+	PICO_STATUS await_resume() { return stream->status; }
+};
+
+int16_t CoSchedulerInit(CO_SCHEDULER * scheduler, int16_t nThreads);
+void CoSpawn(CO_SCHEDULER * scheduler, CO_TASK && task);
+void CoSchedulerWait(CO_SCHEDULER * scheduler);
+void CoSchedulerFree(CO_SCHEDULER * scheduler);
+CO_BLOCK_READY CoRunBlock(CO_SCHEDULER * scheduler, int16_t handle, int32_t preTrigger, int32_t postTrigger,
+	uint32_t timebase, int16_t oversample, uint32_t segmentIndex);
+void CoStreamInit(CO_STREAM * stream, CO_SCHEDULER * scheduler, int16_t handle);
+CO_CHUNK_READY CoNextChunk(CO_STREAM * stream);
@@ -0,0 +1,115 @@
+﻿/******************************************************************************
+ *
+ * Filename: CsvFormat.cpp
+ *
+ * Description:
+ *   Быстрый вывод текстовых таблиц отсчётов (см. CsvFormat.h).
+ *
+ ******************************************************************************/
+#include <stdlib.h>
+#include "CsvFormat.h"
+
+/****************************************************************************
+* CsvTableInit
+* Выделяет таблицу, заполненную текстом самих отсчётов
+*
+* Возвращает 0, если не удалось выделить память
+****************************************************************************/
+int16_t CsvTableInit(CSV_TABLE * table)
+{
+	int32_t raw;
+
+	if ((table->slots = (char *) malloc((size_t) CSV_TABLE_SIZE * CSV_SLOT_SIZE)) == NULL)
+	{
+		return 0;
+	}
+
+	for (raw = INT16_MIN; raw <= INT16_MAX; raw++)
+	{
+		CsvTableSet(table, (int16_t) raw, raw);
+	}
+
+	return 1;
+}
+
+/****************************************************************************
+* CsvTableSet
+* Задаёт значение, выводимое для отсчёта raw
+****************************************************************************/
+void CsvTableSet(CSV_TABLE * table, int16_t raw, int32_t value)
+{
+	char * slot = table->slots + (size_t) (uint16_t) raw * CSV_SLOT_SIZE;
+	char digits[12];
+	int32_t length = 0;
+	int32_t n = 0;
+	uint32_t magnitude = value < 0 ? 0u - (uint32_t) value : (uint32_t) value;
+
+	do
+	{
+		digits[n++] = (char) ('0' + magnitude % 10);
+		magnitude /= 10;
+	}
+	while (magnitude);
+
+	if (value < 0)
+	{
+		slot[length++] = '-';
+	}
+
+	while (n)
+	{
+		slot[length++] = digits[--n];
+	}
+
+	slot[length++] = ',';
+	slot[length++] = ' ';
+	slot[CSV_SLOT_SIZE - 1] = (char) length;
+}
+
+/****************************************************************************
+* CsvTableFree
+****************************************************************************/
+void CsvTableFree(CSV_TABLE * table)
+{
+	free(table->slots);
+	table->slots = NULL;
+}
+
+/****************************************************************************
+* CsvWriterOpen
+* Буферизованный вывод в открытый файл fp (файл закрывает вызывающая сторона)
+****************************************************************************/
+int16_t CsvWriterOpen(CSV_WRITER * writer, FILE * fp, size_t size)
+{
+	writer->fp = fp;
+	writer->size = size;
+	writer->used = 0;
+
+	return (writer->buffer = (char *) malloc(size)) != NULL;
+}
+
+/****************************************************************************
+* CsvFlush
+* Записывает накопленный текст в файл
+****************************************************************************/
+int16_t CsvFlush(CSV_WRITER * writer)
+{
+	int16_t ok = writer->used == 0 || fwrite(writer->buffer, writer->used, 1, writer->fp) == 1;
+
+	writer->used = 0;
+	return ok;
+}
+
+/****************************************************************************
+* CsvWriterClose
+* Записывает остаток буфера и освобождает его
+****************************************************************************/
+void CsvWriterClose(CSV_WRITER * writer)
+{
+	if (writer->buffer != NULL)
+	{
+		CsvFlush(writer);
+		free(writer->buffer);
+		writer->buffer = NULL;
+	}
+}
@@ -0,0 +1,79 @@
+﻿/******************************************************************************
+ *
+ * Filename: CsvFormat.h
+ *
+ * Description:
+ *   Быстрый вывод текстовых таблиц отсчётов.
+ *   Текст "%d, " для каждого из 65536 значений отсчёта заранее записывается
+ *   в таблицу (для отсчётов АЦП - само значение, для милливольт - результат
+ *   преобразования текущего диапазона канала). Строка собирается
+ *   копированием готовых фрагментов в большой буфер, который записывается
+ *   в файл целиком. Результат побайтно совпадает с выводом fprintf.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#define CSV_SLOT_SIZE		16			// Текст значения и ", ", в последнем байте - длина
+#define CSV_TABLE_SIZE		65536
+#define CSV_BUFFER_SIZE		(1 << 20)
+
+typedef struct tCsvTable
+{
+	char *		slots;			// CSV_TABLE_SIZE ячеек по CSV_SLOT_SIZE, индекс - отсчёт как uint16_t
+}CSV_TABLE;
+
+typedef struct tCsvWriter
+{
+	FILE *		fp;
+	char *		buffer;
+	size_t		size;
+	size_t		used;
+}CSV_WRITER;
+
+int16_t CsvTableInit(CSV_TABLE * table);
+void CsvTableSet(CSV_TABLE * table, int16_t raw, int32_t value);
+void CsvTableFree(CSV_TABLE * table);
+
+int16_t CsvWriterOpen(CSV_WRITER * writer, FILE * fp, size_t size);
+int16_t CsvFlush(CSV_WRITER * writer);
+void CsvWriterClose(CSV_WRITER * writer);
+
+/****************************************************************************
+* CsvAppend
+* Копирует текст значения raw в out (out должен вмещать CSV_SLOT_SIZE байт)
+*
+* Возвращает указатель на конец текста
+****************************************************************************/
+static inline char * CsvAppend(char * out, const CSV_TABLE * table, int16_t raw)
+{
+	const char * slot = table->slots + (size_t) (uint16_t) raw * CSV_SLOT_SIZE;
+
+	memcpy(out, slot, CSV_SLOT_SIZE);
+	return out + slot[CSV_SLOT_SIZE - 1];
+}
+
+/****************************************************************************
+* CsvReserve
+* Место для bytes байт в буфере (при необходимости буфер записывается в файл)
+****************************************************************************/
+static inline char * CsvReserve(CSV_WRITER * writer, size_t bytes)
+{
+	if (writer->used + bytes > writer->size)
+	{
+		CsvFlush(writer);
+	}
+
+	return writer->buffer + writer->used;
+}
+
+/****************************************************************************
+* CsvCommit
+* Подтверждает текст, записанный в буфер после CsvReserve, до end
+****************************************************************************/
+static inline void CsvCommit(CSV_WRITER * writer, const char * end)
+{
+	writer->used = end - writer->buffer;
+}
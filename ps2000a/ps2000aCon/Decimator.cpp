@@ -0,0 +1,459 @@
+﻿/******************************************************************************
+ *
+ * Filename: Decimator.cpp
+ *
+ * Description:
+ *   Прореживание потоковых данных на стороне ПК (см. Decimator.h).
+ *
+ ******************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "Decimator.h"
+#include "Simd.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/****************************************************************************
+* DecimatorAllocate
+* (пере)выделяет буферы всех выходов под фрагменты длиной до capacity отсчётов
+****************************************************************************/
+static int16_t DecimatorAllocate(DECIMATOR * decimator, int32_t capacity)
+{
+	int16_t o, ch;
+
+	for (o = 0; o < decimator->nOutputs; o++)
+	{
+		DECIMATOR_OUTPUT_SETTINGS * settings = &decimator->settings[o];
+		int32_t maxOut = capacity / settings->ratio + 2;
+
+		if (settings->mode == DECIMATE_RAW)
+		{
+			continue;	// Исходные данные передаются получателю без копирования
+		}
+
+		for (ch = 0; ch < decimator->channelCount; ch++)
+		{
+			DECIMATOR_CHANNEL_STATE * state = &decimator->state[o][ch];
+			int16_t * outMax = (int16_t *) realloc(state->outMax, maxOut * sizeof(int16_t));
+			int16_t * outMin;
+
+			if (!outMax)
+			{
+				return 0;
+			}
+
+			state->outMax = outMax;
+
+			if ((outMin = (int16_t *) realloc(state->outMin, maxOut * sizeof(int16_t))) == NULL)
+			{
+				return 0;
+			}
+
+			state->outMin = outMin;
+
+			if (settings->firTaps > 0)
+			{
+				float * history = (float *) realloc(state->history, (settings->firTaps - 1 + capacity) * sizeof(float));
+
+				if (!history)
+				{
+					return 0;
+				}
+
+				if (!state->history)
+				{
+					memset(history, 0, (settings->firTaps - 1) * sizeof(float));	// Фильтр стартует с нулевого состояния
+				}
+
+				state->history = history;
+			}
+		}
+	}
+
+	decimator->capacity = capacity;
+	return 1;
+}
+
+/****************************************************************************
+* DecimatorInit
+* Параметры
+* - decimator - структура для инициализации
+* - channelCount - количество аналоговых каналов устройства
+* - settings, nOutputs - описание выходов (не более DECIMATOR_MAX_OUTPUTS)
+*
+* Возвращает 1 при успехе, 0 при неверных параметрах
+****************************************************************************/
+int16_t DecimatorInit(DECIMATOR * decimator, int16_t channelCount, const DECIMATOR_OUTPUT_SETTINGS * settings, int16_t nOutputs)
+{
+	int16_t o;
+
+	memset(decimator, 0, sizeof(DECIMATOR));
+
+	if (nOutputs < 1 || nOutputs > DECIMATOR_MAX_OUTPUTS || channelCount < 1 || channelCount > PS2000A_MAX_CHANNELS)
+	{
+		return 0;
+	}
+
+	decimator->channelCount = channelCount;
+	decimator->nOutputs = nOutputs;
+
+	for (o = 0; o < nOutputs; o++)
+	{
+		DECIMATOR_OUTPUT_SETTINGS * output = &decimator->settings[o];
+
+		*output = settings[o];
+
+		if (output->ratio == 0 || output->mode == DECIMATE_RAW)
+		{
+			output->ratio = 1;
+		}
+
+		if (output->mode != DECIMATE_PICK || output->firTaps < 0)
+		{
+			output->firTaps = 0;
+		}
+		else if (output->firTaps > DECIMATOR_MAX_TAPS)
+		{
+			output->firTaps = DECIMATOR_MAX_TAPS;
+		}
+
+		if (output->firTaps > 0)
+		{
+			// Антиалиасинговый фильтр с частотой среза на новой частоте Найквиста (0.5 / ratio исходной частоты)
+			decimator->taps[o] = (float *) malloc(output->firTaps * sizeof(float));
+
+			if (!decimator->taps[o])
+			{
+				DecimatorFree(decimator);
+				return 0;
+			}
+
+			DecimatorDesignLowPass(decimator->taps[o], output->firTaps, 0.5 / output->ratio);
+		}
+	}
+
+	return 1;
+}
+
+/****************************************************************************
+* DecimatorMean
+* Среднее count отсчётов с суммой sum, округлённое к ближайшему целому
+****************************************************************************/
+static int16_t DecimatorMean(int64_t sum, uint32_t count)
+{
+	int64_t half = count / 2;
+
+	return (int16_t) (sum >= 0 ? (sum + half) / (int64_t) count : -((-sum + half) / (int64_t) count));
+}
+
+/****************************************************************************
+* DecimatorBlocks
+* Усреднение или агрегирование (максимум/минимум) по блокам из ratio отсчётов.
+* Блоки могут переходить через границу фрагментов - незавершённый блок
+* хранится в state. Возвращает количество выходных значений.
+****************************************************************************/
+static int32_t DecimatorBlocks(DECIMATOR_OUTPUT_SETTINGS * settings, DECIMATOR_CHANNEL_STATE * state,
+	uint32_t * count, const int16_t * src, int32_t nSamples)
+{
+	int32_t i = 0;
+	int32_t nOut = 0;
+	uint32_t ratio = settings->ratio;
+
+	while (i < nSamples)
+	{
+		int32_t take = (int32_t) (ratio - *count);
+
+		if (take > nSamples - i)
+		{
+			take = nSamples - i;
+		}
+
+		if (*count == 0)
+		{
+			state->sum = 0;
+			state->minValue = INT16_MAX;
+			state->maxValue = INT16_MIN;
+		}
+
+		if (settings->mode == DECIMATE_AVERAGE)
+		{
+			state->sum += SimdSum16(src + i, take);
+		}
+		else
+		{
+			SimdMinMax16(src + i, take, &state->minValue, &state->maxValue);
+		}
+
+		*count += take;
+		i += take;
+
+		if (*count == ratio)
+		{
+			if (settings->mode == DECIMATE_AVERAGE)
+			{
+				int16_t mean = DecimatorMean(state->sum, ratio);
+
+				state->outMax[nOut] = mean;
+				state->outMin[nOut] = mean;
+			}
+			else
+			{
+				state->outMax[nOut] = state->maxValue;
+				state->outMin[nOut] = state->minValue;
+			}
+
+			nOut++;
+			*count = 0;
+		}
+	}
+
+	return nOut;
+}
+
+/****************************************************************************
+* DecimatorPick
+* Выбор каждого ratio-го отсчёта. При заданном КИХ-фильтре значение
+* вычисляется только в выбираемых точках (полифазная схема), поэтому
+* стоимость фильтра делится на коэффициент прореживания.
+* Возвращает количество выходных значений.
+****************************************************************************/
+static int32_t DecimatorPick(DECIMATOR_OUTPUT_SETTINGS * settings, DECIMATOR_CHANNEL_STATE * state, const float * taps,
+	uint32_t * count, const int16_t * src, int32_t nSamples)
+{
+	int32_t nOut = 0;
+	int32_t p = (int32_t) *count;
+	int32_t history = settings->firTaps - 1;
+
+	if (settings->firTaps == 0)
+	{
+		for (; p < nSamples; p += settings->ratio)
+		{
+			state->outMax[nOut++] = src[p];
+		}
+	}
+	else
+	{
+		float * work = state->history;	// [history предыдущих отсчётов][nSamples отсчётов фрагмента]
+
+		SimdInt16ToFloat(src, work + history, nSamples);
+
+		for (; p < nSamples; p += settings->ratio)
+		{
+			// Окно заканчивается на отсчёте p; коэффициенты симметричны, поэтому порядок не важен
+			float value = SimdDotFloat(taps, work + p, settings->firTaps);
+
+			SimdFloatToInt16(&value, &state->outMax[nOut++], 1);
+		}
+
+		memmove(work, work + nSamples, history * sizeof(float));
+	}
+
+	memcpy(state->outMin, state->outMax, nOut * sizeof(int16_t));
+	*count = (uint32_t) (p - nSamples);
+	return nOut;
+}
+
+/****************************************************************************
+* DecimatorProcess
+* Передаёт очередной фрагмент данных всем выходам.
+* Параметры
+* - channels[ch] - указатель на nSamples отсчётов канала ch, NULL для выключенных каналов
+* - nSamples - длина фрагмента (одинаковая для всех каналов)
+****************************************************************************/
+void DecimatorProcess(DECIMATOR * decimator, int16_t ** channels, int32_t nSamples)
+{
+	int16_t o, ch;
+	int16_t * outMax[PS2000A_MAX_CHANNELS];
+	int16_t * outMin[PS2000A_MAX_CHANNELS];
+
+	if (nSamples <= 0)
+	{
+		return;
+	}
+
+	if (nSamples > decimator->capacity && !DecimatorAllocate(decimator, nSamples))
+	{
+		return;
+	}
+
+	for (ch = 0; ch < decimator->channelCount; ch++)
+	{
+		decimator->enabled[ch] = channels[ch] != NULL;
+	}
+
+	for (o = 0; o < decimator->nOutputs; o++)
+	{
+		DECIMATOR_OUTPUT_SETTINGS * settings = &decimator->settings[o];
+		int32_t nOut = 0;
+		uint32_t count = decimator->count[o];
+
+		if (settings->mode == DECIMATE_RAW)
+		{
+			nOut = nSamples;
+
+			if (settings->window && decimator->outputIndex[o] + nOut > settings->window)
+			{
+				nOut = (int32_t) (settings->window - decimator->outputIndex[o]);
+			}
+
+			if (nOut > 0 && settings->sink)
+			{
+				settings->sink(settings->context, o, channels, channels, nOut, decimator->outputIndex[o]);
+			}
+
+			decimator->outputIndex[o] += nOut;
+			continue;
+		}
+
+		for (ch = 0; ch < decimator->channelCount; ch++)
+		{
+			DECIMATOR_CHANNEL_STATE * state = &decimator->state[o][ch];
+
+			outMax[ch] = NULL;
+			outMin[ch] = NULL;
+
+			if (channels[ch] == NULL)
+			{
+				continue;
+			}
+
+			// Все каналы получают одинаковое число отсчётов, поэтому счётчик блока у них общий
+			count = decimator->count[o];
+
+			if (settings->mode == DECIMATE_PICK)
+			{
+				nOut = DecimatorPick(settings, state, decimator->taps[o], &count, channels[ch], nSamples);
+			}
+			else
+			{
+				nOut = DecimatorBlocks(settings, state, &count, channels[ch], nSamples);
+			}
+
+			outMax[ch] = state->outMax;
+			outMin[ch] = state->outMin;
+		}
+
+		decimator->count[o] = count;
+
+		if (nOut > 0 && settings->sink)
+		{
+			settings->sink(settings->context, o, outMax, outMin, nOut, decimator->outputIndex[o]);
+		}
+
+		decimator->outputIndex[o] += nOut;
+	}
+}
+
+/****************************************************************************
+* DecimatorFlush
+* Выдаёт незавершённые блоки режимов DECIMATE_AVERAGE и DECIMATE_AGGREGATE
+* (вызывается один раз после окончания сбора)
+****************************************************************************/
+void DecimatorFlush(DECIMATOR * decimator)
+{
+	int16_t o, ch;
+	int16_t * outMax[PS2000A_MAX_CHANNELS];
+	int16_t * outMin[PS2000A_MAX_CHANNELS];
+
+	for (o = 0; o < decimator->nOutputs; o++)
+	{
+		DECIMATOR_OUTPUT_SETTINGS * settings = &decimator->settings[o];
+		uint32_t count = decimator->count[o];
+
+		if ((settings->mode != DECIMATE_AVERAGE && settings->mode != DECIMATE_AGGREGATE) || count == 0)
+		{
+			continue;
+		}
+
+		for (ch = 0; ch < decimator->channelCount; ch++)
+		{
+			DECIMATOR_CHANNEL_STATE * state = &decimator->state[o][ch];
+
+			outMax[ch] = NULL;
+			outMin[ch] = NULL;
+
+			if (!decimator->enabled[ch])
+			{
+				continue;
+			}
+
+			if (settings->mode == DECIMATE_AVERAGE)
+			{
+				state->outMax[0] = DecimatorMean(state->sum, count);
+				state->outMin[0] = state->outMax[0];
+			}
+			else
+			{
+				state->outMax[0] = state->maxValue;
+				state->outMin[0] = state->minValue;
+			}
+
+			outMax[ch] = state->outMax;
+			outMin[ch] = state->outMin;
+		}
+
+		decimator->count[o] = 0;
+
+		if (settings->sink)
+		{
+			settings->sink(settings->context, o, outMax, outMin, 1, decimator->outputIndex[o]);
+		}
+
+		decimator->outputIndex[o]++;
+	}
+}
+
+/****************************************************************************
+* DecimatorFree
+* Освобождает все буферы прореживателя
+****************************************************************************/
+void DecimatorFree(DECIMATOR * decimator)
+{
+	int16_t o, ch;
+
+	for (o = 0; o < DECIMATOR_MAX_OUTPUTS; o++)
+	{
+		for (ch = 0; ch < PS2000A_MAX_CHANNELS; ch++)
+		{
+			free(decimator->state[o][ch].outMax);
+			free(decimator->state[o][ch].outMin);
+			free(decimator->state[o][ch].history);
+		}
+
+		free(decimator->taps[o]);
+	}
+
+	memset(decimator, 0, sizeof(DECIMATOR));
+}
+
+/****************************************************************************
+* DecimatorDesignLowPass
+* Рассчитывает коэффициенты ФНЧ методом взвешенного sinc (окно Хэмминга)
+* Параметры
+* - taps, nTaps - массив коэффициентов и его длина
+* - cutoff - частота среза относительно частоты дискретизации (0..0.5)
+****************************************************************************/
+void DecimatorDesignLowPass(float * taps, int16_t nTaps, double cutoff)
+{
+	int16_t i;
+	double sum = 0.0;
+	double centre = (nTaps - 1) / 2.0;
+
+	for (i = 0; i < nTaps; i++)
+	{
+		double x = i - centre;
+		double sinc = (x == 0.0) ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+		double window = (nTaps > 1) ? 0.54 - 0.46 * cos(2.0 * M_PI * i / (nTaps - 1)) : 1.0;
+
+		taps[i] = (float) (sinc * window);
+		sum += taps[i];
+	}
+
+	for (i = 0; i < nTaps; i++)
+	{
+		taps[i] = (float) (taps[i] / sum);		// Единичный коэффициент передачи на постоянном токе
+	}
+}
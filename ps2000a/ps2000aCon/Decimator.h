@@ -0,0 +1,72 @@
+﻿/******************************************************************************
+ *
+ * Filename: Decimator.h
+ *
+ * Description:
+ *   Прореживание потоковых данных на стороне ПК.
+ *   Один поток необработанных отсчётов (PS2000A_RATIO_MODE_NONE) превращается
+ *   сразу в несколько выходов с собственными режимами и коэффициентами,
+ *   например: исходные данные для окна, среднее x100 для журнала и
+ *   минимум/максимум x1000 для предварительного просмотра.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include "ps2000aApi.h"
+
+#define DECIMATOR_MAX_OUTPUTS	8
+#define DECIMATOR_MAX_TAPS		256
+
+typedef enum
+{
+	DECIMATE_RAW,			// Исходные отсчёты без прореживания (ограничены окном)
+	DECIMATE_PICK,			// Каждый N-й отсчёт, при необходимости после КИХ-фильтра
+	DECIMATE_AVERAGE,		// Среднее по N отсчётам
+	DECIMATE_AGGREGATE		// Максимум и минимум по N отсчётам
+}DECIMATION_MODE;
+
+/* Получатель прореженных данных.
+ * maxValues[ch] - значения (или максимумы для DECIMATE_AGGREGATE), minValues[ch] - минимумы
+ * (для остальных режимов совпадают с maxValues). Для выключенных каналов указатели равны NULL.
+ * firstIndex - номер первого выходного отсчёта от начала сбора */
+typedef void (*DECIMATOR_SINK)(void * context, int16_t output, int16_t ** maxValues, int16_t ** minValues,
+	int32_t nValues, uint64_t firstIndex);
+
+typedef struct tDecimatorOutputSettings
+{
+	DECIMATION_MODE	mode;
+	uint32_t		ratio;			// Коэффициент прореживания (для DECIMATE_RAW не используется)
+	uint64_t		window;			// DECIMATE_RAW: количество передаваемых отсчётов, 0 - без ограничения
+	int16_t			firTaps;		// DECIMATE_PICK: длина антиалиасингового КИХ-фильтра, 0 - без фильтра
+	DECIMATOR_SINK	sink;
+	void *			context;
+}DECIMATOR_OUTPUT_SETTINGS;
+
+typedef struct tDecimatorChannelState
+{
+	int64_t		sum;			// Накопители текущего (незавершённого) блока
+	int16_t		minValue;
+	int16_t		maxValue;
+	float *		history;		// firTaps - 1 предыдущих отсчётов, за которыми следует текущий фрагмент
+	int16_t *	outMax;
+	int16_t *	outMin;
+}DECIMATOR_CHANNEL_STATE;
+
+typedef struct tDecimator
+{
+	int16_t						channelCount;
+	int16_t						nOutputs;
+	int16_t						enabled[PS2000A_MAX_CHANNELS];		// Каналы, переданные в последний вызов DecimatorProcess
+	int32_t						capacity;		// Максимальная длина фрагмента, под которую выделены буферы
+	DECIMATOR_OUTPUT_SETTINGS	settings[DECIMATOR_MAX_OUTPUTS];
+	float *						taps[DECIMATOR_MAX_OUTPUTS];
+	uint32_t					count[DECIMATOR_MAX_OUTPUTS];		// Отсчётов в текущем блоке / до следующего выбираемого отсчёта
+	uint64_t					outputIndex[DECIMATOR_MAX_OUTPUTS];
+	DECIMATOR_CHANNEL_STATE		state[DECIMATOR_MAX_OUTPUTS][PS2000A_MAX_CHANNELS];
+}DECIMATOR;
+
+int16_t DecimatorInit(DECIMATOR * decimator, int16_t channelCount, const DECIMATOR_OUTPUT_SETTINGS * settings, int16_t nOutputs);
+void DecimatorProcess(DECIMATOR * decimator, int16_t ** channels, int32_t nSamples);
+void DecimatorFlush(DECIMATOR * decimator);
+void DecimatorFree(DECIMATOR * decimator);
+void DecimatorDesignLowPass(float * taps, int16_t nTaps, double cutoff);
@@ -0,0 +1,242 @@
+﻿/******************************************************************************
+ *
+ * Filename: DeviceManager.cpp
+ *
+ * Description:
+ *   Одновременная работа с несколькими осциллографами (см. DeviceManager.h).
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include "windows.h"
+#include "DeviceManager.h"
+
+/****************************************************************************
+* DeviceEnumerate
+* Находит подключённые устройства и заполняет список серийных номеров
+*
+* Возвращает количество найденных устройств
+****************************************************************************/
+int16_t DeviceEnumerate(DEVICE_MANAGER * manager)
+{
+	int8_t serials[DEVICE_MAX_UNITS * DEVICE_SERIAL_LENGTH];
+	int16_t count = 0;
+	int16_t serialLth = sizeof(serials);
+	int8_t * serial;
+	int8_t * next;
+	PICO_STATUS status;
+
+	memset(manager, 0, sizeof(DEVICE_MANAGER));
+	memset(serials, 0, sizeof(serials));
+
+	status = ps2000aEnumerateUnits(&count, serials, &serialLth);
+
+	if (status != PICO_OK)
+	{
+		printf("DeviceEnumerate:ps2000aEnumerateUnits ------ 0x%08lx \n", status);
+		return 0;
+	}
+
+	// Серийные номера разделены запятыми: "AY123/0045,AY123/0046"
+	for (serial = serials; serial != NULL && *serial && manager->count < DEVICE_MAX_UNITS; serial = next)
+	{
+		DEVICE_ENTRY * device = &manager->devices[manager->count];
+		size_t length;
+
+		next = (int8_t *) strchr((char *) serial, ',');
+		length = next ? (size_t) (next - serial) : strlen((char *) serial);
+
+		if (next)
+		{
+			next++;
+		}
+
+		if (length == 0 || length >= DEVICE_SERIAL_LENGTH)
+		{
+			continue;
+		}
+
+		memcpy(device->serial, serial, length);
+		device->serial[length] = 0;
+		device->manager = manager;
+		device->index = manager->count++;
+		device->status = PICO_NOT_FOUND;
+	}
+
+	return manager->count;
+}
+
+/****************************************************************************
+* DeviceOpenStart
+* Начинает асинхронное открытие устройства (пустой серийный номер -
+* первое найденное устройство). Пока загружается прошивка, вызывающая
+* сторона может выполнять свою подготовку, затем вызывает DeviceOpenWait
+****************************************************************************/
+PICO_STATUS DeviceOpenStart(DEVICE_ENTRY * device)
+{
+	int16_t started = 0;
+	PICO_STATUS status;
+
+	device->handle = 0;
+	status = ps2000aOpenUnitAsync(&started, device->serial[0] ? device->serial : NULL);
+
+	if (status != PICO_OK || !started)
+	{
+		printf("DeviceOpenStart:ps2000aOpenUnitAsync(%s) ------ 0x%08lx \n", (char *) device->serial, status);
+		return status != PICO_OK ? status : PICO_OPERATION_FAILED;
+	}
+
+	return PICO_OK;
+}
+
+/****************************************************************************
+* DeviceOpenWait
+* Ожидает завершения открытия, выводя ход загрузки прошивки
+****************************************************************************/
+PICO_STATUS DeviceOpenWait(DEVICE_ENTRY * device)
+{
+	int16_t progress = 0;
+	int16_t lastProgress = -1;
+	int16_t complete = 0;
+	PICO_STATUS status;
+
+	do
+	{
+		Sleep(10);
+		status = ps2000aOpenUnitProgress(&device->handle, &progress, &complete);
+
+		if (progress != lastProgress)
+		{
+			printf("\r%s: %3d%%", (char *) device->serial, progress);
+			lastProgress = progress;
+		}
+	}
+	while (status == PICO_OK && !complete);
+
+	printf("\n");
+
+	if (status != PICO_OK || device->handle <= 0)
+	{
+		printf("DeviceOpenWait:ps2000aOpenUnitProgress(%s) ------ 0x%08lx \n", (char *) device->serial, status);
+		device->handle = 0;
+		return status != PICO_OK ? status : PICO_OPERATION_FAILED;
+	}
+
+	return PICO_OK;
+}
+
+/****************************************************************************
+* DeviceOpen
+* Открывает устройство, при неудаче повторяет попытку
+* Параметры
+* - retries - количество повторных попыток
+* - retryDelay - пауза перед повторной попыткой, мс (устройство после
+*   отключения питания появляется на шине не сразу)
+****************************************************************************/
+PICO_STATUS DeviceOpen(DEVICE_ENTRY * device, int16_t retries, uint32_t retryDelay)
+{
+	PICO_STATUS status;
+	int16_t attempt = 0;
+
+	while ((status = DeviceOpenStart(device)) != PICO_OK || (status = DeviceOpenWait(device)) != PICO_OK)
+	{
+		if (attempt++ >= retries)
+		{
+			break;
+		}
+
+		printf("DeviceOpen: retry %d of %d in %lu ms\n", attempt, retries, (unsigned long) retryDelay);
+		Sleep(retryDelay);
+	}
+
+	return status;
+}
+
+/****************************************************************************
+* DeviceThread
+* Точка входа рабочего потока устройства
+****************************************************************************/
+static DWORD WINAPI DeviceThread(LPVOID parameter)
+{
+	DEVICE_ENTRY * device = (DEVICE_ENTRY *) parameter;
+
+	device->result = device->manager->worker(device, device->manager->context);
+	return 0;
+}
+
+/****************************************************************************
+* DeviceStartAll
+* Открывает найденные устройства и запускает рабочий поток для каждого
+* сразу после его открытия
+*
+* Возвращает количество запущенных потоков
+****************************************************************************/
+int16_t DeviceStartAll(DEVICE_MANAGER * manager, DEVICE_WORKER worker, void * context)
+{
+	int16_t started = 0;
+	int16_t i;
+
+	manager->worker = worker;
+	manager->context = context;
+
+	for (i = 0; i < manager->count; i++)
+	{
+		DEVICE_ENTRY * device = &manager->devices[i];
+
+		device->status = DeviceOpen(device, manager->retries, manager->retryDelay);
+
+		if (device->status != PICO_OK)
+		{
+			continue;
+		}
+
+		device->thread = CreateThread(NULL, 0, DeviceThread, device, 0, NULL);
+
+		if (device->thread == NULL)
+		{
+			printf("DeviceStartAll: cannot start a thread for %s\n", (char *) device->serial);
+			continue;
+		}
+
+		started++;
+	}
+
+	return started;
+}
+
+/****************************************************************************
+* DeviceWaitAll
+* Ожидает завершения всех рабочих потоков
+****************************************************************************/
+void DeviceWaitAll(DEVICE_MANAGER * manager)
+{
+	int16_t i;
+
+	for (i = 0; i < manager->count; i++)
+	{
+		if (manager->devices[i].thread != NULL)
+		{
+			WaitForSingleObject((HANDLE) manager->devices[i].thread, INFINITE);
+			CloseHandle((HANDLE) manager->devices[i].thread);
+			manager->devices[i].thread = NULL;
+		}
+	}
+}
+
+/****************************************************************************
+* DeviceCloseAll
+* Закрывает все открытые устройства (после DeviceWaitAll)
+****************************************************************************/
+void DeviceCloseAll(DEVICE_MANAGER * manager)
+{
+	int16_t i;
+
+	for (i = 0; i < manager->count; i++)
+	{
+		if (manager->devices[i].handle > 0)
+		{
+			ps2000aCloseUnit(manager->devices[i].handle);
+			manager->devices[i].handle = 0;
+		}
+	}
+}
@@ -0,0 +1,55 @@
+﻿/******************************************************************************
+ *
+ * Filename: DeviceManager.h
+ *
+ * Description:
+ *   Одновременная работа с несколькими осциллографами.
+ *   Менеджер находит подключённые устройства (ps2000aEnumerateUnits),
+ *   открывает их по очереди асинхронно (ps2000aOpenUnitAsync допускает только
+ *   одну операцию открытия одновременно, неудачное открытие повторяется)
+ *   и запускает для каждого открытого устройства отдельный рабочий поток,
+ *   не дожидаясь открытия остальных.
+ *   Загрузка прошивки следующего устройства идёт параллельно с настройкой
+ *   и сбором данных на уже открытых.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include "ps2000aApi.h"
+
+#define DEVICE_MAX_UNITS		8
+#define DEVICE_SERIAL_LENGTH	16
+
+typedef struct tDeviceManager DEVICE_MANAGER;
+
+typedef struct tDeviceEntry
+{
+	DEVICE_MANAGER *	manager;
+	int16_t				index;							// Порядковый номер устройства у менеджера
+	int8_t				serial[DEVICE_SERIAL_LENGTH];
+	int16_t				handle;							// 0 - устройство не открыто
+	PICO_STATUS			status;							// Результат открытия
+	int16_t				result;							// Значение, возвращённое рабочей функцией
+	void *				thread;
+}DEVICE_ENTRY;
+
+// Рабочая функция выполняется в отдельном потоке для каждого открытого устройства
+typedef int16_t (*DEVICE_WORKER)(DEVICE_ENTRY * device, void * context);
+
+struct tDeviceManager
+{
+	DEVICE_ENTRY	devices[DEVICE_MAX_UNITS];
+	int16_t			count;
+	DEVICE_WORKER	worker;
+	void *			context;
+	int16_t			retries;			// Повторные попытки открытия (см. DeviceOpen)
+	uint32_t		retryDelay;
+};
+
+int16_t DeviceEnumerate(DEVICE_MANAGER * manager);
+PICO_STATUS DeviceOpenStart(DEVICE_ENTRY * device);
+PICO_STATUS DeviceOpenWait(DEVICE_ENTRY * device);
+PICO_STATUS DeviceOpen(DEVICE_ENTRY * device, int16_t retries, uint32_t retryDelay);
+int16_t DeviceStartAll(DEVICE_MANAGER * manager, DEVICE_WORKER worker, void * context);
+void DeviceWaitAll(DEVICE_MANAGER * manager);
+void DeviceCloseAll(DEVICE_MANAGER * manager);
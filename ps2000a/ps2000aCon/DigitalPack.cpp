@@ -0,0 +1,138 @@
+﻿/******************************************************************************
+ *
+ * Filename: DigitalPack.cpp
+ *
+ * Description:
+ *   Упаковка и распаковка данных цифровых портов (см. DigitalPack.h).
+ *
+ ******************************************************************************/
+#include <string.h>
+#include "DigitalPack.h"
+#include "Simd.h"
+
+/****************************************************************************
+* DigitalPackPorts
+* Объединяет буферы портов 0 и 1 в 16-разрядные слова
+****************************************************************************/
+void DigitalPackPorts(const int16_t * port0, const int16_t * port1, uint16_t * words, int32_t nSamples)
+{
+	int32_t i = 0;
+
+#ifdef SIMD_SSE2
+	const __m128i lowByte = _mm_set1_epi16(0x00ff);
+
+	for (; i + 8 <= nSamples; i += 8)
+	{
+		__m128i p0 = _mm_and_si128(_mm_loadu_si128((const __m128i *) (port0 + i)), lowByte);
+		__m128i p1 = _mm_slli_epi16(_mm_loadu_si128((const __m128i *) (port1 + i)), 8);
+
+		_mm_storeu_si128((__m128i *) (words + i), _mm_or_si128(p0, p1));
+	}
+#endif
+
+	for (; i < nSamples; i++)
+	{
+		words[i] = (uint16_t) (((port1[i] & 0x00ff) << 8) | (port0[i] & 0x00ff));
+	}
+}
+
+/****************************************************************************
+* DigitalUnpackChannel
+* Извлекает один канал Dbit как массив 0/1, по байту на отсчёт
+****************************************************************************/
+void DigitalUnpackChannel(const uint16_t * words, int32_t nSamples, int16_t bit, uint8_t * values)
+{
+	int32_t i = 0;
+
+#ifdef SIMD_SSE2
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i shift = _mm_cvtsi32_si128(bit);
+
+	for (; i + 16 <= nSamples; i += 16)
+	{
+		__m128i a = _mm_and_si128(_mm_srl_epi16(_mm_loadu_si128((const __m128i *) (words + i)), shift), one);
+		__m128i b = _mm_and_si128(_mm_srl_epi16(_mm_loadu_si128((const __m128i *) (words + i + 8)), shift), one);
+
+		_mm_storeu_si128((__m128i *) (values + i), _mm_packus_epi16(a, b));
+	}
+#endif
+
+	for (; i < nSamples; i++)
+	{
+		values[i] = (uint8_t) ((words[i] >> bit) & 1);
+	}
+}
+
+/****************************************************************************
+* DigitalFindEdges
+* Находит отсчёты, на которых меняется состояние портов.
+* Параметры
+* - previous - состояние перед первым отсчётом фрагмента, обновляется
+*   последним состоянием фрагмента (так фронты не теряются на границах)
+* - firstSample - номер первого отсчёта фрагмента от начала сбора
+* - edges - массив не менее чем из nSamples элементов
+*
+* Возвращает количество найденных фронтов
+****************************************************************************/
+int32_t DigitalFindEdges(const uint16_t * words, int32_t nSamples, uint16_t * previous, uint64_t firstSample, DIGITAL_EDGE * edges)
+{
+	int32_t nEdges = 0;
+	int32_t i = 0;
+	uint16_t last = *previous;
+
+	if (nSamples <= 0)
+	{
+		return 0;
+	}
+
+	if (words[0] != last)
+	{
+		edges[nEdges].sample = firstSample;
+		edges[nEdges].state = words[0];
+		edges[nEdges].changed = (uint16_t) (words[0] ^ last);
+		nEdges++;
+	}
+
+	i = 1;
+
+#ifdef SIMD_SSE2
+	// Блоки по 8 отсчётов без изменений (обычный случай для медленных логических сигналов)
+	// пропускаются одним сравнением
+	for (; i + 8 <= nSamples; i += 8)
+	{
+		__m128i current = _mm_loadu_si128((const __m128i *) (words + i));
+		__m128i before = _mm_loadu_si128((const __m128i *) (words + i - 1));
+		int32_t k;
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(current, before)) == 0xffff)
+		{
+			continue;
+		}
+
+		for (k = i; k < i + 8; k++)
+		{
+			if (words[k] != words[k - 1])
+			{
+				edges[nEdges].sample = firstSample + k;
+				edges[nEdges].state = words[k];
+				edges[nEdges].changed = (uint16_t) (words[k] ^ words[k - 1]);
+				nEdges++;
+			}
+		}
+	}
+#endif
+
+	for (; i < nSamples; i++)
+	{
+		if (words[i] != words[i - 1])
+		{
+			edges[nEdges].sample = firstSample + i;
+			edges[nEdges].state = words[i];
+			edges[nEdges].changed = (uint16_t) (words[i] ^ words[i - 1]);
+			nEdges++;
+		}
+	}
+
+	*previous = words[nSamples - 1];
+	return nEdges;
+}
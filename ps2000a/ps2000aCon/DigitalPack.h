@@ -0,0 +1,25 @@
+﻿/******************************************************************************
+ *
+ * Filename: DigitalPack.h
+ *
+ * Description:
+ *   Упакованное представление цифровых портов MSO.
+ *   Драйвер возвращает каждый порт отдельным буфером int16_t, в котором
+ *   значимы только младшие 8 бит. Данные хранятся как одно 16-разрядное слово
+ *   на отсчёт (D15..D8 - порт 1, D7..D0 - порт 0), а отдельные каналы
+ *   (по байту 0/1 на отсчёт) и списки фронтов извлекаются по запросу.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+
+typedef struct tDigitalEdge
+{
+	uint64_t	sample;			// Номер отсчёта, на котором изменилось состояние
+	uint16_t	state;			// Новое состояние D15..D0
+	uint16_t	changed;		// Биты, изменившиеся относительно предыдущего отсчёта
+}DIGITAL_EDGE;
+
+void DigitalPackPorts(const int16_t * port0, const int16_t * port1, uint16_t * words, int32_t nSamples);
+void DigitalUnpackChannel(const uint16_t * words, int32_t nSamples, int16_t bit, uint8_t * values);
+int32_t DigitalFindEdges(const uint16_t * words, int32_t nSamples, uint16_t * previous, uint64_t firstSample, DIGITAL_EDGE * edges);
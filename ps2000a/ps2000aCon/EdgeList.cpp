@@ -0,0 +1,216 @@
+﻿/******************************************************************************
+ *
+ * Filename: EdgeList.cpp
+ *
+ * Description:
+ *   Кодирование цифровых потоков списком переходов (см. EdgeList.h).
+ *
+ ******************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "EdgeList.h"
+#include "CaptureFile.h"
+
+/****************************************************************************
+* EdgeEncoderInit
+* Подготавливает кодировщик к новому сбору
+****************************************************************************/
+void EdgeEncoderInit(EDGE_ENCODER * encoder)
+{
+	memset(encoder, 0, sizeof(EDGE_ENCODER));
+}
+
+/****************************************************************************
+* EdgeEncode
+* Кодирует очередной фрагмент слов цифровых портов
+* Параметры
+* - words, nSamples - фрагмент упакованных слов (см. DigitalPackPorts)
+* - records - не менее nSamples элементов для результата
+*
+* Возвращает количество записанных переходов
+****************************************************************************/
+int32_t EdgeEncode(EDGE_ENCODER * encoder, const uint16_t * words, int32_t nSamples, EDGE_RECORD * records)
+{
+	int32_t nEdges;
+	int32_t i;
+
+	if (nSamples <= 0)
+	{
+		return 0;
+	}
+
+	if (nSamples > encoder->capacity)
+	{
+		DIGITAL_EDGE * edges = (DIGITAL_EDGE *) realloc(encoder->edges, nSamples * sizeof(DIGITAL_EDGE));
+
+		if (!edges)
+		{
+			return 0;
+		}
+
+		encoder->edges = edges;
+		encoder->capacity = nSamples;
+	}
+
+	if (encoder->nSamples == 0)
+	{
+		encoder->state = (uint16_t) ~words[0];		// Начальное состояние записывается всегда
+	}
+
+	nEdges = DigitalFindEdges(words, nSamples, &encoder->state, encoder->nSamples, encoder->edges);
+
+	for (i = 0; i < nEdges; i++)
+	{
+		records[i].sample = encoder->edges[i].sample;
+		records[i].state = encoder->edges[i].state;
+	}
+
+	encoder->nSamples += nSamples;
+	return nEdges;
+}
+
+/****************************************************************************
+* EdgeEncoderFree
+* Освобождает рабочий буфер кодировщика
+****************************************************************************/
+void EdgeEncoderFree(EDGE_ENCODER * encoder)
+{
+	free(encoder->edges);
+	memset(encoder, 0, sizeof(EDGE_ENCODER));
+}
+
+/****************************************************************************
+* EdgeListAppend
+* Добавляет переходы очередного фрагмента к списку в памяти
+* Параметры
+* - records, nRecords - переходы фрагмента
+* - nSamples - количество отсчётов во фрагменте
+****************************************************************************/
+int16_t EdgeListAppend(EDGE_LIST * list, const EDGE_RECORD * records, int32_t nRecords, uint64_t nSamples)
+{
+	if (list->nRecords + nRecords > list->capacity)
+	{
+		int64_t capacity = list->capacity ? list->capacity * 2 : 1024;
+		EDGE_RECORD * buffer;
+
+		while (capacity < list->nRecords + nRecords)
+		{
+			capacity *= 2;
+		}
+
+		if ((buffer = (EDGE_RECORD *) realloc(list->records, (size_t) capacity * sizeof(EDGE_RECORD))) == NULL)
+		{
+			return 0;
+		}
+
+		list->records = buffer;
+		list->capacity = capacity;
+	}
+
+	memcpy(list->records + list->nRecords, records, nRecords * sizeof(EDGE_RECORD));
+	list->nRecords += nRecords;
+	list->nSamples += nSamples;
+	return 1;
+}
+
+/****************************************************************************
+* EdgeListLoad
+* Читает все фрагменты CAPTURE_CHUNK_EDGES из файла захвата
+*
+* Возвращает 1 при успехе, 0 если файл не удалось открыть
+****************************************************************************/
+int16_t EdgeListLoad(EDGE_LIST * list, const char * fileName)
+{
+	CAPTURE_FILE capture;
+	CAPTURE_CHUNK chunk;
+	void * payload = NULL;
+	uint32_t capacity = 0;
+	int16_t ok = 1;
+
+	memset(list, 0, sizeof(EDGE_LIST));
+
+	if (!CaptureOpen(&capture, fileName))
+	{
+		return 0;
+	}
+
+	while (ok && CaptureReadChunk(&capture, &chunk, &payload, &capacity))
+	{
+		if (chunk.type == CAPTURE_CHUNK_EDGES)
+		{
+			ok = EdgeListAppend(list, (const EDGE_RECORD *) payload, chunk.payloadSize / sizeof(EDGE_RECORD), chunk.nSamples);
+		}
+	}
+
+	free(payload);
+	CaptureClose(&capture);
+	return ok;
+}
+
+/****************************************************************************
+* EdgeListDecode
+* Восстанавливает слова портов для отсчётов firstSample .. firstSample + nSamples - 1
+*
+* Возвращает количество восстановленных отсчётов (меньше nSamples, если
+* диапазон выходит за конец записи)
+****************************************************************************/
+int32_t EdgeListDecode(const EDGE_LIST * list, uint64_t firstSample, int32_t nSamples, uint16_t * words)
+{
+	int64_t lo = 0;
+	int64_t hi = list->nRecords - 1;
+	int64_t r;
+	int32_t i = 0;
+
+	if (list->nRecords == 0 || nSamples <= 0 || firstSample >= list->nSamples)
+	{
+		return 0;
+	}
+
+	if (firstSample + nSamples > list->nSamples)
+	{
+		nSamples = (int32_t) (list->nSamples - firstSample);
+	}
+
+	// Двоичный поиск последнего перехода не позже firstSample
+	while (lo < hi)
+	{
+		int64_t mid = (lo + hi + 1) / 2;
+
+		if (list->records[mid].sample <= firstSample)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+
+	for (r = lo; i < nSamples; r++)
+	{
+		uint16_t state = list->records[r].state;
+		int32_t end = nSamples;
+
+		if (r + 1 < list->nRecords && list->records[r + 1].sample < firstSample + nSamples)
+		{
+			end = (int32_t) (list->records[r + 1].sample - firstSample);
+		}
+
+		for (; i < end; i++)
+		{
+			words[i] = state;
+		}
+	}
+
+	return nSamples;
+}
+
+/****************************************************************************
+* EdgeListFree
+* Освобождает список переходов
+****************************************************************************/
+void EdgeListFree(EDGE_LIST * list)
+{
+	free(list->records);
+	memset(list, 0, sizeof(EDGE_LIST));
+}
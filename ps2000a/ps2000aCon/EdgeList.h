@@ -0,0 +1,50 @@
+﻿/******************************************************************************
+ *
+ * Filename: EdgeList.h
+ *
+ * Description:
+ *   Кодирование цифровых потоков списком переходов.
+ *   Логические сигналы меняются редко, поэтому вместо слова на каждый отсчёт
+ *   хранятся только пары (номер отсчёта, новое состояние D15..D0).
+ *   Первый отсчёт сбора записывается всегда, чтобы было известно
+ *   начальное состояние. Декодер восстанавливает любой диапазон отсчётов.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include "DigitalPack.h"
+
+#pragma pack(push, 1)
+
+typedef struct tEdgeRecord
+{
+	uint64_t	sample;
+	uint16_t	state;
+}EDGE_RECORD;
+
+#pragma pack(pop)
+
+typedef struct tEdgeEncoder
+{
+	uint16_t		state;			// Последнее состояние портов
+	uint64_t		nSamples;		// Количество закодированных отсчётов
+	DIGITAL_EDGE *	edges;			// Рабочий буфер DigitalFindEdges
+	int32_t			capacity;
+}EDGE_ENCODER;
+
+typedef struct tEdgeList
+{
+	EDGE_RECORD *	records;
+	int64_t			nRecords;
+	int64_t			capacity;
+	uint64_t		nSamples;		// Общее количество отсчётов, описываемых списком
+}EDGE_LIST;
+
+void EdgeEncoderInit(EDGE_ENCODER * encoder);
+int32_t EdgeEncode(EDGE_ENCODER * encoder, const uint16_t * words, int32_t nSamples, EDGE_RECORD * records);
+void EdgeEncoderFree(EDGE_ENCODER * encoder);
+
+int16_t EdgeListAppend(EDGE_LIST * list, const EDGE_RECORD * records, int32_t nRecords, uint64_t nSamples);
+int16_t EdgeListLoad(EDGE_LIST * list, const char * fileName);
+int32_t EdgeListDecode(const EDGE_LIST * list, uint64_t firstSample, int32_t nSamples, uint16_t * words);
+void EdgeListFree(EDGE_LIST * list);
@@ -0,0 +1,30 @@
+﻿/******************************************************************************
+ *
+ * Filename: FileOpen.h
+ *
+ * Description:
+ *   Открытие файлов, общее для файлов захвата, калибровки и кэша устройств.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdio.h>
+
+/****************************************************************************
+* FileOpen
+* fopen, допустимый при проверках SDL компилятора Microsoft
+****************************************************************************/
+static inline FILE * FileOpen(const char * fileName, const char * mode)
+{
+	FILE * fp = NULL;
+
+#ifdef _MSC_VER
+	if (fopen_s(&fp, fileName, mode) != 0)
+	{
+		fp = NULL;
+	}
+#else
+	fp = fopen(fileName, mode);
+#endif
+
+	return fp;
+}
@@ -0,0 +1,395 @@
+﻿/******************************************************************************
+ *
+ * Filename: ProtocolDecoder.cpp
+ *
+ * Description:
+ *   Потоковые декодеры протоколов UART, SPI и I2C (см. ProtocolDecoder.h).
+ *
+ ******************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "ProtocolDecoder.h"
+
+#define BIT(state, bit)		(((state) >> (bit)) & 1)
+
+/****************************************************************************
+* ProtocolEmit
+* Передаёт кадр получателю
+****************************************************************************/
+static void ProtocolEmit(PROTOCOL_DECODER * decoder, PROTOCOL_FRAME_TYPE type, uint64_t startSample, uint64_t endSample,
+	uint16_t data, uint16_t data2, int16_t flags)
+{
+	PROTOCOL_FRAME frame;
+
+	if (!decoder->sink)
+	{
+		return;
+	}
+
+	frame.protocol = decoder->settings.type;
+	frame.type = type;
+	frame.startSample = startSample;
+	frame.endSample = endSample;
+	frame.time = startSample * decoder->sampleInterval;
+	frame.data = data;
+	frame.data2 = data2;
+	frame.flags = flags;
+
+	decoder->sink(decoder->context, &frame);
+}
+
+/****************************************************************************
+* UartAdvance
+* Считывает биты кадра UART во всех точках до отсчёта until (не включая его),
+* на этом участке линия находится в состоянии state
+****************************************************************************/
+static void UartAdvance(PROTOCOL_DECODER * decoder, uint64_t until, uint16_t state)
+{
+	PROTOCOL_SETTINGS * settings = &decoder->settings;
+	int16_t parityBits = settings->parity ? 1 : 0;
+	int16_t totalBits = 1 + settings->dataBits + parityBits + settings->stopBits;
+
+	while (decoder->phase && decoder->nextPoint < (double) until)
+	{
+		int16_t level = (int16_t) (BIT(state, settings->dataBit) ^ (settings->inverted ? 1 : 0));
+		int16_t k = decoder->bitCount;
+
+		if (k == 0)
+		{
+			if (level)		// Помеха: к середине стартового бита линия вернулась в покой
+			{
+				decoder->phase = 0;
+				break;
+			}
+		}
+		else if (k <= settings->dataBits)
+		{
+			decoder->shift |= (uint32_t) level << (k - 1);		// Младший бит первым
+			decoder->ones += level;
+		}
+		else if (parityBits && k == settings->dataBits + 1)
+		{
+			if (((decoder->ones + level) & 1) != (settings->parity == 1 ? 1 : 0))
+			{
+				decoder->flags |= PROTOCOL_FLAG_PARITY_ERROR;
+			}
+		}
+		else if (!level)
+		{
+			decoder->flags |= PROTOCOL_FLAG_FRAMING_ERROR;		// Стоповый бит должен быть в состоянии покоя
+		}
+
+		if (++decoder->bitCount == totalBits)
+		{
+			ProtocolEmit(decoder, PROTOCOL_FRAME_DATA, decoder->frameStart, (uint64_t) decoder->nextPoint,
+				(uint16_t) decoder->shift, 0, decoder->flags);
+			decoder->phase = 0;
+			break;
+		}
+
+		decoder->nextPoint += decoder->samplesPerBit;
+	}
+}
+
+/****************************************************************************
+* UartEdge
+* Обработка перехода: спад линии в состоянии покоя начинает новый кадр
+****************************************************************************/
+static void UartEdge(PROTOCOL_DECODER * decoder, const DIGITAL_EDGE * edge)
+{
+	PROTOCOL_SETTINGS * settings = &decoder->settings;
+	int16_t before = (int16_t) (BIT(decoder->state, settings->dataBit) ^ (settings->inverted ? 1 : 0));
+	int16_t after = (int16_t) (BIT(edge->state, settings->dataBit) ^ (settings->inverted ? 1 : 0));
+
+	if (!decoder->phase && before && !after)
+	{
+		decoder->phase = 1;
+		decoder->bitCount = 0;
+		decoder->shift = 0;
+		decoder->ones = 0;
+		decoder->flags = 0;
+		decoder->frameStart = edge->sample;
+		decoder->nextPoint = edge->sample + decoder->samplesPerBit / 2;		// Середина стартового бита
+	}
+}
+
+/****************************************************************************
+* SpiEdge
+* Обработка перехода: данные считываются на рабочем фронте SCLK
+* (нарастающем для режимов 0 и 3, спадающем для режимов 1 и 2)
+****************************************************************************/
+static void SpiEdge(PROTOCOL_DECODER * decoder, const DIGITAL_EDGE * edge)
+{
+	PROTOCOL_SETTINGS * settings = &decoder->settings;
+	int16_t cpol = (settings->mode >> 1) & 1;
+	int16_t cpha = settings->mode & 1;
+	int16_t sampleOnRising = (cpol == cpha);
+
+	if (settings->selectBit >= 0 && BIT(edge->changed, settings->selectBit))
+	{
+		decoder->bitCount = 0;		// Начало или конец передачи - незавершённое слово отбрасывается
+		decoder->shift = 0;
+		decoder->shift2 = 0;
+	}
+
+	if (settings->selectBit >= 0 && BIT(edge->state, settings->selectBit))
+	{
+		return;		// Ведомый не выбран
+	}
+
+	if (BIT(edge->changed, settings->clockBit) && (int16_t) BIT(edge->state, settings->clockBit) == sampleOnRising)
+	{
+		uint32_t mosi = BIT(edge->state, settings->dataBit);
+		uint32_t miso = settings->misoBit >= 0 ? BIT(edge->state, settings->misoBit) : 0;
+
+		if (decoder->bitCount == 0)
+		{
+			decoder->frameStart = edge->sample;
+		}
+
+		if (settings->msbFirst)
+		{
+			decoder->shift = (decoder->shift << 1) | mosi;
+			decoder->shift2 = (decoder->shift2 << 1) | miso;
+		}
+		else
+		{
+			decoder->shift |= mosi << decoder->bitCount;
+			decoder->shift2 |= miso << decoder->bitCount;
+		}
+
+		if (++decoder->bitCount == settings->dataBits)
+		{
+			ProtocolEmit(decoder, PROTOCOL_FRAME_DATA, decoder->frameStart, edge->sample,
+				(uint16_t) decoder->shift, (uint16_t) decoder->shift2, 0);
+			decoder->bitCount = 0;
+			decoder->shift = 0;
+			decoder->shift2 = 0;
+		}
+	}
+}
+
+/****************************************************************************
+* I2cEdge
+* Обработка перехода: изменение SDA при высоком SCL - условия START/STOP,
+* нарастающий фронт SCL - очередной бит (8 бит данных и бит подтверждения)
+****************************************************************************/
+static void I2cEdge(PROTOCOL_DECODER * decoder, const DIGITAL_EDGE * edge)
+{
+	PROTOCOL_SETTINGS * settings = &decoder->settings;
+	uint16_t sclBefore = BIT(decoder->state, settings->clockBit);
+	uint16_t sclAfter = BIT(edge->state, settings->clockBit);
+	uint16_t sdaAfter = BIT(edge->state, settings->dataBit);
+
+	if (sclBefore && sclAfter && BIT(edge->changed, settings->dataBit))
+	{
+		if (!sdaAfter)
+		{
+			ProtocolEmit(decoder, PROTOCOL_FRAME_START, edge->sample, edge->sample, 0, 0, 0);
+			decoder->phase = 1;			// Следующий байт - адрес
+		}
+		else
+		{
+			ProtocolEmit(decoder, PROTOCOL_FRAME_STOP, edge->sample, edge->sample, 0, 0, 0);
+			decoder->phase = 0;
+		}
+
+		decoder->bitCount = 0;
+		decoder->shift = 0;
+		return;
+	}
+
+	if (decoder->phase && !sclBefore && sclAfter)
+	{
+		if (decoder->bitCount == 0)
+		{
+			decoder->frameStart = edge->sample;
+		}
+
+		if (decoder->bitCount < 8)
+		{
+			decoder->shift = (decoder->shift << 1) | sdaAfter;
+			decoder->bitCount++;
+		}
+		else
+		{
+			int16_t flags = sdaAfter ? PROTOCOL_FLAG_NACK : 0;
+
+			if (decoder->phase == 1)
+			{
+				ProtocolEmit(decoder, PROTOCOL_FRAME_ADDRESS, decoder->frameStart, edge->sample, (uint16_t) (decoder->shift >> 1), 0,
+					(int16_t) (flags | ((decoder->shift & 1) ? PROTOCOL_FLAG_READ : 0)));
+			}
+			else
+			{
+				ProtocolEmit(decoder, PROTOCOL_FRAME_DATA, decoder->frameStart, edge->sample, (uint16_t) decoder->shift, 0, flags);
+			}
+
+			decoder->phase = 2;
+			decoder->bitCount = 0;
+			decoder->shift = 0;
+		}
+	}
+}
+
+/****************************************************************************
+* ProtocolInit
+* Параметры
+* - settings - протокол и назначение цифровых каналов
+* - sampleInterval - интервал между отсчётами цифровых портов, нс
+* - sink, context - получатель декодированных кадров
+*
+* Возвращает 1 при успехе, 0 при неверных параметрах
+****************************************************************************/
+int16_t ProtocolInit(PROTOCOL_DECODER * decoder, const PROTOCOL_SETTINGS * settings, double sampleInterval,
+	PROTOCOL_SINK sink, void * context)
+{
+	memset(decoder, 0, sizeof(PROTOCOL_DECODER));
+
+	decoder->settings = *settings;
+	decoder->sink = sink;
+	decoder->context = context;
+	decoder->sampleInterval = sampleInterval;
+
+	if (settings->dataBit < 0 || settings->dataBit > 15)
+	{
+		return 0;
+	}
+
+	switch (settings->type)
+	{
+		case PROTOCOL_UART:
+			if (settings->baudRate == 0 || sampleInterval <= 0.0 || settings->dataBits < 5 || settings->dataBits > 9)
+			{
+				return 0;
+			}
+
+			decoder->samplesPerBit = 1e9 / settings->baudRate / sampleInterval;
+
+			if (decoder->samplesPerBit < 2.0)
+			{
+				return 0;		// Частота дискретизации слишком мала для этой скорости
+			}
+			break;
+
+		case PROTOCOL_SPI:
+			if (settings->clockBit < 0 || settings->clockBit > 15 || settings->dataBits < 1 || settings->dataBits > 16 ||
+				settings->misoBit > 15 || settings->selectBit > 15)
+			{
+				return 0;
+			}
+			break;
+
+		case PROTOCOL_I2C:
+			if (settings->clockBit < 0 || settings->clockBit > 15)
+			{
+				return 0;
+			}
+			break;
+
+		default:
+			return 0;
+	}
+
+	return 1;
+}
+
+/****************************************************************************
+* ProtocolProcess
+* Декодирует очередной фрагмент слов цифровых портов
+****************************************************************************/
+void ProtocolProcess(PROTOCOL_DECODER * decoder, const uint16_t * words, int32_t nSamples)
+{
+	int32_t nEdges;
+	int32_t e;
+	uint16_t previous;
+
+	if (nSamples <= 0)
+	{
+		return;
+	}
+
+	if (nSamples > decoder->capacity)
+	{
+		DIGITAL_EDGE * edges = (DIGITAL_EDGE *) realloc(decoder->edges, nSamples * sizeof(DIGITAL_EDGE));
+
+		if (!edges)
+		{
+			return;
+		}
+
+		decoder->edges = edges;
+		decoder->capacity = nSamples;
+	}
+
+	if (decoder->nSamples == 0)
+	{
+		decoder->state = words[0];		// Начальное состояние не считается переходом
+	}
+
+	previous = decoder->state;
+	nEdges = DigitalFindEdges(words, nSamples, &previous, decoder->nSamples, decoder->edges);
+
+	for (e = 0; e < nEdges; e++)
+	{
+		DIGITAL_EDGE * edge = &decoder->edges[e];
+
+		switch (decoder->settings.type)
+		{
+			case PROTOCOL_UART:
+				UartAdvance(decoder, edge->sample, decoder->state);
+				UartEdge(decoder, edge);
+				break;
+
+			case PROTOCOL_SPI:
+				SpiEdge(decoder, edge);
+				break;
+
+			case PROTOCOL_I2C:
+				I2cEdge(decoder, edge);
+				break;
+		}
+
+		decoder->state = edge->state;
+	}
+
+	decoder->nSamples += nSamples;
+
+	if (decoder->settings.type == PROTOCOL_UART)
+	{
+		UartAdvance(decoder, decoder->nSamples, decoder->state);
+	}
+}
+
+/****************************************************************************
+* ProtocolFree
+* Освобождает рабочие буферы декодера
+****************************************************************************/
+void ProtocolFree(PROTOCOL_DECODER * decoder)
+{
+	free(decoder->edges);
+	decoder->edges = NULL;
+	decoder->capacity = 0;
+}
+
+/****************************************************************************
+* ProtocolName
+* Возвращает название протокола для вывода
+****************************************************************************/
+const char * ProtocolName(PROTOCOL_TYPE type)
+{
+	switch (type)
+	{
+		case PROTOCOL_UART:
+			return "UART";
+
+		case PROTOCOL_SPI:
+			return "SPI";
+
+		case PROTOCOL_I2C:
+			return "I2C";
+
+		default:
+			return "?";
+	}
+}
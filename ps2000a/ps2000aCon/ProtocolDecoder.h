@@ -0,0 +1,95 @@
+﻿/******************************************************************************
+ *
+ * Filename: ProtocolDecoder.h
+ *
+ * Description:
+ *   Потоковые декодеры протоколов UART, SPI и I2C для цифровых портов MSO.
+ *   Декодер получает упакованные 16-разрядные слова портов (см. DigitalPack.h)
+ *   фрагмент за фрагментом, хранит состояние между фрагментами и передаёт
+ *   получателю декодированные кадры с номером отсчёта и временем.
+ *   Обрабатываются только переходы сигналов, поэтому участки без изменений
+ *   пропускаются целиком.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include "DigitalPack.h"
+
+typedef enum
+{
+	PROTOCOL_UART,
+	PROTOCOL_SPI,
+	PROTOCOL_I2C
+}PROTOCOL_TYPE;
+
+typedef enum
+{
+	PROTOCOL_FRAME_DATA,			// Байт (слово) данных
+	PROTOCOL_FRAME_ADDRESS,			// I2C: адрес ведомого (7 бит), направление во флаге PROTOCOL_FLAG_READ
+	PROTOCOL_FRAME_START,			// I2C: условие START (или повторный START)
+	PROTOCOL_FRAME_STOP				// I2C: условие STOP
+}PROTOCOL_FRAME_TYPE;
+
+#define PROTOCOL_FLAG_PARITY_ERROR		0x0001
+#define PROTOCOL_FLAG_FRAMING_ERROR		0x0002
+#define PROTOCOL_FLAG_NACK				0x0004
+#define PROTOCOL_FLAG_READ				0x0008
+
+typedef struct tProtocolSettings
+{
+	PROTOCOL_TYPE	type;
+	int16_t			dataBit;		// UART: RX, SPI: MOSI, I2C: SDA (номер цифрового канала D0..D15)
+	int16_t			clockBit;		// SPI: SCLK, I2C: SCL
+	int16_t			misoBit;		// SPI: MISO, -1 - не используется
+	int16_t			selectBit;		// SPI: CS (активный низкий уровень), -1 - не используется
+	uint32_t		baudRate;		// UART: скорость, бод
+	int16_t			dataBits;		// UART: битов данных, SPI: битов в слове
+	int16_t			parity;			// UART: 0 - нет, 1 - нечётность, 2 - чётность
+	int16_t			stopBits;		// UART
+	int16_t			mode;			// SPI: режим 0..3 (CPOL * 2 + CPHA)
+	int16_t			msbFirst;		// SPI: старший бит первым
+	int16_t			inverted;		// UART: инвертированная линия (покой - низкий уровень)
+}PROTOCOL_SETTINGS;
+
+typedef struct tProtocolFrame
+{
+	PROTOCOL_TYPE		protocol;
+	PROTOCOL_FRAME_TYPE	type;
+	uint64_t			startSample;	// Номер отсчёта начала кадра от начала сбора
+	uint64_t			endSample;
+	double				time;			// Время начала кадра, нс
+	uint16_t			data;			// Данные (SPI: MOSI)
+	uint16_t			data2;			// SPI: MISO
+	int16_t				flags;			// PROTOCOL_FLAG_*
+}PROTOCOL_FRAME;
+
+typedef void (*PROTOCOL_SINK)(void * context, const PROTOCOL_FRAME * frame);
+
+typedef struct tProtocolDecoder
+{
+	PROTOCOL_SETTINGS	settings;
+	PROTOCOL_SINK		sink;
+	void *				context;
+	double				sampleInterval;		// Интервал между отсчётами, нс
+	double				samplesPerBit;		// UART
+
+	uint64_t			nSamples;			// Обработано отсчётов
+	uint16_t			state;				// Состояние портов на последнем отсчёте
+	DIGITAL_EDGE *		edges;
+	int32_t				capacity;
+
+	int16_t				phase;				// 0 - ожидание начала кадра
+	int16_t				bitCount;
+	uint32_t			shift;
+	uint32_t			shift2;
+	int16_t				ones;
+	int16_t				flags;
+	double				nextPoint;			// UART: отсчёт, в котором считывается следующий бит
+	uint64_t			frameStart;
+}PROTOCOL_DECODER;
+
+int16_t ProtocolInit(PROTOCOL_DECODER * decoder, const PROTOCOL_SETTINGS * settings, double sampleInterval,
+	PROTOCOL_SINK sink, void * context);
+void ProtocolProcess(PROTOCOL_DECODER * decoder, const uint16_t * words, int32_t nSamples);
+void ProtocolFree(PROTOCOL_DECODER * decoder);
+const char * ProtocolName(PROTOCOL_TYPE type);
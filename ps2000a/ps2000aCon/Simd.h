@@ -0,0 +1,318 @@
+﻿/******************************************************************************
+ *
+ * Filename: Simd.h
+ *
+ * Description:
+ *   Векторные ядра (SSE2) для обработки отсчётов АЦП на стороне ПК.
+ *   Для каждого ядра есть скалярный вариант, который используется,
+ *   если компилятор не поддерживает SSE2.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+/****************************************************************************
+* SimdSum16
+*
+* Сумма n 16-разрядных отсчётов
+****************************************************************************/
+static inline int64_t SimdSum16(const int16_t * src, int32_t n)
+{
+	int64_t sum = 0;
+	int32_t i = 0;
+
+#ifdef SIMD_SSE2
+	const __m128i ones = _mm_set1_epi16(1);
+
+	while (n - i >= 8)
+	{
+		// Не более 16384 итераций на один аккумулятор, чтобы 32-разрядные суммы не переполнились
+		int32_t block = (n - i) / 8;
+		__m128i acc = _mm_setzero_si128();
+		int32_t lanes[4];
+
+		if (block > 16384)
+		{
+			block = 16384;
+		}
+
+		for (; block > 0; block--, i += 8)
+		{
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i *) (src + i)), ones));
+		}
+
+		_mm_storeu_si128((__m128i *) lanes, acc);
+		sum += (int64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		sum += src[i];
+	}
+
+	return sum;
+}
+
+/****************************************************************************
+* SimdMinMax16
+*
+* Обновляет *minValue и *maxValue минимумом и максимумом n отсчётов
+****************************************************************************/
+static inline void SimdMinMax16(const int16_t * src, int32_t n, int16_t * minValue, int16_t * maxValue)
+{
+	int16_t lo = *minValue;
+	int16_t hi = *maxValue;
+	int32_t i = 0;
+
+#ifdef SIMD_SSE2
+	if (n >= 8)
+	{
+		__m128i vmin = _mm_set1_epi16(lo);
+		__m128i vmax = _mm_set1_epi16(hi);
+		int16_t lanes[8];
+		int32_t k;
+
+		for (; i + 8 <= n; i += 8)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+			vmin = _mm_min_epi16(vmin, v);
+			vmax = _mm_max_epi16(vmax, v);
+		}
+
+		_mm_storeu_si128((__m128i *) lanes, vmin);
+		for (k = 0; k < 8; k++)
+		{
+			lo = lanes[k] < lo ? lanes[k] : lo;
+		}
+
+		_mm_storeu_si128((__m128i *) lanes, vmax);
+		for (k = 0; k < 8; k++)
+		{
+			hi = lanes[k] > hi ? lanes[k] : hi;
+		}
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		lo = src[i] < lo ? src[i] : lo;
+		hi = src[i] > hi ? src[i] : hi;
+	}
+
+	*minValue = lo;
+	*maxValue = hi;
+}
+
+/****************************************************************************
+* SimdInt16ToFloat
+*
+* Преобразует n 16-разрядных отсчётов в float
+****************************************************************************/
+static inline void SimdInt16ToFloat(const int16_t * src, float * dst, int32_t n)
+{
+	int32_t i = 0;
+
+#ifdef SIMD_SSE2
+	for (; i + 8 <= n; i += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);	// расширение знака младших 4 отсчётов
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);	// и старших 4 отсчётов
+
+		_mm_storeu_ps(dst + i, _mm_cvtepi32_ps(lo));
+		_mm_storeu_ps(dst + i + 4, _mm_cvtepi32_ps(hi));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		dst[i] = (float) src[i];
+	}
+}
+
+/****************************************************************************
+* SimdDotFloat
+*
+* Скалярное произведение двух векторов длины n
+****************************************************************************/
+static inline float SimdDotFloat(const float * a, const float * b, int32_t n)
+{
+	float sum = 0.0f;
+	int32_t i = 0;
+
+#ifdef SIMD_SSE2
+	if (n >= 8)
+	{
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		float lanes[4];
+
+		for (; i + 8 <= n; i += 8)
+		{
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+		}
+
+		_mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+		sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		sum += a[i] * b[i];
+	}
+
+	return sum;
+}
+
+/****************************************************************************
+* SimdFloatToInt16
+*
+* Округляет n значений float до ближайшего целого с насыщением до int16_t
+****************************************************************************/
+static inline void SimdFloatToInt16(const float * src, int16_t * dst, int32_t n)
+{
+	int32_t i = 0;
+
+#ifdef SIMD_SSE2
+	for (; i + 8 <= n; i += 8)
+	{
+		__m128i lo = _mm_cvtps_epi32(_mm_loadu_ps(src + i));
+		__m128i hi = _mm_cvtps_epi32(_mm_loadu_ps(src + i + 4));
+
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_packs_epi32(lo, hi));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		float v = src[i];
+
+		v = v > 32767.0f ? 32767.0f : (v < -32768.0f ? -32768.0f : v);
+		dst[i] = (int16_t) (v < 0.0f ? v - 0.5f : v + 0.5f);
+	}
+}
+
+/****************************************************************************
+* SimdScaleToInt16
+*
+* dst[i] = src[i] * scale + bias, округлённое и ограниченное пределами lo .. hi
+****************************************************************************/
+static inline void SimdScaleToInt16(const float * src, int32_t n, float scale, float bias, int16_t lo, int16_t hi, int16_t * dst)
+{
+	int32_t i = 0;
+
+#ifdef SIMD_SSE2
+	const __m128 vscale = _mm_set1_ps(scale);
+	const __m128 vbias = _mm_set1_ps(bias);
+	const __m128i vlo = _mm_set1_epi16(lo);
+	const __m128i vhi = _mm_set1_epi16(hi);
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m128i a = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src + i), vscale), vbias));
+		__m128i b = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src + i + 4), vscale), vbias));
+
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_min_epi16(_mm_max_epi16(_mm_packs_epi32(a, b), vlo), vhi));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		float v = src[i] * scale + bias;
+
+		v = v > hi ? hi : (v < lo ? lo : v);
+		dst[i] = (int16_t) (v < 0.0f ? v - 0.5f : v + 0.5f);
+	}
+}
+
+/****************************************************************************
+* SimdPack8
+*
+* Упаковывает n отсчётов в int8_t (dst[i] = src[i] >> shift), если все
+* отсчёты кратны 1 << shift и помещаются в int8_t после сдвига
+*
+* Возвращает 0, если хотя бы один отсчёт упаковать без потерь нельзя
+* (dst при этом заполнен частично)
+****************************************************************************/
+static inline int16_t SimdPack8(const int16_t * src, int32_t n, int16_t shift, int8_t * dst)
+{
+	int32_t lost = 0;
+	int32_t i = 0;
+
+#ifdef SIMD_SSE2
+	if (n >= 16)
+	{
+		const __m128i lowBits = _mm_set1_epi16((int16_t) ((1 << shift) - 1));
+		const __m128i count = _mm_cvtsi32_si128(shift);
+		const __m128i rangeCount = _mm_cvtsi32_si128(shift + 7);
+		__m128i bad = _mm_setzero_si128();
+		int16_t lanes[8];
+		int32_t k;
+
+		for (; i + 16 <= n; i += 16)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i *) (src + i));
+			__m128i b = _mm_loadu_si128((const __m128i *) (src + i + 8));
+
+			// Отсчёт допустим, если младшие биты нулевые, а биты старше shift + 7 совпадают со знаком
+			bad = _mm_or_si128(bad, _mm_and_si128(_mm_or_si128(a, b), lowBits));
+			bad = _mm_or_si128(bad, _mm_xor_si128(_mm_sra_epi16(a, rangeCount), _mm_srai_epi16(a, 15)));
+			bad = _mm_or_si128(bad, _mm_xor_si128(_mm_sra_epi16(b, rangeCount), _mm_srai_epi16(b, 15)));
+			_mm_storeu_si128((__m128i *) (dst + i), _mm_packs_epi16(_mm_sra_epi16(a, count), _mm_sra_epi16(b, count)));
+		}
+
+		_mm_storeu_si128((__m128i *) lanes, bad);
+		for (k = 0; k < 8; k++)
+		{
+			lost |= lanes[k];
+		}
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		int32_t value = src[i] >> shift;
+
+		lost |= (src[i] & ((1 << shift) - 1)) | (value < INT8_MIN || value > INT8_MAX);
+		dst[i] = (int8_t) value;
+	}
+
+	return lost == 0;
+}
+
+/****************************************************************************
+* SimdUnpack8
+*
+* Восстанавливает n отсчётов, упакованных SimdPack8 (shift не больше 8)
+****************************************************************************/
+static inline void SimdUnpack8(const int8_t * src, int32_t n, int16_t shift, int16_t * dst)
+{
+	int32_t i = 0;
+
+#ifdef SIMD_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i count = _mm_cvtsi32_si128(8 - shift);
+
+	for (; i + 16 <= n; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+
+		// Байт в старшей половине слова - это отсчёт << 8, арифметический сдвиг вправо оставляет << shift
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_sra_epi16(_mm_unpacklo_epi8(zero, v), count));
+		_mm_storeu_si128((__m128i *) (dst + i + 8), _mm_sra_epi16(_mm_unpackhi_epi8(zero, v), count));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		dst[i] = (int16_t) (src[i] * (1 << shift));
+	}
+}
@@ -0,0 +1,428 @@
+﻿/******************************************************************************
+ *
+ * Filename: StreamFilter.cpp
+ *
+ * Description:
+ *   Цифровая фильтрация потоковых аналоговых данных (см. StreamFilter.h).
+ *
+ ******************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "StreamFilter.h"
+#include "Decimator.h"
+#include "Simd.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/****************************************************************************
+* FilterInit
+* Параметры
+* - chain - цепочка для инициализации
+* - settings, nStages - звенья в порядке применения (не более FILTER_MAX_STAGES)
+*
+* Возвращает 1 при успехе, 0 при неверных параметрах или нехватке памяти
+****************************************************************************/
+int16_t FilterInit(FILTER_CHAIN * chain, const FILTER_STAGE_SETTINGS * settings, int16_t nStages)
+{
+	int16_t s;
+
+	memset(chain, 0, sizeof(FILTER_CHAIN));
+
+	if (nStages < 0 || nStages > FILTER_MAX_STAGES)
+	{
+		return 0;
+	}
+
+	for (s = 0; s < nStages; s++)
+	{
+		FILTER_STAGE_SETTINGS * stage = &chain->settings[s];
+		int32_t nCoefficients = 0;
+
+		*stage = settings[s];
+
+		switch (stage->type)
+		{
+			case FILTER_FIR:
+				if (stage->length < 1 || stage->length > FILTER_MAX_TAPS)
+				{
+					return 0;
+				}
+				nCoefficients = stage->length;
+				break;
+
+			case FILTER_BIQUAD:
+				if (stage->length < 1 || stage->length > FILTER_MAX_SECTIONS)
+				{
+					return 0;
+				}
+				nCoefficients = stage->length * 5;
+				break;
+
+			case FILTER_MOVING_AVERAGE:
+				if (stage->length < 1 || stage->length > FILTER_MAX_WINDOW)
+				{
+					return 0;
+				}
+				break;
+
+			case FILTER_MEDIAN:
+				if (stage->length < 1 || stage->length > FILTER_MAX_MEDIAN || (stage->length & 1) == 0)
+				{
+					return 0;
+				}
+				break;
+
+			default:
+				return 0;
+		}
+
+		chain->nStages = s + 1;
+
+		if (nCoefficients == 0)
+		{
+			continue;
+		}
+
+		// Коэффициенты копируются, чтобы вызывающая сторона не отвечала за время их жизни
+		if ((chain->coefficients[s] = (float *) malloc(nCoefficients * sizeof(float))) == NULL)
+		{
+			FilterFree(chain);
+			return 0;
+		}
+
+		if (stage->coefficients && stage->type == FILTER_FIR)
+		{
+			int16_t k;
+
+			// Коэффициенты хранятся в обратном порядке: FilterFir умножает их на окно,
+			// идущее от старых отсчётов к новым, и получает свёртку, а не корреляцию
+			for (k = 0; k < stage->length; k++)
+			{
+				chain->coefficients[s][k] = stage->coefficients[stage->length - 1 - k];
+			}
+		}
+		else if (stage->coefficients)
+		{
+			memcpy(chain->coefficients[s], stage->coefficients, nCoefficients * sizeof(float));
+		}
+		else if (stage->type == FILTER_FIR)
+		{
+			// Расчётный ФНЧ симметричен, обращать порядок не нужно
+			DecimatorDesignLowPass(chain->coefficients[s], stage->length, stage->cutoff);
+		}
+		else
+		{
+			FilterDesignButterworth(chain->coefficients[s], stage->length, stage->cutoff);
+		}
+
+		stage->coefficients = chain->coefficients[s];
+	}
+
+	return 1;
+}
+
+/****************************************************************************
+* FilterFir
+* КИХ-фильтр: каждый выходной отсчёт - векторное скалярное произведение
+* коэффициентов (в обратном порядке, см. FilterInit) и окна входных отсчётов,
+* окно продолжается в предыдущий фрагмент
+*
+* Возвращает 0 при нехватке памяти (фрагмент не изменяется)
+****************************************************************************/
+static int16_t FilterFir(FILTER_STAGE_SETTINGS * stage, FILTER_STAGE_STATE * state, float * data, int32_t nSamples)
+{
+	int32_t i;
+	int32_t history = stage->length - 1;
+
+	if (state->capacity < nSamples)
+	{
+		float * buffer = (float *) realloc(state->history, (history + nSamples) * sizeof(float));
+
+		if (!buffer)
+		{
+			return 0;
+		}
+
+		if (!state->history)
+		{
+			memset(buffer, 0, history * sizeof(float));
+		}
+
+		state->history = buffer;
+		state->capacity = nSamples;
+	}
+
+	memcpy(state->history + history, data, nSamples * sizeof(float));
+
+	for (i = 0; i < nSamples; i++)
+	{
+		data[i] = SimdDotFloat(stage->coefficients, state->history + i, stage->length);
+	}
+
+	memmove(state->history, state->history + nSamples, history * sizeof(float));
+
+	return 1;
+}
+
+/****************************************************************************
+* FilterBiquad
+* Каскад биквадратных звеньев (транспонированная прямая форма II).
+* Рекурсивный фильтр не векторизуется по времени, поэтому состояние
+* хранится в double для устойчивости при низких частотах среза.
+****************************************************************************/
+static void FilterBiquad(FILTER_STAGE_SETTINGS * stage, FILTER_STAGE_STATE * state, float * data, int32_t nSamples)
+{
+	int16_t k;
+	int32_t i;
+
+	for (k = 0; k < stage->length; k++)
+	{
+		const float * c = stage->coefficients + k * 5;
+		double b0 = c[0], b1 = c[1], b2 = c[2], a1 = c[3], a2 = c[4];
+		double z0 = state->z[k][0];
+		double z1 = state->z[k][1];
+
+		for (i = 0; i < nSamples; i++)
+		{
+			double x = data[i];
+			double y = b0 * x + z0;
+
+			z0 = b1 * x - a1 * y + z1;
+			z1 = b2 * x - a2 * y;
+			data[i] = (float) y;
+		}
+
+		state->z[k][0] = z0;
+		state->z[k][1] = z1;
+	}
+}
+
+/****************************************************************************
+* FilterMovingAverage
+* Скользящее среднее по окну из length отсчётов (до заполнения окна -
+* среднее по уже полученным отсчётам)
+*
+* Возвращает 0 при нехватке памяти (фрагмент не изменяется)
+****************************************************************************/
+static int16_t FilterMovingAverage(FILTER_STAGE_SETTINGS * stage, FILTER_STAGE_STATE * state, float * data, int32_t nSamples)
+{
+	int32_t i;
+
+	if (!state->history && (state->history = (float *) calloc(stage->length, sizeof(float))) == NULL)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < nSamples; i++)
+	{
+		state->sum += data[i] - state->history[state->position];
+		state->history[state->position] = data[i];
+		state->position = (state->position + 1) % stage->length;
+
+		if (state->filled < stage->length)
+		{
+			state->filled++;
+		}
+
+		data[i] = (float) (state->sum / state->filled);
+	}
+
+	return 1;
+}
+
+/****************************************************************************
+* FilterMedian
+* Скользящая медиана: окно хранится в кольцевом буфере и в отсортированном
+* массиве, каждый новый отсчёт заменяет самый старый со сдвигом O(length)
+*
+* Возвращает 0 при нехватке памяти (фрагмент не изменяется)
+****************************************************************************/
+static int16_t FilterMedian(FILTER_STAGE_SETTINGS * stage, FILTER_STAGE_STATE * state, float * data, int32_t nSamples)
+{
+	int32_t i, k;
+
+	if (!state->history)
+	{
+		state->history = (float *) calloc(stage->length, sizeof(float));
+		state->sorted = (float *) calloc(stage->length, sizeof(float));
+
+		if (!state->history || !state->sorted)
+		{
+			free(state->history);
+			free(state->sorted);
+			state->history = NULL;
+			state->sorted = NULL;
+			return 0;
+		}
+	}
+
+	for (i = 0; i < nSamples; i++)
+	{
+		float value = data[i];
+
+		if (state->filled == stage->length)
+		{
+			// Удалить самый старый отсчёт из отсортированного массива
+			float oldest = state->history[state->position];
+
+			for (k = 0; k < state->filled - 1 && state->sorted[k] != oldest; k++);
+			memmove(&state->sorted[k], &state->sorted[k + 1], (state->filled - 1 - k) * sizeof(float));
+			state->filled--;
+		}
+
+		// Вставить новый отсчёт, сохраняя порядок
+		for (k = state->filled; k > 0 && state->sorted[k - 1] > value; k--)
+		{
+			state->sorted[k] = state->sorted[k - 1];
+		}
+
+		state->sorted[k] = value;
+		state->filled++;
+
+		state->history[state->position] = value;
+		state->position = (state->position + 1) % stage->length;
+
+		data[i] = state->sorted[state->filled / 2];
+	}
+
+	return 1;
+}
+
+/****************************************************************************
+* FilterProcess
+* Фильтрует фрагмент на месте.
+* Параметры
+* - buffer - номер буфера (channel * 2 для максимумов, channel * 2 + 1 для минимумов),
+*   у каждого буфера собственное состояние звеньев
+* - data, nSamples - фрагмент данных
+*
+* Возвращает 0, если звену не хватило памяти: фрагмент остаётся
+* нефильтрованным (или отфильтрованным только предыдущими звеньями)
+****************************************************************************/
+int16_t FilterProcess(FILTER_CHAIN * chain, int16_t buffer, int16_t * data, int32_t nSamples)
+{
+	int16_t s;
+	int16_t ok = 1;
+
+	if (chain->nStages == 0 || nSamples <= 0 || buffer < 0 || buffer >= PS2000A_MAX_CHANNEL_BUFFERS)
+	{
+		return 1;
+	}
+
+	if (nSamples > chain->capacity)
+	{
+		float * work = (float *) realloc(chain->work, nSamples * sizeof(float));
+
+		if (!work)
+		{
+			return 0;
+		}
+
+		chain->work = work;
+		chain->capacity = nSamples;
+	}
+
+	SimdInt16ToFloat(data, chain->work, nSamples);
+
+	for (s = 0; s < chain->nStages && ok; s++)
+	{
+		FILTER_STAGE_SETTINGS * stage = &chain->settings[s];
+		FILTER_STAGE_STATE * state = &chain->state[s][buffer];
+
+		switch (stage->type)
+		{
+			case FILTER_FIR:
+				ok = FilterFir(stage, state, chain->work, nSamples);
+				break;
+
+			case FILTER_BIQUAD:
+				FilterBiquad(stage, state, chain->work, nSamples);
+				break;
+
+			case FILTER_MOVING_AVERAGE:
+				ok = FilterMovingAverage(stage, state, chain->work, nSamples);
+				break;
+
+			case FILTER_MEDIAN:
+				ok = FilterMedian(stage, state, chain->work, nSamples);
+				break;
+		}
+	}
+
+	SimdFloatToInt16(chain->work, data, nSamples);
+
+	return ok;
+}
+
+/****************************************************************************
+* FilterReset
+* Сбрасывает состояние всех звеньев (например, перед новым сбором)
+****************************************************************************/
+void FilterReset(FILTER_CHAIN * chain)
+{
+	int16_t s, b;
+
+	for (s = 0; s < chain->nStages; s++)
+	{
+		for (b = 0; b < PS2000A_MAX_CHANNEL_BUFFERS; b++)
+		{
+			FILTER_STAGE_STATE * state = &chain->state[s][b];
+
+			free(state->history);
+			free(state->sorted);
+			memset(state, 0, sizeof(FILTER_STAGE_STATE));
+		}
+	}
+}
+
+/****************************************************************************
+* FilterFree
+* Освобождает все буферы цепочки
+****************************************************************************/
+void FilterFree(FILTER_CHAIN * chain)
+{
+	int16_t s;
+
+	FilterReset(chain);
+
+	for (s = 0; s < FILTER_MAX_STAGES; s++)
+	{
+		free(chain->coefficients[s]);
+	}
+
+	free(chain->work);
+	memset(chain, 0, sizeof(FILTER_CHAIN));
+}
+
+/****************************************************************************
+* FilterDesignButterworth
+* Рассчитывает ФНЧ Баттерворта порядка 2 * nSections в виде каскада
+* биквадратных звеньев (билинейное преобразование)
+* Параметры
+* - sections - массив из 5 * nSections коэффициентов (b0, b1, b2, a1, a2)
+* - cutoff - частота среза относительно частоты дискретизации (0..0.5)
+****************************************************************************/
+void FilterDesignButterworth(float * sections, int16_t nSections, double cutoff)
+{
+	int16_t k;
+	double w0 = 2.0 * M_PI * cutoff;
+	double cosW0 = cos(w0);
+
+	for (k = 0; k < nSections; k++)
+	{
+		// Добротность k-го звена определяется положением пары полюсов на окружности
+		double q = 1.0 / (2.0 * cos(M_PI * (2 * k + 1) / (4.0 * nSections)));
+		double alpha = sin(w0) / (2.0 * q);
+		double a0 = 1.0 + alpha;
+		float * c = sections + k * 5;
+
+		c[0] = (float) ((1.0 - cosW0) / 2.0 / a0);
+		c[1] = (float) ((1.0 - cosW0) / a0);
+		c[2] = c[0];
+		c[3] = (float) (-2.0 * cosW0 / a0);
+		c[4] = (float) ((1.0 - alpha) / a0);
+	}
+}
@@ -0,0 +1,64 @@
+﻿/******************************************************************************
+ *
+ * Filename: StreamFilter.h
+ *
+ * Description:
+ *   Цифровая фильтрация потоковых аналоговых данных между CallBackStreaming
+ *   и записью в файл. Цепочка из нескольких звеньев (КИХ, каскад биквадратных
+ *   БИХ-звеньев, скользящее среднее, медиана) хранит своё состояние между
+ *   фрагментами, поэтому результат не зависит от того, как драйвер разбил
+ *   поток на фрагменты.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include "ps2000aApi.h"
+
+#define FILTER_MAX_STAGES		4
+#define FILTER_MAX_TAPS			256
+#define FILTER_MAX_SECTIONS		8
+#define FILTER_MAX_WINDOW		1024
+#define FILTER_MAX_MEDIAN		63
+
+typedef enum
+{
+	FILTER_FIR,					// КИХ-фильтр, length - количество коэффициентов
+	FILTER_BIQUAD,				// Каскад биквадратных звеньев, length - количество звеньев
+	FILTER_MOVING_AVERAGE,		// Скользящее среднее, length - ширина окна
+	FILTER_MEDIAN				// Скользящая медиана, length - ширина окна (нечётная)
+}FILTER_TYPE;
+
+typedef struct tFilterStageSettings
+{
+	FILTER_TYPE		type;
+	int16_t			length;
+	const float *	coefficients;	// FIR: length коэффициентов h[0] .. h[length - 1] (y[n] = сумма h[k] x[n - k]); BIQUAD: по 5 на звено (b0, b1, b2, a1, a2), a0 = 1
+	double			cutoff;			// Если coefficients == NULL: частота среза ФНЧ относительно частоты дискретизации
+}FILTER_STAGE_SETTINGS;
+
+typedef struct tFilterStageState
+{
+	int32_t		capacity;		// Длина фрагмента, под которую выделен history
+	float *		history;		// FIR: length - 1 предыдущих отсчётов и текущий фрагмент; MOVING_AVERAGE, MEDIAN: кольцевой буфер окна
+	float *		sorted;			// MEDIAN: отсортированное содержимое окна
+	double		z[FILTER_MAX_SECTIONS][2];		// BIQUAD: состояние звеньев (транспонированная прямая форма II)
+	double		sum;			// MOVING_AVERAGE: сумма окна
+	int32_t		position;		// Позиция в кольцевом буфере
+	int32_t		filled;			// Количество отсчётов в окне
+}FILTER_STAGE_STATE;
+
+typedef struct tFilterChain
+{
+	int16_t					nStages;
+	int32_t					capacity;
+	float *					work;		// Рабочий буфер фрагмента (float)
+	FILTER_STAGE_SETTINGS	settings[FILTER_MAX_STAGES];
+	float *					coefficients[FILTER_MAX_STAGES];
+	FILTER_STAGE_STATE		state[FILTER_MAX_STAGES][PS2000A_MAX_CHANNEL_BUFFERS];
+}FILTER_CHAIN;
+
+int16_t FilterInit(FILTER_CHAIN * chain, const FILTER_STAGE_SETTINGS * settings, int16_t nStages);
+int16_t FilterProcess(FILTER_CHAIN * chain, int16_t buffer, int16_t * data, int32_t nSamples);
+void FilterReset(FILTER_CHAIN * chain);
+void FilterFree(FILTER_CHAIN * chain);
+void FilterDesignButterworth(float * sections, int16_t nSections, double cutoff);
@@ -0,0 +1,65 @@
+﻿/******************************************************************************
+ *
+ * Filename: StreamRing.cpp
+ *
+ * Description:
+ *   Кольцо буферов потокового сбора без копирования (см. StreamRing.h).
+ *
+ ******************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "StreamRing.h"
+#include "BufferAlloc.h"
+
+/****************************************************************************
+* StreamRingInit
+* Выделяет память кольца
+* Параметры
+* - used - признак использования каждого из PS2000A_MAX_CHANNEL_BUFFERS буферов
+* - nSlots, slotSamples - количество слотов и отсчётов в слоте
+* - allocFlags - BUFFER_ALLOC_FLAGS памяти кольца
+*
+* Возвращает 0, если не удалось выделить память
+****************************************************************************/
+int16_t StreamRingInit(STREAM_RING * ring, const int16_t * used, uint32_t nSlots, uint32_t slotSamples, uint32_t allocFlags)
+{
+	int16_t buffer;
+
+	memset(ring, 0, sizeof(STREAM_RING));
+
+	if (nSlots < 2 || slotSamples == 0)
+	{
+		return 0;
+	}
+
+	ring->nSlots = nSlots;
+	ring->slotSamples = slotSamples;
+	ring->size = nSlots * slotSamples;
+
+	for (buffer = 0; buffer < PS2000A_MAX_CHANNEL_BUFFERS; buffer++)
+	{
+		if (used[buffer] && (ring->buffers[buffer] = (int16_t *) BufferAlloc(ring->size * sizeof(int16_t), allocFlags)) == NULL)
+		{
+			StreamRingFree(ring);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/****************************************************************************
+* StreamRingFree
+* Освобождает память кольца (после ps2000aStop)
+****************************************************************************/
+void StreamRingFree(STREAM_RING * ring)
+{
+	int16_t buffer;
+
+	for (buffer = 0; buffer < PS2000A_MAX_CHANNEL_BUFFERS; buffer++)
+	{
+		BufferFree(ring->buffers[buffer]);
+	}
+
+	memset(ring, 0, sizeof(STREAM_RING));
+}
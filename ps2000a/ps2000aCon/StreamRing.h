@@ -0,0 +1,28 @@
+﻿/******************************************************************************
+ *
+ * Filename: StreamRing.h
+ *
+ * Description:
+ *   Кольцо буферов потокового сбора без копирования.
+ *   Память кольца сама регистрируется в драйвере через ps2000aSetDataBuffers
+ *   (длина буфера - nSlots * slotSamples, ps2000aRunStreaming получает
+ *   slotSamples, поэтому один обратный вызов передаёт не больше слота).
+ *   Драйвер пишет в кольцо только внутри ps2000aGetStreamingLatestValues,
+ *   а отсчёты обратного вызова читаются прямо из кольца до следующего
+ *   опроса, поэтому ни копирование, ни учёт занятых слотов не нужны.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include "ps2000aApi.h"
+
+typedef struct tStreamRing
+{
+	int16_t *				buffers[PS2000A_MAX_CHANNEL_BUFFERS];	// Память кольца буфера, NULL - буфер не используется
+	uint32_t				slotSamples;
+	uint32_t				nSlots;
+	uint32_t				size;			// nSlots * slotSamples
+}STREAM_RING;
+
+int16_t StreamRingInit(STREAM_RING * ring, const int16_t * used, uint32_t nSlots, uint32_t slotSamples, uint32_t allocFlags);
+void StreamRingFree(STREAM_RING * ring);
@@ -0,0 +1,436 @@
+﻿/******************************************************************************
+ *
+ * Filename: TimeAlign.cpp
+ *
+ * Description:
+ *   Привязка захватов нескольких устройств к общей шкале времени
+ *   (см. TimeAlign.h).
+ *
+ ******************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "TimeAlign.h"
+
+#define SYNC_HYSTERESIS		256		// Гистерезис обнаружения фронтов синхросигнала, отсчёты АЦП
+
+typedef struct tAlignDevice
+{
+	TIME_POINT *	points;
+	int32_t			nPoints;
+	int32_t			pointCapacity;
+	uint64_t *		edges;
+	int32_t			nEdges;
+	int32_t			edgeCapacity;
+	double			nominalInterval;
+	TIME_MODEL		model;
+}ALIGN_DEVICE;
+
+/****************************************************************************
+* TimeAlignNow
+* Возвращает время монотонных часов ПК, нс
+****************************************************************************/
+int64_t TimeAlignNow(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	if (frequency.QuadPart == 0)
+	{
+		QueryPerformanceFrequency(&frequency);
+	}
+
+	QueryPerformanceCounter(&counter);
+	return (int64_t) ((double) counter.QuadPart * 1e9 / (double) frequency.QuadPart);
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+/****************************************************************************
+* TimeAlignFit
+* Оценивает связь номера отсчёта со временем ПК по меткам фрагментов
+* Параметры
+* - points, nPoints - метки времени в порядке сбора
+* - nominalInterval - интервал между отсчётами по настройкам устройства, нс
+*
+* Наклон - метод наименьших квадратов, смещение - по нижней огибающей,
+* так как задержка обратного вызова может быть только положительной.
+* Возвращает 1 при успехе, 0 если меток нет
+****************************************************************************/
+int16_t TimeAlignFit(const TIME_POINT * points, int32_t nPoints, double nominalInterval, TIME_MODEL * model)
+{
+	double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+	double x0, y0;
+	double slope = nominalInterval;
+	double minResidual, maxResidual;
+	int32_t i;
+
+	memset(model, 0, sizeof(TIME_MODEL));
+
+	if (nPoints <= 0)
+	{
+		return 0;
+	}
+
+	// Отсчёт от первой метки сохраняет точность double на длинных записях
+	x0 = (double) points[0].sample;
+	y0 = (double) points[0].hostTime;
+
+	for (i = 0; i < nPoints; i++)
+	{
+		double x = (double) points[i].sample - x0;
+		double y = (double) points[i].hostTime - y0;
+
+		sx += x;
+		sy += y;
+		sxx += x * x;
+		sxy += x * y;
+	}
+
+	if (nPoints > 1 && nPoints * sxx - sx * sx > 0.0)
+	{
+		slope = (nPoints * sxy - sx * sy) / (nPoints * sxx - sx * sx);
+
+		// Короткая или неравномерная запись может дать неправдоподобный наклон
+		if (nominalInterval > 0.0 && fabs(slope / nominalInterval - 1.0) > 0.01)
+		{
+			slope = nominalInterval;
+		}
+	}
+
+	minResidual = maxResidual = (double) points[0].hostTime - y0;
+
+	for (i = 0; i < nPoints; i++)
+	{
+		double residual = ((double) points[i].hostTime - y0) - slope * ((double) points[i].sample - x0);
+
+		if (residual < minResidual)
+		{
+			minResidual = residual;
+		}
+
+		if (residual > maxResidual)
+		{
+			maxResidual = residual;
+		}
+	}
+
+	model->hostInterval = slope;
+	model->hostOffset = y0 + minResidual - slope * x0;
+	model->jitter = maxResidual - minResidual;
+	model->nPoints = nPoints;
+	return 1;
+}
+
+/****************************************************************************
+* TimeAlignFindPulses
+* Находит нарастающие фронты синхросигнала во фрагменте
+* Параметры
+* - data, nSamples - отсчёты канала синхросигнала
+* - threshold - порог, отсчёты АЦП
+* - level - состояние сигнала между фрагментами (-1 перед первым фрагментом)
+* - firstSample - номер первого отсчёта фрагмента
+* - edges, maxEdges - найденные фронты
+*
+* Возвращает количество найденных фронтов
+****************************************************************************/
+int32_t TimeAlignFindPulses(const int16_t * data, int32_t nSamples, int16_t threshold, int16_t * level,
+	uint64_t firstSample, uint64_t * edges, int32_t maxEdges)
+{
+	int32_t nEdges = 0;
+	int32_t i;
+
+	for (i = 0; i < nSamples; i++)
+	{
+		if (*level != 1 && data[i] > threshold + SYNC_HYSTERESIS)
+		{
+			// Сигнал, высокий с начала записи, фронтом не считается
+			if (*level == 0 && nEdges < maxEdges)
+			{
+				edges[nEdges++] = firstSample + i;
+			}
+
+			*level = 1;
+		}
+		else if (*level != 0 && data[i] < threshold - SYNC_HYSTERESIS)
+		{
+			*level = 0;
+		}
+	}
+
+	return nEdges;
+}
+
+/****************************************************************************
+* LoadAlignDevice
+* Читает метки времени и фронты синхросигнала из файла захвата
+****************************************************************************/
+static int16_t LoadAlignDevice(ALIGN_DEVICE * device, const char * fileName, int16_t syncBuffer, int16_t syncThreshold)
+{
+	CAPTURE_FILE capture;
+	CAPTURE_CHUNK chunk;
+	void * payload = NULL;
+	uint32_t capacity = 0;
+	int16_t level = -1;
+	int16_t ok = 1;
+
+	if (!CaptureOpen(&capture, fileName))
+	{
+		return 0;
+	}
+
+	device->nominalInterval = capture.header.sampleInterval;
+
+	while (ok && CaptureReadChunk(&capture, &chunk, &payload, &capacity))
+	{
+		if (chunk.type == CAPTURE_CHUNK_TIMESTAMP && chunk.payloadSize >= sizeof(int64_t))
+		{
+			if (device->nPoints == device->pointCapacity)
+			{
+				int32_t newCapacity = device->pointCapacity ? device->pointCapacity * 2 : 1024;
+				TIME_POINT * points = (TIME_POINT *) realloc(device->points, newCapacity * sizeof(TIME_POINT));
+
+				if (!points)
+				{
+					ok = 0;
+					break;
+				}
+
+				device->points = points;
+				device->pointCapacity = newCapacity;
+			}
+
+			device->points[device->nPoints].sample = chunk.firstSample + chunk.nSamples;
+			memcpy(&device->points[device->nPoints].hostTime, payload, sizeof(int64_t));
+			device->nPoints++;
+		}
+		else if (chunk.type == CAPTURE_CHUNK_ANALOGUE && chunk.channel == syncBuffer && syncBuffer >= 0)
+		{
+			int32_t nSamples = (int32_t) (chunk.payloadSize / sizeof(int16_t));
+
+			if (device->nEdges + nSamples > device->edgeCapacity)
+			{
+				int32_t newCapacity = device->edgeCapacity * 2 > device->nEdges + nSamples ? device->edgeCapacity * 2 : device->nEdges + nSamples;
+				uint64_t * edges = (uint64_t *) realloc(device->edges, newCapacity * sizeof(uint64_t));
+
+				if (!edges)
+				{
+					ok = 0;
+					break;
+				}
+
+				device->edges = edges;
+				device->edgeCapacity = newCapacity;
+			}
+
+			device->nEdges += TimeAlignFindPulses((const int16_t *) payload, nSamples, syncThreshold, &level,
+				chunk.firstSample, device->edges + device->nEdges, device->edgeCapacity - device->nEdges);
+		}
+	}
+
+	free(payload);
+	CaptureClose(&capture);
+
+	return ok && TimeAlignFit(device->points, device->nPoints, device->nominalInterval, &device->model);
+}
+
+/****************************************************************************
+* AlignBySyncPulses
+* Уточняет привязку устройства по общим фронтам синхросигнала
+* (начальное приближение - привязка по времени ПК в result)
+*
+* Возвращает количество сопоставленных фронтов
+****************************************************************************/
+static int16_t AlignBySyncPulses(const ALIGN_DEVICE * device, const ALIGN_DEVICE * reference, CAPTURE_ALIGNMENT * result)
+{
+	double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0, syy = 0.0;
+	double x0 = 0.0, y0 = 0.0;
+	double tolerance;
+	double squares;
+	double residual;
+	int32_t matched = 0;
+	int32_t i;
+
+	if (device->nEdges == 0 || reference->nEdges == 0)
+	{
+		return 0;
+	}
+
+	// Ошибка привязки по времени ПК не больше суммы задержек обоих устройств
+	tolerance = (device->model.jitter + reference->model.jitter) / reference->model.hostInterval + 1.0;
+
+	for (i = 0; i < device->nEdges; i++)
+	{
+		double predicted = result->offset + result->scale * (double) device->edges[i];
+		int32_t lo = 0;
+		int32_t hi = reference->nEdges - 1;
+		int32_t nearest;
+		double distance;
+
+		// Ближайший фронт опорного устройства
+		while (lo < hi)
+		{
+			int32_t mid = (lo + hi) / 2;
+
+			if ((double) reference->edges[mid] < predicted)
+			{
+				lo = mid + 1;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+
+		nearest = lo;
+
+		if (lo > 0 && fabs((double) reference->edges[lo - 1] - predicted) < fabs((double) reference->edges[lo] - predicted))
+		{
+			nearest = lo - 1;
+		}
+
+		distance = fabs((double) reference->edges[nearest] - predicted);
+
+		// Сопоставление неоднозначно, если соседние фронты ближе, чем возможная ошибка
+		if (distance > tolerance ||
+			(nearest > 0 && (double) (reference->edges[nearest] - reference->edges[nearest - 1]) < 2.0 * tolerance) ||
+			(nearest + 1 < reference->nEdges && (double) (reference->edges[nearest + 1] - reference->edges[nearest]) < 2.0 * tolerance))
+		{
+			continue;
+		}
+
+		if (matched == 0)
+		{
+			x0 = (double) device->edges[i];
+			y0 = (double) reference->edges[nearest];
+		}
+
+		sx += (double) device->edges[i] - x0;
+		sy += (double) reference->edges[nearest] - y0;
+		sxx += ((double) device->edges[i] - x0) * ((double) device->edges[i] - x0);
+		sxy += ((double) device->edges[i] - x0) * ((double) reference->edges[nearest] - y0);
+		syy += ((double) reference->edges[nearest] - y0) * ((double) reference->edges[nearest] - y0);
+		matched++;
+	}
+
+	if (matched == 0)
+	{
+		return 0;
+	}
+
+	if (matched > 1 && matched * sxx - sx * sx > 0.0)
+	{
+		result->scale = (matched * sxy - sx * sy) / (matched * sxx - sx * sx);
+	}
+
+	// Прямая проходит через среднюю точку сопоставленных фронтов
+	result->offset = y0 + sy / matched - result->scale * (x0 + sx / matched);
+
+	// Среднеквадратичный остаток, но не меньше одного отсчёта опорного устройства
+	squares = (syy - sy * sy / matched) - 2.0 * result->scale * (sxy - sx * sy / matched) +
+		result->scale * result->scale * (sxx - sx * sx / matched);
+	residual = squares > 0.0 ? sqrt(squares / matched) : 0.0;
+	result->error = (residual > 1.0 ? residual : 1.0) * reference->model.hostInterval;
+
+	return (int16_t) (matched > INT16_MAX ? INT16_MAX : matched);
+}
+
+/****************************************************************************
+* TimeAlignCaptures
+* Привязывает захваты нескольких устройств к шкале отсчётов опорного
+* и дописывает результат в каждый файл
+* Параметры
+* - fileNames, nFiles - файлы захвата устройств
+* - reference - номер опорного устройства
+* - syncBuffer - буфер с общим синхросигналом (номер как в CAPTURE_CHUNK_ANALOGUE), -1 - не используется
+* - syncThreshold - порог синхросигнала, отсчёты АЦП
+* - results - привязка каждого устройства (может быть NULL)
+*
+* Возвращает количество привязанных устройств
+****************************************************************************/
+int16_t TimeAlignCaptures(const char ** fileNames, int16_t nFiles, int16_t reference, int16_t syncBuffer, int16_t syncThreshold,
+	CAPTURE_ALIGNMENT * results)
+{
+	ALIGN_DEVICE devices[TIME_ALIGN_MAX_DEVICES];
+	int16_t loaded[TIME_ALIGN_MAX_DEVICES];
+	int16_t aligned = 0;
+	int16_t d;
+
+	if (nFiles <= 0 || nFiles > TIME_ALIGN_MAX_DEVICES || reference < 0 || reference >= nFiles)
+	{
+		return 0;
+	}
+
+	memset(devices, 0, sizeof(devices));
+
+	for (d = 0; d < nFiles; d++)
+	{
+		loaded[d] = LoadAlignDevice(&devices[d], fileNames[d], syncBuffer, syncThreshold);
+	}
+
+	if (loaded[reference])
+	{
+		const ALIGN_DEVICE * ref = &devices[reference];
+
+		for (d = 0; d < nFiles; d++)
+		{
+			CAPTURE_ALIGNMENT alignment;
+			CAPTURE_FILE capture;
+			const ALIGN_DEVICE * device = &devices[d];
+
+			if (!loaded[d])
+			{
+				continue;
+			}
+
+			memset(&alignment, 0, sizeof(CAPTURE_ALIGNMENT));
+			alignment.reference = reference;
+			alignment.scale = device->model.hostInterval / ref->model.hostInterval;
+			alignment.offset = (device->model.hostOffset - ref->model.hostOffset) / ref->model.hostInterval;
+			alignment.drift = device->nominalInterval > 0.0 ? (device->model.hostInterval / device->nominalInterval - 1.0) * 1e6 : 0.0;
+			alignment.error = device->model.jitter + ref->model.jitter;
+
+			if (d == reference)
+			{
+				alignment.offset = 0.0;
+				alignment.scale = 1.0;
+				alignment.error = 0.0;
+			}
+			else if (syncBuffer >= 0)
+			{
+				alignment.syncPulses = AlignBySyncPulses(device, ref, &alignment);
+			}
+
+			if (CaptureAppend(&capture, fileNames[d]))
+			{
+				CaptureWriteChunk(&capture, CAPTURE_CHUNK_ALIGNMENT, d, 0, &alignment, 0, sizeof(CAPTURE_ALIGNMENT));
+				CaptureClose(&capture);
+			}
+
+			if (results)
+			{
+				results[d] = alignment;
+			}
+
+			aligned++;
+		}
+	}
+
+	for (d = 0; d < nFiles; d++)
+	{
+		free(devices[d].points);
+		free(devices[d].edges);
+	}
+
+	return aligned;
+}
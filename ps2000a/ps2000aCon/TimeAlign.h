@@ -0,0 +1,43 @@
+﻿/******************************************************************************
+ *
+ * Filename: TimeAlign.h
+ *
+ * Description:
+ *   Привязка захватов нескольких устройств к общей шкале времени.
+ *   Во время сбора каждый фрагмент помечается временем ПК (монотонные часы)
+ *   в момент обратного вызова (CAPTURE_CHUNK_TIMESTAMP). После сбора по этим
+ *   меткам для каждого устройства оцениваются смещение и уход частоты
+ *   дискретизации: прямая по нижней огибающей (минимальная задержка
+ *   обратного вызова). Если на свободный канал всех устройств подан общий
+ *   синхросигнал (например, выход генератора одного из устройств), привязка
+ *   уточняется по фронтам импульсов до долей отсчёта.
+ *   Результат дописывается в каждый файл фрагментом CAPTURE_CHUNK_ALIGNMENT;
+ *   при повторной привязке действует последний такой фрагмент.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include "CaptureFile.h"
+
+#define TIME_ALIGN_MAX_DEVICES	8
+
+typedef struct tTimePoint
+{
+	uint64_t	sample;			// Номер отсчёта, следующего за последним переданным
+	int64_t		hostTime;		// Время ПК в момент передачи, нс
+}TIME_POINT;
+
+typedef struct tTimeModel
+{
+	double		hostOffset;		// Время ПК отсчёта 0, нс
+	double		hostInterval;	// Интервал между отсчётами по часам ПК, нс
+	double		jitter;			// Наибольшая задержка обратного вызова сверх минимальной, нс
+	int32_t		nPoints;
+}TIME_MODEL;
+
+int64_t TimeAlignNow(void);
+int16_t TimeAlignFit(const TIME_POINT * points, int32_t nPoints, double nominalInterval, TIME_MODEL * model);
+int32_t TimeAlignFindPulses(const int16_t * data, int32_t nSamples, int16_t threshold, int16_t * level,
+	uint64_t firstSample, uint64_t * edges, int32_t maxEdges);
+int16_t TimeAlignCaptures(const char ** fileNames, int16_t nFiles, int16_t reference, int16_t syncBuffer, int16_t syncThreshold,
+	CAPTURE_ALIGNMENT * results);
@@ -0,0 +1,183 @@
+﻿/******************************************************************************
+ *
+ * Filename: ToneAnalysis.cpp
+ *
+ * Description:
+ *   Измерение амплитуды и фазы синусоиды известной частоты
+ *   (см. ToneAnalysis.h).
+ *
+ ******************************************************************************/
+#include <math.h>
+#include "ToneAnalysis.h"
+
+#define TONE_PI				3.14159265358979323846
+#define TONE_RESYNC			1024		// Через столько отсчётов поворот пересчитывается заново, чтобы не копилась погрешность
+
+/****************************************************************************
+* ToneMeasure
+* Измеряет синусоиду с частотой cyclesPerSample (периодов на отсчёт) в nSamples
+* отсчётах samples по окну из целого числа периодов
+*
+* Возвращает 0, если в захвате нет ни одного полного периода или частота
+* не ниже половины частоты дискретизации
+****************************************************************************/
+int16_t ToneMeasure(const int16_t * samples, int32_t nSamples, double cyclesPerSample, TONE * tone)
+{
+	double omega = 2.0 * TONE_PI * cyclesPerSample;
+	double cycles;
+	double sum = 0.0;
+	double inPhase = 0.0;
+	double quadrature = 0.0;
+	double c, s, t;
+	double stepCos, stepSin;
+	double value;
+	int32_t window;
+	int32_t i;
+
+	if (nSamples < 2 || cyclesPerSample <= 0.0 || cyclesPerSample >= 0.5)
+	{
+		return 0;
+	}
+
+	if ((cycles = floor(nSamples * cyclesPerSample)) < 1.0)
+	{
+		return 0;
+	}
+
+	window = (int32_t) (cycles / cyclesPerSample + 0.5);
+	window = window > nSamples ? nSamples : window;
+
+	for (i = 0; i < window; i++)
+	{
+		sum += samples[i];
+	}
+
+	tone->offset = sum / window;
+
+	// cos и sin отсчёта i получаются поворотом на omega от предыдущего
+	stepCos = cos(omega);
+	stepSin = sin(omega);
+	c = 1.0;
+	s = 0.0;
+
+	for (i = 0; i < window; i++)
+	{
+		if (i % TONE_RESYNC == 0)
+		{
+			c = cos(omega * i);
+			s = sin(omega * i);
+		}
+
+		value = samples[i] - tone->offset;
+		inPhase += value * c;
+		quadrature += value * s;
+
+		t = c * stepCos - s * stepSin;
+		s = s * stepCos + c * stepSin;
+		c = t;
+	}
+
+	// x[i] = A cos(omega i + phi): сумма x cos = A cos(phi) window / 2, сумма x sin = -A sin(phi) window / 2
+	tone->amplitude = 2.0 * sqrt(inPhase * inPhase + quadrature * quadrature) / window;
+	tone->phase = atan2(-quadrature, inPhase) * 180.0 / TONE_PI;
+	tone->nSamples = window;
+
+	return 1;
+}
+
+/****************************************************************************
+* ToneResponseInit
+* Готовит пустое накопление отклика
+****************************************************************************/
+void ToneResponseInit(TONE_RESPONSE * response)
+{
+	response->re = 0.0;
+	response->im = 0.0;
+	response->reference = 0.0;
+	response->response = 0.0;
+	response->count = 0;
+}
+
+/****************************************************************************
+* ToneResponseAdd
+* Добавляет захват: опорный сигнал reference и отклик measured, измеренные
+* в одном захвате, с масштабами мВ на отсчёт АЦП их каналов
+* (захват без опорного сигнала не учитывается)
+****************************************************************************/
+void ToneResponseAdd(TONE_RESPONSE * response, const TONE * reference, double referenceMvPerCount,
+	const TONE * measured, double measuredMvPerCount)
+{
+	double referenceMv = reference->amplitude * referenceMvPerCount;
+	double measuredMv = measured->amplitude * measuredMvPerCount;
+	double shift = (measured->phase - reference->phase) * TONE_PI / 180.0;
+
+	if (referenceMv <= 0.0)
+	{
+		return;
+	}
+
+	response->re += measuredMv / referenceMv * cos(shift);
+	response->im += measuredMv / referenceMv * sin(shift);
+	response->reference += referenceMv;
+	response->response += measuredMv;
+	response->count++;
+}
+
+/****************************************************************************
+* ToneResponseResult
+* Средние амплитуды опорного сигнала и отклика (мВ), усиление (дБ) и сдвиг
+* фазы отклика относительно опорного сигнала (градусы, -180 .. 180]
+*
+* Возвращает 0, если не добавлено ни одного захвата
+****************************************************************************/
+int16_t ToneResponseResult(const TONE_RESPONSE * response, double * referenceMv, double * responseMv,
+	double * gainDb, double * phase)
+{
+	double magnitude;
+
+	if (response->count == 0)
+	{
+		return 0;
+	}
+
+	magnitude = sqrt(response->re * response->re + response->im * response->im) / response->count;
+
+	*referenceMv = response->reference / response->count;
+	*responseMv = response->response / response->count;
+	*gainDb = magnitude > 0.0 ? 20.0 * log10(magnitude) : -HUGE_VAL;
+	*phase = atan2(response->im, response->re) * 180.0 / TONE_PI;
+
+	return 1;
+}
+
+/****************************************************************************
+* ToneFrequencies
+* Заполняет frequencies nPoints частотами от start до stop: равномерно или,
+* если logarithmic и обе границы положительны, по логарифмической шкале
+*
+* Возвращает число частот
+****************************************************************************/
+int16_t ToneFrequencies(double * frequencies, int16_t nPoints, double start, double stop, int16_t logarithmic)
+{
+	int16_t i;
+
+	if (nPoints < 1)
+	{
+		return 0;
+	}
+
+	if (nPoints == 1)
+	{
+		frequencies[0] = start;
+		return 1;
+	}
+
+	for (i = 0; i < nPoints; i++)
+	{
+		frequencies[i] = logarithmic && start > 0.0 && stop > 0.0 ?
+			start * pow(stop / start, (double) i / (nPoints - 1)) :
+			start + (stop - start) * i / (nPoints - 1);
+	}
+
+	return nPoints;
+}
@@ -0,0 +1,42 @@
+﻿/******************************************************************************
+ *
+ * Filename: ToneAnalysis.h
+ *
+ * Description:
+ *   Измерение амплитуды и фазы синусоиды известной частоты в захвате
+ *   для снятия частотной характеристики развёрткой генератора.
+ *   ToneMeasure проецирует отсчёты на косинус и синус заданной частоты
+ *   на целом числе периодов (остаток окна отбрасывается), поэтому
+ *   постоянная составляющая и гармоники не искажают результат.
+ *   ToneResponseAdd накапливает комплексное отношение отклика датчика
+ *   к опорному сигналу по нескольким захватам точки, ToneResponseResult
+ *   выдаёт средние амплитуды, усиление в дБ и сдвиг фазы.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+
+typedef struct tTone
+{
+	double		amplitude;		// Амплитуда (половина размаха), отсчёты АЦП
+	double		phase;			// Фаза косинуса в начале окна, градусы (-180 .. 180]
+	double		offset;			// Постоянная составляющая, отсчёты АЦП
+	int32_t		nSamples;		// Отсчётов в окне из целого числа периодов
+}TONE;
+
+typedef struct tToneResponse
+{
+	double		re;				// Сумма комплексных отношений отклик / опорный сигнал
+	double		im;
+	double		reference;		// Сумма амплитуд опорного сигнала, мВ
+	double		response;		// Сумма амплитуд отклика, мВ
+	int32_t		count;
+}TONE_RESPONSE;
+
+int16_t ToneMeasure(const int16_t * samples, int32_t nSamples, double cyclesPerSample, TONE * tone);
+void ToneResponseInit(TONE_RESPONSE * response);
+void ToneResponseAdd(TONE_RESPONSE * response, const TONE * reference, double referenceMvPerCount,
+	const TONE * measured, double measuredMvPerCount);
+int16_t ToneResponseResult(const TONE_RESPONSE * response, double * referenceMv, double * responseMv,
+	double * gainDb, double * phase);
+int16_t ToneFrequencies(double * frequencies, int16_t nPoints, double start, double stop, int16_t logarithmic);
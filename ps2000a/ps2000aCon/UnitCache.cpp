@@ -0,0 +1,218 @@
+﻿/******************************************************************************
+ *
+ * Filename: UnitCache.cpp
+ *
+ * Description:
+ *   Кэш сведений об устройствах на диске (см. UnitCache.h).
+ *   Формат файла: строка на устройство, поля разделены табуляцией:
+ *   maxValue, затем UNIT_INFO_COUNT строк сведений.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include "UnitCache.h"
+#include "FileOpen.h"
+#include "PicoStatus.h"
+
+static std::mutex cacheLock;
+
+/****************************************************************************
+* ParseLine
+* Разбирает строку файла кэша
+****************************************************************************/
+static int16_t ParseLine(char * line, UNIT_INFO * info)
+{
+	char * field = line;
+	char * tab;
+	int16_t i;
+
+	memset(info, 0, sizeof(UNIT_INFO));
+	line[strcspn(line, "\r\n")] = 0;
+
+	if ((tab = strchr(field, '\t')) == NULL)
+	{
+		return 0;
+	}
+
+	*tab = 0;
+	info->maxValue = (int16_t) atoi(field);
+	field = tab + 1;
+
+	for (i = 0; i < UNIT_INFO_COUNT; i++)
+	{
+		tab = strchr(field, '\t');
+
+		if (tab == NULL && i < UNIT_INFO_COUNT - 1)
+		{
+			return 0;
+		}
+
+		if (tab)
+		{
+			*tab = 0;
+		}
+
+		if (strlen(field) >= UNIT_INFO_LENGTH)
+		{
+			return 0;
+		}
+
+		memcpy(info->lines[i], field, strlen(field) + 1);
+		field = tab ? tab + 1 : field + strlen(field);
+	}
+
+	return info->maxValue > 0 && info->lines[PICO_BATCH_AND_SERIAL][0] != 0;
+}
+
+/****************************************************************************
+* UnitCacheLoad
+* Читает файл кэша (отсутствующий файл - пустой кэш)
+*
+* Возвращает количество загруженных записей
+****************************************************************************/
+int16_t UnitCacheLoad(UNIT_CACHE * cache, const char * fileName)
+{
+	char line[UNIT_INFO_COUNT * (UNIT_INFO_LENGTH + 1) + 16];
+	UNIT_INFO info;
+	FILE * fp;
+	size_t length = strlen(fileName);
+	std::lock_guard<std::mutex> guard(cacheLock);
+
+	free(cache->entries);
+	memset(cache, 0, sizeof(UNIT_CACHE));
+	memcpy(cache->fileName, fileName, length < sizeof(cache->fileName) ? length : sizeof(cache->fileName) - 1);
+	cache->loaded = 1;
+
+	if ((fp = FileOpen(fileName, "r")) == NULL)
+	{
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		if (!ParseLine(line, &info))
+		{
+			continue;
+		}
+
+		if (cache->count == cache->capacity)
+		{
+			int16_t capacity = cache->capacity ? cache->capacity * 2 : 8;
+			UNIT_INFO * entries = (UNIT_INFO *) realloc(cache->entries, capacity * sizeof(UNIT_INFO));
+
+			if (!entries)
+			{
+				break;
+			}
+
+			cache->entries = entries;
+			cache->capacity = capacity;
+		}
+
+		cache->entries[cache->count++] = info;
+	}
+
+	fclose(fp);
+	return cache->count;
+}
+
+/****************************************************************************
+* UnitCacheFind
+* Ищет сведения об устройстве с данным серийным номером, полученные
+* той же версией драйвера
+*
+* Возвращает 1, если запись найдена
+****************************************************************************/
+int16_t UnitCacheFind(UNIT_CACHE * cache, const char * serial, const char * driverVersion, UNIT_INFO * info)
+{
+	int16_t i;
+	std::lock_guard<std::mutex> guard(cacheLock);
+
+	for (i = 0; i < cache->count; i++)
+	{
+		if (strcmp(cache->entries[i].lines[PICO_BATCH_AND_SERIAL], serial) == 0 &&
+			strcmp(cache->entries[i].lines[PICO_DRIVER_VERSION], driverVersion) == 0)
+		{
+			*info = cache->entries[i];
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/****************************************************************************
+* UnitCacheStore
+* Добавляет или заменяет запись устройства и перезаписывает файл кэша
+*
+* Возвращает 1, если файл записан
+****************************************************************************/
+int16_t UnitCacheStore(UNIT_CACHE * cache, const UNIT_INFO * info)
+{
+	FILE * fp;
+	int16_t i, j;
+	std::lock_guard<std::mutex> guard(cacheLock);
+
+	for (i = 0; i < cache->count; i++)
+	{
+		if (strcmp(cache->entries[i].lines[PICO_BATCH_AND_SERIAL], info->lines[PICO_BATCH_AND_SERIAL]) == 0)
+		{
+			break;
+		}
+	}
+
+	if (i == cache->capacity)
+	{
+		int16_t capacity = cache->capacity ? cache->capacity * 2 : 8;
+		UNIT_INFO * entries = (UNIT_INFO *) realloc(cache->entries, capacity * sizeof(UNIT_INFO));
+
+		if (!entries)
+		{
+			return 0;
+		}
+
+		cache->entries = entries;
+		cache->capacity = capacity;
+	}
+
+	cache->entries[i] = *info;
+
+	if (i == cache->count)
+	{
+		cache->count++;
+	}
+
+	if ((fp = FileOpen(cache->fileName, "w")) == NULL)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < cache->count; i++)
+	{
+		fprintf(fp, "%d", cache->entries[i].maxValue);
+
+		for (j = 0; j < UNIT_INFO_COUNT; j++)
+		{
+			fprintf(fp, "\t%s", cache->entries[i].lines[j]);
+		}
+
+		fprintf(fp, "\n");
+	}
+
+	fclose(fp);
+	return 1;
+}
+
+/****************************************************************************
+* UnitCacheFree
+* Освобождает записи кэша в памяти
+****************************************************************************/
+void UnitCacheFree(UNIT_CACHE * cache)
+{
+	std::lock_guard<std::mutex> guard(cacheLock);
+
+	free(cache->entries);
+	memset(cache, 0, sizeof(UNIT_CACHE));
+}
@@ -0,0 +1,39 @@
+﻿/******************************************************************************
+ *
+ * Filename: UnitCache.h
+ *
+ * Description:
+ *   Кэш сведений об устройствах на диске.
+ *   Строки ps2000aGetUnitInfo и ps2000aMaximumValue не меняются для данного
+ *   экземпляра устройства, поэтому при повторном открытии вместо
+ *   двенадцати обращений к устройству достаточно запросить серийный номер
+ *   и версию драйвера; остальное берётся из файла по серийному номеру.
+ *   Запись кэша действительна только для той же версии драйвера.
+ *   Функции можно вызывать из нескольких потоков одновременно.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+
+#define UNIT_INFO_COUNT		11
+#define UNIT_INFO_LENGTH	80
+
+typedef struct tUnitInfo
+{
+	char		lines[UNIT_INFO_COUNT][UNIT_INFO_LENGTH];	// Строки ps2000aGetUnitInfo по номерам PICO_INFO
+	int16_t		maxValue;
+}UNIT_INFO;
+
+typedef struct tUnitCache
+{
+	UNIT_INFO *	entries;
+	int16_t		count;
+	int16_t		capacity;
+	int16_t		loaded;
+	char		fileName[64];
+}UNIT_CACHE;
+
+int16_t UnitCacheLoad(UNIT_CACHE * cache, const char * fileName);
+int16_t UnitCacheFind(UNIT_CACHE * cache, const char * serial, const char * driverVersion, UNIT_INFO * info);
+int16_t UnitCacheStore(UNIT_CACHE * cache, const UNIT_INFO * info);
+void UnitCacheFree(UNIT_CACHE * cache);
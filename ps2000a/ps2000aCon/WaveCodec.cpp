@@ -0,0 +1,159 @@
+﻿/******************************************************************************
+ *
+ * Filename: WaveCodec.cpp
+ *
+ * Description:
+ *   Сжатие без потерь 16-разрядных отсчётов АЦП (см. WaveCodec.h).
+ *
+ ******************************************************************************/
+#include <string.h>
+#include "WaveCodec.h"
+
+#define WAVE_CODEC_MAX_BITS		17			// Разность двух int16_t
+
+/****************************************************************************
+* WaveCodecBound
+* Наибольший размер сжатых данных для n отсчётов, байт
+****************************************************************************/
+uint32_t WaveCodecBound(int32_t n)
+{
+	uint32_t blocks = (n + WAVE_CODEC_BLOCK - 1) / WAVE_CODEC_BLOCK;
+
+	return blocks * (2 + (WAVE_CODEC_BLOCK * WAVE_CODEC_MAX_BITS + 7) / 8) + 8;
+}
+
+/****************************************************************************
+* WaveCodecEncode
+* Сжимает n отсчётов src в dst (не менее WaveCodecBound(n) байт)
+*
+* Возвращает размер сжатых данных, байт
+****************************************************************************/
+uint32_t WaveCodecEncode(const int16_t * src, int32_t n, uint8_t * dst)
+{
+	uint32_t codes[WAVE_CODEC_BLOCK];
+	int32_t deltas[WAVE_CODEC_BLOCK];
+	uint8_t * out = dst;
+	int32_t previous = 0;
+	int32_t start, count, i;
+
+	for (start = 0; start < n; start += WAVE_CODEC_BLOCK)
+	{
+		uint32_t bits = 0;
+		uint32_t combined = 0;
+		uint32_t shift = 0;
+		uint32_t width = 0;
+		uint64_t accumulator = 0;
+		uint32_t filled = 0;
+
+		count = n - start < WAVE_CODEC_BLOCK ? n - start : WAVE_CODEC_BLOCK;
+
+		for (i = 0; i < count; i++)
+		{
+			deltas[i] = src[start + i] - previous;
+			previous = src[start + i];
+			combined |= (uint32_t) deltas[i];
+		}
+
+		if (combined)
+		{
+			while (!(combined & (1u << shift)))
+			{
+				shift++;
+			}
+		}
+
+		for (i = 0; i < count; i++)
+		{
+			int32_t delta = deltas[i] >> shift;		// Точно: младшие shift бит всех разностей нулевые
+
+			codes[i] = ((uint32_t) delta << 1) ^ (uint32_t) (delta >> 31);
+			bits |= codes[i];
+		}
+
+		while (bits >> width)
+		{
+			width++;
+		}
+
+		*out++ = (uint8_t) width;
+		*out++ = (uint8_t) shift;
+
+		for (i = 0; i < count && width; i++)
+		{
+			accumulator |= (uint64_t) codes[i] << filled;
+			filled += width;
+
+			while (filled >= 8)
+			{
+				*out++ = (uint8_t) accumulator;
+				accumulator >>= 8;
+				filled -= 8;
+			}
+		}
+
+		if (filled)
+		{
+			*out++ = (uint8_t) accumulator;
+		}
+	}
+
+	return (uint32_t) (out - dst);
+}
+
+/****************************************************************************
+* WaveCodecDecode
+* Восстанавливает n отсчётов из size байт сжатых данных
+*
+* Возвращает 0, если данные повреждены
+****************************************************************************/
+int16_t WaveCodecDecode(const uint8_t * src, uint32_t size, int16_t * dst, int32_t n)
+{
+	const uint8_t * in = src;
+	const uint8_t * end = src + size;
+	int32_t previous = 0;
+	int32_t start, count, i;
+
+	for (start = 0; start < n; start += WAVE_CODEC_BLOCK)
+	{
+		uint32_t width, shift, mask;
+		uint64_t accumulator = 0;
+		uint32_t filled = 0;
+
+		count = n - start < WAVE_CODEC_BLOCK ? n - start : WAVE_CODEC_BLOCK;
+
+		if (end - in < 2)
+		{
+			return 0;
+		}
+
+		width = *in++;
+		shift = *in++;
+
+		if (width > WAVE_CODEC_MAX_BITS || shift > 16 || (uint32_t) (end - in) < (count * width + 7) / 8)
+		{
+			return 0;
+		}
+
+		mask = (1u << width) - 1;
+
+		for (i = 0; i < count; i++)
+		{
+			uint32_t code;
+
+			while (filled < width)
+			{
+				accumulator |= (uint64_t) *in++ << filled;
+				filled += 8;
+			}
+
+			code = (uint32_t) accumulator & mask;
+			accumulator >>= width;
+			filled -= width;
+
+			previous += (int32_t) ((code >> 1) ^ (0u - (code & 1))) * (1 << shift);
+			dst[start + i] = (int16_t) previous;
+		}
+	}
+
+	return in == end;
+}
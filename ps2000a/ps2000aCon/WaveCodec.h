@@ -0,0 +1,22 @@
+﻿/******************************************************************************
+ *
+ * Filename: WaveCodec.h
+ *
+ * Description:
+ *   Сжатие без потерь 16-разрядных отсчётов АЦП для файла захвата.
+ *   Отсчёты заменяются разностями соседних (первая разность - от нуля,
+ *   поэтому каждый фрагмент декодируется независимо), разности делятся на
+ *   блоки по WAVE_CODEC_BLOCK. Для блока общие младшие нулевые биты
+ *   отбрасываются (8-разрядный АЦП выдаёт отсчёты, кратные 256), разности
+ *   переводятся в беззнаковые (zigzag) и упаковываются минимальным числом
+ *   бит. Заголовок блока - 2 байта: разрядность и сдвиг.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+
+#define WAVE_CODEC_BLOCK	128
+
+uint32_t WaveCodecBound(int32_t n);
+uint32_t WaveCodecEncode(const int16_t * src, int32_t n, uint8_t * dst);
+int16_t WaveCodecDecode(const uint8_t * src, uint32_t size, int16_t * dst, int32_t n);
@@ -0,0 +1,742 @@
+﻿/******************************************************************************
+ *
+ * Filename: WaveFile.cpp
+ *
+ * Description:
+ *   Загрузка буферов генератора произвольной формы из файлов
+ *   (см. WaveFile.h).
+ *
+ ******************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _WIN32
+#include "windows.h"
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "WaveFile.h"
+#include "Simd.h"
+
+#define WAVE_FULL_SCALE		32767.5		// Половина размаха отсчётов int16 (-32768 .. 32767 - это -1 .. 1)
+
+typedef struct tMappedFile
+{
+	const uint8_t *	data;
+	uint64_t		size;
+#ifdef _WIN32
+	HANDLE			file;
+	HANDLE			mapping;
+#endif
+}MAPPED_FILE;
+
+// Отсчёты файла: двоичные прямо из отображения или разобранные из текста
+typedef struct tWaveSource
+{
+	const int16_t *	samples;
+	const float *	values;
+	int64_t			count;
+}WAVE_SOURCE;
+
+/****************************************************************************
+* FileStamp
+* Размер и время изменения файла без его открытия
+*
+* Возвращает 0, если файла нет
+****************************************************************************/
+static int16_t FileStamp(const char * fileName, uint64_t * fileSize, int64_t * modified)
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+
+	if (!GetFileAttributesExA(fileName, GetFileExInfoStandard, &attributes))
+	{
+		return 0;
+	}
+
+	*fileSize = ((uint64_t) attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+	*modified = (int64_t) (((uint64_t) attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime);
+#else
+	struct stat status;
+
+	if (stat(fileName, &status) != 0)
+	{
+		return 0;
+	}
+
+	*fileSize = (uint64_t) status.st_size;
+	*modified = (int64_t) status.st_mtim.tv_sec * 1000000000 + status.st_mtim.tv_nsec;
+#endif
+
+	return 1;
+}
+
+/****************************************************************************
+* MapFile
+* Отображает файл в память только для чтения
+*
+* Возвращает 0, если файл не открылся или пуст
+****************************************************************************/
+static int16_t MapFile(const char * fileName, MAPPED_FILE * mapped)
+{
+#ifdef _WIN32
+	LARGE_INTEGER size;
+
+	mapped->data = NULL;
+	mapped->mapping = NULL;
+	mapped->file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if (mapped->file == INVALID_HANDLE_VALUE)
+	{
+		return 0;
+	}
+
+	if (GetFileSizeEx(mapped->file, &size) && size.QuadPart > 0 &&
+		(mapped->mapping = CreateFileMappingA(mapped->file, NULL, PAGE_READONLY, 0, 0, NULL)) != NULL)
+	{
+		mapped->data = (const uint8_t *) MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0);
+		mapped->size = (uint64_t) size.QuadPart;
+	}
+
+	if (mapped->data == NULL)
+	{
+		if (mapped->mapping != NULL)
+		{
+			CloseHandle(mapped->mapping);
+		}
+
+		CloseHandle(mapped->file);
+		return 0;
+	}
+#else
+	struct stat status;
+	void * data;
+	int file;
+
+	mapped->data = NULL;
+
+	if ((file = open(fileName, O_RDONLY)) < 0)
+	{
+		return 0;
+	}
+
+	if (fstat(file, &status) != 0 || status.st_size <= 0 ||
+		(data = mmap(NULL, (size_t) status.st_size, PROT_READ, MAP_PRIVATE, file, 0)) == MAP_FAILED)
+	{
+		close(file);
+		return 0;
+	}
+
+	// Отображение остаётся действительным и после закрытия дескриптора
+	close(file);
+	madvise(data, (size_t) status.st_size, MADV_SEQUENTIAL);
+	mapped->data = (const uint8_t *) data;
+	mapped->size = (uint64_t) status.st_size;
+#endif
+
+	return 1;
+}
+
+/****************************************************************************
+* UnmapFile
+* Закрывает отображение MapFile
+****************************************************************************/
+static void UnmapFile(MAPPED_FILE * mapped)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(mapped->data);
+	CloseHandle(mapped->mapping);
+	CloseHandle(mapped->file);
+#else
+	munmap((void *) mapped->data, (size_t) mapped->size);
+#endif
+
+	mapped->data = NULL;
+}
+
+/****************************************************************************
+* HashBytes
+* 64-разрядный FNV-1a содержимого файла
+****************************************************************************/
+static uint64_t HashBytes(const uint8_t * data, uint64_t size)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	uint64_t i;
+
+	for (i = 0; i < size; i++)
+	{
+		hash = (hash ^ data[i]) * 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/****************************************************************************
+* DetectFormat
+* Формат по расширению имени файла
+****************************************************************************/
+static WAVE_FILE_FORMAT DetectFormat(const char * fileName)
+{
+	const char * extension = strrchr(fileName, '.');
+	char lower[8];
+	int16_t i;
+
+	if (extension == NULL || strlen(extension) >= sizeof(lower))
+	{
+		return WAVE_FILE_TEXT;
+	}
+
+	for (i = 0; extension[i]; i++)
+	{
+		lower[i] = (char) (extension[i] >= 'A' && extension[i] <= 'Z' ? extension[i] - 'A' + 'a' : extension[i]);
+	}
+
+	lower[i] = 0;
+
+	if (strcmp(lower, ".bin") == 0 || strcmp(lower, ".raw") == 0 || strcmp(lower, ".dat") == 0)
+	{
+		return WAVE_FILE_BINARY;
+	}
+
+	return strcmp(lower, ".csv") == 0 ? WAVE_FILE_CSV : WAVE_FILE_TEXT;
+}
+
+/****************************************************************************
+* IsSeparator
+* Символ, которым может закончиться число
+****************************************************************************/
+static int16_t IsSeparator(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ',' || c == ';';
+}
+
+/****************************************************************************
+* ParseNumber
+* Разбирает число (целое или с точкой и порядком) с *cursor до end;
+* после числа должен стоять разделитель или конец
+*
+* Возвращает 0, если в этом месте не число; *cursor указывает за число
+****************************************************************************/
+static int16_t ParseNumber(const char ** cursor, const char * end, double * value)
+{
+	const char * p = *cursor;
+	const char * exponentStart;
+	double mantissa = 0.0;
+	double sign = 1.0;
+	int32_t exponent = 0;
+	int32_t exponentValue = 0;
+	int32_t exponentSign = 1;
+	int32_t digits = 0;
+
+	if (p < end && (*p == '+' || *p == '-'))
+	{
+		sign = *p++ == '-' ? -1.0 : 1.0;
+	}
+
+	for (; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+	{
+		mantissa = mantissa * 10.0 + (*p - '0');
+	}
+
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++, exponent--)
+		{
+			mantissa = mantissa * 10.0 + (*p - '0');
+		}
+	}
+
+	if (digits == 0)
+	{
+		return 0;
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		exponentStart = p++;
+
+		if (p < end && (*p == '+' || *p == '-'))
+		{
+			exponentSign = *p++ == '-' ? -1 : 1;
+		}
+
+		if (p < end && *p >= '0' && *p <= '9')
+		{
+			for (; p < end && *p >= '0' && *p <= '9'; p++)
+			{
+				exponentValue = exponentValue < 1000 ? exponentValue * 10 + (*p - '0') : exponentValue;
+			}
+
+			exponent += exponentSign * exponentValue;
+		}
+		else
+		{
+			p = exponentStart;
+		}
+	}
+
+	if (p < end && !IsSeparator(*p))
+	{
+		return 0;
+	}
+
+	*value = sign * (exponent ? mantissa * pow(10.0, exponent) : mantissa);
+	*cursor = p;
+
+	return 1;
+}
+
+/****************************************************************************
+* AppendValue
+* Добавляет значение в растущий массив
+*
+* Возвращает 0, если не хватило памяти
+****************************************************************************/
+static int16_t AppendValue(float ** values, int64_t * count, int64_t * capacity, double value)
+{
+	float * grown;
+
+	if (*count == *capacity)
+	{
+		*capacity = *capacity ? *capacity * 2 : 65536;
+
+		if ((grown = (float *) realloc(*values, (size_t) *capacity * sizeof(float))) == NULL)
+		{
+			return 0;
+		}
+
+		*values = grown;
+	}
+
+	(*values)[(*count)++] = (float) value;
+	return 1;
+}
+
+/****************************************************************************
+* ParseText
+* Разбирает числа текстового файла (format WAVE_FILE_TEXT - все числа,
+* WAVE_FILE_CSV - поле column каждой строки) в values в отсчётах шкалы int16
+*
+* Возвращает число значений, 0 - чисел нет или не хватило памяти
+****************************************************************************/
+static int64_t ParseText(const char * text, uint64_t size, WAVE_FILE_FORMAT format, int16_t column, float ** values)
+{
+	const char * end = text + size;
+	const char * p = text;
+	const char * field;
+	const char * lineEnd;
+	int64_t count = 0;
+	int64_t capacity = 0;
+	int64_t i;
+	double value;
+	double peak = 0.0;
+	double chosen;
+	int16_t index;
+	int16_t found;
+
+	*values = NULL;
+
+	while (p < end)
+	{
+		if (format == WAVE_FILE_CSV)
+		{
+			for (lineEnd = p; lineEnd < end && *lineEnd != '\n'; lineEnd++);
+
+			// Поля строки по порядку; при column = -1 остаётся последнее числовое
+			found = 0;
+			chosen = 0.0;
+
+			for (index = 0, field = p; field < lineEnd; index++)
+			{
+				while (field < lineEnd && (*field == ' ' || *field == '\t' || *field == '\r'))
+				{
+					field++;
+				}
+
+				if (ParseNumber(&field, lineEnd, &value) && (column < 0 || index == column))
+				{
+					chosen = value;
+					found = 1;
+				}
+
+				while (field < lineEnd && *field != ',' && *field != ';' && *field != '\t')
+				{
+					field++;
+				}
+
+				if (field < lineEnd)
+				{
+					field++;
+				}
+			}
+
+			if (found && !AppendValue(values, &count, &capacity, chosen))
+			{
+				free(*values);
+				*values = NULL;
+				return 0;
+			}
+
+			p = lineEnd + 1;
+		}
+		else
+		{
+			while (p < end && IsSeparator(*p))
+			{
+				p++;
+			}
+
+			if (p == end)
+			{
+				break;
+			}
+
+			if (ParseNumber(&p, end, &value))
+			{
+				if (!AppendValue(values, &count, &capacity, value))
+				{
+					free(*values);
+					*values = NULL;
+					return 0;
+				}
+			}
+			else
+			{
+				while (p < end && !IsSeparator(*p))
+				{
+					p++;
+				}
+			}
+		}
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		peak = fabs((*values)[i]) > peak ? fabs((*values)[i]) : peak;
+	}
+
+	// Все значения в -1 .. 1 - доли шкалы, иначе - отсчёты
+	for (i = 0; i < count; i++)
+	{
+		value = peak <= 1.0 ? (*values)[i] * WAVE_FULL_SCALE - 0.5 : (*values)[i];
+		(*values)[i] = (float) (value < -32768.0 ? -32768.0 : value > 32767.0 ? 32767.0 : value);
+	}
+
+	return count;
+}
+
+/****************************************************************************
+* SourceValue
+* Отсчёт k (0 .. count - 1) источника
+****************************************************************************/
+static inline double SourceValue(const WAVE_SOURCE * source, int64_t k)
+{
+	return source->samples != NULL ? source->samples[k] : source->values[k];
+}
+
+/****************************************************************************
+* ResampleCubic
+* Увеличение числа отсчётов: периодическая интерполяция Катмулла-Рома
+****************************************************************************/
+static void ResampleCubic(const WAVE_SOURCE * source, float * out, int32_t size)
+{
+	int64_t m = source->count;
+	double x, t;
+	double p0, p1, p2, p3;
+	int64_t k;
+	int32_t i;
+
+	for (i = 0; i < size; i++)
+	{
+		x = (double) i * m / size;
+		k = (int64_t) x;
+		t = x - k;
+
+		p0 = SourceValue(source, (k + m - 1) % m);
+		p1 = SourceValue(source, k % m);
+		p2 = SourceValue(source, (k + 1) % m);
+		p3 = SourceValue(source, (k + 2) % m);
+
+		out[i] = (float) (p1 + 0.5 * t * (p2 - p0 + t * (2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3 + t * (3.0 * (p1 - p2) + p3 - p0))));
+	}
+}
+
+/****************************************************************************
+* ResampleArea
+* Уменьшение числа отсчётов: отсчёт i - среднее кусочно-линейного сигнала
+* на интервале шириной m / size с центром в i * m / size (сигнал
+* периодический). Интеграл F(x) считается одним проходом по источнику
+****************************************************************************/
+static void ResampleArea(const WAVE_SOURCE * source, float * out, int32_t size)
+{
+	int64_t m = source->count;
+	double width = (double) m / size;
+	double integral = 0.0;		// F(k)
+	double first = 0.0;			// F на правой границе интервала отсчёта 0 (x = width / 2)
+	double previous = 0.0;
+	double current;
+	double x, f, y0, y1;
+	int64_t k = 0;
+	int32_t i;
+
+	// Границы интервалов (i + 0.5) * width, i = 0 .. size - 1, возрастают - источник читается по порядку
+	for (i = 0; i < size; i++)
+	{
+		x = (i + 0.5) * width;
+
+		while (k + 1 <= (int64_t) x && k + 1 <= m)
+		{
+			integral += (SourceValue(source, k) + SourceValue(source, (k + 1) % m)) / 2.0;
+			k++;
+		}
+
+		f = x - k;
+		y0 = SourceValue(source, k % m);
+		y1 = SourceValue(source, (k + 1) % m);
+		current = integral + f * y0 + f * f / 2.0 * (y1 - y0);
+
+		if (i == 0)
+		{
+			first = current;
+		}
+		else
+		{
+			out[i] = (float) ((current - previous) / width);
+		}
+
+		previous = current;
+	}
+
+	while (k < m)
+	{
+		integral += (SourceValue(source, k) + SourceValue(source, (k + 1) % m)) / 2.0;
+		k++;
+	}
+
+	// Интервал отсчёта 0 переходит через конец периода: от (size - 0.5) * width до m и от 0 до width / 2
+	out[0] = (float) ((integral - previous + first) / width);
+}
+
+/****************************************************************************
+* Convert
+* Пересчитывает источник в size отсчётов и масштабирует в пределы limits
+****************************************************************************/
+static void Convert(WAVE_LOADER * loader, const WAVE_SOURCE * source, int32_t size, const WAVE_LIMITS * limits, int16_t * buffer)
+{
+	double half = (limits->maxValue - limits->minValue) / 2.0;
+	double middle = (limits->maxValue + limits->minValue) / 2.0;
+	int64_t i;
+
+	if (source->count == size)
+	{
+		for (i = 0; i < size; i++)
+		{
+			loader->work[i] = (float) SourceValue(source, i);
+		}
+	}
+	else if (source->count < size)
+	{
+		ResampleCubic(source, loader->work, size);
+	}
+	else
+	{
+		ResampleArea(source, loader->work, size);
+	}
+
+	// Отсчёт шкалы int16 c - это доля (c + 0.5) / WAVE_FULL_SCALE диапазона устройства
+	SimdScaleToInt16(loader->work, size, (float) (half / WAVE_FULL_SCALE), (float) (middle + half * 0.5 / WAVE_FULL_SCALE),
+		limits->minValue, limits->maxValue, buffer);
+}
+
+/****************************************************************************
+* StoreEntry
+* Запоминает буфер в свободной или самой давно использованной записи кэша
+****************************************************************************/
+static void StoreEntry(WAVE_LOADER * loader, const WAVE_FILE_ENTRY * key, const int16_t * buffer)
+{
+	WAVE_FILE_ENTRY * entry = &loader->cache[0];
+	int16_t i;
+
+	for (i = 0; i < WAVE_FILE_CACHE_ENTRIES; i++)
+	{
+		if (loader->cache[i].buffer == NULL)
+		{
+			entry = &loader->cache[i];
+			break;
+		}
+
+		if (loader->cache[i].lastUse < entry->lastUse)
+		{
+			entry = &loader->cache[i];
+		}
+	}
+
+	free(entry->buffer);
+	*entry = *key;
+	entry->lastUse = loader->useCounter;
+
+	if ((entry->buffer = (int16_t *) malloc(key->size * sizeof(int16_t))) != NULL)
+	{
+		memcpy(entry->buffer, buffer, key->size * sizeof(int16_t));
+	}
+}
+
+/****************************************************************************
+* SameConversion
+* Буфер записи построен с теми же настройками, что нужны сейчас
+****************************************************************************/
+static int16_t SameConversion(const WAVE_FILE_ENTRY * entry, const WAVE_FILE_ENTRY * key)
+{
+	return entry->buffer != NULL && entry->format == key->format && entry->column == key->column && entry->size == key->size &&
+		memcmp(&entry->limits, &key->limits, sizeof(WAVE_LIMITS)) == 0;
+}
+
+/****************************************************************************
+* WaveFileLoad
+* Загружает сигнал из файла fileName в buffer (не меньше
+* PS2000A_MAX_SIG_GEN_BUFFER_SIZE отсчётов) в размере и пределах limits
+* (см. WaveSynthAttach). В sourceSamples (если не NULL) - отсчётов в файле
+*
+* Возвращает число отсчётов буфера, 0 - файл не прочитан или в нём нет отсчётов
+****************************************************************************/
+int32_t WaveFileLoad(WAVE_LOADER * loader, const char * fileName, WAVE_FILE_FORMAT format, int16_t column,
+	const WAVE_LIMITS * limits, int16_t * buffer, int64_t * sourceSamples)
+{
+	WAVE_FILE_ENTRY key;
+	WAVE_FILE_ENTRY * entry;
+	WAVE_SOURCE source;
+	MAPPED_FILE mapped;
+	float * values = NULL;
+	size_t length;
+	int16_t i;
+
+	if ((length = strlen(fileName)) >= WAVE_FILE_NAME_LENGTH)
+	{
+		return 0;
+	}
+
+	memset(&key, 0, sizeof(WAVE_FILE_ENTRY));
+	memcpy(key.fileName, fileName, length);
+	key.format = format == WAVE_FILE_AUTO ? DetectFormat(fileName) : format;
+	key.column = key.format == WAVE_FILE_CSV ? column : 0;
+	key.limits = *limits;
+	key.size = (int32_t) (limits->maxSize < PS2000A_MAX_SIG_GEN_BUFFER_SIZE ? limits->maxSize : PS2000A_MAX_SIG_GEN_BUFFER_SIZE);
+
+	if (key.size < 1 || (uint32_t) key.size < limits->minSize || !FileStamp(fileName, &key.fileSize, &key.modified))
+	{
+		return 0;
+	}
+
+	loader->useCounter++;
+
+	// Тот же файл с тем же размером и временем изменения - без чтения
+	for (i = 0; i < WAVE_FILE_CACHE_ENTRIES; i++)
+	{
+		entry = &loader->cache[i];
+
+		if (SameConversion(entry, &key) && entry->fileSize == key.fileSize && entry->modified == key.modified &&
+			strcmp(entry->fileName, key.fileName) == 0)
+		{
+			memcpy(buffer, entry->buffer, entry->size * sizeof(int16_t));
+			entry->lastUse = loader->useCounter;
+			loader->hits++;
+
+			if (sourceSamples != NULL)
+			{
+				*sourceSamples = entry->sourceSamples;
+			}
+
+			return entry->size;
+		}
+	}
+
+	if (loader->work == NULL && (loader->work = (float *) malloc(PS2000A_MAX_SIG_GEN_BUFFER_SIZE * sizeof(float))) == NULL)
+	{
+		return 0;
+	}
+
+	if (!MapFile(fileName, &mapped))
+	{
+		return 0;
+	}
+
+	key.fileSize = mapped.size;
+	key.hash = HashBytes(mapped.data, mapped.size);
+
+	// Содержимое уже встречалось (файл переписан без изменений или скопирован) - без разбора
+	for (i = 0; i < WAVE_FILE_CACHE_ENTRIES; i++)
+	{
+		entry = &loader->cache[i];
+
+		if (SameConversion(entry, &key) && entry->fileSize == key.fileSize && entry->hash == key.hash)
+		{
+			memcpy(buffer, entry->buffer, entry->size * sizeof(int16_t));
+			key.sourceSamples = entry->sourceSamples;
+			UnmapFile(&mapped);
+			StoreEntry(loader, &key, buffer);
+			loader->contentHits++;
+
+			if (sourceSamples != NULL)
+			{
+				*sourceSamples = key.sourceSamples;
+			}
+
+			return key.size;
+		}
+	}
+
+	source.samples = NULL;
+	source.values = NULL;
+
+	if (key.format == WAVE_FILE_BINARY)
+	{
+		// Отображение начинается с границы страницы - отсчёты int16 выровнены
+		source.samples = (const int16_t *) mapped.data;
+		source.count = (int64_t) (mapped.size / sizeof(int16_t));
+	}
+	else
+	{
+		source.count = ParseText((const char *) mapped.data, mapped.size, key.format, key.column, &values);
+		source.values = values;
+	}
+
+	if (source.count > 0)
+	{
+		Convert(loader, &source, key.size, limits, buffer);
+		key.sourceSamples = source.count;
+		StoreEntry(loader, &key, buffer);
+		loader->misses++;
+	}
+
+	free(values);
+	UnmapFile(&mapped);
+
+	if (sourceSamples != NULL)
+	{
+		*sourceSamples = source.count;
+	}
+
+	return source.count > 0 ? key.size : 0;
+}
+
+/****************************************************************************
+* WaveLoaderFree
+* Освобождает кэш и рабочий буфер
+****************************************************************************/
+void WaveLoaderFree(WAVE_LOADER * loader)
+{
+	int16_t i;
+
+	for (i = 0; i < WAVE_FILE_CACHE_ENTRIES; i++)
+	{
+		free(loader->cache[i].buffer);
+		loader->cache[i].buffer = NULL;
+	}
+
+	free(loader->work);
+	loader->work = NULL;
+}
@@ -0,0 +1,66 @@
+﻿/******************************************************************************
+ *
+ * Filename: WaveFile.h
+ *
+ * Description:
+ *   Загрузка буферов генератора произвольной формы из файлов.
+ *   Поддерживаются двоичные файлы int16 (.bin, .raw, .dat), CSV (берётся
+ *   столбец column, -1 - последний; строки без числа в нём, например
+ *   заголовок, пропускаются) и текст с числами через пробелы или по строкам.
+ *   Значения - отсчёты полной шкалы -32768 .. 32767 либо, если все числа
+ *   текстового файла не больше 1 по модулю, доли шкалы -1 .. 1.
+ *   Файл отображается в память и не копируется перед разбором.
+ *   Сигнал любой длины считается одним периодом и пересчитывается в
+ *   размер буфера устройства: при увеличении - кубической интерполяцией
+ *   Катмулла-Рома, при уменьшении - усреднением по интервалу отсчёта
+ *   (подавление наложения спектров), затем масштабируется в пределы
+ *   ps2000aSigGenArbitraryMinMaxValues.
+ *   Готовые буферы хранятся в кэше: повторная загрузка файла с тем же
+ *   размером и временем изменения не читает его, а изменённый или
+ *   другой файл с тем же содержимым (хэш FNV-1a) не разбирается заново.
+ *   WAVE_LOADER не синхронизирован: у каждого потока свой.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include "WaveSynth.h"
+
+#define WAVE_FILE_CACHE_ENTRIES		16
+#define WAVE_FILE_NAME_LENGTH		260
+
+typedef enum enWaveFileFormat
+{
+	WAVE_FILE_AUTO,			// По расширению: .bin, .raw, .dat - двоичный, .csv - CSV, остальное - текст
+	WAVE_FILE_BINARY,
+	WAVE_FILE_CSV,
+	WAVE_FILE_TEXT
+} WAVE_FILE_FORMAT;
+
+typedef struct tWaveFileEntry
+{
+	char				fileName[WAVE_FILE_NAME_LENGTH];
+	uint64_t			fileSize;
+	int64_t				modified;			// Время изменения файла (единицы зависят от ОС)
+	uint64_t			hash;				// FNV-1a содержимого
+	WAVE_FILE_FORMAT	format;				// Настройки преобразования, для которых построен buffer
+	int16_t				column;
+	WAVE_LIMITS			limits;
+	int64_t				sourceSamples;		// Отсчётов в файле
+	int16_t *			buffer;				// NULL - запись свободна
+	int32_t				size;
+	uint32_t			lastUse;
+}WAVE_FILE_ENTRY;
+
+typedef struct tWaveLoader
+{
+	WAVE_FILE_ENTRY		cache[WAVE_FILE_CACHE_ENTRIES];
+	float *				work;				// PS2000A_MAX_SIG_GEN_BUFFER_SIZE отсчётов после пересчёта
+	uint32_t			useCounter;
+	uint32_t			hits;				// Загрузок без чтения файла
+	uint32_t			contentHits;		// Загрузок по хэшу содержимого без разбора
+	uint32_t			misses;
+}WAVE_LOADER;
+
+int32_t WaveFileLoad(WAVE_LOADER * loader, const char * fileName, WAVE_FILE_FORMAT format, int16_t column,
+	const WAVE_LIMITS * limits, int16_t * buffer, int64_t * sourceSamples);
+void WaveLoaderFree(WAVE_LOADER * loader);
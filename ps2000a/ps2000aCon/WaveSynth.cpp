@@ -0,0 +1,770 @@
+﻿/******************************************************************************
+ *
+ * Filename: WaveSynth.cpp
+ *
+ * Description:
+ *   Синтез сигналов для генератора произвольной формы (см. WaveSynth.h).
+ *
+ ******************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "WaveSynth.h"
+#include "Simd.h"
+
+#define WAVE_PI				3.14159265358979323846
+#define WAVE_MIN_EDGE		1e-3		// Наименьший фронт, отсчёты (фронт 0 - скачок)
+
+// Отводы регистра M-последовательности по степени (бит k маски - разряд k регистра)
+static const uint16_t prbsTaps[WAVE_PRBS_MAX_ORDER + 1] = { 0, 0, 0x3, 0x3, 0x3, 0x5, 0x3, 0x3, 0x1d, 0x11, 0x9, 0x5, 0x107, 0x27 };
+
+/****************************************************************************
+* WaveSin
+* x[i] = sin(2 pi x[i]) - x задан в периодах
+****************************************************************************/
+static void WaveSin(float * x, int32_t n)
+{
+	int32_t i = 0;
+
+#ifdef SIMD_SSE2
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 quarter = _mm_set1_ps(0.25f);
+	const __m128 twoPi = _mm_set1_ps((float) (2.0 * WAVE_PI));
+	const __m128 c3 = _mm_set1_ps(-1.0f / 6.0f);
+	const __m128 c5 = _mm_set1_ps(1.0f / 120.0f);
+	const __m128 c7 = _mm_set1_ps(-1.0f / 5040.0f);
+	const __m128 c9 = _mm_set1_ps(1.0f / 362880.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 v = _mm_loadu_ps(x + i);
+		__m128 above, below, t, t2;
+
+		// Приведение к -0.5 .. 0.5 периода и отражение в -0.25 .. 0.25, где ряд до t^9 точнее 4e-6
+		v = _mm_sub_ps(v, _mm_cvtepi32_ps(_mm_cvtps_epi32(v)));
+		above = _mm_cmpgt_ps(v, quarter);
+		below = _mm_cmplt_ps(v, _mm_sub_ps(zero, quarter));
+		v = _mm_or_ps(_mm_andnot_ps(_mm_or_ps(above, below), v),
+			_mm_or_ps(_mm_and_ps(above, _mm_sub_ps(half, v)), _mm_and_ps(below, _mm_sub_ps(_mm_sub_ps(zero, half), v))));
+
+		t = _mm_mul_ps(v, twoPi);
+		t2 = _mm_mul_ps(t, t);
+		v = _mm_add_ps(c7, _mm_mul_ps(t2, c9));
+		v = _mm_add_ps(c5, _mm_mul_ps(t2, v));
+		v = _mm_add_ps(c3, _mm_mul_ps(t2, v));
+		v = _mm_add_ps(one, _mm_mul_ps(t2, v));
+		_mm_storeu_ps(x + i, _mm_mul_ps(t, v));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		x[i] = (float) sin(2.0 * WAVE_PI * x[i]);
+	}
+}
+
+/****************************************************************************
+* WaveExp
+* x[i] = exp(x[i]) для x[i] <= 0 (значения меньше -87 дают почти 0)
+****************************************************************************/
+static void WaveExp(float * x, int32_t n)
+{
+	int32_t i = 0;
+
+#ifdef SIMD_SSE2
+	const __m128 lowest = _mm_set1_ps(-87.0f);
+	const __m128 log2e = _mm_set1_ps(1.44269504f);
+	const __m128 ln2 = _mm_set1_ps(0.69314718f);
+	const __m128 c2 = _mm_set1_ps(1.0f / 2.0f);
+	const __m128 c3 = _mm_set1_ps(1.0f / 6.0f);
+	const __m128 c4 = _mm_set1_ps(1.0f / 24.0f);
+	const __m128 c5 = _mm_set1_ps(1.0f / 120.0f);
+	const __m128 c6 = _mm_set1_ps(1.0f / 720.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128i bias = _mm_set1_epi32(127);
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 v = _mm_max_ps(_mm_loadu_ps(x + i), lowest);
+		__m128i k;
+		__m128 g, p;
+
+		// exp(x) = 2^k * exp(g), k - ближайшее к x / ln 2, |g| <= ln 2 / 2; 2^k собирается прямо в поле порядка
+		k = _mm_cvtps_epi32(_mm_mul_ps(v, log2e));
+		g = _mm_sub_ps(v, _mm_mul_ps(_mm_cvtepi32_ps(k), ln2));
+		p = _mm_add_ps(c5, _mm_mul_ps(g, c6));
+		p = _mm_add_ps(c4, _mm_mul_ps(g, p));
+		p = _mm_add_ps(c3, _mm_mul_ps(g, p));
+		p = _mm_add_ps(c2, _mm_mul_ps(g, p));
+		p = _mm_add_ps(one, _mm_mul_ps(g, p));
+		p = _mm_add_ps(one, _mm_mul_ps(g, p));
+		_mm_storeu_ps(x + i, _mm_mul_ps(p, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(k, bias), 23))));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		x[i] = x[i] < -87.0f ? 0.0f : (float) exp(x[i]);
+	}
+}
+
+/****************************************************************************
+* WavePosition
+* p[i] - положение отсчёта i внутри своего периода period (в отсчётах)
+****************************************************************************/
+static void WavePosition(float * p, int32_t n, double period)
+{
+	float inverse = (float) (1.0 / period);
+	int32_t i = 0;
+
+#ifdef SIMD_SSE2
+	const __m128 vperiod = _mm_set1_ps((float) period);
+	const __m128 vinverse = _mm_set1_ps(inverse);
+	const __m128 step = _mm_set1_ps(4.0f);
+	const __m128 zero = _mm_setzero_ps();
+	__m128 index = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+
+	for (; i + 4 <= n; i += 4)
+	{
+		// Номер периода - целая часть (отбрасывание дробной части, индексы неотрицательны)
+		__m128 whole = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(index, vinverse)));
+
+		_mm_storeu_ps(p + i, _mm_max_ps(_mm_sub_ps(index, _mm_mul_ps(whole, vperiod)), zero));
+		index = _mm_add_ps(index, step);
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		float whole = (float) (int32_t) (i * inverse);
+		float position = i - whole * (float) period;
+
+		p[i] = position > 0.0f ? position : 0.0f;
+	}
+}
+
+/****************************************************************************
+* WaveTrapezoid
+* p[i] = трапеция 0 .. 1 от положения p[i] в периоде: фронт rise, вершина
+* top и спад fall отсчётов, остаток периода - 0
+****************************************************************************/
+static void WaveTrapezoid(float * p, int32_t n, double rise, double top, double fall)
+{
+	float riseSlope = (float) (1.0 / (rise > WAVE_MIN_EDGE ? rise : WAVE_MIN_EDGE));
+	float fallSlope = (float) (1.0 / (fall > WAVE_MIN_EDGE ? fall : WAVE_MIN_EDGE));
+	float end = (float) (rise + top + fall);
+	int32_t i = 0;
+
+#ifdef SIMD_SSE2
+	const __m128 vrise = _mm_set1_ps(riseSlope);
+	const __m128 vfall = _mm_set1_ps(fallSlope);
+	const __m128 vend = _mm_set1_ps(end);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 v = _mm_loadu_ps(p + i);
+		__m128 up = _mm_mul_ps(v, vrise);
+		__m128 down = _mm_mul_ps(_mm_sub_ps(vend, v), vfall);
+
+		_mm_storeu_ps(p + i, _mm_max_ps(_mm_min_ps(_mm_min_ps(up, down), one), zero));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		float up = p[i] * riseSlope;
+		float down = (end - p[i]) * fallSlope;
+		float v = up < down ? up : down;
+
+		p[i] = v > 1.0f ? 1.0f : (v < 0.0f ? 0.0f : v);
+	}
+}
+
+/****************************************************************************
+* WaveScale
+* dst[i] = src[i] * a
+****************************************************************************/
+static void WaveScale(float * dst, const float * src, int32_t n, float a)
+{
+	int32_t i = 0;
+
+#ifdef SIMD_SSE2
+	const __m128 va = _mm_set1_ps(a);
+
+	for (; i + 4 <= n; i += 4)
+	{
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), va));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		dst[i] = src[i] * a;
+	}
+}
+
+/****************************************************************************
+* WaveMulAdd
+* dst[i] = dst[i] * a + src[i] * b
+****************************************************************************/
+static void WaveMulAdd(float * dst, const float * src, int32_t n, float a, float b)
+{
+	int32_t i = 0;
+
+#ifdef SIMD_SSE2
+	const __m128 va = _mm_set1_ps(a);
+	const __m128 vb = _mm_set1_ps(b);
+
+	for (; i + 4 <= n; i += 4)
+	{
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(dst + i), va), _mm_mul_ps(_mm_loadu_ps(src + i), vb)));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		dst[i] = dst[i] * a + src[i] * b;
+	}
+}
+
+/****************************************************************************
+* WavePeak
+* Наибольшее значение |x[i]|
+****************************************************************************/
+static float WavePeak(const float * x, int32_t n)
+{
+	float peak = 0.0f;
+	int32_t i;
+
+	for (i = 0; i < n; i++)
+	{
+		peak = fabsf(x[i]) > peak ? fabsf(x[i]) : peak;
+	}
+
+	return peak;
+}
+
+/****************************************************************************
+* WaveParamsInit
+* Заполняет params параметрами формы shape по умолчанию (все поля, которые
+* не нужны форме, обнуляются)
+****************************************************************************/
+void WaveParamsInit(WAVE_PARAMS * params, WAVE_SHAPE shape)
+{
+	memset(params, 0, sizeof(WAVE_PARAMS));
+	params->shape = shape;
+	params->amplitude = 1.0;
+
+	switch (shape)
+	{
+		case WAVE_PULSES:
+			params->repeats = 4;
+			params->rise = 0.02;
+			params->width = 0.25;
+			params->fall = 0.02;
+			break;
+
+		case WAVE_CHIRP:
+			params->startCycles = 1.0;
+			params->stopCycles = 100.0;
+			break;
+
+		case WAVE_PRBS:
+			params->prbsOrder = 9;
+			params->prbsSeed = 1;
+			break;
+
+		case WAVE_MULTITONE:
+			params->nTones = 3;
+			params->toneCycles[0] = 1;
+			params->toneCycles[1] = 3;
+			params->toneCycles[2] = 5;
+			params->toneLevels[0] = 1.0;
+			params->toneLevels[1] = 1.0 / 3.0;
+			params->toneLevels[2] = 1.0 / 5.0;
+			break;
+
+		case WAVE_DECAY:
+			params->repeats = 4;
+			params->rise = 0.005;
+			params->fall = 0.1;
+			break;
+	}
+}
+
+/****************************************************************************
+* CanonicalParams
+* Копирует в canonical общие поля и поля формы params, размер 0 заменяется
+* наибольшим допустимым - одинаковые сигналы дают одинаковые байты для хэша
+****************************************************************************/
+static void CanonicalParams(const WAVE_SYNTH * synth, const WAVE_PARAMS * params, WAVE_PARAMS * canonical)
+{
+	int16_t i;
+
+	memset(canonical, 0, sizeof(WAVE_PARAMS));
+	canonical->shape = params->shape;
+	canonical->size = params->size;
+	canonical->amplitude = params->amplitude;
+	canonical->offset = params->offset;
+
+	if (canonical->size == 0)
+	{
+		canonical->size = (int32_t) (synth->limits.maxSize < PS2000A_MAX_SIG_GEN_BUFFER_SIZE ?
+			synth->limits.maxSize : PS2000A_MAX_SIG_GEN_BUFFER_SIZE);
+	}
+
+	switch (params->shape)
+	{
+		case WAVE_PULSES:
+			canonical->repeats = params->repeats;
+			canonical->rise = params->rise;
+			canonical->width = params->width;
+			canonical->fall = params->fall;
+			break;
+
+		case WAVE_DECAY:
+			canonical->repeats = params->repeats;
+			canonical->rise = params->rise;
+			canonical->fall = params->fall;
+			break;
+
+		case WAVE_CHIRP:
+			canonical->startCycles = params->startCycles;
+			canonical->stopCycles = params->stopCycles;
+			canonical->logarithmic = params->logarithmic ? 1 : 0;
+			break;
+
+		case WAVE_PRBS:
+			canonical->rise = params->rise;
+			canonical->prbsOrder = params->prbsOrder;
+			canonical->prbsSeed = params->prbsSeed;
+			break;
+
+		case WAVE_MULTITONE:
+			canonical->nTones = params->nTones;
+
+			for (i = 0; i < params->nTones && i < WAVE_MAX_TONES; i++)
+			{
+				canonical->toneCycles[i] = params->toneCycles[i];
+				canonical->toneLevels[i] = params->toneLevels[i];
+				canonical->tonePhases[i] = params->tonePhases[i];
+			}
+			break;
+	}
+}
+
+/****************************************************************************
+* HashParams
+* 64-разрядный FNV-1a приведённых параметров
+****************************************************************************/
+static uint64_t HashParams(const WAVE_PARAMS * params)
+{
+	const uint8_t * bytes = (const uint8_t *) params;
+	uint64_t hash = 14695981039346656037ULL;
+	size_t i;
+
+	for (i = 0; i < sizeof(WAVE_PARAMS); i++)
+	{
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/****************************************************************************
+* FlushCache
+* Освобождает все буферы кэша
+****************************************************************************/
+static void FlushCache(WAVE_SYNTH * synth)
+{
+	int16_t i;
+
+	for (i = 0; i < WAVE_CACHE_ENTRIES; i++)
+	{
+		free(synth->cache[i].buffer);
+		synth->cache[i].buffer = NULL;
+	}
+}
+
+/****************************************************************************
+* WaveSynthAttach
+* Берёт пределы генератора произвольной формы устройства handle; если они
+* отличаются от прежних, кэш очищается. WAVE_SYNTH, обнулённый заранее
+* (например, глобальный), готовится при первом вызове
+*
+* Возвращает 0, если у устройства нет генератора произвольной формы
+* или не хватило памяти
+****************************************************************************/
+int16_t WaveSynthAttach(WAVE_SYNTH * synth, int16_t handle)
+{
+	WAVE_LIMITS limits;
+
+	if (ps2000aSigGenArbitraryMinMaxValues(handle, &limits.minValue, &limits.maxValue, &limits.minSize, &limits.maxSize) != PICO_OK)
+	{
+		return 0;
+	}
+
+	if (synth->work == NULL)
+	{
+		synth->work = (float *) malloc(PS2000A_MAX_SIG_GEN_BUFFER_SIZE * sizeof(float));
+		synth->scratch = (float *) malloc(PS2000A_MAX_SIG_GEN_BUFFER_SIZE * sizeof(float));
+
+		if (synth->work == NULL || synth->scratch == NULL)
+		{
+			WaveSynthFree(synth);
+			return 0;
+		}
+	}
+
+	if (memcmp(&limits, &synth->limits, sizeof(WAVE_LIMITS)) != 0)
+	{
+		FlushCache(synth);
+		synth->limits = limits;
+	}
+
+	return 1;
+}
+
+/****************************************************************************
+* WaveSynthValidate
+* Проверяет параметры по пределам устройства и ограничениям формы
+*
+* Возвращает 0, если сигнал с такими параметрами построить нельзя
+****************************************************************************/
+int16_t WaveSynthValidate(const WAVE_SYNTH * synth, const WAVE_PARAMS * params)
+{
+	WAVE_PARAMS canonical;
+	int16_t i;
+
+	CanonicalParams(synth, params, &canonical);
+
+	if (canonical.size < 1 || canonical.size > PS2000A_MAX_SIG_GEN_BUFFER_SIZE ||
+		(uint32_t) canonical.size < synth->limits.minSize || (uint32_t) canonical.size > synth->limits.maxSize)
+	{
+		return 0;
+	}
+
+	if (canonical.amplitude < 0.0 || canonical.amplitude + fabs(canonical.offset) > 1.0)
+	{
+		return 0;
+	}
+
+	switch (canonical.shape)
+	{
+		case WAVE_PULSES:
+			return canonical.repeats >= 1 && canonical.repeats <= canonical.size && canonical.rise >= 0.0 && canonical.width >= 0.0 &&
+				canonical.fall >= 0.0 && canonical.rise + canonical.width + canonical.fall <= 1.0;
+
+		case WAVE_DECAY:
+			return canonical.repeats >= 1 && canonical.repeats <= canonical.size && canonical.rise >= 0.0 && canonical.fall > 0.0 &&
+				canonical.rise < canonical.fall;
+
+		case WAVE_CHIRP:
+			return canonical.startCycles > 0.0 && canonical.stopCycles > 0.0 &&
+				canonical.startCycles < canonical.size / 2.0 && canonical.stopCycles < canonical.size / 2.0;
+
+		case WAVE_PRBS:
+			return canonical.prbsOrder >= 2 && canonical.prbsOrder <= WAVE_PRBS_MAX_ORDER && canonical.prbsSeed != 0 &&
+				(canonical.prbsSeed >> canonical.prbsOrder) == 0 && (1 << canonical.prbsOrder) - 1 <= canonical.size &&
+				canonical.rise >= 0.0 && canonical.rise <= 1.0;
+
+		case WAVE_MULTITONE:
+			if (canonical.nTones < 1 || canonical.nTones > WAVE_MAX_TONES)
+			{
+				return 0;
+			}
+
+			for (i = 0; i < canonical.nTones; i++)
+			{
+				if (canonical.toneCycles[i] < 1 || canonical.toneCycles[i] >= canonical.size / 2)
+				{
+					return 0;
+				}
+			}
+
+			return 1;
+	}
+
+	return 0;
+}
+
+/****************************************************************************
+* SynthPulses
+* Трапецеидальные импульсы 0 .. 1
+****************************************************************************/
+static void SynthPulses(WAVE_SYNTH * synth, const WAVE_PARAMS * params)
+{
+	double period = (double) params->size / params->repeats;
+
+	WavePosition(synth->work, params->size, period);
+	WaveTrapezoid(synth->work, params->size, params->rise * period, params->width * period, params->fall * period);
+}
+
+/****************************************************************************
+* SynthChirp
+* Синусоида с частотой от startCycles до stopCycles периодов на буфер: фаза
+* считается в double, дробная часть периода - во float для WaveSin
+****************************************************************************/
+static void SynthChirp(WAVE_SYNTH * synth, const WAVE_PARAMS * params)
+{
+	double ratio = params->stopCycles / params->startCycles;
+	double logRatio = log(ratio);
+	double t;
+	double cycles;
+	int32_t i;
+
+	for (i = 0; i < params->size; i++)
+	{
+		t = (double) i / params->size;
+		cycles = params->logarithmic && fabs(logRatio) > 1e-12 ?
+			params->startCycles * (pow(ratio, t) - 1.0) / logRatio :
+			params->startCycles * t + (params->stopCycles - params->startCycles) * t * t / 2.0;
+		synth->work[i] = (float) (cycles - floor(cycles));
+	}
+
+	WaveSin(synth->work, params->size);
+}
+
+/****************************************************************************
+* SynthPrbs
+* M-последовательность +-1 из 2^prbsOrder - 1 бит на буфер; переход
+* между битами - линейный за долю бита rise
+****************************************************************************/
+static void SynthPrbs(WAVE_SYNTH * synth, const WAVE_PARAMS * params)
+{
+	int32_t bits = (1 << params->prbsOrder) - 1;
+	double bitLength = (double) params->size / bits;
+	double edge = params->rise * bitLength;
+	double position;
+	uint32_t state = params->prbsSeed;
+	uint32_t feedback;
+	float previous;
+	float current;
+	int32_t bit;
+	int32_t i;
+
+	// Уровни всех бит периода - в scratch (bits <= size)
+	for (bit = 0; bit < bits; bit++)
+	{
+		synth->scratch[bit] = (state & 1) ? 1.0f : -1.0f;
+		feedback = state & prbsTaps[params->prbsOrder];
+		feedback ^= feedback >> 8;
+		feedback ^= feedback >> 4;
+		feedback ^= feedback >> 2;
+		feedback ^= feedback >> 1;
+		state = (state >> 1) | ((feedback & 1) << (params->prbsOrder - 1));
+	}
+
+	for (i = 0; i < params->size; i++)
+	{
+		bit = (int32_t) ((int64_t) i * bits / params->size);
+		position = i - bit * bitLength;
+		current = synth->scratch[bit];
+		previous = synth->scratch[bit > 0 ? bit - 1 : bits - 1];		// Буфер повторяется - перед первым битом последний
+
+		synth->work[i] = position >= edge ? current : previous + (current - previous) * (float) (position / edge);
+	}
+}
+
+/****************************************************************************
+* SynthMultitone
+* Сумма тонов; фаза отсчёта i тона - (toneCycles * i) mod size, точно в целых
+****************************************************************************/
+static void SynthMultitone(WAVE_SYNTH * synth, const WAVE_PARAMS * params)
+{
+	double start;
+	int16_t tone;
+	int32_t i;
+
+	memset(synth->work, 0, params->size * sizeof(float));
+
+	for (tone = 0; tone < params->nTones; tone++)
+	{
+		start = params->tonePhases[tone] / 360.0;
+
+		for (i = 0; i < params->size; i++)
+		{
+			synth->scratch[i] = (float) ((double) (((int64_t) params->toneCycles[tone] * i) % params->size) / params->size + start);
+		}
+
+		WaveSin(synth->scratch, params->size);
+		WaveMulAdd(synth->work, synth->scratch, params->size, 1.0f, (float) params->toneLevels[tone]);
+	}
+}
+
+/****************************************************************************
+* SynthDecay
+* Импульсы exp(-t / fall) - exp(-t / rise) с учётом хвостов всех предыдущих
+* (буфер повторяется): сумма по периодам - множитель 1 / (1 - exp(-period / tau))
+****************************************************************************/
+static void SynthDecay(WAVE_SYNTH * synth, const WAVE_PARAMS * params)
+{
+	double period = (double) params->size / params->repeats;
+	double fall = params->fall * period;
+	double rise = params->rise * period;
+
+	WavePosition(synth->work, params->size, period);
+	WaveScale(synth->scratch, synth->work, params->size, (float) (-1.0 / fall));
+	WaveExp(synth->scratch, params->size);
+
+	if (rise > WAVE_MIN_EDGE)
+	{
+		WaveScale(synth->work, synth->work, params->size, (float) (-1.0 / rise));
+		WaveExp(synth->work, params->size);
+		WaveMulAdd(synth->work, synth->scratch, params->size, (float) (-1.0 / (1.0 - exp(-period / rise))),
+			(float) (1.0 / (1.0 - exp(-period / fall))));
+	}
+	else
+	{
+		WaveScale(synth->work, synth->scratch, params->size, (float) (1.0 / (1.0 - exp(-period / fall))));
+	}
+}
+
+/****************************************************************************
+* WaveSynthGenerate
+* Строит сигнал params в buffer (не меньше PS2000A_MAX_SIG_GEN_BUFFER_SIZE
+* отсчётов) в пределах устройства, подключённого WaveSynthAttach; сигнал
+* с уже встречавшимися параметрами копируется из кэша
+*
+* Возвращает число отсчётов сигнала, 0 - параметры недопустимы
+****************************************************************************/
+int32_t WaveSynthGenerate(WAVE_SYNTH * synth, const WAVE_PARAMS * params, int16_t * buffer)
+{
+	WAVE_PARAMS canonical;
+	WAVE_CACHE_ENTRY * entry;
+	uint64_t hash;
+	double half = (synth->limits.maxValue - synth->limits.minValue) / 2.0;
+	double middle = (synth->limits.maxValue + synth->limits.minValue) / 2.0;
+	double scale = 1.0;		// Нормированный сигнал -1 .. 1 - это scale * work + bias
+	double bias = 0.0;
+	float peak;
+	int16_t i;
+
+	if (synth->work == NULL || !WaveSynthValidate(synth, params))
+	{
+		return 0;
+	}
+
+	CanonicalParams(synth, params, &canonical);
+	hash = HashParams(&canonical);
+	synth->useCounter++;
+
+	for (i = 0; i < WAVE_CACHE_ENTRIES; i++)
+	{
+		entry = &synth->cache[i];
+
+		if (entry->buffer != NULL && entry->hash == hash && memcmp(&entry->params, &canonical, sizeof(WAVE_PARAMS)) == 0)
+		{
+			memcpy(buffer, entry->buffer, entry->size * sizeof(int16_t));
+			entry->lastUse = synth->useCounter;
+			synth->hits++;
+			return entry->size;
+		}
+	}
+
+	switch (canonical.shape)
+	{
+		case WAVE_PULSES:
+			SynthPulses(synth, &canonical);
+			scale = 2.0;
+			bias = -1.0;
+			break;
+
+		case WAVE_CHIRP:
+			SynthChirp(synth, &canonical);
+			break;
+
+		case WAVE_PRBS:
+			SynthPrbs(synth, &canonical);
+			break;
+
+		case WAVE_MULTITONE:
+			SynthMultitone(synth, &canonical);
+			peak = WavePeak(synth->work, canonical.size);
+			scale = peak > 0.0f ? 1.0 / peak : 1.0;
+			break;
+
+		case WAVE_DECAY:
+			SynthDecay(synth, &canonical);
+			peak = WavePeak(synth->work, canonical.size);
+			scale = peak > 0.0f ? 2.0 / peak : 1.0;
+			bias = -1.0;
+			break;
+	}
+
+	// Отсчёт = middle + half * (amplitude * (scale * work + bias) + offset)
+	SimdScaleToInt16(synth->work, canonical.size, (float) (half * canonical.amplitude * scale),
+		(float) (middle + half * (canonical.amplitude * bias + canonical.offset)), synth->limits.minValue, synth->limits.maxValue, buffer);
+	synth->misses++;
+
+	// В кэш - на место свободной или самой давно использованной записи
+	entry = &synth->cache[0];
+
+	for (i = 0; i < WAVE_CACHE_ENTRIES; i++)
+	{
+		if (synth->cache[i].buffer == NULL)
+		{
+			entry = &synth->cache[i];
+			break;
+		}
+
+		if (synth->cache[i].lastUse < entry->lastUse)
+		{
+			entry = &synth->cache[i];
+		}
+	}
+
+	free(entry->buffer);
+
+	if ((entry->buffer = (int16_t *) malloc(canonical.size * sizeof(int16_t))) != NULL)
+	{
+		memcpy(entry->buffer, buffer, canonical.size * sizeof(int16_t));
+		entry->hash = hash;
+		entry->params = canonical;
+		entry->size = canonical.size;
+		entry->lastUse = synth->useCounter;
+	}
+
+	return canonical.size;
+}
+
+/****************************************************************************
+* WaveSynthCheck
+* Проверяет готовый буфер (например, загруженный из файла) по пределам
+* устройства: размер и значения отсчётов
+*
+* Возвращает 0, если генератор такой буфер не примет
+****************************************************************************/
+int16_t WaveSynthCheck(const WAVE_SYNTH * synth, const int16_t * buffer, int32_t size)
+{
+	int16_t minValue = INT16_MAX;
+	int16_t maxValue = INT16_MIN;
+
+	if (size < 1 || size > PS2000A_MAX_SIG_GEN_BUFFER_SIZE ||
+		(uint32_t) size < synth->limits.minSize || (uint32_t) size > synth->limits.maxSize)
+	{
+		return 0;
+	}
+
+	SimdMinMax16(buffer, size, &minValue, &maxValue);
+
+	return minValue >= synth->limits.minValue && maxValue <= synth->limits.maxValue;
+}
+
+/****************************************************************************
+* WaveSynthFree
+* Освобождает кэш и рабочие буферы
+****************************************************************************/
+void WaveSynthFree(WAVE_SYNTH * synth)
+{
+	FlushCache(synth);
+	free(synth->work);
+	free(synth->scratch);
+	synth->work = NULL;
+	synth->scratch = NULL;
+	memset(&synth->limits, 0, sizeof(WAVE_LIMITS));
+}
@@ -0,0 +1,91 @@
+﻿/******************************************************************************
+ *
+ * Filename: WaveSynth.h
+ *
+ * Description:
+ *   Синтез сигналов для генератора произвольной формы (AWG).
+ *   Буфер одного периода выхода генератора (до
+ *   PS2000A_MAX_SIG_GEN_BUFFER_SIZE отсчётов) строится по параметрам
+ *   WAVE_PARAMS: серия трапецеидальных импульсов с заданными фронтом и
+ *   спадом, линейный или экспоненциальный чирп, ПСП (M-последовательность),
+ *   сумма тонов, серия импульсов с экспоненциальным нарастанием и спадом
+ *   (как у сцинтиллятора). Отсчёты вычисляются векторными ядрами SSE2
+ *   (со скалярным вариантом, см. Simd.h) и масштабируются в пределы
+ *   ps2000aSigGenArbitraryMinMaxValues подключённого устройства.
+ *   Готовые буферы хранятся в кэше по хэшу параметров, поэтому повторный
+ *   выбор того же сигнала - только копирование.
+ *   WAVE_SYNTH не синхронизирован: у каждого потока свой.
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include "ps2000aApi.h"
+
+#define WAVE_MAX_TONES			8
+#define WAVE_CACHE_ENTRIES		16
+#define WAVE_PRBS_MAX_ORDER		13			// 2^13 - 1 бит ещё помещаются в буфер генератора
+
+typedef enum enWaveShape
+{
+	WAVE_PULSES,			// Трапецеидальные импульсы: repeats за буфер, rise, width, fall - доли периода импульса
+	WAVE_CHIRP,				// Чирп от startCycles до stopCycles периодов на буфер
+	WAVE_PRBS,				// M-последовательность степени prbsOrder на весь буфер, rise - доля бита
+	WAVE_MULTITONE,			// Сумма nTones синусоид, нормированная к полной шкале
+	WAVE_DECAY				// Импульсы exp(-t / fall) - exp(-t / rise): repeats за буфер, rise и fall - доли периода
+} WAVE_SHAPE;
+
+typedef struct tWaveParams
+{
+	WAVE_SHAPE	shape;
+	int32_t		size;							// Отсчётов буфера, 0 - наибольший размер, допустимый устройством
+	double		amplitude;						// Размах относительно полной шкалы генератора (0 .. 1)
+	double		offset;							// Смещение относительно половины шкалы (-1 .. 1)
+	int32_t		repeats;						// Импульсов за буфер (WAVE_PULSES, WAVE_DECAY)
+	double		rise;							// Фронт или постоянная нарастания
+	double		width;							// Вершина импульса (WAVE_PULSES)
+	double		fall;							// Спад или постоянная спада
+	double		startCycles;					// Частоты чирпа, периодов на буфер
+	double		stopCycles;
+	int16_t		logarithmic;					// Экспоненциальный закон частоты чирпа
+	int16_t		prbsOrder;						// 2 .. WAVE_PRBS_MAX_ORDER
+	uint16_t	prbsSeed;						// Начальное состояние регистра (не 0)
+	int16_t		nTones;
+	int32_t		toneCycles[WAVE_MAX_TONES];		// Периодов тона на буфер - целое, чтобы буфер повторялся без разрыва
+	double		toneLevels[WAVE_MAX_TONES];		// Относительные амплитуды тонов
+	double		tonePhases[WAVE_MAX_TONES];		// Начальные фазы тонов, градусы
+}WAVE_PARAMS;
+
+typedef struct tWaveLimits
+{
+	int16_t		minValue;		// Пределы ps2000aSigGenArbitraryMinMaxValues
+	int16_t		maxValue;
+	uint32_t	minSize;
+	uint32_t	maxSize;
+}WAVE_LIMITS;
+
+typedef struct tWaveCacheEntry
+{
+	uint64_t	hash;
+	WAVE_PARAMS	params;			// Приведённые параметры (только поля своей формы, size определён)
+	int16_t *	buffer;			// NULL - запись свободна
+	int32_t		size;
+	uint32_t	lastUse;
+}WAVE_CACHE_ENTRY;
+
+typedef struct tWaveSynth
+{
+	WAVE_LIMITS			limits;
+	float *				work;			// Рабочие буферы синтеза по PS2000A_MAX_SIG_GEN_BUFFER_SIZE
+	float *				scratch;
+	WAVE_CACHE_ENTRY	cache[WAVE_CACHE_ENTRIES];
+	uint32_t			useCounter;
+	uint32_t			hits;
+	uint32_t			misses;
+}WAVE_SYNTH;
+
+void WaveParamsInit(WAVE_PARAMS * params, WAVE_SHAPE shape);
+int16_t WaveSynthAttach(WAVE_SYNTH * synth, int16_t handle);
+int16_t WaveSynthValidate(const WAVE_SYNTH * synth, const WAVE_PARAMS * params);
+int32_t WaveSynthGenerate(WAVE_SYNTH * synth, const WAVE_PARAMS * params, int16_t * buffer);
+int16_t WaveSynthCheck(const WAVE_SYNTH * synth, const int16_t * buffer, int32_t size);
+void WaveSynthFree(WAVE_SYNTH * synth);
@@ -0,0 +1,310 @@
+﻿/******************************************************************************
+ *
+ * Filename: WorkerPool.cpp
+ *
+ * Description:
+ *   Пул потоков обработки с перехватом заданий (см. WorkerPool.h).
+ *
+ ******************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include "WorkerPool.h"
+
+// Очередь потока пула, из которого ставится задание (NULL - поток не из пула)
+static thread_local WORK_QUEUE * ownQueue = NULL;
+
+/****************************************************************************
+* TakeWork
+* Берёт последнее задание своей очереди own или, если она пуста, перехватывает
+* самое старое задание чужой очереди
+*
+* Возвращает 0, если заданий нет
+****************************************************************************/
+static int16_t TakeWork(WORKER_POOL * pool, WORK_QUEUE * own, WORK_ITEM * item)
+{
+	WORK_QUEUE * queue;
+	int16_t start = own != NULL ? (int16_t) (own - pool->queues) : 0;
+	int16_t i;
+
+	if (own != NULL)
+	{
+		std::lock_guard<std::mutex> guard(own->lock);
+
+		if (own->count > 0)
+		{
+			own->count--;
+			*item = own->items[(own->head + own->count) % own->capacity];
+			pool->queued--;
+			return 1;
+		}
+	}
+
+	for (i = 0; i < pool->nWorkers; i++)
+	{
+		queue = &pool->queues[(start + i) % pool->nWorkers];
+
+		if (queue == own)
+		{
+			continue;
+		}
+
+		std::lock_guard<std::mutex> guard(queue->lock);
+
+		if (queue->count > 0)
+		{
+			*item = queue->items[queue->head];
+			queue->head = (queue->head + 1) % queue->capacity;
+			queue->count--;
+			pool->queued--;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/****************************************************************************
+* RunWork
+* Выполняет задание и сообщает ожидающим о завершении его группы
+****************************************************************************/
+static void RunWork(WORKER_POOL * pool, const WORK_ITEM * item)
+{
+	item->function(item->argument);
+	WorkGroupDone(pool, item->group);
+}
+
+/****************************************************************************
+* WorkerThread
+* Поток пула: выполняет задания, пока пул не остановлен и не выполнены все задания
+****************************************************************************/
+static DWORD WINAPI WorkerThread(LPVOID parameter)
+{
+	WORK_QUEUE * queue = (WORK_QUEUE *) parameter;
+	WORKER_POOL * pool = queue->pool;
+	WORK_ITEM item;
+
+	ownQueue = queue;
+
+	for (;;)
+	{
+		if (TakeWork(pool, queue, &item))
+		{
+			RunWork(pool, &item);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> wait(pool->lock);
+
+		if (pool->stopping && pool->queued.load() == 0)
+		{
+			break;
+		}
+
+		pool->signal.wait(wait, [pool] { return pool->stopping || pool->queued.load() > 0; });
+	}
+
+	ownQueue = NULL;
+	return 0;
+}
+
+/****************************************************************************
+* WorkerPoolInit
+* Запускает nThreads потоков (0 - по числу процессоров)
+*
+* Возвращает 0, если не удалось выделить очереди; если не запустился ни
+* один поток, задания выполняет WorkerPoolWait
+****************************************************************************/
+int16_t WorkerPoolInit(WORKER_POOL * pool, int16_t nThreads)
+{
+	SYSTEM_INFO systemInfo;
+	int16_t i;
+
+	if (nThreads <= 0)
+	{
+		GetSystemInfo(&systemInfo);
+		nThreads = (int16_t) systemInfo.dwNumberOfProcessors;
+	}
+
+	nThreads = nThreads < 1 ? 1 : nThreads > WORKER_POOL_MAX_THREADS ? WORKER_POOL_MAX_THREADS : nThreads;
+
+	pool->stopping = 0;
+	pool->queued = 0;
+	pool->nextQueue = 0;
+	pool->nWorkers = 0;
+
+	if ((pool->queues = new (std::nothrow) WORK_QUEUE[nThreads]) == NULL)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < nThreads; i++)
+	{
+		pool->queues[i].items = NULL;
+		pool->queues[i].head = 0;
+		pool->queues[i].count = 0;
+		pool->queues[i].capacity = 0;
+		pool->queues[i].thread = NULL;
+		pool->queues[i].pool = pool;
+	}
+
+	// Очереди должны быть готовы до запуска первого потока - потоки сразу начинают перехват
+	pool->nWorkers = nThreads;
+
+	for (i = 0; i < nThreads; i++)
+	{
+		pool->queues[i].thread = CreateThread(NULL, 0, WorkerThread, &pool->queues[i], 0, NULL);
+	}
+
+	return 1;
+}
+
+/****************************************************************************
+* WorkGroupInit
+* Готовит пустую группу заданий
+****************************************************************************/
+void WorkGroupInit(WORK_GROUP * group)
+{
+	group->pending.store(0, std::memory_order_relaxed);
+}
+
+/****************************************************************************
+* WorkGroupAdd
+* Учитывает в группе работу, которая завершится вызовом WorkGroupDone
+****************************************************************************/
+void WorkGroupAdd(WORK_GROUP * group)
+{
+	group->pending.fetch_add(1, std::memory_order_relaxed);
+}
+
+/****************************************************************************
+* WorkGroupDone
+* Отмечает завершение одной работы группы и будит ожидающих, если она последняя
+****************************************************************************/
+void WorkGroupDone(WORKER_POOL * pool, WORK_GROUP * group)
+{
+	if (group->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		std::lock_guard<std::mutex> guard(pool->lock);
+		pool->signal.notify_all();
+	}
+}
+
+/****************************************************************************
+* WorkerPoolSubmit
+* Ставит задание function(argument) группы group в очередь пула
+* (если очередь не удалось увеличить, задание выполняется сразу)
+****************************************************************************/
+void WorkerPoolSubmit(WORKER_POOL * pool, WORK_GROUP * group, WORK_FUNCTION function, void * argument)
+{
+	WORK_QUEUE * queue;
+	WORK_ITEM * items;
+	WORK_ITEM item;
+	uint32_t capacity;
+	uint32_t i;
+
+	item.function = function;
+	item.argument = argument;
+	item.group = group;
+
+	if (pool->nWorkers == 0)
+	{
+		function(argument);
+		return;
+	}
+
+	queue = ownQueue != NULL && ownQueue->pool == pool ? ownQueue :
+		&pool->queues[pool->nextQueue.fetch_add(1, std::memory_order_relaxed) % pool->nWorkers];
+
+	group->pending.fetch_add(1, std::memory_order_relaxed);
+
+	{
+		std::lock_guard<std::mutex> guard(queue->lock);
+
+		if (queue->count == queue->capacity)
+		{
+			capacity = queue->capacity ? queue->capacity * 2 : 64;
+
+			if ((items = (WORK_ITEM *) malloc(capacity * sizeof(WORK_ITEM))) == NULL)
+			{
+				group->pending.fetch_sub(1, std::memory_order_relaxed);
+				function(argument);
+				return;
+			}
+
+			for (i = 0; i < queue->count; i++)
+			{
+				items[i] = queue->items[(queue->head + i) % queue->capacity];
+			}
+
+			free(queue->items);
+			queue->items = items;
+			queue->head = 0;
+			queue->capacity = capacity;
+		}
+
+		queue->items[(queue->head + queue->count) % queue->capacity] = item;
+		queue->count++;
+		pool->queued++;
+	}
+
+	std::lock_guard<std::mutex> guard(pool->lock);
+	pool->signal.notify_one();
+}
+
+/****************************************************************************
+* WorkerPoolWait
+* Ждёт завершения всех заданий группы, выполняя задания пула, пока они есть
+****************************************************************************/
+void WorkerPoolWait(WORKER_POOL * pool, WORK_GROUP * group)
+{
+	WORK_QUEUE * own = ownQueue != NULL && ownQueue->pool == pool ? ownQueue : NULL;
+	WORK_ITEM item;
+
+	while (group->pending.load(std::memory_order_acquire) > 0)
+	{
+		if (TakeWork(pool, own, &item))
+		{
+			RunWork(pool, &item);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> wait(pool->lock);
+		pool->signal.wait(wait, [pool, group] { return group->pending.load() == 0 || pool->queued.load() > 0; });
+	}
+}
+
+/****************************************************************************
+* WorkerPoolFree
+* Останавливает потоки пула после выполнения поставленных заданий
+****************************************************************************/
+void WorkerPoolFree(WORKER_POOL * pool)
+{
+	int16_t i;
+
+	if (pool->queues == NULL)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(pool->lock);
+		pool->stopping = 1;
+		pool->signal.notify_all();
+	}
+
+	for (i = 0; i < pool->nWorkers; i++)
+	{
+		if (pool->queues[i].thread != NULL)
+		{
+			WaitForSingleObject(pool->queues[i].thread, INFINITE);
+			CloseHandle(pool->queues[i].thread);
+		}
+
+		free(pool->queues[i].items);
+	}
+
+	delete [] pool->queues;
+	pool->queues = NULL;
+	pool->nWorkers = 0;
+}
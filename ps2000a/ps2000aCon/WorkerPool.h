@@ -0,0 +1,69 @@
+﻿/******************************************************************************
+ *
+ * Filename: WorkerPool.h
+ *
+ * Description:
+ *   Пул потоков обработки с перехватом заданий.
+ *   У каждого потока своя очередь: задания, поставленные из потока пула,
+ *   попадают в его очередь, остальные - в очереди по кругу. Поток берёт
+ *   задания с конца своей очереди, а когда она пуста - перехватывает
+ *   самые старые задания с начала чужих очередей.
+ *   Задания объединяются в группы (WORK_GROUP); WorkerPoolWait ждёт
+ *   завершения группы и сам выполняет задания, пока ждёт, поэтому пул
+ *   работает и без запущенных потоков. WorkGroupAdd и WorkGroupDone
+ *   учитывают в группе работу вне очередей пула (например, сопрограмму,
+ *   ждущую обратного вызова драйвера).
+ *
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "windows.h"
+
+#define WORKER_POOL_MAX_THREADS		32
+
+typedef void (*WORK_FUNCTION)(void * argument);
+
+typedef struct tWorkGroup
+{
+	std::atomic<int32_t>	pending;		// Незавершённых заданий группы
+}WORK_GROUP;
+
+typedef struct tWorkItem
+{
+	WORK_FUNCTION	function;
+	void *			argument;
+	WORK_GROUP *	group;
+}WORK_ITEM;
+
+typedef struct tWorkQueue
+{
+	std::mutex				lock;
+	WORK_ITEM *				items;			// Кольцевой буфер заданий
+	uint32_t				head;			// Самое старое задание - его перехватывают другие потоки
+	uint32_t				count;
+	uint32_t				capacity;
+	HANDLE					thread;
+	struct tWorkerPool *	pool;
+}WORK_QUEUE;
+
+typedef struct tWorkerPool
+{
+	WORK_QUEUE *			queues;
+	int16_t					nWorkers;
+	int16_t					stopping;
+	std::atomic<int32_t>	queued;			// Заданий во всех очередях
+	std::atomic<uint32_t>	nextQueue;		// Очередь для следующего задания не из потока пула
+	std::mutex				lock;			// Защищает только ожидание signal
+	std::condition_variable	signal;			// Новое задание, завершение группы или остановка пула
+}WORKER_POOL;
+
+int16_t WorkerPoolInit(WORKER_POOL * pool, int16_t nThreads);
+void WorkGroupInit(WORK_GROUP * group);
+void WorkGroupAdd(WORK_GROUP * group);
+void WorkGroupDone(WORKER_POOL * pool, WORK_GROUP * group);
+void WorkerPoolSubmit(WORKER_POOL * pool, WORK_GROUP * group, WORK_FUNCTION function, void * argument);
+void WorkerPoolWait(WORKER_POOL * pool, WORK_GROUP * group);
+void WorkerPoolFree(WORKER_POOL * pool);
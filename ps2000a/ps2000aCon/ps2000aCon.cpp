@@ -65,9 +65,31 @@
  ******************************************************************************/
 #pragma once
 #include <stdio.h>
+#include <atomic>
+#include <new>
 #include "windows.h"
 #include <conio.h>
 #include "ps2000aApi.h"
+#include "Decimator.h"
+#include "StreamFilter.h"
+#include "CaptureFile.h"
+#include "DigitalPack.h"
+#include "EdgeList.h"
+#include "ProtocolDecoder.h"
+#include "DeviceManager.h"
+#include "TimeAlign.h"
+#include "UnitCache.h"
+#include "AutoRange.h"
+#include "Calibration.h"
+#include "CsvFormat.h"
+#include "CaptureExport.h"
+#include "StreamRing.h"
+#include "BufferAlloc.h"
+#include "WorkerPool.h"
+#include "CoAcquire.h"
+#include "ToneAnalysis.h"
+#include "WaveSynth.h"
+#include "WaveFile.h"
 #include <time.h>
 #include <istream>
 
@@ -98,6 +120,9 @@ typedef struct
 	int16_t DCcoupled;
 	int16_t range;
 	int16_t enabled;
+	float analogueOffset;		// Смещение, В - добавляется к входному сигналу перед АЦП (действующее, в пределах диапазона)
+	float requestedOffset;		// Смещение, заданное пользователем или EstimateBaseline, В - из него
+								// analogueOffset получается ограничением для каждого нового диапазона
 }CHANNEL_SETTINGS;
 
 typedef struct tTriggerDirections
@@ -120,9 +145,29 @@ typedef struct tPwq
 	PS2000A_PULSE_WIDTH_TYPE type;
 }PWQ;
 
+#define		MAX_TRIGGER_ENTRIES		8
+
+// Копия последних настроек SetTrigger для восстановления после переподключения
+typedef struct tTriggerSettings
+{
+	PS2000A_TRIGGER_CHANNEL_PROPERTIES	channelProperties[MAX_TRIGGER_ENTRIES];
+	int16_t								nChannelProperties;
+	PS2000A_TRIGGER_CONDITIONS			conditions[MAX_TRIGGER_ENTRIES];
+	int16_t								nConditions;
+	TRIGGER_DIRECTIONS					directions;
+	PS2000A_PWQ_CONDITIONS				pwqConditions[MAX_TRIGGER_ENTRIES];
+	PWQ									pwq;
+	uint32_t							delay;
+	int16_t								auxOutputEnabled;
+	int32_t								autoTriggerMs;
+	PS2000A_DIGITAL_CHANNEL_DIRECTIONS	digitalDirections[PS2000A_MAX_DIGITAL_CHANNELS];
+	int16_t								nDigitalDirections;
+}TRIGGER_SETTINGS;
+
 typedef struct
 {
 	int16_t					handle;
+	int8_t					serial[16];
 	PS2000A_RANGE			firstRange;
 	PS2000A_RANGE			lastRange;
 	uint8_t					signalGenerator;
@@ -133,12 +178,67 @@ typedef struct
 	int16_t					digitalPorts;
 	int16_t					awgBufferSize;
 	double					awgDACFrequency;
+	TRIGGER_SETTINGS		trigger;
+	CONVERSION_TABLE		conversion[PS2000A_MAX_CHANNELS];	// Таблицы отсчёт -> мВ для текущих диапазонов и смещений
+	WORKER_POOL *			blockPool;			// Пул обработки блоков (создаётся при первом сборе серии или большого блока)
 }UNIT;
 
 // Глобальные переменные
-uint32_t	timebase = 8;
+// Выбранные настройки (timebase, имена выходных файлов) свои у каждого потока, чтобы при работе
+// с несколькими устройствами (multiDevice) потоки не мешали друг другу; состояние обратных
+// вызовов драйвера хранится в SESSION каждого сбора
+thread_local uint32_t	timebase = 8;
 int16_t     oversample = 1;
 BOOL		scaleVoltages = TRUE;
+BOOL		hostDecimation = FALSE;		// Прореживание потока на ПК (см. decimationFiles) вместо агрегирования драйвером
+BOOL		streamFiltering = FALSE;	// Фильтрация аналоговых потоковых данных перед записью (см. streamFilters)
+BOOL		binaryCapture = FALSE;		// Запись в двоичный файл захвата (CaptureFile) вместо текстовых файлов
+BOOL		digitalEdges = TRUE;		// Цифровой поток в файле захвата хранится списком переходов, а не словом на отсчёт
+BOOL		protocolDecoding = FALSE;	// Декодирование протоколов цифрового потока (см. protocolDecoders) в ProtocolFile
+BOOL		multiDevice = FALSE;		// Сбор со всех подключённых устройств одновременно, по потоку на устройство
+BOOL		multiDeviceBlock = FALSE;	// Устройства собирают блоки (BlockDataHandler), иначе - потоковый сбор
+BOOL		timeAlignment = TRUE;		// После сбора с нескольких устройств привязать их файлы захвата к общей шкале времени
+int16_t		syncBuffer = -1;			// Буфер с общим синхросигналом (например, 2 - максимумы канала B), -1 - только по времени ПК
+int16_t		syncThreshold = 0;			// Порог синхросигнала, отсчёты АЦП
+BOOL		streamReconnect = TRUE;		// При потере связи во время потокового сбора переоткрыть устройство и продолжить запись
+BOOL		autoRanging = FALSE;		// Автоматический выбор диапазона аналоговых каналов между блоками и сегментами потока
+int32_t		autoRangeSegment = 50000;	// Отсчётов потока в сегменте, после которого пересматривается диапазон
+double		autoRangeUpper = 0.9;		// Доля шкалы, выше которой диапазон увеличивается
+double		autoRangeLower = 0.7;		// Доля шкалы меньшего диапазона, ниже которой он уменьшается
+int16_t		autoRangeHold = 3;			// Сегментов подряд со слабым сигналом перед уменьшением диапазона
+BOOL		exportCsv = FALSE;			// После потокового сбора в файл захвата выгрузить его в StreamFile или, для цифровых портов, в DigiStreamFile (см. CaptureExport.h)
+int16_t		exportThreads = 0;			// Потоков выгрузки, 0 - по числу процессоров
+BOOL		captureCompression = FALSE;	// Сжимать аналоговые фрагменты файла захвата (см. WaveCodec.h)
+BOOL		packSamples = FALSE;		// Хранить в файле захвата отсчёты 8-разрядного АЦП по байту (если не задано сжатие)
+BOOL		zeroCopyStreaming = FALSE;	// Аналоговый поток пишется драйвером прямо в кольцо слотов, без копирования (см. StreamRing.h)
+uint32_t	streamRingSlots = 8;		// Слотов кольца, каждый - на один обратный вызов
+uint32_t	bufferAllocFlags = 0;		// BUFFER_ALLOC_FLAGS буферов отсчётов (большие страницы, закрепление, узел NUMA)
+int16_t		blockCount = 1;				// Блоков подряд в одном сборе: следующий запускается сразу после чтения предыдущего
+int16_t		blockWorkers = 0;			// Потоков обработки блоков (см. WorkerPool.h), 0 - по числу процессоров
+BOOL		blockPipeline = FALSE;		// Серия блоков через кольцо буферов: чтение блока не ждёт записи предыдущих
+int16_t		blockRingSlots = 4;			// Слотов кольца буферов серии блоков
+BOOL		coroutineCapture = FALSE;	// Сбор сопрограммой (см. CoAcquire.h): подбор диапазонов по блокам, затем потоковый сбор
+int16_t		coroutineBlocks = 5;		// Блоков подбора диапазонов в CollectCoroutine
+uint32_t	coroutineSamples = 1000000;	// Отсчётов потокового сбора в CollectCoroutine
+BOOL		sweepCapture = FALSE;		// Снять частотную характеристику развёрткой генератора (см. CollectSweep)
+double		sweepStart = 10.0;			// Первая частота развёртки, Гц
+double		sweepStop = 100000.0;		// Последняя частота развёртки, Гц
+int16_t		sweepPoints = 31;			// Частот в развёртке
+BOOL		sweepLogarithmic = TRUE;	// Частоты по логарифмической шкале (иначе - равномерно)
+uint32_t	sweepAmplitudes[] = { 2000000 };	// Размахи генератора, мкВ: развёртка по частоте повторяется для каждого
+BOOL		sweepArbitrary = FALSE;		// Синус из таблицы генератора произвольной формы вместо встроенного
+int16_t		sweepReference = PS2000A_CHANNEL_A;	// Канал, на который подан выход генератора
+int16_t		sweepResponse = PS2000A_CHANNEL_B;	// Канал датчика
+int32_t		sweepSamples = 4096;		// Отсчётов в захвате точки
+double		sweepCycles = 8.0;			// Периодов сигнала в захвате (по нему выбирается временная база)
+uint32_t	sweepCaptures = 4;			// Захватов быстрого блока на точку, отклик по ним усредняется (1 - обычный блок)
+uint32_t	sweepSettle = 20;			// Пауза после смены частоты генератора, мс
+BOOL		autoOffset = FALSE;			// При настройке устройства измерить базовую линию каналов и скомпенсировать её смещением
+int32_t		baselineSamples = 1000;		// Отсчётов в предварительном захвате для оценки базовой линии
+uint32_t	baselineTimeout = 2000;		// Наибольшее ожидание предварительного захвата, мс
+BOOL		unitInfoCache = TRUE;		// Брать сведения об уже открывавшихся устройствах из UnitCacheFile
+int16_t		openRetries = 5;			// Повторные попытки открытия устройства вместо завершения программы
+uint32_t	openRetryDelay = 2000;		// Пауза между попытками, мс
 
 uint16_t inputRanges [PS2000A_MAX_RANGES] = {	10,
 	20,
@@ -153,19 +253,24 @@ uint16_t inputRanges [PS2000A_MAX_RANGES] = {	10,
 	20000,
 	50000};
 
-BOOL     		g_ready = FALSE;
-int32_t 		g_times [PS2000A_MAX_CHANNELS];
-int16_t     	g_timeUnit;
-int32_t      	g_sampleCount;
-uint32_t		g_startIndex;
-int16_t			g_autoStopped;
-int16_t			g_trig = 0;
-uint32_t		g_trigAt = 0;
-int16_t			g_overflow = 0;
-
-char BlockFile[20]		= "block.txt";
-char DigiBlockFile[20]	= "digiblock.txt";
-char StreamFile[20]		= "stream.txt";
+thread_local int32_t 	g_times [PS2000A_MAX_CHANNELS];
+thread_local int16_t    g_timeUnit;
+
+thread_local char BlockFile[32]		= "block.txt";
+thread_local char DigiBlockFile[32]	= "digiblock.txt";
+thread_local char StreamFile[32]	= "stream.txt";
+thread_local char DigiStreamFile[32]	= "digistream.txt";
+thread_local char CaptureFile[32]	= "capture.bin";
+thread_local char ProtocolFile[32]	= "protocol.txt";
+thread_local char SweepFile[32]		= "sweep.txt";
+char UnitCacheFile[20]				= "unitinfo.cache";
+char CalibrationFile[20]			= "calibration.txt";
+
+UNIT_CACHE		unitCache;		// Общий для всех потоков, функции UnitCache* синхронизированы
+thread_local AUTO_RANGE autoRange;
+thread_local WAVE_SYNTH waveSynth;	// Синтез и кэш буферов генератора произвольной формы
+thread_local WAVE_LOADER waveLoader;	// Кэш буферов генератора произвольной формы, загруженных из файлов
+CALIBRATION		calibration;	// Загружается в main до открытия устройств, далее только читается
 
 // Используйте эту структуру, чтобы помочь в сборе потоковых данных
 typedef struct tBufferInfo
@@ -179,11 +284,81 @@ typedef struct tBufferInfo
 
 } BUFFER_INFO;
 
+// Состояние одного сбора, передаётся драйверу как pParameter обратных вызовов.
+// CallBackBlock вызывается из потока драйвера, поэтому обратный вызов заполняет поля,
+// затем публикует их записью ready (memory_order_release); обработчик читает поля
+// только после ready, прочитанного с memory_order_acquire
+typedef struct tSession
+{
+	UNIT *					unit;
+	BUFFER_INFO *			bufferInfo;		// Буферы потокового сбора для копирования, NULL - не копировать
+	uint32_t				timebase;		// Настройки этого сбора (timebase может быть увеличен обработчиком)
+	int16_t					oversample;
+	std::atomic<int16_t>	ready;			// Данные получены
+	std::atomic<int16_t>	autoStopped;	// Потоковый сбор завершён
+	int32_t					sampleCount;	// Отсчётов в последнем обратном вызове потокового сбора
+	uint32_t				startIndex;
+	int16_t					overflow;
+	int16_t					triggered;
+	uint32_t				triggerAt;
+	int64_t					hostTime;		// Время ПК (нс) последнего обратного вызова
+	PICO_STATUS				status;			// Состояние, переданное CallBackBlock
+}SESSION;
+
+/****************************************************************************
+* SessionInit
+* Готовит состояние сбора устройства unit с выбранными timebase и oversample
+****************************************************************************/
+void SessionInit(SESSION * session, UNIT * unit, BUFFER_INFO * bufferInfo)
+{
+	session->unit = unit;
+	session->bufferInfo = bufferInfo;
+	session->timebase = timebase;
+	session->oversample = oversample;
+	session->sampleCount = 0;
+	session->startIndex = 0;
+	session->overflow = 0;
+	session->triggered = 0;
+	session->triggerAt = 0;
+	session->hostTime = 0;
+	session->status = PICO_OK;
+	session->ready.store(FALSE, std::memory_order_relaxed);
+	session->autoStopped.store(FALSE, std::memory_order_relaxed);
+}
+
+// Выход прореживания на стороне ПК и файл, в который он записывается
+typedef struct tDecimationFile
+{
+	DECIMATION_MODE	mode;
+	uint32_t		ratio;
+	uint64_t		window;
+	int16_t			firTaps;
+	char			fileName[32];
+	UNIT *			unit;
+	FILE *			fp;
+} DECIMATION_FILE;
+
+thread_local DECIMATION_FILE decimationFiles[] = {	{ DECIMATE_RAW,			1,		1000000,	0,	"stream_raw.txt",	NULL,	NULL },		// Полная частота, первые 10^6 отсчётов
+										{ DECIMATE_AVERAGE,		100,	0,			0,	"stream_avg.txt",	NULL,	NULL },		// Среднее x100 для журнала
+										{ DECIMATE_AGGREGATE,	1000,	0,			0,	"stream_preview.txt",	NULL,	NULL } };	// Минимум/максимум x1000 для просмотра
+
+// Звенья фильтра потоковых данных в порядке применения
+FILTER_STAGE_SETTINGS streamFilters[] = {	{ FILTER_MEDIAN,	5,	NULL,	0.0 },		// Подавление одиночных выбросов
+											{ FILTER_BIQUAD,	2,	NULL,	0.01 } };	// ФНЧ Баттерворта 4-го порядка, срез 0.01 Fs
+
+#define MAX_PROTOCOL_DECODERS	4
+
+// Декодеры протоколов цифрового потока: тип, данные, такт, MISO, CS, бод, биты, чётность, стоп, режим SPI, MSB, инверсия
+// (UART нужно не меньше 2 отсчётов на бит: для 9600 бод интервал не больше 52 мкс, а не 10 мс цифрового потока по умолчанию)
+PROTOCOL_SETTINGS protocolDecoders[] = {	{ PROTOCOL_UART,	0,	-1,	-1,	-1,	9600,	8,	0,	1,	0,	0,	0 },	// UART RX на D0
+											{ PROTOCOL_SPI,		2,	1,	3,	4,	0,		8,	0,	0,	0,	1,	0 },	// SPI режим 0: SCLK D1, MOSI D2, MISO D3, CS D4
+											{ PROTOCOL_I2C,		6,	5,	-1,	-1,	0,		8,	0,	0,	0,	1,	0 } };	// I2C: SCL D5, SDA D6
+
 
 /****************************************************************************
 * CallBackStreaming
 * используется при вызовах потокового сбора данных ps2000a при получении данных.
-* используется для установки глобальных флагов и т.д., проверяемых пользовательскими процедурами
+* заполняет SESSION, переданный через pParameter, и копирует отсчёты в буферы приложения
 ****************************************************************************/
 void PREF4 CallBackStreaming(	int16_t handle,
 	int32_t noOfSamples,
@@ -196,25 +371,25 @@ void PREF4 CallBackStreaming(	int16_t handle,
 {
 	int32_t channel;
 	int32_t digiPort;
-	BUFFER_INFO * bufferInfo = NULL;
+	SESSION * session = (SESSION *) pParameter;
+	BUFFER_INFO * bufferInfo;
 
-	if (pParameter != NULL)
+	if (session == NULL)
 	{
-		bufferInfo = (BUFFER_INFO *) pParameter;
+		return;
 	}
 
-	// используется для потоковой передачи
-	g_sampleCount	= noOfSamples;
-	g_startIndex	= startIndex;
-	g_autoStopped	= autoStop;
-	g_overflow		= overflow;
+	bufferInfo = session->bufferInfo;
 
-	// отметьте, что чтение данных завершено
-	g_ready = TRUE;
+	// используется для потоковой передачи
+	session->hostTime		= TimeAlignNow();
+	session->sampleCount	= noOfSamples;
+	session->startIndex		= startIndex;
+	session->overflow		= overflow;
 
 	// флаги, показывающие, произошел ли триггер и где именно
-	g_trig = triggered;
-	g_trigAt = triggerAt;
+	session->triggered = triggered;
+	session->triggerAt = triggerAt;
 
 	if (bufferInfo != NULL && noOfSamples)
 	{
@@ -274,18 +449,117 @@ void PREF4 CallBackStreaming(	int16_t handle,
 			}
 		}
 	}
+
+	// отметьте, что чтение данных завершено: поля и скопированные отсчёты видны обработчику после ready
+	session->autoStopped.store(autoStop, std::memory_order_release);
+	session->ready.store(TRUE, std::memory_order_release);
 }
 
 /****************************************************************************
 * CallBackBlock
 * используется для сбора блоков данных ps2000a при получении данных.
-* используется для установки глобальных флагов и т.д., проверяемых пользовательскими процедурами
+* отмечает готовность в SESSION, переданном через pParameter
 ****************************************************************************/
 void PREF4 CallBackBlock(	int16_t handle, PICO_STATUS status, void * pParameter)
 {
-	if (status != PICO_CANCELLED)
+	// Драйвер вызывает функцию из своего потока, поэтому состояние передаётся через pParameter
+	SESSION * session = (SESSION *) pParameter;
+
+	if (status != PICO_CANCELLED && session != NULL)
+	{
+		session->status = status;
+		session->hostTime = TimeAlignNow();
+		session->ready.store(TRUE, std::memory_order_release);
+	}
+}
+
+/****************************************************************************
+* UpdateConversion
+* Пересчитывает таблицы преобразования отсчётов в мВ для текущих диапазонов
+* и смещений каналов (вызывается после каждого изменения настроек каналов)
+****************************************************************************/
+void UpdateConversion(UNIT * unit)
+{
+	PS2000A_SCALING_FACTORS_VALUES scaling[PS2000A_MAX_CHANNELS];
+	PICO_STATUS scalingStatus;
+	int16_t minValue;
+	int16_t adcOffset;
+	int16_t ch;
+	double positive;
+	double negative;
+	double gain;
+	double offsetMv;
+
+	memset(scaling, 0, sizeof(scaling));
+
+	for (ch = 0; ch < unit->channelCount; ch++)
+	{
+		scaling[ch].channelOrPort = (PS2000A_CHANNEL) ch;
+		scaling[ch].range = (PS2000A_RANGE) unit->channelSettings[ch].range;
+	}
+
+	scalingStatus = ps2000aGetScalingValues(unit->handle, scaling, unit->channelCount);
+
+	if (ps2000aMinimumValue(unit->handle, &minValue) != PICO_OK || minValue >= 0)
+	{
+		minValue = -unit->maxValue;
+	}
+
+	for (ch = 0; ch < unit->channelCount; ch++)
+	{
+		if (!unit->channelSettings[ch].enabled)
+		{
+			continue;
+		}
+
+		if (scalingStatus == PICO_OK && scaling[ch].scalingFactor > 0.0)
+		{
+			// Коэффициенты драйвера: мВ на отсчёт и отсчёт нуля
+			positive = negative = scaling[ch].scalingFactor;
+			adcOffset = scaling[ch].offset;
+		}
+		else
+		{
+			positive = (double) inputRanges[unit->channelSettings[ch].range] / unit->maxValue;
+			negative = (double) inputRanges[unit->channelSettings[ch].range] / -minValue;
+			adcOffset = 0;
+		}
+
+		CalibrationFind(&calibration, (const char *) unit->serial, ch, unit->channelSettings[ch].range, &gain, &offsetMv);
+
+		if (!ConversionBuild(&unit->conversion[ch], adcOffset, positive, negative,
+			unit->channelSettings[ch].analogueOffset * 1000.0, gain, offsetMv))
+		{
+			printf("UpdateConversion: out of memory, channel %c uses nominal scaling\n", 'A' + ch);
+		}
+	}
+}
+
+/****************************************************************************
+* ReleaseConversion
+* Освобождает таблицы преобразования
+****************************************************************************/
+void ReleaseConversion(UNIT * unit)
+{
+	int16_t ch;
+
+	for (ch = 0; ch < PS2000A_MAX_CHANNELS; ch++)
+	{
+		ConversionFree(&unit->conversion[ch]);
+	}
+}
+
+/****************************************************************************
+* ReleaseBlockPool
+* Останавливает пул обработки блоков устройства
+****************************************************************************/
+void ReleaseBlockPool(UNIT * unit)
+{
+	if (unit->blockPool != NULL)
 	{
-		g_ready = TRUE;
+		WorkerPoolFree(unit->blockPool);
+		delete unit->blockPool;
+		unit->blockPool = NULL;
 	}
 }
 
@@ -294,6 +568,8 @@ void PREF4 CallBackBlock(	int16_t handle, PICO_STATUS status, void * pParameter)
 ****************************************************************************/
 void CloseDevice(UNIT *unit)
 {
+	ReleaseBlockPool(unit);
+	ReleaseConversion(unit);
 	ps2000aCloseUnit(unit->handle);
 }
 
@@ -313,8 +589,11 @@ void SetDefaults(UNIT * unit)
 		status = ps2000aSetChannel(unit->handle, (PS2000A_CHANNEL) (PS2000A_CHANNEL_A + i),
 			unit->channelSettings[PS2000A_CHANNEL_A + i].enabled,
 			(PS2000A_COUPLING) unit->channelSettings[PS2000A_CHANNEL_A + i].DCcoupled,
-			(PS2000A_RANGE) unit->channelSettings[PS2000A_CHANNEL_A + i].range, 0);
+			(PS2000A_RANGE) unit->channelSettings[PS2000A_CHANNEL_A + i].range,
+			unit->channelSettings[PS2000A_CHANNEL_A + i].analogueOffset);
 	}
+
+	UpdateConversion(unit);
 }
 
 /****************************************************************************
@@ -357,7 +636,7 @@ PICO_STATUS DisableAnalogue(UNIT *unit)
 	{
 
 		status = ps2000aSetChannel(unit->handle, (PS2000A_CHANNEL) ch, 0, (PS2000A_COUPLING) unit->channelSettings[ch].DCcoupled, 
-			(PS2000A_RANGE) unit->channelSettings[ch].range, 0);
+			(PS2000A_RANGE) unit->channelSettings[ch].range, unit->channelSettings[ch].analogueOffset);
 
 		if (status != PICO_OK)
 		{
@@ -380,24 +659,47 @@ PICO_STATUS RestoreAnalogueSettings(UNIT *unit)
 	{
 
 		status = ps2000aSetChannel(unit->handle, (PS2000A_CHANNEL) ch, unit->channelSettings[ch].enabled, (PS2000A_COUPLING) unit->channelSettings[ch].DCcoupled, 
-			(PS2000A_RANGE) unit->channelSettings[ch].range, 0);
+			(PS2000A_RANGE) unit->channelSettings[ch].range, unit->channelSettings[ch].analogueOffset);
 
 		if (status != PICO_OK)
 		{
 			printf("RestoreAnalogueSettings:ps2000aSetChannel(channel %d) ------ 0x%08lx \n", ch, status);
 		}
 	}
+
+	UpdateConversion(unit);
 	return status;
 }
 
+/****************************************************************************
+* offset_mv
+*
+* Смещение канала ch в милливольтах
+****************************************************************************/
+int32_t offset_mv(int32_t ch, UNIT * unit)
+{
+	float offset = unit->channelSettings[ch].analogueOffset * 1000.0f;
+
+	return (int32_t) (offset < 0.0f ? offset - 0.5f : offset + 0.5f);
+}
+
 /****************************************************************************
 * adc_to_mv
 *
-* Преобразуйте значение 16-разрядного АЦП в милливольты
+* Преобразуйте значение 16-разрядного АЦП канала ch в милливольты
+* (с учётом диапазона, смещения и калибровки канала - см. UpdateConversion)
 ****************************************************************************/
 int32_t adc_to_mv(int32_t raw, int32_t ch, UNIT * unit)
 {
-	return (raw * inputRanges[ch]) / unit->maxValue;
+	float mv;
+
+	if (unit->conversion[ch].mv == NULL)
+	{
+		return (raw * inputRanges[unit->channelSettings[ch].range]) / unit->maxValue - offset_mv(ch, unit);
+	}
+
+	mv = ConversionLookup(&unit->conversion[ch], (int16_t) raw);
+	return (int32_t) (mv < 0.0f ? mv - 0.5f : mv + 0.5f);
 }
 
 /****************************************************************************
@@ -409,7 +711,7 @@ int32_t adc_to_mv(int32_t raw, int32_t ch, UNIT * unit)
 ****************************************************************************/
 int16_t mv_to_adc(int16_t mv, int16_t ch, UNIT * unit)
 {
-	return (mv * unit->maxValue) / inputRanges[ch];
+	return (int16_t) (((mv + offset_mv(ch, unit)) * unit->maxValue) / inputRanges[unit->channelSettings[ch].range]);
 }
 
 /****************************************************************************
@@ -463,6 +765,87 @@ int8_t* timeUnitsToString(PS2000A_TIME_UNITS timeUnits)
 
 }
 
+/****************************************************************************
+* timeUnitsToNs
+*
+* Возвращает количество наносекунд в единице PS2000A_TIME_UNITS
+*
+****************************************************************************/
+double timeUnitsToNs(PS2000A_TIME_UNITS timeUnits)
+{
+	static const double nsPerUnit[] = { 1e-6, 1e-3, 1.0, 1e3, 1e6, 1e9 };	// fs, ps, ns, us, ms, s
+
+	return (timeUnits >= PS2000A_FS && timeUnits <= PS2000A_S) ? nsPerUnit[timeUnits] : 1.0;
+}
+
+/****************************************************************************
+* FillCaptureScale
+*
+* Записывает шкалы каналов, по которым adc_to_mv считает милливольты
+* (нули - номинальная шкала диапазона, если таблица не построена)
+****************************************************************************/
+void FillCaptureScale(UNIT * unit, CAPTURE_SCALE * scale)
+{
+	int32_t ch;
+
+	memset(scale, 0, PS2000A_MAX_CHANNELS * sizeof(CAPTURE_SCALE));
+
+	for (ch = 0; ch < unit->channelCount; ch++)
+	{
+		if (unit->conversion[ch].mv != NULL)
+		{
+			scale[ch].adcOffset = unit->conversion[ch].adcOffset;
+			scale[ch].mvPerCountPositive = unit->conversion[ch].mvPerCountPositive;
+			scale[ch].mvPerCountNegative = unit->conversion[ch].mvPerCountNegative;
+			scale[ch].gain = unit->conversion[ch].gain;
+			scale[ch].offsetMv = unit->conversion[ch].offsetMv;
+		}
+	}
+}
+
+/****************************************************************************
+* FillCaptureHeader
+*
+* Заполняет заголовок файла захвата текущими настройками устройства
+* Input :
+* - sampleInterval: интервал между сохраняемыми отсчётами, нс
+* - downsampleRatio, ratioMode: режим сокращения данных драйвером
+****************************************************************************/
+void FillCaptureHeader(SESSION * session, CAPTURE_HEADER * header, double sampleInterval, uint32_t downsampleRatio, PS2000A_RATIO_MODE ratioMode)
+{
+	UNIT * unit = session->unit;
+	int32_t ch;
+	int16_t shift = 0;
+
+	memset(header, 0, sizeof(CAPTURE_HEADER));
+
+	header->channelCount = unit->channelCount;
+	header->digitalPorts = unit->digitalPorts;
+	header->maxValue = unit->maxValue;
+
+	for (ch = 0; ch < unit->channelCount; ch++)
+	{
+		header->enabled[ch] = unit->channelSettings[ch].enabled;
+		header->range[ch] = unit->channelSettings[ch].range;
+		header->analogueOffset[ch] = unit->channelSettings[ch].analogueOffset;
+	}
+
+	FillCaptureScale(unit, header->scale);
+
+	header->timebase = session->timebase;
+	header->sampleInterval = sampleInterval;
+	header->downsampleRatio = downsampleRatio;
+	header->ratioMode = ratioMode;
+
+	// Шаг АЦП 1 << shift, при котором наибольший отсчёт помещается в int8_t (32512 = 127 << 8)
+	while (shift < 8 && (unit->maxValue >> shift) > INT8_MAX && !(unit->maxValue & (1 << shift)))
+	{
+		shift++;
+	}
+
+	header->sampleShift = packSamples && (unit->maxValue >> shift) <= INT8_MAX ? shift : 0;
+}
+
 /****************************************************************************
 * ClearDataBuffers
 *
@@ -494,1528 +877,3901 @@ PICO_STATUS ClearDataBuffers(UNIT * unit)
 }
 
 /****************************************************************************
-* BlockDataHandler
-* - Используется всеми процедурами обработки данных блока
-* - собирает данные (пользователь устанавливает режим запуска перед вызовом), отображает 10 элементов
-* и сохраняет все в data.txt
-* Input :
-* - единица измерения: используемая единица измерения.
-* - текст: текст, отображаемый перед отображением фрагмента данных
-* - смещение: смещение в буфер данных для начала отображения фрагмента.
+* ClampAnalogueOffset
+* Ограничивает смещение пределами, допустимыми для диапазона и связи
+* (устройства без поддержки смещения - 0)
 ****************************************************************************/
-void BlockDataHandler(UNIT * unit, const char * text, int32_t offset, MODE mode, int16_t etsModeSet)
+float ClampAnalogueOffset(UNIT * unit, PS2000A_RANGE range, PS2000A_COUPLING coupling, float offset)
 {
-	uint16_t bit;
-	uint16_t bitValue;
-	uint16_t digiValue;
-	uint32_t segmentIndex = 0;
+	float maximumVoltage;
+	float minimumVoltage;
 
-	int32_t i, j;
-	int32_t timeInterval;
-	int32_t sampleCount = BUFFER_SIZE;
-	int32_t maxSamples;
-	int32_t timeIndisposed;
+	if (ps2000aGetAnalogueOffset(unit->handle, range, coupling, &maximumVoltage, &minimumVoltage) != PICO_OK)
+	{
+		return 0.0f;
+	}
 
-	int16_t * buffers[PS2000A_MAX_CHANNEL_BUFFERS];
-	int16_t * digiBuffer[PS2000A_MAX_DIGITAL_PORTS];
+	return offset > maximumVoltage ? maximumVoltage : offset < minimumVoltage ? minimumVoltage : offset;
+}
 
-	int64_t * etsTime=0; // Буфер для данных о времени ETS
+/****************************************************************************
+* SyncAutoRange
+* Передаёт контроллеру диапазонов controller настройки каналов, изменённые вручную
+****************************************************************************/
+void SyncAutoRange(UNIT * unit, AUTO_RANGE * controller)
+{
+	int16_t ch;
 
-	FILE * fp = NULL;
-	FILE * digiFp = NULL;
-	
-	PICO_STATUS status;
-	PS2000A_RATIO_MODE ratioMode = PS2000A_RATIO_MODE_NONE;
-	
-	if (mode == ANALOGUE || mode == MIXED)		// Аналоговый или (только для MSO) СМЕШАННЫЙ
+	for (ch = 0; ch < unit->channelCount; ch++)
 	{
-		for (i = 0; i < unit->channelCount; i++) 
+		if (controller->channels[ch].enabled != unit->channelSettings[ch].enabled ||
+			controller->channels[ch].range != unit->channelSettings[ch].range)
 		{
-			if (unit->channelSettings[i].enabled)
-			{
-				buffers[i * 2] = (int16_t*) malloc(sampleCount * sizeof(int16_t));
-				buffers[i * 2 + 1] = (int16_t*) malloc(sampleCount * sizeof(int16_t));
-				
-				status = ps2000aSetDataBuffers(unit->handle, (int32_t) i, buffers[i * 2], buffers[i * 2 + 1], sampleCount, segmentIndex, ratioMode);
-
-				printf(status?"BlockDataHandler:ps2000aSetDataBuffers(channel %d) ------ 0x%08lx \n":"", i, status);
-			}
+			AutoRangeSetChannel(controller, ch, unit->channelSettings[ch].enabled, unit->channelSettings[ch].range);
 		}
 	}
+}
 
-	// Настройте временные буферы, если данные записываются в режиме блокировки ETS (только при включенных аналоговых каналах).
-	if (mode == ANALOGUE && etsModeSet == TRUE)
-	{
-		etsTime = (int64_t *) calloc(sampleCount, sizeof (int64_t));   
-		status = ps2000aSetEtsTimeBuffer(unit->handle, etsTime, sampleCount);
-	}
+/****************************************************************************
+* SelectAutoRanges
+* Завершает сегмент: заполняет ranges[PS2000A_MAX_CHANNELS] диапазонами,
+* выбранными контроллером controller (у выключенных каналов - текущими),
+* не меняя настроек устройства
+*
+* Возвращает TRUE, если диапазон хотя бы одного канала должен измениться
+****************************************************************************/
+BOOL SelectAutoRanges(UNIT * unit, AUTO_RANGE * controller, int16_t * ranges)
+{
+	BOOL changed = FALSE;
+	int16_t ch;
 
-	if (mode == DIGITAL || mode == MIXED)		// (Только для MSO) Цифровой или СМЕШАННЫЙ
+	for (ch = 0; ch < PS2000A_MAX_CHANNELS; ch++)
 	{
-		for (i= 0; i < unit->digitalPorts; i++) 
+		ranges[ch] = ch < unit->channelCount ? unit->channelSettings[ch].range : 0;
+
+		if (ch < unit->channelCount && unit->channelSettings[ch].enabled)
 		{
-			digiBuffer[i] = (int16_t*) malloc(sampleCount* sizeof(int16_t));
-			status = ps2000aSetDataBuffer(unit->handle, (int32_t) (i + PS2000A_DIGITAL_PORT0), digiBuffer[i], sampleCount, 0, ratioMode);
-			printf(status?"BlockDataHandler:ps2000aSetDataBuffer(port 0x%X) ------ 0x%08lx \n":"", i + PS2000A_DIGITAL_PORT0, status);
+			ranges[ch] = AutoRangeUpdate(controller, ch);
+			changed = changed || ranges[ch] != unit->channelSettings[ch].range;
 		}
 	}
 
-	/*  Проверьте текущий базовый временной индекс и найдите максимальное количество выборок и временной интервал (в наносекундах).*/
-	while (ps2000aGetTimebase(unit->handle, timebase, sampleCount, &timeInterval, oversample, &maxSamples, 0) != PICO_OK)
+	return changed;
+}
+
+/****************************************************************************
+* SetAutoRanges
+* Переключает каналы на диапазоны ranges, выбранные SelectAutoRanges
+* (вызывается только для остановленного устройства)
+*
+* Возвращает TRUE, если диапазон хотя бы одного канала изменился
+****************************************************************************/
+BOOL SetAutoRanges(UNIT * unit, AUTO_RANGE * controller, const int16_t * ranges)
+{
+	PICO_STATUS status;
+	BOOL changed = FALSE;
+	int16_t ch;
+	int16_t range;
+	float offset;
+
+	for (ch = 0; ch < unit->channelCount; ch++)
 	{
-		timebase++;
+		range = ranges[ch];
+
+		if (!unit->channelSettings[ch].enabled || range == unit->channelSettings[ch].range)
+		{
+			continue;
+		}
+
+		offset = ClampAnalogueOffset(unit, (PS2000A_RANGE) range, (PS2000A_COUPLING) unit->channelSettings[ch].DCcoupled,
+			unit->channelSettings[ch].requestedOffset);
+		status = ps2000aSetChannel(unit->handle, (PS2000A_CHANNEL) ch, TRUE, (PS2000A_COUPLING) unit->channelSettings[ch].DCcoupled,
+			(PS2000A_RANGE) range, offset);
+
+		if (status != PICO_OK)
+		{
+			printf("ApplyAutoRange:ps2000aSetChannel(channel %d) ------ 0x%08lx \n", ch, status);
+			AutoRangeSetChannel(controller, ch, TRUE, unit->channelSettings[ch].range);
+			continue;
+		}
+
+		printf("\nChannel %c: range %d mV -> %d mV", 'A' + ch, inputRanges[unit->channelSettings[ch].range], inputRanges[range]);
+		unit->channelSettings[ch].range = range;
+		unit->channelSettings[ch].analogueOffset = offset;
+		changed = TRUE;
 	}
 
-	if (!etsModeSet)
+	if (changed)
 	{
-		printf("\nTimebase: %lu  SampleInterval: %ldnS  oversample: %hd\n", timebase, timeInterval, oversample);
+		UpdateConversion(unit);
 	}
 
-	/* Запустите его сбор, затем дождитесь завершения*/
-	g_ready = FALSE;
-	status = ps2000aRunBlock(unit->handle, 0, sampleCount, timebase, oversample,	&timeIndisposed, 0, CallBackBlock, NULL);
-	printf(status?"BlockDataHandler:ps2000aRunBlock ------ 0x%08lx \n":"", status);
+	return changed;
+}
 
-	printf("Waiting for trigger...Press a key to abort\n");
+/****************************************************************************
+* ApplyAutoRange
+* Завершает сегмент и переключает диапазоны каналов, выбранные контроллером controller.
+* Новые диапазоны действуют со следующего сбора (устройство должно быть остановлено)
+*
+* Возвращает TRUE, если диапазон хотя бы одного канала изменился
+****************************************************************************/
+BOOL ApplyAutoRange(UNIT * unit, AUTO_RANGE * controller)
+{
+	int16_t ranges[PS2000A_MAX_CHANNELS];
 
-	while (!g_ready && !_kbhit())
-	{
-		Sleep(0);
-	}
+	return SelectAutoRanges(unit, controller, ranges) && SetAutoRanges(unit, controller, ranges);
+}
 
-	if (g_ready) 
-	{
-		status = ps2000aGetValues(unit->handle, 0, (uint32_t*) &sampleCount, 10, ratioMode, 0, NULL);
-		printf(status?"BlockDataHandler:ps2000aGetValues ------ 0x%08lx \n":"", status);
+#define BLOCK_TASK_ROWS		4096		// Строк блока в одном задании пула обработки
+#define BLOCK_ROW_LENGTH	256			// Наибольшая длина строки block.txt
+#define BLOCK_RING_MAX_SLOTS	8		// Наибольшее число слотов кольца буферов серии блоков
+
+// Прочитанный блок и текстовые файлы, в которые он записывается
+typedef struct tBlockJob
+{
+	UNIT *		unit;
+	int16_t **	buffers;
+	int16_t **	digiBuffer;
+	int64_t *	etsTime;			// NULL - время по timeInterval
+	int32_t		startTime;			// g_times[0] потока сбора (в потоках пула g_times свои)
+	int32_t		timeInterval;
+	int16_t		analogueText;		// Формировать строки block.txt
+	int16_t		digitalText;		// Формировать строки digiblock.txt
+}BLOCK_JOB;
+
+// Задание пула обработки: строки firstRow .. firstRow + nRows - 1 блока в своих буферах
+typedef struct tBlockText
+{
+	BLOCK_JOB *	job;
+	int32_t		firstRow;
+	int32_t		nRows;
+	char *		analogue;
+	int32_t		analogueLength;
+	char *		digital;
+	int32_t		digitalLength;
+}BLOCK_TEXT;
+
+/****************************************************************************
+* BlockTextTask
+* задание пула обработки: форматирует строки блока для block.txt и digiblock.txt
+* (буферы записываются в файлы по порядку после завершения всех заданий блока)
+****************************************************************************/
+void BlockTextTask(void * argument)
+{
+	BLOCK_TEXT * text = (BLOCK_TEXT *) argument;
+	BLOCK_JOB * job = text->job;
+	UNIT * unit = job->unit;
+	uint16_t bit;
+	uint16_t digiValue;
+	int32_t i, j;
+	int32_t length;
+	char * row;
 
-		/* Распечатайте первые 10 показаний, при необходимости преобразовав их в мВ */
-		printf("%s\n",text);
+	text->analogueLength = 0;
+	text->digitalLength = 0;
 
-		if (mode == ANALOGUE || mode == MIXED)		// если мы делаем аналоговую или СМЕШАННУЮ музыку
+	if (job->analogueText && (text->analogue = (char *) malloc(text->nRows * BLOCK_ROW_LENGTH)) != NULL)
+	{
+		for (i = text->firstRow; i < text->firstRow + text->nRows; i++)
 		{
-			printf("Channels are in (%s)\n\n", ( scaleVoltages ) ? ("mV") : ("ADC Counts"));
+			row = text->analogue + text->analogueLength;
+
+			if (job->etsTime != NULL)
+			{
+				length = sprintf_s(row, BLOCK_ROW_LENGTH, "%lld ", job->etsTime[i]);
+			}
+			else
+			{
+				length = sprintf_s(row, BLOCK_ROW_LENGTH, "%7d ", job->startTime + (int32_t)(i * job->timeInterval));
+			}
 
 			for (j = 0; j < unit->channelCount; j++) 
 			{
 				if (unit->channelSettings[j].enabled) 
 				{
-					printf("Channel%c:\t", 'A' + j);
+					length += sprintf_s(	row + length, BLOCK_ROW_LENGTH - length,
+						"Ch%C  %5d = %+5dmV, %5d = %+5dmV   ",
+						(char)('A' + j),
+						job->buffers[j * 2][i],
+						adc_to_mv(job->buffers[j * 2][i], PS2000A_CHANNEL_A + j, unit),
+						job->buffers[j * 2 + 1][i],
+						adc_to_mv(job->buffers[j * 2 + 1][i], PS2000A_CHANNEL_A + j, unit));
 				}
 			}
 
-			printf("\n");
-		}
-
-		if (mode == DIGITAL || mode == MIXED)	// если мы работаем в цифровом или СМЕШАННОМ формате
-		{
-			printf("Digital\n");
+			row[length++] = '\n';
+			text->analogueLength += length;
 		}
+	}
 
-		printf("\n");
+	// D15 - D8, затем D7 - D0: по 16 значений "0 " или "1 " в строке
+	if (job->digitalText && (text->digital = (char *) malloc(text->nRows * 33)) != NULL)
+	{
+		row = text->digital;
 
-		for (i = offset; i < offset+10; i++) 
+		for (i = text->firstRow; i < text->firstRow + text->nRows; i++)
 		{
-			if (mode == ANALOGUE || mode == MIXED)	// если мы делаем аналоговую или СМЕШАННУЮ музыку
-			{
-				for (j = 0; j < unit->channelCount; j++) 
-				{
-					if (unit->channelSettings[j].enabled) 
-					{
-						printf("  %6d        ", scaleVoltages ? 
-							adc_to_mv(buffers[j * 2][i], unit->channelSettings[PS2000A_CHANNEL_A + j].range, unit)	// // Если требуется масштабировать напряжения, выведите значение mV
-							: buffers[j * 2][i]);																	// в противном случае выведите количество АЦП
-					}
-				}
-			}
+			digiValue = 0x00ff & job->digiBuffer[1][i];
+			digiValue <<= 8;
+			digiValue |= job->digiBuffer[0][i];
 
-			if (mode == DIGITAL || mode == MIXED)	// если мы работаем в цифровом или СМЕШАННОМ формате
+			for (bit = 0; bit < 16; bit++)
 			{
-				digiValue = 0x00ff & digiBuffer[1][i];
-				digiValue <<= 8;
-				digiValue |= digiBuffer[0][i];
-				printf("0x%04X", digiValue);
+				*row++ = (0x8000 >> bit) & digiValue ? '1' : '0';
+				*row++ = ' ';
 			}
-			printf("\n");
+
+			*row++ = '\n';
 		}
 
-		if (mode == ANALOGUE || mode == MIXED)		// если мы делаем аналоговую или СМЕШАННУЮ музыку
-		{
-			sampleCount = min(sampleCount, BUFFER_SIZE);
+		text->digitalLength = (int32_t) (row - text->digital);
+	}
+}
 
-			fopen_s(&fp, BlockFile, "w");
-			
-			if (fp != NULL)
-			{
-				if (etsModeSet)
-				{
-					fprintf(fp, "ETS Block Data log\n\n");
-				}
-				else
-				{
-					fprintf(fp, "Block Data log\n\n");
-				}
-
-				fprintf(fp, "Results shown for each of the %d Channels are......\n",unit->channelCount);
-				fprintf(fp, "Maximum Aggregated value ADC Count & mV, Minimum Aggregated value ADC Count & mV\n\n");
-
-				if (etsModeSet)
-				{
-					fprintf(fp, "Time (fs) ");
-				}
-				else
-				{
-					fprintf(fp, "Time (ns)  ");
-				}
-
-				for (i = 0; i < unit->channelCount; i++) 
-				{
-					fprintf(fp," Ch   Max ADC  Max mV   Min ADC  Min mV  ");
-				}
-
-				fprintf(fp, "\n");
-
-				for (i = 0; i < sampleCount; i++) 
-				{
-					if (mode == ANALOGUE && etsModeSet == TRUE)
-					{
-						fprintf(fp, "%d ", etsTime[i]);
-					}
-					else
-					{
-						fprintf(fp, "%7d ", g_times[0] + (int32_t)(i * timeInterval));
-					}
-
-					for (j = 0; j < unit->channelCount; j++) 
-					{
-						if (unit->channelSettings[j].enabled) 
-						{
-							fprintf(	fp,
-								"Ch%C  %5d = %+5dmV, %5d = %+5dmV   ",
-								(char)('A' + j),
-								buffers[j * 2][i],
-								adc_to_mv(buffers[j * 2][i], unit->channelSettings[PS2000A_CHANNEL_A + j].range, unit),
-								buffers[j * 2 + 1][i],
-								adc_to_mv(buffers[j * 2 + 1][i], unit->channelSettings[PS2000A_CHANNEL_A + j].range, unit));
-						}
-					}
-					fprintf(fp, "\n");
-				}
-			}
-			else
-			{
-				printf(	"Cannot open the file block.txt for writing.\n"
-					"Please ensure that you have permission to access.\n");
-			}
-		}
-
-		if (mode == DIGITAL || mode == MIXED)
-		{
-			fopen_s(&digiFp, DigiBlockFile, "w");
-
-			if (digiFp != NULL)
-			{
-				fprintf(digiFp, "Block Digital Data log.\n");
-				fprintf(digiFp,"Results shown for D15 - D8 and D7 to D0.\n\n");
-
-				for(i = 0; i < sampleCount; i++)
-				{
-					digiValue = 0x00ff & digiBuffer[1][i];	// Замаскируйте значения порта 1, чтобы получить меньшие 8 бит
-					digiValue <<= 8;						// Сдвинуть на 8 бит, чтобы поместить в верхние 8 бит 16-битного слова
-					digiValue |= digiBuffer[0][i];			// Замаскируйте значения порта 0, чтобы получить меньшие 8 бит
-
-					for (bit = 0; bit < 16; bit++)
-					{
-						// Значение сдвига (32768 - двоичное значение 1000 0000 0000 0000 0000) И значение, позволяющее получить 1 или 0 для канала
-                        // Порядок будет от D15 до D8, затем от D7 до D0
-
-						bitValue = (0x8000 >> bit) & digiValue? 1 : 0;
-						fprintf(digiFp, "%u ", bitValue);
-					}
-
-					fprintf(digiFp, "\n");
-				}
-			}
-			else
-			{
-				printf(	"Cannot open the file digiblock.txt for writing.\n"
-					"Please ensure that you have permission to access.\n");
-			}
-		}
-
-	} 
-	else 
-	{
-		printf("data collection aborted\n");
-		_getch();
-	}
-
-	status = ps2000aStop(unit->handle);
-	printf(status?"BlockDataHandler:ps2000aStop ------ 0x%08lx \n":"", status);
-
-	if (fp != NULL)
-	{
-		fclose(fp);
-	}
+// Слот кольца буферов серии блоков: драйвер возвращает в него блок, пул формирует строки,
+// а WriteBlock записывает их до того, как слот получит следующий блок
+typedef struct tBlockSlot
+{
+	int16_t *				buffers[PS2000A_MAX_CHANNEL_BUFFERS];
+	int16_t *				digiBuffer[PS2000A_MAX_DIGITAL_PORTS];
+	int32_t					block;			// Номер блока в слоте, -1 - слот записан
+	uint32_t				nValues;
+	int16_t					overflow;
+	int64_t					hostTime;		// Время ПК (нс) готовности блока
+	BLOCK_JOB				job;
+	BLOCK_TEXT *			texts;
+	WORK_GROUP				group;
+}BLOCK_SLOT;
+
+// Файлы, в которые блоки записываются по порядку номеров
+typedef struct tBlockOutput
+{
+	MODE			mode;
+	int16_t			series;			// Собирается серия блоков - разделять их в файлах
+	int32_t			sampleCount;
+	int32_t			nTexts;			// Заданий пула на блок
+	FILE *			fp;
+	FILE *			digiFp;
+	CAPTURE_FILE	capture;
+	int16_t			captureOpen;
+}BLOCK_OUTPUT;
 
-	if (digiFp != NULL)
-	{
-		fclose(digiFp);
-	}
+/****************************************************************************
+* SetBlockBuffers
+* регистрирует в драйвере буферы слота, в которые будет возвращён следующий блок
+****************************************************************************/
+void SetBlockBuffers(UNIT * unit, MODE mode, BLOCK_SLOT * slot, int32_t sampleCount, PS2000A_RATIO_MODE ratioMode)
+{
+	PICO_STATUS status;
+	int32_t i;
 
-	if (mode == ANALOGUE || mode == MIXED)		// Только в том случае, если мы выделим эти буферы
+	if (mode == ANALOGUE || mode == MIXED)
 	{
 		for (i = 0; i < unit->channelCount; i++) 
 		{
 			if (unit->channelSettings[i].enabled)
 			{
-				free(buffers[i * 2]);
-				free(buffers[i * 2 + 1]);
+				status = ps2000aSetDataBuffers(unit->handle, (int32_t) i, slot->buffers[i * 2], slot->buffers[i * 2 + 1], sampleCount, 0, ratioMode);
+				printf(status?"BlockDataHandler:ps2000aSetDataBuffers(channel %d) ------ 0x%08lx \n":"", i, status);
 			}
 		}
 	}
 
-	if (mode == ANALOGUE && etsModeSet == TRUE)	// Только в том случае, если мы выделим эти буферы
-	{
-		free(etsTime);
-	}
-
-	if (mode == DIGITAL || mode == MIXED)		// Только в том случае, если мы выделим эти буферы
+	if (mode == DIGITAL || mode == MIXED)
 	{
 		for (i = 0; i < unit->digitalPorts; i++) 
 		{
-			free(digiBuffer[i]);
+			status = ps2000aSetDataBuffer(unit->handle, (int32_t) (i + PS2000A_DIGITAL_PORT0), slot->digiBuffer[i], sampleCount, 0, ratioMode);
+			printf(status?"BlockDataHandler:ps2000aSetDataBuffer(port 0x%X) ------ 0x%08lx \n":"", i + PS2000A_DIGITAL_PORT0, status);
 		}
 	}
-
-	ClearDataBuffers(unit);
 }
 
 /****************************************************************************
-* StreamDataHandler
-* - Используется в двух примерах потоковых данных - запущенный и триггерный
-* Входные данные:
-* - unit - модуль для выборки
-* - предварительный триггер - количество выборок в фазе предварительного запуска
-* (0, если триггер не был установлен)
-***************************************************************************/
-void StreamDataHandler(UNIT * unit, uint32_t preTrigger, MODE mode)
+* ArmBlock
+* запускает сбор следующего блока; при overlapped драйвер сам передаст блок
+* в зарегистрированные буферы слота по его завершении (ps2000aGetValuesOverlapped)
+****************************************************************************/
+PICO_STATUS ArmBlock(UNIT * unit, SESSION * session, BLOCK_SLOT * slot, int32_t sampleCount, PS2000A_RATIO_MODE ratioMode, int16_t overlapped)
 {
-	int8_t * timeUnitsStr;
-	
-	int16_t  autostop;
-	uint16_t portValue, portValueOR, portValueAND;
-	uint32_t segmentIndex = 0;
-
-	int16_t * buffers[PS2000A_MAX_CHANNEL_BUFFERS];
-	int16_t * appBuffers[PS2000A_MAX_CHANNEL_BUFFERS];
-	int16_t * digiBuffers[PS2000A_MAX_DIGITAL_PORTS];
-	int16_t * appDigiBuffers[PS2000A_MAX_DIGITAL_PORTS];
-	
-	int32_t index = 0;
-	int32_t totalSamples;
-	int32_t bit;
-	int32_t i, j;
-
-	int32_t sampleCount = 40000; /*убедитесь, что буфер достаточно велик */
-	uint32_t postTrigger;
-	uint32_t downsampleRatio = 1;
-	uint32_t sampleInterval;
-	uint32_t triggeredAt = 0;
-
-	clock_t timer_start = clock();
-	clock_t timer_now=0;
-	double elapsed=0;
-
-	BUFFER_INFO bufferInfo;
-	FILE * fp = NULL;
-
 	PICO_STATUS status;
-	PS2000A_TIME_UNITS timeUnits;
-	PS2000A_RATIO_MODE ratioMode;
+	int32_t timeIndisposed;
 
-	if (mode == ANALOGUE)		// Аналог
+	if (overlapped)
 	{
-		for (i = 0; i < unit->channelCount; i++) 
-		{
-			if (unit->channelSettings[i].enabled)
-			{
-				buffers[i * 2] = (int16_t*) malloc(sampleCount * sizeof(int16_t));
-				buffers[i * 2 + 1] = (int16_t*) malloc(sampleCount * sizeof(int16_t));
-				status = ps2000aSetDataBuffers(unit->handle, (int32_t)i, buffers[i * 2], buffers[i * 2 + 1], sampleCount, segmentIndex, PS2000A_RATIO_MODE_AGGREGATE);
-
-				appBuffers[i * 2] = (int16_t*) malloc(sampleCount * sizeof(int16_t));
-				appBuffers[i * 2 + 1] = (int16_t*) malloc(sampleCount * sizeof(int16_t));
-
-				printf(status?"StreamDataHandler:ps2000aSetDataBuffers(channel %ld) ------ 0x%08lx \n":"", i, status);
-			}
-		}
-
-		downsampleRatio = 20;
-		timeUnits = PS2000A_US;
-		sampleInterval = 1;
-		ratioMode = PS2000A_RATIO_MODE_AGGREGATE;
-		postTrigger = 1000000;
-		autostop = TRUE;
+		slot->nValues = (uint32_t) sampleCount;
+		status = ps2000aGetValuesOverlapped(unit->handle, 0, &slot->nValues, 1, ratioMode, 0, &slot->overflow);
+		printf(status?"BlockDataHandler:ps2000aGetValuesOverlapped ------ 0x%08lx \n":"", status);
 	}
 
-	bufferInfo.unit = unit;
-	bufferInfo.mode = mode;	
-	bufferInfo.driverBuffers = buffers;
-	bufferInfo.appBuffers = appBuffers;
-	bufferInfo.driverDigBuffers = digiBuffers;
-	bufferInfo.appDigBuffers = appDigiBuffers;
-
-	if (mode == AGGREGATED)		// (Только для MSO) АГРЕГИРОВАННЫЙ
-	{
-		for (i= 0; i < unit->digitalPorts; i++) 
-		{
+	session->ready.store(FALSE, std::memory_order_relaxed);
+	status = ps2000aRunBlock(unit->handle, 0, sampleCount, session->timebase, session->oversample, &timeIndisposed, 0, CallBackBlock, session);
+	printf(status?"BlockDataHandler:ps2000aRunBlock ------ 0x%08lx \n":"", status);
 
-			digiBuffers[i * 2] = (int16_t*) malloc(sampleCount * sizeof(int16_t));
-			digiBuffers[i * 2 + 1] = (int16_t*) malloc(sampleCount * sizeof(int16_t));
-			status = ps2000aSetDataBuffers(unit->handle, (PS2000A_CHANNEL) (i + PS2000A_DIGITAL_PORT0), digiBuffers[i * 2], digiBuffers[i * 2 + 1], sampleCount, 0, PS2000A_RATIO_MODE_AGGREGATE);
+	return status;
+}
 
-			appDigiBuffers[i * 2] = (int16_t*) malloc(sampleCount * sizeof(int16_t));
-			appDigiBuffers[i * 2 + 1] = (int16_t*) malloc(sampleCount * sizeof(int16_t)); 
+/****************************************************************************
+* SubmitBlock
+* ставит формирование строк блока в слоте в очередь пула обработки
+* (без пула - формирует их сразу)
+****************************************************************************/
+void SubmitBlock(BLOCK_OUTPUT * output, WORKER_POOL * pool, BLOCK_SLOT * slot)
+{
+	int32_t i;
 
-			printf(status?"StreamDataHandler:ps2000aSetDataBuffer(channel %ld) ------ 0x%08lx \n":"", i, status);
-		}
+	slot->job.startTime = g_times[0];
+	slot->job.analogueText = output->fp != NULL;
+	slot->job.digitalText = output->digiFp != NULL;
 
-		downsampleRatio = 10;
-		timeUnits = PS2000A_MS;
-		sampleInterval = 10;
-		ratioMode = PS2000A_RATIO_MODE_AGGREGATE;
-		postTrigger = 10;
-		autostop = FALSE;
-	}
+	WorkGroupInit(&slot->group);
 
-	if (mode == DIGITAL)		// (Только для MSO) Цифровой
+	if ((output->fp == NULL && output->digiFp == NULL) || slot->texts == NULL)
 	{
-		for (i= 0; i < unit->digitalPorts; i++) 
-		{
-			digiBuffers[i] = (int16_t*) malloc(sampleCount* sizeof(int16_t));
-			status = ps2000aSetDataBuffer(unit->handle, (PS2000A_CHANNEL) (i + PS2000A_DIGITAL_PORT0), digiBuffers[i], sampleCount, 0, PS2000A_RATIO_MODE_NONE);
-
-			appDigiBuffers[i] = (int16_t*) malloc(sampleCount * sizeof(int16_t));
-
-			printf(status?"StreamDataHandler:ps2000aSetDataBuffer(channel %ld) ------ 0x%08lx \n":"", i, status);
-		}
-
-		downsampleRatio = 1;
-		timeUnits = PS2000A_MS;
-		sampleInterval = 10;
-		ratioMode = PS2000A_RATIO_MODE_NONE;
-		postTrigger = 10;
-		autostop = FALSE;
+		return;
 	}
 
-	if (autostop)
+	for (i = 0; i < output->nTexts && i * BLOCK_TASK_ROWS < (int32_t) slot->nValues; i++)
 	{
-		printf("\nStreaming Data for %lu samples", postTrigger / downsampleRatio);
+		slot->texts[i].job = &slot->job;
+		slot->texts[i].firstRow = i * BLOCK_TASK_ROWS;
+		slot->texts[i].nRows = min(BLOCK_TASK_ROWS, (int32_t) slot->nValues - slot->texts[i].firstRow);
+		slot->texts[i].analogue = NULL;
+		slot->texts[i].digital = NULL;
 
-		if (preTrigger)	// мы передаем 0 для предварительного запуска, если мы не настраиваем триггер
+		if (pool != NULL)
 		{
-			printf(" after the trigger occurs\nNote: %lu Pre Trigger samples before Trigger arms\n\n",preTrigger / downsampleRatio);
+			WorkerPoolSubmit(pool, &slot->group, BlockTextTask, &slot->texts[i]);
 		}
 		else
 		{
-			printf("\n\n");
+			BlockTextTask(&slot->texts[i]);
 		}
 	}
-	else
-	{
-		printf("\nStreaming Data continually\n\n");
-	}
-
-	g_autoStopped = FALSE;
+}
 
-	status = ps2000aRunStreaming(unit->handle, &sampleInterval, timeUnits, preTrigger, postTrigger - preTrigger, 
-				autostop, downsampleRatio, ratioMode, (uint32_t) sampleCount);
+/****************************************************************************
+* WriteBlock
+* дожидается обработки блока в слоте и записывает его в файлы; слот освобождается
+****************************************************************************/
+void WriteBlock(BLOCK_OUTPUT * output, WORKER_POOL * pool, BLOCK_SLOT * slot)
+{
+	UNIT * unit = slot->job.unit;
+	uint64_t firstSample;
+	uint16_t * digiWords;
+	int32_t i, j;
 
-	if (status == PICO_OK)
-	{	
-		timeUnitsStr = timeUnitsToString(timeUnits);
-		printf("Streaming data... (interval: %d %s) Press a key to stop\n", sampleInterval, timeUnitsStr);
+	if (slot->block < 0)
+	{
+		return;
 	}
-	else
+
+	if (pool != NULL)
 	{
-		printf("StreamDataHandler:ps2000aRunStreaming ------ 0x%08lx \n", status);
+		WorkerPoolWait(pool, &slot->group);
 	}
 
-	if (mode == ANALOGUE)
+	// Блоки серии следуют в файле захвата друг за другом, время каждого - во фрагменте CAPTURE_CHUNK_TIMESTAMP
+	if (output->captureOpen)
 	{
-		fopen_s(&fp, StreamFile, "w");
+		firstSample = (uint64_t) slot->block * output->sampleCount;
 
-		if (fp != NULL)
+		if (output->series)
 		{
-			/*fprintf(fp, "For each of the %d Channels, results shown are....\n", unit->channelCount);
-			fprintf(fp,"Maximum Aggregated value ADC Count & mV, Minimum Aggregated value ADC Count & mV\n\n");*/
+			CaptureWriteChunk(&output->capture, CAPTURE_CHUNK_TIMESTAMP, 0, firstSample, &slot->hostTime, slot->nValues, sizeof(slot->hostTime));
+		}
 
-			for (i = 0; i < unit->channelCount; i++) 
+		if (output->mode == ANALOGUE || output->mode == MIXED)
+		{
+			for (j = 0; j < unit->channelCount; j++) 
 			{
-				if (unit->channelSettings[i].enabled) 
+				if (unit->channelSettings[j].enabled) 
 				{
-					fprintf(fp,"Max ADC   Max mV   Min ADC   Min mV");
+					CaptureWriteChunk(&output->capture, CAPTURE_CHUNK_ANALOGUE, (int16_t) (j * 2), firstSample, slot->buffers[j * 2], slot->nValues, slot->nValues * sizeof(int16_t));
 				}
 			}
+		}
 
-			fprintf(fp, "\n");
+		if (output->mode == DIGITAL || output->mode == MIXED)		// Порты упаковываются в одно 16-разрядное слово на отсчёт
+		{
+			if ((digiWords = (uint16_t *) malloc(slot->nValues * sizeof(uint16_t))) == NULL)
+			{
+				printf("WriteBlock: out of memory, digital chunk of block %d skipped\n", slot->block + 1);
+			}
+			else
+			{
+				DigitalPackPorts(slot->digiBuffer[0], slot->digiBuffer[1], digiWords, slot->nValues);
+				CaptureWriteChunk(&output->capture, CAPTURE_CHUNK_DIGITAL, 0, firstSample, digiWords, slot->nValues, slot->nValues * sizeof(uint16_t));
+				free(digiWords);
+			}
 		}
 	}
 
-	totalSamples = 0;
-
-	// Захватывать данные, если не нажата клавиша или не установлен флаг g_auto Stopped при обратном вызове потоковой передачи
-	while (/*!_kbhit() && */ !g_autoStopped)
+	if ((output->fp != NULL || output->digiFp != NULL) && slot->texts != NULL)
 	{
-		timer_now = clock();
-		double elapsed = (double)(timer_now - timer_start) / CLOCKS_PER_SEC;  // Прошедшее время в секундах
-		if (elapsed >= 3) g_autoStopped = TRUE;
-		/* Опрос до тех пор, пока не будут получены данные. До тех пор функфция получения последних значений потоковой передачи не вызовет обратный вызов */
-		g_ready = FALSE;
+		if (output->series)
+		{
+			if (output->fp != NULL)
+			{
+				fprintf(output->fp, "Block %d\n", slot->block + 1);
+			}
 
-		status = ps2000aGetStreamingLatestValues(unit->handle, CallBackStreaming, &bufferInfo);
-		index ++;
+			if (output->digiFp != NULL)
+			{
+				fprintf(output->digiFp, "Block %d\n", slot->block + 1);
+			}
+		}
 
-		if (g_ready && g_sampleCount > 0) /* может быть готово и не содержать данных, если сработала автостопировка */
+		for (i = 0; i < output->nTexts && i * BLOCK_TASK_ROWS < (int32_t) slot->nValues; i++)
 		{
-			if (g_trig)
+			if ((slot->job.analogueText && slot->texts[i].analogue == NULL) || (slot->job.digitalText && slot->texts[i].digital == NULL))
 			{
-				triggeredAt = totalSamples + g_trigAt;		// вычислить, где произошел срабатывание триггера в общем количестве собранных образцов
+				printf("BlockDataHandler: not enough memory for rows %d - %d\n", slot->texts[i].firstRow, slot->texts[i].firstRow + slot->texts[i].nRows - 1);
 			}
 
-			totalSamples += g_sampleCount;
-			printf("\nCollected %3li samples, index = %5lu, Total: %6d samples ", g_sampleCount, g_startIndex, totalSamples);
-
-			if (g_trig)
+			if (slot->texts[i].analogue != NULL)
 			{
-				printf("Trig. at index %lu", triggeredAt);	// показать, где произошел срабатывание
+				fwrite(slot->texts[i].analogue, slot->texts[i].analogueLength, 1, output->fp);
 			}
 
-			for (i = g_startIndex; i < (int32_t)(g_startIndex + g_sampleCount); i++) 
+			if (slot->texts[i].digital != NULL)
 			{
-				if (mode == ANALOGUE)
-				{
-					if (fp != NULL)
-					{
-						for (j = 0; j < unit->channelCount; j++) 
-						{
-							if (unit->channelSettings[j].enabled) 
-							{
-								fprintf(	fp,
-									"%d, %d, %d, %d, ",
-									appBuffers[j * 2][i],
-									adc_to_mv(appBuffers[j * 2][i], unit->channelSettings[PS2000A_CHANNEL_A + j].range, unit),
-									appBuffers[j * 2 + 1][i],
-									adc_to_mv(appBuffers[j * 2 + 1][i], unit->channelSettings[PS2000A_CHANNEL_A + j].range, unit));
-							}
-						}
+				fwrite(slot->texts[i].digital, slot->texts[i].digitalLength, 1, output->digiFp);
+			}
 
-						fprintf(fp, "\n");
-					}
-					else
-					{
-						printf("Cannot open the file stream.txt for writing.\n");
-					}
+			free(slot->texts[i].analogue);
+			free(slot->texts[i].digital);
+			slot->texts[i].analogue = NULL;
+			slot->texts[i].digital = NULL;
+		}
+	}
 
-				}
+	slot->block = -1;
+}
 
-				if (mode == DIGITAL)
-				{
-					portValue = 0x00ff & appDigiBuffers[1][i];	// Замаскируйте значения порта 1, чтобы получить меньшие 8 бит
-					portValue <<= 8;							// Сдвинуть на 8 бит, чтобы поместить в верхние 8 бит 16-битного слова
-					portValue |= 0x00ff & appDigiBuffers[0][i];	// Замаскируйте значения порта 0, чтобы получить меньшие 8 бит
+/****************************************************************************
+* BlockDataHandler
+* - Используется всеми процедурами обработки данных блока
+* - собирает данные (пользователь устанавливает режим запуска перед вызовом), отображает 10 элементов
+* и сохраняет все в data.txt
+* - при blockCount > 1 собирает серию блоков: следующий блок запускается сразу после
+* чтения предыдущего, а строки файлов формируются пулом потоков (blockWorkers),
+* пока устройство ждёт запуска
+* - при blockPipeline блоки серии возвращаются в кольцо из blockRingSlots буферов
+* (ps2000aGetValuesOverlapped вместе с запуском следующего блока), и чтение блока
+* не ждёт записи предыдущих
+* Input :
+* - единица измерения: используемая единица измерения.
+* - текст: текст, отображаемый перед отображением фрагмента данных
+* - смещение: смещение в буфер данных для начала отображения фрагмента.
+****************************************************************************/
+void BlockDataHandler(UNIT * unit, const char * text, int32_t offset, MODE mode, int16_t etsModeSet)
+{
+	uint16_t digiValue;
 
-					printf("\nIndex=%04lu: Value = 0x%04X  =  ", i, portValue);
+	int32_t i, j;
+	int32_t timeInterval;
+	int32_t sampleCount = BUFFER_SIZE;
+	int32_t maxSamples;
+	int32_t block;
+	int32_t blocks;
+	int16_t nSlots;
+	int16_t ranging;
+	int16_t pipelined;
 
-					for (bit = 0; bit < 16; bit++)
-					{
-						// Значение сдвига (32768 - двоичное значение 1000 0000 0000 0000 0000) И значение, позволяющее получить 1 или 0 для канала
-                        // Порядок будет от D15 до D8, затем от D7 до D0
-						printf( (0x8000 >> bit) & portValue? "1 " : "0 ");
-					}
-				}
+	int64_t * etsTime=0; // Буфер для данных о времени ETS
 
-				if (mode == AGGREGATED)
-				{
-					portValueOR = 0x00ff & appDigiBuffers[2][i];
-					portValueOR <<= 8;
-					portValueOR |= 0x00ff & appDigiBuffers[0][i];
+	CAPTURE_HEADER header;
 
-					portValueAND = 0x00ff & appDigiBuffers[3][i];
-					portValueAND <<= 8;
-					portValueAND |= 0x00ff & appDigiBuffers[1][i];
+	SESSION session;
+	WORKER_POOL * pool = NULL;
+	BLOCK_SLOT slots[BLOCK_RING_MAX_SLOTS];
+	BLOCK_SLOT * slot;
+	BLOCK_OUTPUT output;
+	
+	PICO_STATUS status;
+	PS2000A_RATIO_MODE ratioMode = PS2000A_RATIO_MODE_NONE;
 
-					printf("\nIndex=%04lu: Bitwise  OR of last %ld readings = 0x%04X ",i,  downsampleRatio, portValueOR);
-					printf("\nIndex=%04lu: Bitwise AND of last %ld readings = 0x%04X ",i,  downsampleRatio, portValueAND);
-				}
-			}
-		}
-	}
+	SessionInit(&session, unit, NULL);
 
-	ps2000aStop(unit->handle);
+	// Блок ETS складывается драйвером из многих запусков, поэтому в режиме ETS серии нет
+	blocks = etsModeSet || blockCount < 1 ? 1 : blockCount;
 
-	if (!g_autoStopped) 
-	{
-		printf("\nData collection aborted.\n");
-		_getch();
-	}
+	// Автоматически выбранный диапазон меняет пересчёт в мВ, поэтому тогда следующий блок
+	// запускается только после обработки предыдущего
+	ranging = autoRanging && (mode == ANALOGUE || mode == MIXED) && !etsModeSet;
 
-	if (g_overflow)
-	{
-		printf("Overflow on voltage range.\n");
-	}
+	pipelined = blockPipeline && blocks > 1 && !ranging;
+	nSlots = !pipelined ? 1 : blockRingSlots < 2 ? 2 : blockRingSlots > BLOCK_RING_MAX_SLOTS ? BLOCK_RING_MAX_SLOTS : blockRingSlots;
 
-	if (fp != NULL) 
-	{
-		fclose(fp);	
-	}
+	output.mode = mode;
+	output.series = blocks > 1;
+	output.sampleCount = sampleCount;
+	output.nTexts = (sampleCount + BLOCK_TASK_ROWS - 1) / BLOCK_TASK_ROWS;
+	output.fp = NULL;
+	output.digiFp = NULL;
+	output.captureOpen = FALSE;
 
-	if (mode == ANALOGUE)		// Только в том случае, если мы выделим эти буферы
+	for (i = 0; i < nSlots; i++)
 	{
-		for (i = 0; i < unit->channelCount; i++) 
+		slot = &slots[i];
+		slot->block = -1;
+		slot->texts = (BLOCK_TEXT *) calloc(output.nTexts, sizeof(BLOCK_TEXT));
+		slot->job.unit = unit;
+		slot->job.buffers = slot->buffers;
+		slot->job.digiBuffer = slot->digiBuffer;
+		slot->job.etsTime = NULL;
+		WorkGroupInit(&slot->group);
+
+		if (mode == ANALOGUE || mode == MIXED)		// Аналоговый или (только для MSO) СМЕШАННЫЙ
 		{
-			if (unit->channelSettings[i].enabled)
+			for (j = 0; j < unit->channelCount; j++) 
 			{
-				free(buffers[i * 2]);
-				free(buffers[i * 2 + 1]);
-
-				free(appBuffers[i * 2]);
-				free(appBuffers[i * 2 + 1]);
+				if (unit->channelSettings[j].enabled)
+				{
+					slot->buffers[j * 2] = (int16_t*) BufferAlloc(sampleCount * sizeof(int16_t), bufferAllocFlags);
+					slot->buffers[j * 2 + 1] = (int16_t*) BufferAlloc(sampleCount * sizeof(int16_t), bufferAllocFlags);
+				}
 			}
 		}
-	}
 
-	if (mode == DIGITAL) 		// Только если мы выделим эти буферы
-	{
-		for (i = 0; i < unit->digitalPorts; i++) 
+		if (mode == DIGITAL || mode == MIXED)		// (Только для MSO) Цифровой или СМЕШАННЫЙ
 		{
-			free(digiBuffers[i]);
-			free(appDigiBuffers[i]);
+			for (j = 0; j < unit->digitalPorts; j++) 
+			{
+				slot->digiBuffer[j] = (int16_t*) BufferAlloc(sampleCount* sizeof(int16_t), bufferAllocFlags);
+			}
 		}
-
 	}
 
-	if (mode == AGGREGATED) 		// Только в том случае, если мы выделим эти буферы
+	SetBlockBuffers(unit, mode, &slots[0], sampleCount, ratioMode);
+
+	// Настройте временные буферы, если данные записываются в режиме блокировки ETS (только при включенных аналоговых каналах).
+	if (mode == ANALOGUE && etsModeSet == TRUE)
 	{
-		for (i = 0; i < unit->digitalPorts * 2; i++) 
-		{
-			free(digiBuffers[i]);
-			free(appDigiBuffers[i]);
-		}
+		etsTime = (int64_t *) calloc(sampleCount, sizeof (int64_t));   
+		status = ps2000aSetEtsTimeBuffer(unit->handle, etsTime, sampleCount);
+		slots[0].job.etsTime = etsTime;
 	}
 
-	ClearDataBuffers(unit);
-}
-
-
-/****************************************************************************
-* SetTrigger
-*
-* Параметры
-* - *unit - указатель на структуру UNIT
-* - *Свойства канала - указатель на структуру PS2000A_TRIGGER_CHANNEL_PROPERTIES
-* - nChannelProperties - количество элементов PS2000A_TRIGGER_CHANNEL_PROPERTIES в channelProperties
-* - *triggerConditions - указатель на структуру PS2000A_TRIGGER_CONDITIONS
-* - nTriggerConditions - количество элементов PS2000A_TRIGGER_CONDITIONS в triggerConditions
-* - *directions - указатель на структуру TRIGGER_DIRECTIONS
-* - *pwq - указатель на структуру pwq (определитель длительности импульса)
-* - delay - время задержки между запуском и первой выборкой
-* - Функция auxoutputable - Не используется
-* - Автозапуск - период ожидания, если запуск не происходит
-* - *digitalDirections - указатель на структуру PS2000A_DIGITAL_CHANNEL_DIRECTIONS
-* - nDigitalDirections - количество элементов PS2000A_DIGITAL_CHANNEL_DIRECTIONS в digitalDirections
-*
-* Возвращает - PICO_STATUS - для отображения успешного выполнения или в случае возникновения ошибки.
-*
-***************************************************************************/
-PICO_STATUS SetTrigger(	UNIT * unit,
-	PS2000A_TRIGGER_CHANNEL_PROPERTIES * channelProperties,
-	int16_t nChannelProperties,
-	PS2000A_TRIGGER_CONDITIONS * triggerConditions,
-	int16_t nTriggerConditions,
-	TRIGGER_DIRECTIONS * directions,
-	PWQ * pwq,
-	uint32_t delay,
-	int16_t auxOutputEnabled,
-	int32_t autoTriggerMs,
-	PS2000A_DIGITAL_CHANNEL_DIRECTIONS * digitalDirections,
-	int16_t nDigitalDirections)
-{
-	PICO_STATUS status;
-
-	if ((status = ps2000aSetTriggerChannelProperties(unit->handle,
-		channelProperties,
-		nChannelProperties,
-		auxOutputEnabled,
-		autoTriggerMs)) != PICO_OK) 
+	/*  Проверьте текущий базовый временной индекс и найдите максимальное количество выборок и временной интервал (в наносекундах).*/
+	while (ps2000aGetTimebase(unit->handle, session.timebase, sampleCount, &timeInterval, session.oversample, &maxSamples, 0) != PICO_OK)
 	{
-		printf("SetTrigger:ps2000aSetTriggerChannelProperties ------ Ox%8lx \n", status);
-		return status;
+		session.timebase++;
 	}
 
-	if ((status = ps2000aSetTriggerChannelConditions(unit->handle,	triggerConditions, nTriggerConditions)) != PICO_OK) 
+	if (!etsModeSet)
 	{
-		printf("SetTrigger:ps2000aSetTriggerChannelConditions ------ 0x%8lx \n", status);
-		return status;
+		printf("\nTimebase: %lu  SampleInterval: %ldnS  oversample: %hd\n", session.timebase, timeInterval, session.oversample);
 	}
 
-	if ((status = ps2000aSetTriggerChannelDirections(unit->handle,
-		directions->channelA,
-		directions->channelB,
-		directions->channelC,
-		directions->channelD,
-		directions->ext,
-		directions->aux)) != PICO_OK) 
+	if (blocks > 1)
 	{
-		printf("SetTrigger:ps2000aSetTriggerChannelDirections ------ 0x%08lx \n", status);
-		return status;
+		printf("Collecting %d blocks%s\n", blocks, pipelined ? " (overlapped retrieval)" : "");
 	}
 
-	if ((status = ps2000aSetTriggerDelay(unit->handle, delay)) != PICO_OK) 
+	for (i = 0; i < nSlots; i++)
 	{
-		printf("SetTrigger:ps2000aSetTriggerDelay ------ 0x%08lx \n", status);
-		return status;
+		slots[i].job.timeInterval = timeInterval;
 	}
 
-	if ((status = ps2000aSetPulseWidthQualifier(unit->handle,
-		pwq->conditions,
-		pwq->nConditions, 
-		pwq->direction,
-		pwq->lower, 
-		pwq->upper, 
-		pwq->type)) != PICO_OK)
+	// Пул создаётся один раз на устройство; строки одиночного блока в одно задание
+	// быстрее сформировать без него
+	if (blocks > 1 || output.nTexts > 1)
 	{
-		printf("SetTrigger:ps2000aSetPulseWidthQualifier ------ 0x%08lx \n", status);
-		return status;
+		if (unit->blockPool == NULL && (unit->blockPool = new (std::nothrow) WORKER_POOL) != NULL &&
+			!WorkerPoolInit(unit->blockPool, blockWorkers))
+		{
+			delete unit->blockPool;
+			unit->blockPool = NULL;
+		}
+
+		pool = unit->blockPool;
 	}
 
-	if (unit->digitalPorts)					// Функция ps2000aSetTriggerDigitalPortProperties применима только к MSO
-{
-		if ((status = ps2000aSetTriggerDigitalPortProperties(unit->handle,
-			digitalDirections, 
-			nDigitalDirections)) != PICO_OK) 
+	/* Запустите его сбор, затем дождитесь завершения*/
+	ArmBlock(unit, &session, &slots[0], sampleCount, ratioMode, pipelined);
+
+	printf("Waiting for trigger...Press a key to abort\n");
+
+	for (block = 0; block < blocks; block++)
+	{
+		slot = &slots[block % nSlots];
+
+		while (!session.ready.load(std::memory_order_acquire) && !_kbhit())
 		{
-			printf("SetTrigger:ps2000aSetTriggerDigitalPortProperties ------ 0x%08lx \n", status);
-			return status;
+			Sleep(0);
 		}
-	}
-	return status;
-}
 
-/****************************************************************************
-* Немедленный сбор блока
-* эта функция демонстрирует, как собирать отдельный блок данных
-* из модуля (начать сбор немедленно)
-****************************************************************************/
-void CollectBlockImmediate(UNIT * unit)
-{
-	PWQ pulseWidth;
-	TRIGGER_DIRECTIONS directions;
+		if (!session.ready.load(std::memory_order_acquire)) 
+		{
+			printf("data collection aborted\n");
+			_getch();
+			break;
+		}
 
-	memset(&directions, 0, sizeof(TRIGGER_DIRECTIONS));
-	memset(&pulseWidth, 0, sizeof(PWQ));
+		// При ps2000aGetValuesOverlapped блок уже в слоте, иначе слот освобождается до чтения в него
+		if (!pipelined)
+		{
+			WriteBlock(&output, pool, slot);
 
-	printf("Collect block immediate\n");
-	printf("Data is written to disk file (%s)\n", BlockFile);
-	printf("Press a key to start...\n");
-	_getch();
+			slot->nValues = (uint32_t) sampleCount;
+			status = ps2000aGetValues(unit->handle, 0, &slot->nValues, 10, ratioMode, 0, &slot->overflow);
+			printf(status?"BlockDataHandler:ps2000aGetValues ------ 0x%08lx \n":"", status);
+		}
 
-	SetDefaults(unit);
+		slot->nValues = min(slot->nValues, (uint32_t) sampleCount);
+		slot->hostTime = session.hostTime;
+		slot->block = block;
 
-	/* Триггер отключен	*/
-	SetTrigger(unit, NULL, 0, NULL, 0, &directions, &pulseWidth, 0, 0, 0, 0, 0);
+		// Отсчёты уже в буферах приложения - устройство ждёт следующего запуска, пока блок обрабатывается
+		if (block + 1 < blocks && !ranging)
+		{
+			if (pipelined)
+			{
+				WriteBlock(&output, pool, &slots[(block + 1) % nSlots]);
+				SetBlockBuffers(unit, mode, &slots[(block + 1) % nSlots], sampleCount, ratioMode);
+			}
 
-	BlockDataHandler(unit, "\nFirst 10 readings:\n", 0, ANALOGUE, FALSE);
-}
+			blocks = ArmBlock(unit, &session, &slots[(block + 1) % nSlots], sampleCount, ratioMode, pipelined) == PICO_OK ? blocks : block + 1;
+		}
 
-/****************************************************************************
-* Собирать блоки данных
-* эта функция демонстрирует, как собирать блок
-данных с использованием эквивалентной временной выборки (ETS).
-****************************************************************************/
-void CollectBlockEts(UNIT * unit)
-{
-	PICO_STATUS status;
-	int32_t		ets_sampletime;
-	int16_t		triggerVoltage = mv_to_adc(1000, unit->channelSettings[PS2000A_CHANNEL_A].range, unit);
-	uint32_t	delay = 0;
-	int16_t		etsModeSet = FALSE;
+		if (block == 0)
+		{
+			/* Распечатайте первые 10 показаний, при необходимости преобразовав их в мВ */
+			printf("%s\n",text);
 
-	struct tPwq pulseWidth;
-	struct tTriggerDirections directions;
+			if (mode == ANALOGUE || mode == MIXED)		// если мы делаем аналоговую или СМЕШАННУЮ музыку
+			{
+				printf("Channels are in (%s)\n\n", ( scaleVoltages ) ? ("mV") : ("ADC Counts"));
 
-	PS2000A_TRIGGER_CHANNEL_PROPERTIES sourceDetails = {	triggerVoltage,
-		256 * 10,
-		triggerVoltage,
-		256 * 10,
-		PS2000A_CHANNEL_A,
-		PS2000A_LEVEL};
+				for (j = 0; j < unit->channelCount; j++) 
+				{
+					if (unit->channelSettings[j].enabled) 
+					{
+						printf("Channel%c:\t", 'A' + j);
+					}
+				}
 
-	PS2000A_TRIGGER_CONDITIONS conditions = {	PS2000A_CONDITION_TRUE,
-		PS2000A_CONDITION_DONT_CARE,
-		PS2000A_CONDITION_DONT_CARE,
-		PS2000A_CONDITION_DONT_CARE,
-		PS2000A_CONDITION_DONT_CARE,
-		PS2000A_CONDITION_DONT_CARE,
-		PS2000A_CONDITION_DONT_CARE,
-		PS2000A_CONDITION_DONT_CARE};
+				printf("\n");
+			}
 
+			if (mode == DIGITAL || mode == MIXED)	// если мы работаем в цифровом или СМЕШАННОМ формате
+			{
+				printf("Digital\n");
+			}
 
-	memset(&pulseWidth, 0, sizeof(struct tPwq));
-	memset(&directions, 0, sizeof(struct tTriggerDirections));
-	directions.channelA = PS2000A_RISING;
+			printf("\n");
 
-	printf("Collect ETS block...\n");
-	printf("Collects when value rises past %d", scaleVoltages? 
-		adc_to_mv(sourceDetails.thresholdUpper,	unit->channelSettings[PS2000A_CHANNEL_A].range, unit)	// Если требуется масштабировать напряжения, выведите значение mV
-		: sourceDetails.thresholdUpper);																	// в противном случае выведите количество АЦП
-	
+			for (i = offset; i < offset+10; i++) 
+			{
+				if (mode == ANALOGUE || mode == MIXED)	// если мы делаем аналоговую или СМЕШАННУЮ музыку
+				{
+					for (j = 0; j < unit->channelCount; j++) 
+					{
+						if (unit->channelSettings[j].enabled) 
+						{
+							printf("  %6d        ", scaleVoltages ? 
+								adc_to_mv(slot->buffers[j * 2][i], PS2000A_CHANNEL_A + j, unit)	// // Если требуется масштабировать напряжения, выведите значение mV
+								: slot->buffers[j * 2][i]);																	// в противном случае выведите количество АЦП
+						}
+					}
+				}
+
+				if (mode == DIGITAL || mode == MIXED)	// если мы работаем в цифровом или СМЕШАННОМ формате
+				{
+					digiValue = 0x00ff & slot->digiBuffer[1][i];
+					digiValue <<= 8;
+					digiValue |= slot->digiBuffer[0][i];
+					printf("0x%04X", digiValue);
+				}
+				printf("\n");
+			}
+
+			if (binaryCapture)
+			{
+				FillCaptureHeader(&session, &header, etsModeSet ? 0.0 : (double) timeInterval, 1, ratioMode);
+
+				if ((output.captureOpen = CaptureCreate(&output.capture, CaptureFile, &header)) != 0)
+				{
+					output.capture.compress = (int16_t) captureCompression;
+				}
+				else
+				{
+					printf(	"Cannot open the file %s for writing.\n"
+						"Please ensure that you have permission to access.\n", CaptureFile);
+				}
+			}
+
+			if ((mode == ANALOGUE || mode == MIXED) && !binaryCapture)		// если мы делаем аналоговую или СМЕШАННУЮ музыку
+			{
+				fopen_s(&output.fp, BlockFile, "w");
+				
+				if (output.fp != NULL)
+				{
+					if (etsModeSet)
+					{
+						fprintf(output.fp, "ETS Block Data log\n\n");
+					}
+					else
+					{
+						fprintf(output.fp, "Block Data log\n\n");
+					}
+
+					fprintf(output.fp, "Results shown for each of the %d Channels are......\n",unit->channelCount);
+					fprintf(output.fp, "Maximum Aggregated value ADC Count & mV, Minimum Aggregated value ADC Count & mV\n\n");
+
+					if (etsModeSet)
+					{
+						fprintf(output.fp, "Time (fs) ");
+					}
+					else
+					{
+						fprintf(output.fp, "Time (ns)  ");
+					}
+
+					for (i = 0; i < unit->channelCount; i++) 
+					{
+						fprintf(output.fp," Ch   Max ADC  Max mV   Min ADC  Min mV  ");
+					}
+
+					fprintf(output.fp, "\n");
+				}
+				else
+				{
+					printf(	"Cannot open the file block.txt for writing.\n"
+						"Please ensure that you have permission to access.\n");
+				}
+			}
+
+			if ((mode == DIGITAL || mode == MIXED) && !binaryCapture)
+			{
+				fopen_s(&output.digiFp, DigiBlockFile, "w");
+
+				if (output.digiFp != NULL)
+				{
+					fprintf(output.digiFp, "Block Digital Data log.\n");
+					fprintf(output.digiFp,"Results shown for D15 - D8 and D7 to D0.\n\n");
+				}
+				else
+				{
+					printf(	"Cannot open the file digiblock.txt for writing.\n"
+						"Please ensure that you have permission to access.\n");
+				}
+			}
+		}
+		else
+		{
+			printf("Block %d of %d\n", block + 1, blocks);
+		}
+
+		// Строки блока формируются пулом частями по BLOCK_TASK_ROWS и записываются по порядку
+		SubmitBlock(&output, pool, slot);
+
+		if (ranging)
+		{
+			WriteBlock(&output, pool, slot);
+
+			// Диапазоны, выбранные по этому блоку, действуют со следующего сбора
+			SyncAutoRange(unit, &autoRange);
+
+			for (j = 0; j < unit->channelCount; j++) 
+			{
+				if (unit->channelSettings[j].enabled) 
+				{
+					AutoRangeObserve(&autoRange, (int16_t) j, slot->buffers[j * 2], slot->nValues);
+				}
+			}
+
+			AutoRangeOverflow(&autoRange, slot->overflow);
+
+			if (ApplyAutoRange(unit, &autoRange))
+			{
+				printf("\n");
+			}
+
+			if (block + 1 < blocks)
+			{
+				blocks = ArmBlock(unit, &session, slot, sampleCount, ratioMode, FALSE) == PICO_OK ? blocks : block + 1;
+			}
+		}
+	}
+
+	status = ps2000aStop(unit->handle);
+	printf(status?"BlockDataHandler:ps2000aStop ------ 0x%08lx \n":"", status);
+
+	// Оставшиеся блоки записываются по порядку: самый старый - в слоте следующего блока
+	for (i = 0; i < nSlots; i++)
+	{
+		WriteBlock(&output, pool, &slots[(block + i) % nSlots]);
+	}
+
+	if (output.captureOpen)
+	{
+		CaptureClose(&output.capture);
+	}
+
+	if (output.fp != NULL)
+	{
+		fclose(output.fp);
+	}
+
+	if (output.digiFp != NULL)
+	{
+		fclose(output.digiFp);
+	}
+
+	for (i = 0; i < nSlots; i++)
+	{
+		if (mode == ANALOGUE || mode == MIXED)		// Только в том случае, если мы выделим эти буферы
+		{
+			for (j = 0; j < unit->channelCount; j++) 
+			{
+				if (unit->channelSettings[j].enabled)
+				{
+					BufferFree(slots[i].buffers[j * 2]);
+					BufferFree(slots[i].buffers[j * 2 + 1]);
+				}
+			}
+		}
+
+		if (mode == DIGITAL || mode == MIXED)		// Только в том случае, если мы выделим эти буферы
+		{
+			for (j = 0; j < unit->digitalPorts; j++) 
+			{
+				BufferFree(slots[i].digiBuffer[j]);
+			}
+		}
+
+		free(slots[i].texts);
+	}
+
+	if (mode == ANALOGUE && etsModeSet == TRUE)	// Только в том случае, если мы выделим эти буферы
+	{
+		free(etsTime);
+	}
+
+	ClearDataBuffers(unit);
+}
+
+/****************************************************************************
+* ProtocolFileSink
+* получатель кадров декодеров протоколов - записывает кадр строкой в ProtocolFile
+****************************************************************************/
+void ProtocolFileSink(void * context, const PROTOCOL_FRAME * frame)
+{
+	FILE * fp = (FILE *) context;
+	const char * frameTypes[] = { "DATA", "ADDR", "START", "STOP" };
+
+	if (fp == NULL)
+	{
+		return;
+	}
+
+	fprintf(fp, "%.0f, %s, %s, 0x%04X, 0x%04X, %s%s%s%s\n",
+		frame->time,
+		ProtocolName(frame->protocol),
+		frameTypes[frame->type],
+		frame->data,
+		frame->data2,
+		frame->flags & PROTOCOL_FLAG_READ ? "R " : "",
+		frame->flags & PROTOCOL_FLAG_NACK ? "NACK " : "",
+		frame->flags & PROTOCOL_FLAG_PARITY_ERROR ? "PARITY " : "",
+		frame->flags & PROTOCOL_FLAG_FRAMING_ERROR ? "FRAMING " : "");
+}
+
+/****************************************************************************
+* DecimationFileSink
+* получатель данных прореживателя - записывает значения в файл выхода
+* в том же формате, что и stream.txt (для режимов без агрегирования
+* максимум и минимум совпадают)
+****************************************************************************/
+void DecimationFileSink(void * context, int16_t output, int16_t ** maxValues, int16_t ** minValues, int32_t nValues, uint64_t firstIndex)
+{
+	DECIMATION_FILE * file = (DECIMATION_FILE *) context;
+	int32_t i, j;
+
+	if (file->fp == NULL)
+	{
+		return;
+	}
+
+	for (i = 0; i < nValues; i++)
+	{
+		for (j = 0; j < file->unit->channelCount; j++)
+		{
+			if (maxValues[j] != NULL)
+			{
+				fprintf(	file->fp,
+					"%d, %d, %d, %d, ",
+					maxValues[j][i],
+					adc_to_mv(maxValues[j][i], PS2000A_CHANNEL_A + j, file->unit),
+					minValues[j][i],
+					adc_to_mv(minValues[j][i], PS2000A_CHANNEL_A + j, file->unit));
+			}
+		}
+
+		fprintf(file->fp, "\n");
+	}
+}
+
+/****************************************************************************
+* OpenDecimationFiles
+* открывает файлы всех выходов из decimationFiles и настраивает прореживатель
+*
+* Возвращает TRUE, если прореживатель готов к работе
+****************************************************************************/
+BOOL OpenDecimationFiles(UNIT * unit, DECIMATOR * decimator)
+{
+	DECIMATOR_OUTPUT_SETTINGS settings[DECIMATOR_MAX_OUTPUTS];
+	int16_t nOutputs = sizeof(decimationFiles) / sizeof(DECIMATION_FILE);
+	int16_t o;
+	int32_t i;
+
+	for (o = 0; o < nOutputs; o++)
+	{
+		decimationFiles[o].unit = unit;
+		decimationFiles[o].fp = NULL;
+		fopen_s(&decimationFiles[o].fp, decimationFiles[o].fileName, "w");
+
+		if (decimationFiles[o].fp != NULL)
+		{
+			for (i = 0; i < unit->channelCount; i++) 
+			{
+				if (unit->channelSettings[i].enabled) 
+				{
+					fprintf(decimationFiles[o].fp, "Max ADC   Max mV   Min ADC   Min mV");
+				}
+			}
+
+			fprintf(decimationFiles[o].fp, "\n");
+		}
+		else
+		{
+			printf("Cannot open the file %s for writing.\n", decimationFiles[o].fileName);
+		}
+
+		settings[o].mode = decimationFiles[o].mode;
+		settings[o].ratio = decimationFiles[o].ratio;
+		settings[o].window = decimationFiles[o].window;
+		settings[o].firTaps = decimationFiles[o].firTaps;
+		settings[o].sink = DecimationFileSink;
+		settings[o].context = &decimationFiles[o];
+	}
+
+	return DecimatorInit(decimator, unit->channelCount, settings, nOutputs);
+}
+
+/****************************************************************************
+* CloseDecimationFiles
+* выдаёт незавершённые блоки и закрывает файлы выходов
+****************************************************************************/
+void CloseDecimationFiles(DECIMATOR * decimator)
+{
+	int16_t o;
+
+	DecimatorFlush(decimator);
+	DecimatorFree(decimator);
+
+	for (o = 0; o < (int16_t) (sizeof(decimationFiles) / sizeof(DECIMATION_FILE)); o++)
+	{
+		if (decimationFiles[o].fp != NULL)
+		{
+			fclose(decimationFiles[o].fp);
+			decimationFiles[o].fp = NULL;
+		}
+	}
+}
+
+/****************************************************************************
+* IsConnectionLost
+* TRUE, если код ошибки драйвера означает потерю связи с устройством
+****************************************************************************/
+BOOL IsConnectionLost(PICO_STATUS status)
+{
+	return status == PICO_NOT_RESPONDING || status == PICO_NOT_FOUND || status == PICO_INVALID_HANDLE;
+}
+
+PICO_STATUS RestoreTrigger(UNIT * unit);
+
+/****************************************************************************
+* ReconnectDevice
+* Закрывает устройство, открывает его заново по серийному номеру и
+* восстанавливает настройки каналов, цифровых портов и триггера из UNIT
+****************************************************************************/
+PICO_STATUS ReconnectDevice(UNIT * unit, MODE mode)
+{
+	DEVICE_ENTRY device;
+	PICO_STATUS status;
+
+	ps2000aCloseUnit(unit->handle);
+
+	memset(&device, 0, sizeof(DEVICE_ENTRY));
+	memcpy(device.serial, unit->serial, sizeof(unit->serial));
+
+	if ((status = DeviceOpen(&device, openRetries, openRetryDelay)) != PICO_OK)
+	{
+		return status;
+	}
+
+	unit->handle = device.handle;
+
+	if (mode == DIGITAL || mode == AGGREGATED)
+	{
+		DisableAnalogue(unit);
+		SetDigitals(unit, 1);
+	}
+	else
+	{
+		SetDefaults(unit);
+
+		if (mode == MIXED)
+		{
+			SetDigitals(unit, 1);
+		}
+	}
+
+	return RestoreTrigger(unit);
+}
+
+/****************************************************************************
+* RegisterStreamingBuffers
+* Повторно передаёт драйверу буферы потокового сбора (после переподключения
+* дескриптор устройства меняется)
+****************************************************************************/
+PICO_STATUS RegisterStreamingBuffers(UNIT * unit, MODE mode, int16_t ** buffers, int16_t ** digiBuffers, int32_t sampleCount, PS2000A_RATIO_MODE ratioMode)
+{
+	PICO_STATUS status = PICO_OK;
+	int32_t i;
+
+	if (mode == ANALOGUE)
+	{
+		for (i = 0; i < unit->channelCount && status == PICO_OK; i++) 
+		{
+			if (unit->channelSettings[i].enabled)
+			{
+				status = ps2000aSetDataBuffers(unit->handle, (int32_t)i, buffers[i * 2], buffers[i * 2 + 1], sampleCount, 0, ratioMode);
+			}
+		}
+	}
+
+	for (i = 0; i < unit->digitalPorts && status == PICO_OK; i++) 
+	{
+		if (mode == AGGREGATED)
+		{
+			status = ps2000aSetDataBuffers(unit->handle, (PS2000A_CHANNEL) (i + PS2000A_DIGITAL_PORT0), digiBuffers[i * 2], digiBuffers[i * 2 + 1], sampleCount, 0, ratioMode);
+		}
+		else if (mode == DIGITAL)
+		{
+			status = ps2000aSetDataBuffer(unit->handle, (PS2000A_CHANNEL) (i + PS2000A_DIGITAL_PORT0), digiBuffers[i], sampleCount, 0, ratioMode);
+		}
+	}
+
+	printf(status?"RegisterStreamingBuffers:ps2000aSetDataBuffers ------ 0x%08lx \n":"", status);
+	return status;
+}
+
+/****************************************************************************
+* StreamingDone
+* Собраны ли уже все запрошенные отсчёты
+* Параметры
+* - collected - отсчётов получено (после сокращения драйвером)
+****************************************************************************/
+BOOL StreamingDone(uint32_t postTrigger, int16_t autostop, uint32_t downsampleRatio, int32_t collected)
+{
+	return autostop && (uint64_t) collected * downsampleRatio >= postTrigger;
+}
+
+/****************************************************************************
+* RestartStreaming
+* Продолжает остановленный потоковый сбор в те же буферы: без предзапуска и
+* только на недостающие отсчёты. Сработавший триггер выключается, чтобы
+* продолжение не ждало нового события и не записывало новый предзапуск
+* Параметры
+* - collected - отсчётов уже получено (после сокращения драйвером)
+* - triggerFired - триггер сработал до остановки
+****************************************************************************/
+PICO_STATUS RestartStreaming(UNIT * unit, SESSION * session, MODE mode, int16_t ** buffers, int16_t ** digiBuffers, int32_t bufferLength,
+	uint32_t * sampleInterval, PS2000A_TIME_UNITS timeUnits, uint32_t postTrigger, int16_t autostop, uint32_t downsampleRatio,
+	PS2000A_RATIO_MODE ratioMode, int32_t sampleCount, int32_t collected, BOOL triggerFired)
+{
+	uint64_t taken = (uint64_t) collected * downsampleRatio;
+	PICO_STATUS status;
+
+	if ((status = RegisterStreamingBuffers(unit, mode, buffers, digiBuffers, bufferLength, ratioMode)) != PICO_OK)
+	{
+		return status;
+	}
+
+	if (triggerFired && (status = ps2000aSetSimpleTrigger(unit->handle, 0, PS2000A_CHANNEL_A, 0, PS2000A_RISING, 0, 0)) != PICO_OK)
+	{
+		printf("RestartStreaming:ps2000aSetSimpleTrigger ------ 0x%08lx \n", status);
+		return status;
+	}
+
+	session->triggered = 0;
+	session->triggerAt = 0;
+
+	return ps2000aRunStreaming(unit->handle, sampleInterval, timeUnits, 0, autostop ? postTrigger - (uint32_t) taken : postTrigger,
+		autostop, downsampleRatio, ratioMode, (uint32_t) sampleCount);
+}
+
+/****************************************************************************
+* UpdateMvText
+* Заполняет таблицы текста милливольт включённых каналов для текущих
+* диапазонов (см. CsvFormat.h)
+*
+* Возвращает FALSE, если не удалось выделить память
+****************************************************************************/
+BOOL UpdateMvText(UNIT * unit, CSV_TABLE * tables)
+{
+	int32_t raw;
+	int16_t ch;
+
+	for (ch = 0; ch < unit->channelCount; ch++)
+	{
+		if (!unit->channelSettings[ch].enabled)
+		{
+			continue;
+		}
+
+		if (tables[ch].slots == NULL && !CsvTableInit(&tables[ch]))
+		{
+			return FALSE;
+		}
+
+		for (raw = INT16_MIN; raw <= INT16_MAX; raw++)
+		{
+			CsvTableSet(&tables[ch], (int16_t) raw, adc_to_mv(raw, ch, unit));
+		}
+	}
+
+	return TRUE;
+}
+
+/****************************************************************************
+* StreamDataHandler
+* - Используется в двух примерах потоковых данных - запущенный и триггерный
+* Входные данные:
+* - unit - модуль для выборки
+* - предварительный триггер - количество выборок в фазе предварительного запуска
+* (0, если триггер не был установлен)
+***************************************************************************/
+void StreamDataHandler(UNIT * unit, uint32_t preTrigger, MODE mode)
+{
+	int8_t * timeUnitsStr;
+	
+	int16_t  autostop;
+	uint16_t portValue, portValueOR, portValueAND;
+	uint32_t segmentIndex = 0;
+
+	int16_t * buffers[PS2000A_MAX_CHANNEL_BUFFERS];
+	int16_t * appBuffers[PS2000A_MAX_CHANNEL_BUFFERS];
+	int16_t * digiBuffers[PS2000A_MAX_DIGITAL_PORTS];
+	int16_t * appDigiBuffers[PS2000A_MAX_DIGITAL_PORTS];
+	
+	int32_t index = 0;
+	int32_t totalSamples;
+	int32_t bit;
+	int32_t i, j;
+
+	int32_t sampleCount = 40000; /*убедитесь, что буфер достаточно велик */
+	uint32_t postTrigger;
+	uint32_t downsampleRatio = 1;
+	uint32_t sampleInterval;
+	uint32_t triggeredAt = 0;
+	BOOL triggerFired = FALSE;
+
+	clock_t timer_start = clock();
+	clock_t timer_now=0;
+	double elapsed=0;
+
+	BUFFER_INFO bufferInfo;
+	SESSION session;
+	FILE * fp = NULL;
+
+	DECIMATOR decimator;
+	FILTER_CHAIN filter;
+	int16_t * chunk[PS2000A_MAX_CHANNELS];
+
+	CAPTURE_FILE capture;
+	CAPTURE_HEADER header;
+	uint16_t * digiWords = NULL;
+	uint64_t chunkStart;
+
+	EDGE_ENCODER edgeEncoder;
+	EDGE_RECORD * edgeRecords = NULL;
+	int32_t nEdges;
+	int64_t totalEdges = 0;
+
+	PROTOCOL_DECODER decoders[MAX_PROTOCOL_DECODERS];
+	int16_t nDecoders = 0;
+	FILE * protocolFp = NULL;
+
+	CAPTURE_GAP gap;
+	int32_t reconnects = 0;
+	int64_t downtime = 0;
+	int64_t rangeDowntime = 0;			// Время перезапусков при смене диапазона, нс
+
+	int16_t ranges[PS2000A_MAX_CHANNELS];
+	CAPTURE_RANGES rangeChunk;
+	int32_t segmentSamples = 0;
+
+	CSV_TABLE adcText;
+	CSV_TABLE mvText[PS2000A_MAX_CHANNELS];
+	CSV_WRITER csv;
+	char * text;
+
+	STREAM_RING ring;
+	int16_t used[PS2000A_MAX_CHANNEL_BUFFERS];
+	int16_t ** samples = appBuffers;		// Отсчёты очередного обратного вызова: копии в appBuffers или кольцо
+	int32_t bufferLength = sampleCount;		// Длина буферов, зарегистрированных в драйвере
+	BOOL zeroCopy = FALSE;
+
+	PICO_STATUS status;
+	PS2000A_TIME_UNITS timeUnits;
+	PS2000A_RATIO_MODE ratioMode;
+
+	if (mode == ANALOGUE && autoRanging)
+	{
+		SyncAutoRange(unit, &autoRange);
+	}
+
+	if (mode == ANALOGUE)		// Аналог
+	{
+		// При прореживании на ПК драйвер передаёт необработанные данные, буфер минимумов не нужен
+		ratioMode = hostDecimation ? PS2000A_RATIO_MODE_NONE : PS2000A_RATIO_MODE_AGGREGATE;
+
+		memset(used, 0, sizeof(used));
+
+		for (i = 0; i < unit->channelCount; i++) 
+		{
+			used[i * 2] = unit->channelSettings[i].enabled;
+			used[i * 2 + 1] = unit->channelSettings[i].enabled && !hostDecimation;
+		}
+
+		// Без копирования драйвер пишет прямо в кольцо, а обратный вызов не заполняет appBuffers
+		if (zeroCopyStreaming && (zeroCopy = StreamRingInit(&ring, used, streamRingSlots, sampleCount, bufferAllocFlags)) != FALSE)
+		{
+			bufferLength = ring.size;
+			samples = ring.buffers;
+		}
+
+		for (i = 0; i < unit->channelCount; i++) 
+		{
+			if (unit->channelSettings[i].enabled && zeroCopy)
+			{
+				buffers[i * 2] = ring.buffers[i * 2];
+				buffers[i * 2 + 1] = ring.buffers[i * 2 + 1];
+				status = ps2000aSetDataBuffers(unit->handle, (int32_t)i, buffers[i * 2], buffers[i * 2 + 1], bufferLength, segmentIndex, ratioMode);
+
+				appBuffers[i * 2] = NULL;
+				appBuffers[i * 2 + 1] = NULL;
+
+				printf(status?"StreamDataHandler:ps2000aSetDataBuffers(channel %ld) ------ 0x%08lx \n":"", i, status);
+			}
+			else if (unit->channelSettings[i].enabled)
+			{
+				buffers[i * 2] = (int16_t*) BufferAlloc(sampleCount * sizeof(int16_t), bufferAllocFlags);
+				buffers[i * 2 + 1] = hostDecimation ? NULL : (int16_t*) BufferAlloc(sampleCount * sizeof(int16_t), bufferAllocFlags);
+				status = ps2000aSetDataBuffers(unit->handle, (int32_t)i, buffers[i * 2], buffers[i * 2 + 1], sampleCount, segmentIndex, ratioMode);
+
+				appBuffers[i * 2] = (int16_t*) BufferAlloc(sampleCount * sizeof(int16_t), bufferAllocFlags);
+				appBuffers[i * 2 + 1] = hostDecimation ? NULL : (int16_t*) BufferAlloc(sampleCount * sizeof(int16_t), bufferAllocFlags);
+
+				printf(status?"StreamDataHandler:ps2000aSetDataBuffers(channel %ld) ------ 0x%08lx \n":"", i, status);
+			}
+		}
+
+		downsampleRatio = hostDecimation ? 1 : 20;
+		timeUnits = PS2000A_US;
+		sampleInterval = 1;
+		postTrigger = 1000000;
+		autostop = TRUE;
+	}
+
+	bufferInfo.unit = unit;
+	bufferInfo.mode = mode;	
+	bufferInfo.driverBuffers = buffers;
+	bufferInfo.appBuffers = appBuffers;
+	bufferInfo.driverDigBuffers = digiBuffers;
+	bufferInfo.appDigBuffers = appDigiBuffers;
+
+	if (mode == AGGREGATED)		// (Только для MSO) АГРЕГИРОВАННЫЙ
+	{
+		for (i= 0; i < unit->digitalPorts; i++) 
+		{
+
+			digiBuffers[i * 2] = (int16_t*) BufferAlloc(sampleCount * sizeof(int16_t), bufferAllocFlags);
+			digiBuffers[i * 2 + 1] = (int16_t*) BufferAlloc(sampleCount * sizeof(int16_t), bufferAllocFlags);
+			status = ps2000aSetDataBuffers(unit->handle, (PS2000A_CHANNEL) (i + PS2000A_DIGITAL_PORT0), digiBuffers[i * 2], digiBuffers[i * 2 + 1], sampleCount, 0, PS2000A_RATIO_MODE_AGGREGATE);
+
+			appDigiBuffers[i * 2] = (int16_t*) BufferAlloc(sampleCount * sizeof(int16_t), bufferAllocFlags);
+			appDigiBuffers[i * 2 + 1] = (int16_t*) BufferAlloc(sampleCount * sizeof(int16_t), bufferAllocFlags);
+
+			printf(status?"StreamDataHandler:ps2000aSetDataBuffer(channel %ld) ------ 0x%08lx \n":"", i, status);
+		}
+
+		downsampleRatio = 10;
+		timeUnits = PS2000A_MS;
+		sampleInterval = 10;
+		ratioMode = PS2000A_RATIO_MODE_AGGREGATE;
+		postTrigger = 10;
+		autostop = FALSE;
+	}
+
+	if (mode == DIGITAL)		// (Только для MSO) Цифровой
+	{
+		for (i= 0; i < unit->digitalPorts; i++) 
+		{
+			digiBuffers[i] = (int16_t*) BufferAlloc(sampleCount* sizeof(int16_t), bufferAllocFlags);
+			status = ps2000aSetDataBuffer(unit->handle, (PS2000A_CHANNEL) (i + PS2000A_DIGITAL_PORT0), digiBuffers[i], sampleCount, 0, PS2000A_RATIO_MODE_NONE);
+
+			appDigiBuffers[i] = (int16_t*) BufferAlloc(sampleCount * sizeof(int16_t), bufferAllocFlags);
+
+			printf(status?"StreamDataHandler:ps2000aSetDataBuffer(channel %ld) ------ 0x%08lx \n":"", i, status);
+		}
+
+		downsampleRatio = 1;
+		timeUnits = PS2000A_MS;
+		sampleInterval = 10;
+		ratioMode = PS2000A_RATIO_MODE_NONE;
+		postTrigger = 10;
+		autostop = FALSE;
+	}
+
+	if (autostop)
+	{
+		printf("\nStreaming Data for %lu samples", postTrigger / downsampleRatio);
+
+		if (preTrigger)	// мы передаем 0 для предварительного запуска, если мы не настраиваем триггер
+		{
+			printf(" after the trigger occurs\nNote: %lu Pre Trigger samples before Trigger arms\n\n",preTrigger / downsampleRatio);
+		}
+		else
+		{
+			printf("\n\n");
+		}
+	}
+	else
+	{
+		printf("\nStreaming Data continually\n\n");
+	}
+
+	SessionInit(&session, unit, &bufferInfo);
+
+	status = ps2000aRunStreaming(unit->handle, &sampleInterval, timeUnits, preTrigger, postTrigger - preTrigger, 
+				autostop, downsampleRatio, ratioMode, (uint32_t) sampleCount);
+
+	if (status == PICO_OK)
+	{	
+		timeUnitsStr = timeUnitsToString(timeUnits);
+		printf("Streaming data... (interval: %d %s) Press a key to stop\n", sampleInterval, timeUnitsStr);
+	}
+	else
+	{
+		printf("StreamDataHandler:ps2000aRunStreaming ------ 0x%08lx \n", status);
+	}
+
+	if (!FilterInit(&filter, streamFilters, (mode == ANALOGUE && streamFiltering) ? sizeof(streamFilters) / sizeof(FILTER_STAGE_SETTINGS) : 0))
+	{
+		printf("StreamDataHandler:FilterInit ------ invalid filter settings\n");
+	}
+
+	if (mode == ANALOGUE && hostDecimation)
+	{
+		if (!OpenDecimationFiles(unit, &decimator))
+		{
+			printf("StreamDataHandler:OpenDecimationFiles ------ invalid decimation settings\n");
+		}
+	}
+	else if (mode == ANALOGUE && !binaryCapture)
+	{
+		fopen_s(&fp, StreamFile, "w");
+
+		if (fp != NULL)
+		{
+			/*fprintf(fp, "For each of the %d Channels, results shown are....\n", unit->channelCount);
+			fprintf(fp,"Maximum Aggregated value ADC Count & mV, Minimum Aggregated value ADC Count & mV\n\n");*/
+
+			for (i = 0; i < unit->channelCount; i++) 
+			{
+				if (unit->channelSettings[i].enabled) 
+				{
+					fprintf(fp,"Max ADC   Max mV   Min ADC   Min mV");
+				}
+			}
+
+			fprintf(fp, "\n");
+		}
+	}
+
+	memset(&adcText, 0, sizeof(adcText));
+	memset(mvText, 0, sizeof(mvText));
+	memset(&csv, 0, sizeof(csv));
+
+	// Строки stream.txt собираются из заранее отформатированных значений,
+	// при нехватке памяти - прежним fprintf
+	if (fp != NULL && (!CsvTableInit(&adcText) || !UpdateMvText(unit, mvText) || !CsvWriterOpen(&csv, fp, CSV_BUFFER_SIZE)))
+	{
+		CsvWriterClose(&csv);
+	}
+
+	memset(&capture, 0, sizeof(CAPTURE_FILE));
+
+	if (binaryCapture && (mode == ANALOGUE || mode == DIGITAL))
+	{
+		FillCaptureHeader(&session, &header, sampleInterval * timeUnitsToNs(timeUnits) * downsampleRatio, downsampleRatio, ratioMode);
+
+		if (!CaptureCreate(&capture, CaptureFile, &header))
+		{
+			printf("Cannot open the file %s for writing.\n", CaptureFile);
+		}
+
+		capture.compress = (int16_t) captureCompression;
+
+		if (mode == DIGITAL && digitalEdges)
+		{
+			EdgeEncoderInit(&edgeEncoder);
+			edgeRecords = (EDGE_RECORD *) malloc(sampleCount * sizeof(EDGE_RECORD));
+		}
+	}
+
+	if (mode == DIGITAL && (binaryCapture || protocolDecoding))
+	{
+		digiWords = (uint16_t *) malloc(sampleCount * sizeof(uint16_t));
+	}
+
+	if (mode == DIGITAL && protocolDecoding)
+	{
+		fopen_s(&protocolFp, ProtocolFile, "w");
+
+		if (protocolFp != NULL)
+		{
+			fprintf(protocolFp, "Time ns, Protocol, Frame, Data, MISO, Flags\n");
+		}
+		else
+		{
+			printf("Cannot open the file %s for writing.\n", ProtocolFile);
+		}
+
+		for (i = 0; i < (int32_t) (sizeof(protocolDecoders) / sizeof(PROTOCOL_SETTINGS)) && nDecoders < MAX_PROTOCOL_DECODERS; i++)
+		{
+			if (ProtocolInit(&decoders[nDecoders], &protocolDecoders[i], sampleInterval * timeUnitsToNs(timeUnits), ProtocolFileSink, protocolFp))
+			{
+				nDecoders++;
+			}
+			else if (protocolDecoders[i].type == PROTOCOL_UART && protocolDecoders[i].baudRate > 0 &&
+				1e9 / protocolDecoders[i].baudRate / (sampleInterval * timeUnitsToNs(timeUnits)) < 2.0)
+			{
+				printf("StreamDataHandler:ProtocolInit(UART) ------ %lu baud needs a sample interval of at most %.0f ns, streaming at %.0f ns: decoder disabled\n",
+					(unsigned long) protocolDecoders[i].baudRate, 1e9 / protocolDecoders[i].baudRate / 2.0, sampleInterval * timeUnitsToNs(timeUnits));
+				ProtocolFree(&decoders[nDecoders]);
+			}
+			else
+			{
+				printf("StreamDataHandler:ProtocolInit(%s) ------ invalid settings for this sample interval\n", ProtocolName(protocolDecoders[i].type));
+				ProtocolFree(&decoders[nDecoders]);
+			}
+		}
+	}
+
+	totalSamples = 0;
+
+	// Захватывать данные, если не нажата клавиша или не установлен флаг g_auto Stopped при обратном вызове потоковой передачи
+	while (/*!_kbhit() && */ !session.autoStopped.load(std::memory_order_acquire))
+	{
+		timer_now = clock();
+		double elapsed = (double)(timer_now - timer_start) / CLOCKS_PER_SEC;  // Прошедшее время в секундах
+		if (elapsed >= 3) session.autoStopped.store(TRUE, std::memory_order_relaxed);
+		/* Опрос до тех пор, пока не будут получены данные. До тех пор функфция получения последних значений потоковой передачи не вызовет обратный вызов */
+		session.ready.store(FALSE, std::memory_order_relaxed);
+
+		status = ps2000aGetStreamingLatestValues(unit->handle, CallBackStreaming, &session);
+		index ++;
+
+		if (streamReconnect && IsConnectionLost(status))
+		{
+			// Переоткрыть устройство и продолжить запись в те же файлы, отметив разрыв
+			gap.lostAt = TimeAlignNow();
+			gap.status = status;
+			printf("\nStreamDataHandler:ps2000aGetStreamingLatestValues ------ 0x%08lx, reconnecting...\n", status);
+
+			// Запрошенные отсчёты уже получены - продолжать нечего
+			if (StreamingDone(postTrigger, autostop, downsampleRatio, totalSamples))
+			{
+				break;
+			}
+
+			// Продолжение - без нового предзапуска и только на недостающие отсчёты
+			if ((status = ReconnectDevice(unit, mode)) != PICO_OK ||
+				(status = RestartStreaming(unit, &session, mode, mode == ANALOGUE ? buffers : NULL, digiBuffers, bufferLength, &sampleInterval,
+					timeUnits, postTrigger, autostop, downsampleRatio, ratioMode, sampleCount, totalSamples, triggerFired)) != PICO_OK)
+			{
+				printf("StreamDataHandler: cannot resume streaming ------ 0x%08lx \n", status);
+				break;
+			}
+
+			gap.resumedAt = TimeAlignNow();
+			downtime += gap.resumedAt - gap.lostAt;
+			reconnects++;
+
+			CaptureWriteChunk(&capture, CAPTURE_CHUNK_GAP, 0, totalSamples, &gap, 0, sizeof(CAPTURE_GAP));
+			printf("Streaming resumed after %.1f s\n", (gap.resumedAt - gap.lostAt) / 1e9);
+			continue;
+		}
+
+		if (session.ready.load(std::memory_order_acquire) && session.sampleCount > 0) /* может быть готово и не содержать данных, если сработала автостопировка */
+		{
+			if (session.triggered && !triggerFired)
+			{
+				triggeredAt = totalSamples + session.triggerAt;		// вычислить, где произошел срабатывание триггера в общем количестве собранных образцов
+				triggerFired = TRUE;
+			}
+
+			chunkStart = totalSamples;
+			totalSamples += session.sampleCount;
+			printf("\nCollected %3li samples, index = %5lu, Total: %6d samples ", session.sampleCount, session.startIndex, totalSamples);
+
+			if (session.triggered)
+			{
+				printf("Trig. at index %lu", triggeredAt);	// показать, где произошел срабатывание
+			}
+
+			if (mode == ANALOGUE && streamFiltering)
+			{
+				// Фильтрация на месте, каждый буфер (максимумы и минимумы) со своим состоянием
+				for (j = 0; j < unit->channelCount * 2; j++) 
+				{
+					if (unit->channelSettings[j / 2].enabled && samples[j] != NULL)
+					{
+						if (!FilterProcess(&filter, (int16_t) j, &samples[j][session.startIndex], session.sampleCount))
+						{
+							printf("\nStreamDataHandler:FilterProcess(buffer %d) ------ out of memory, chunk left unfiltered\n", j);
+						}
+					}
+				}
+			}
+
+			if (mode == ANALOGUE && hostDecimation)
+			{
+				for (j = 0; j < unit->channelCount; j++) 
+				{
+					chunk[j] = unit->channelSettings[j].enabled ? &samples[j * 2][session.startIndex] : NULL;
+				}
+
+				DecimatorProcess(&decimator, chunk, session.sampleCount);
+			}
+
+			if (capture.fp != NULL)
+			{
+				// Метка времени ПК для последующей привязки к другим устройствам (см. TimeAlign.h)
+				CaptureWriteChunk(&capture, CAPTURE_CHUNK_TIMESTAMP, 0, chunkStart, &session.hostTime, session.sampleCount, sizeof(session.hostTime));
+			}
+
+			if (mode == ANALOGUE && capture.fp != NULL)
+			{
+				for (j = 0; j < unit->channelCount * 2; j++) 
+				{
+					if (unit->channelSettings[j / 2].enabled && samples[j] != NULL)
+					{
+						CaptureWriteChunk(&capture, CAPTURE_CHUNK_ANALOGUE, (int16_t) j, chunkStart,
+							&samples[j][session.startIndex], session.sampleCount, session.sampleCount * sizeof(int16_t));
+					}
+				}
+			}
+
+			if (mode == DIGITAL && digiWords != NULL)
+			{
+				// Вместо вывода каждого бита порты упаковываются в 16-разрядные слова и обрабатываются одним блоком
+				DigitalPackPorts(&appDigiBuffers[0][session.startIndex], &appDigiBuffers[1][session.startIndex], digiWords, session.sampleCount);
+
+				for (j = 0; j < nDecoders; j++)
+				{
+					ProtocolProcess(&decoders[j], digiWords, session.sampleCount);
+				}
+			}
+
+			if (mode == DIGITAL && capture.fp != NULL && digiWords != NULL)
+			{
+				if (edgeRecords != NULL)
+				{
+					// Записываются только изменения состояния, фрагмент без переходов занимает один заголовок
+					nEdges = EdgeEncode(&edgeEncoder, digiWords, session.sampleCount, edgeRecords);
+					totalEdges += nEdges;
+					CaptureWriteChunk(&capture, CAPTURE_CHUNK_EDGES, 0, chunkStart, edgeRecords, session.sampleCount, nEdges * sizeof(EDGE_RECORD));
+				}
+				else
+				{
+					CaptureWriteChunk(&capture, CAPTURE_CHUNK_DIGITAL, 0, chunkStart, digiWords, session.sampleCount, session.sampleCount * sizeof(uint16_t));
+				}
+			}
+
+			for (i = session.startIndex; i < (int32_t)(session.startIndex + session.sampleCount); i++) 
+			{
+				if (mode == ANALOGUE && !hostDecimation && !binaryCapture)
+				{
+					if (csv.buffer != NULL)
+					{
+						text = CsvReserve(&csv, unit->channelCount * 4 * CSV_SLOT_SIZE + 1);
+
+						for (j = 0; j < unit->channelCount; j++) 
+						{
+							if (unit->channelSettings[j].enabled) 
+							{
+								text = CsvAppend(text, &adcText, samples[j * 2][i]);
+								text = CsvAppend(text, &mvText[j], samples[j * 2][i]);
+								text = CsvAppend(text, &adcText, samples[j * 2 + 1][i]);
+								text = CsvAppend(text, &mvText[j], samples[j * 2 + 1][i]);
+							}
+						}
+
+						*text++ = '\n';
+						CsvCommit(&csv, text);
+					}
+					else if (fp != NULL)
+					{
+						for (j = 0; j < unit->channelCount; j++) 
+						{
+							if (unit->channelSettings[j].enabled) 
+							{
+								fprintf(	fp,
+									"%d, %d, %d, %d, ",
+									samples[j * 2][i],
+									adc_to_mv(samples[j * 2][i], PS2000A_CHANNEL_A + j, unit),
+									samples[j * 2 + 1][i],
+									adc_to_mv(samples[j * 2 + 1][i], PS2000A_CHANNEL_A + j, unit));
+							}
+						}
+
+						fprintf(fp, "\n");
+					}
+					else
+					{
+						printf("Cannot open the file stream.txt for writing.\n");
+					}
+
+				}
+
+				if (mode == DIGITAL && !binaryCapture)
+				{
+					portValue = 0x00ff & appDigiBuffers[1][i];	// Замаскируйте значения порта 1, чтобы получить меньшие 8 бит
+					portValue <<= 8;							// Сдвинуть на 8 бит, чтобы поместить в верхние 8 бит 16-битного слова
+					portValue |= 0x00ff & appDigiBuffers[0][i];	// Замаскируйте значения порта 0, чтобы получить меньшие 8 бит
+
+					printf("\nIndex=%04lu: Value = 0x%04X  =  ", i, portValue);
+
+					for (bit = 0; bit < 16; bit++)
+					{
+						// Значение сдвига (32768 - двоичное значение 1000 0000 0000 0000 0000) И значение, позволяющее получить 1 или 0 для канала
+                        // Порядок будет от D15 до D8, затем от D7 до D0
+						printf( (0x8000 >> bit) & portValue? "1 " : "0 ");
+					}
+				}
+
+				if (mode == AGGREGATED)
+				{
+					portValueOR = 0x00ff & appDigiBuffers[2][i];
+					portValueOR <<= 8;
+					portValueOR |= 0x00ff & appDigiBuffers[0][i];
+
+					portValueAND = 0x00ff & appDigiBuffers[3][i];
+					portValueAND <<= 8;
+					portValueAND |= 0x00ff & appDigiBuffers[1][i];
+
+					printf("\nIndex=%04lu: Bitwise  OR of last %ld readings = 0x%04X ",i,  downsampleRatio, portValueOR);
+					printf("\nIndex=%04lu: Bitwise AND of last %ld readings = 0x%04X ",i,  downsampleRatio, portValueAND);
+				}
+			}
+
+			if (mode == ANALOGUE && autoRanging)
+			{
+				for (j = 0; j < unit->channelCount * 2; j++) 
+				{
+					if (unit->channelSettings[j / 2].enabled && samples[j] != NULL)
+					{
+						AutoRangeObserve(&autoRange, (int16_t) (j / 2), &samples[j][session.startIndex], session.sampleCount);
+					}
+				}
+
+				AutoRangeOverflow(&autoRange, session.overflow);
+				segmentSamples += session.sampleCount;
+			}
+
+			if (autoRanging && segmentSamples >= autoRangeSegment)
+			{
+				// Диапазон меняется только на остановленном устройстве: сбор останавливается, каналы
+				// переключаются и сбор продолжается без предзапуска на недостающие отсчёты (см. RestartStreaming).
+				// Отсчёты за время перезапуска теряются - в файл захвата записывается разрыв, а новые
+				// диапазоны действуют с номера следующего отсчёта
+				segmentSamples = 0;
+
+				if (!StreamingDone(postTrigger, autostop, downsampleRatio, totalSamples) && SelectAutoRanges(unit, &autoRange, ranges))
+				{
+					gap.lostAt = TimeAlignNow();
+					gap.status = PICO_OK;
+					ps2000aStop(unit->handle);
+					SetAutoRanges(unit, &autoRange, ranges);
+
+					if ((status = RestartStreaming(unit, &session, mode, mode == ANALOGUE ? buffers : NULL, digiBuffers, bufferLength, &sampleInterval,
+						timeUnits, postTrigger, autostop, downsampleRatio, ratioMode, sampleCount, totalSamples, triggerFired)) != PICO_OK)
+					{
+						printf("StreamDataHandler: cannot restart streaming after range change ------ 0x%08lx \n", status);
+						break;
+					}
+
+					gap.resumedAt = TimeAlignNow();
+					rangeDowntime += gap.resumedAt - gap.lostAt;
+
+					// Вместе с диапазоном может измениться и действующее смещение (его пределы зависят от диапазона)
+					for (j = 0; j < PS2000A_MAX_CHANNELS; j++) 
+					{
+						rangeChunk.range[j] = j < unit->channelCount ? unit->channelSettings[j].range : 0;
+						rangeChunk.analogueOffset[j] = j < unit->channelCount ? unit->channelSettings[j].analogueOffset : 0.0f;
+					}
+
+					FillCaptureScale(unit, rangeChunk.scale);
+
+					if (csv.buffer != NULL)
+					{
+						UpdateMvText(unit, mvText);
+					}
+
+					CaptureWriteChunk(&capture, CAPTURE_CHUNK_GAP, 0, totalSamples, &gap, 0, sizeof(CAPTURE_GAP));
+					CaptureWriteChunk(&capture, CAPTURE_CHUNK_RANGE, 0, totalSamples, &rangeChunk, 0, sizeof(CAPTURE_RANGES));
+				}
+			}
+		}
+	}
+
+	ps2000aStop(unit->handle);
+
+	if (!session.autoStopped.load(std::memory_order_relaxed)) 
+	{
+		printf("\nData collection aborted.\n");
+		_getch();
+	}
+
+	if (session.overflow)
+	{
+		printf("Overflow on voltage range.\n");
+	}
+
+	if (reconnects)
+	{
+		printf("Reconnected %d times, total downtime %.1f s\n", reconnects, downtime / 1e9);
+	}
+
+	if (mode == ANALOGUE && autoRanging)
+	{
+		printf("Range switches: %d, restarts %.1f ms\n", autoRange.switches, rangeDowntime / 1e6);
+	}
+
+	CsvWriterClose(&csv);
+	CsvTableFree(&adcText);
+
+	for (j = 0; j < PS2000A_MAX_CHANNELS; j++)
+	{
+		CsvTableFree(&mvText[j]);
+	}
+
+	if (fp != NULL) 
+	{
+		fclose(fp);	
+	}
+
+	if (mode == ANALOGUE && hostDecimation)
+	{
+		CloseDecimationFiles(&decimator);
+	}
+
+	FilterFree(&filter);
+	CaptureClose(&capture);
+
+	if (capture.packedBytes > 0)
+	{
+		double elapsed = (double) (clock() - timer_start) / CLOCKS_PER_SEC;
+
+		printf("Compressed %.1f MB to %.1f MB (%.2f:1), encoding %.0f MB/s, acquisition %.2f MB/s\n",
+			capture.rawBytes / 1e6, capture.packedBytes / 1e6, (double) capture.rawBytes / capture.packedBytes,
+			capture.packTime > 0 ? capture.rawBytes * 1e3 / capture.packTime : 0.0, elapsed > 0.0 ? capture.rawBytes / 1e6 / elapsed : 0.0);
+	}
+
+	if (exportCsv && mode == ANALOGUE && capture.bytesWritten > 0)
+	{
+		uint64_t rows;
+		clock_t exportStart = clock();
+
+		if (CaptureExportCsv(CaptureFile, StreamFile, inputRanges, exportThreads, &rows))
+		{
+			printf("Exported %llu rows to %s in %.2f s\n", (unsigned long long) rows, StreamFile, (double) (clock() - exportStart) / CLOCKS_PER_SEC);
+		}
+		else
+		{
+			printf("Cannot export %s to %s\n", CaptureFile, StreamFile);
+		}
+	}
+
+	if (exportCsv && mode == DIGITAL && capture.bytesWritten > 0)
+	{
+		uint64_t rows;
+
+		if (CaptureExportDigital(CaptureFile, DigiStreamFile, &rows))
+		{
+			printf("Exported %llu rows to %s\n", (unsigned long long) rows, DigiStreamFile);
+		}
+		else
+		{
+			printf("Cannot export %s to %s\n", CaptureFile, DigiStreamFile);
+		}
+	}
+
+	free(digiWords);
+
+	for (j = 0; j < nDecoders; j++)
+	{
+		ProtocolFree(&decoders[j]);
+	}
+
+	if (protocolFp != NULL)
+	{
+		fclose(protocolFp);
+	}
+
+	if (edgeRecords != NULL)
+	{
+		printf("\nDigital transitions: %lld in %d samples\n", (long long) totalEdges, totalSamples);
+		EdgeEncoderFree(&edgeEncoder);
+		free(edgeRecords);
+	}
+
+	if (mode == ANALOGUE && !zeroCopy)		// Только в том случае, если мы выделим эти буферы
+	{
+		for (i = 0; i < unit->channelCount; i++) 
+		{
+			if (unit->channelSettings[i].enabled)
+			{
+				BufferFree(buffers[i * 2]);
+				BufferFree(buffers[i * 2 + 1]);
+
+				BufferFree(appBuffers[i * 2]);
+				BufferFree(appBuffers[i * 2 + 1]);
+			}
+		}
+	}
+
+	if (zeroCopy)
+	{
+		StreamRingFree(&ring);
+	}
+
+	if (mode == DIGITAL) 		// Только если мы выделим эти буферы
+	{
+		for (i = 0; i < unit->digitalPorts; i++) 
+		{
+			BufferFree(digiBuffers[i]);
+			BufferFree(appDigiBuffers[i]);
+		}
+
+	}
+
+	if (mode == AGGREGATED) 		// Только в том случае, если мы выделим эти буферы
+	{
+		for (i = 0; i < unit->digitalPorts * 2; i++) 
+		{
+			BufferFree(digiBuffers[i]);
+			BufferFree(appDigiBuffers[i]);
+		}
+	}
+
+	ClearDataBuffers(unit);
+}
+
+
+/****************************************************************************
+* SetTrigger
+*
+* Параметры
+* - *unit - указатель на структуру UNIT
+* - *Свойства канала - указатель на структуру PS2000A_TRIGGER_CHANNEL_PROPERTIES
+* - nChannelProperties - количество элементов PS2000A_TRIGGER_CHANNEL_PROPERTIES в channelProperties
+* - *triggerConditions - указатель на структуру PS2000A_TRIGGER_CONDITIONS
+* - nTriggerConditions - количество элементов PS2000A_TRIGGER_CONDITIONS в triggerConditions
+* - *directions - указатель на структуру TRIGGER_DIRECTIONS
+* - *pwq - указатель на структуру pwq (определитель длительности импульса)
+* - delay - время задержки между запуском и первой выборкой
+* - Функция auxoutputable - Не используется
+* - Автозапуск - период ожидания, если запуск не происходит
+* - *digitalDirections - указатель на структуру PS2000A_DIGITAL_CHANNEL_DIRECTIONS
+* - nDigitalDirections - количество элементов PS2000A_DIGITAL_CHANNEL_DIRECTIONS в digitalDirections
+*
+* Возвращает - PICO_STATUS - для отображения успешного выполнения или в случае возникновения ошибки.
+*
+***************************************************************************/
+PICO_STATUS SetTrigger(	UNIT * unit,
+	PS2000A_TRIGGER_CHANNEL_PROPERTIES * channelProperties,
+	int16_t nChannelProperties,
+	PS2000A_TRIGGER_CONDITIONS * triggerConditions,
+	int16_t nTriggerConditions,
+	TRIGGER_DIRECTIONS * directions,
+	PWQ * pwq,
+	uint32_t delay,
+	int16_t auxOutputEnabled,
+	int32_t autoTriggerMs,
+	PS2000A_DIGITAL_CHANNEL_DIRECTIONS * digitalDirections,
+	int16_t nDigitalDirections)
+{
+	PICO_STATUS status;
+	TRIGGER_SETTINGS * saved = &unit->trigger;
+
+	// Сохранить настройки для RestoreTrigger (массивы больше MAX_TRIGGER_ENTRIES не сохраняются)
+	memset(saved, 0, sizeof(TRIGGER_SETTINGS));
+
+	if (channelProperties && nChannelProperties <= MAX_TRIGGER_ENTRIES)
+	{
+		memcpy(saved->channelProperties, channelProperties, nChannelProperties * sizeof(PS2000A_TRIGGER_CHANNEL_PROPERTIES));
+		saved->nChannelProperties = nChannelProperties;
+	}
+
+	if (triggerConditions && nTriggerConditions <= MAX_TRIGGER_ENTRIES)
+	{
+		memcpy(saved->conditions, triggerConditions, nTriggerConditions * sizeof(PS2000A_TRIGGER_CONDITIONS));
+		saved->nConditions = nTriggerConditions;
+	}
+
+	saved->directions = *directions;
+	saved->pwq = *pwq;
+	saved->pwq.conditions = NULL;
+
+	if (pwq->conditions && pwq->nConditions <= MAX_TRIGGER_ENTRIES)
+	{
+		memcpy(saved->pwqConditions, pwq->conditions, pwq->nConditions * sizeof(PS2000A_PWQ_CONDITIONS));
+		saved->pwq.conditions = saved->pwqConditions;
+	}
+	else
+	{
+		saved->pwq.nConditions = 0;
+	}
+
+	saved->delay = delay;
+	saved->auxOutputEnabled = auxOutputEnabled;
+	saved->autoTriggerMs = autoTriggerMs;
+
+	if (digitalDirections && nDigitalDirections <= PS2000A_MAX_DIGITAL_CHANNELS)
+	{
+		memcpy(saved->digitalDirections, digitalDirections, nDigitalDirections * sizeof(PS2000A_DIGITAL_CHANNEL_DIRECTIONS));
+		saved->nDigitalDirections = nDigitalDirections;
+	}
+
+	if ((status = ps2000aSetTriggerChannelProperties(unit->handle,
+		channelProperties,
+		nChannelProperties,
+		auxOutputEnabled,
+		autoTriggerMs)) != PICO_OK) 
+	{
+		printf("SetTrigger:ps2000aSetTriggerChannelProperties ------ Ox%8lx \n", status);
+		return status;
+	}
+
+	if ((status = ps2000aSetTriggerChannelConditions(unit->handle,	triggerConditions, nTriggerConditions)) != PICO_OK) 
+	{
+		printf("SetTrigger:ps2000aSetTriggerChannelConditions ------ 0x%8lx \n", status);
+		return status;
+	}
+
+	if ((status = ps2000aSetTriggerChannelDirections(unit->handle,
+		directions->channelA,
+		directions->channelB,
+		directions->channelC,
+		directions->channelD,
+		directions->ext,
+		directions->aux)) != PICO_OK) 
+	{
+		printf("SetTrigger:ps2000aSetTriggerChannelDirections ------ 0x%08lx \n", status);
+		return status;
+	}
+
+	if ((status = ps2000aSetTriggerDelay(unit->handle, delay)) != PICO_OK) 
+	{
+		printf("SetTrigger:ps2000aSetTriggerDelay ------ 0x%08lx \n", status);
+		return status;
+	}
+
+	if ((status = ps2000aSetPulseWidthQualifier(unit->handle,
+		pwq->conditions,
+		pwq->nConditions, 
+		pwq->direction,
+		pwq->lower, 
+		pwq->upper, 
+		pwq->type)) != PICO_OK)
+	{
+		printf("SetTrigger:ps2000aSetPulseWidthQualifier ------ 0x%08lx \n", status);
+		return status;
+	}
+
+	if (unit->digitalPorts)					// Функция ps2000aSetTriggerDigitalPortProperties применима только к MSO
+{
+		if ((status = ps2000aSetTriggerDigitalPortProperties(unit->handle,
+			digitalDirections, 
+			nDigitalDirections)) != PICO_OK) 
+		{
+			printf("SetTrigger:ps2000aSetTriggerDigitalPortProperties ------ 0x%08lx \n", status);
+			return status;
+		}
+	}
+	return status;
+}
+
+/****************************************************************************
+* RestoreTrigger
+* Повторно применяет последние настройки SetTrigger (например, после переподключения)
+****************************************************************************/
+PICO_STATUS RestoreTrigger(UNIT * unit)
+{
+	TRIGGER_SETTINGS trigger = unit->trigger;		// SetTrigger перезаписывает unit->trigger
+
+	trigger.pwq.conditions = trigger.pwq.nConditions ? trigger.pwqConditions : NULL;
+
+	return SetTrigger(unit,
+		trigger.nChannelProperties ? trigger.channelProperties : NULL, trigger.nChannelProperties,
+		trigger.nConditions ? trigger.conditions : NULL, trigger.nConditions,
+		&trigger.directions, &trigger.pwq, trigger.delay, trigger.auxOutputEnabled, trigger.autoTriggerMs,
+		trigger.nDigitalDirections ? trigger.digitalDirections : NULL, trigger.nDigitalDirections);
+}
+
+/****************************************************************************
+* CompareSamples
+* Сравнение отсчётов для qsort
+****************************************************************************/
+int CompareSamples(const void * a, const void * b)
+{
+	return *(const int16_t *) a - *(const int16_t *) b;
+}
+
+/****************************************************************************
+* EstimateBaseline
+* Измеряет базовую линию включённых аналоговых каналов коротким захватом без
+* триггера (медиана отсчётов) и подбирает смещение, переносящее её в середину
+* шкалы. Если базовая линия за пределами диапазона, захват повторяется с уже
+* найденным смещением. Ожидание захвата прерывается нажатием клавиши или
+* через baselineTimeout мс - смещения тогда остаются прежними.
+****************************************************************************/
+PICO_STATUS EstimateBaseline(UNIT * unit)
+{
+	int16_t * buffers[PS2000A_MAX_CHANNELS] = { NULL };
+	int32_t sampleCount;
+	int32_t timeIndisposed;
+	int32_t pass;
+	int32_t medianMv;
+	int16_t ch;
+	int16_t clipped;
+	int64_t deadline;
+	SESSION session;
+	PICO_STATUS status;
+
+	status = ps2000aSetSimpleTrigger(unit->handle, 0, PS2000A_CHANNEL_A, 0, PS2000A_RISING, 0, 0);
+
+	for (ch = 0; ch < unit->channelCount && status == PICO_OK; ch++)
+	{
+		if (unit->channelSettings[ch].enabled)
+		{
+			buffers[ch] = (int16_t *) malloc(baselineSamples * sizeof(int16_t));
+			status = ps2000aSetDataBuffer(unit->handle, (PS2000A_CHANNEL) ch, buffers[ch], baselineSamples, 0, PS2000A_RATIO_MODE_NONE);
+		}
+	}
+
+	for (pass = 0, clipped = 1; pass < 3 && clipped && status == PICO_OK; pass++)
+	{
+		SessionInit(&session, unit, NULL);
+		sampleCount = baselineSamples;
+		clipped = 0;
+
+		if ((status = ps2000aRunBlock(unit->handle, 0, baselineSamples, session.timebase, session.oversample, &timeIndisposed, 0, CallBackBlock, &session)) != PICO_OK)
+		{
+			break;
+		}
+
+		deadline = TimeAlignNow() + (int64_t) baselineTimeout * 1000000;
+
+		while (!session.ready.load(std::memory_order_acquire) && !_kbhit() && TimeAlignNow() < deadline)
+		{
+			Sleep(0);
+		}
+
+		if (!session.ready.load(std::memory_order_acquire))
+		{
+			status = PICO_TIMEOUT;
+
+			if (_kbhit())
+			{
+				_getch();
+				status = PICO_CANCELLED;
+			}
+
+			ps2000aStop(unit->handle);
+			break;
+		}
+
+		if (session.status != PICO_OK)
+		{
+			status = session.status;
+			break;
+		}
+
+		if ((status = ps2000aGetValues(unit->handle, 0, (uint32_t *) &sampleCount, 1, PS2000A_RATIO_MODE_NONE, 0, NULL)) != PICO_OK)
+		{
+			break;
+		}
+
+		for (ch = 0; ch < unit->channelCount; ch++)
+		{
+			if (buffers[ch] == NULL || sampleCount == 0)
+			{
+				continue;
+			}
+
+			// Медиана не чувствительна к импульсам сигнала поверх базовой линии
+			qsort(buffers[ch], sampleCount, sizeof(int16_t), CompareSamples);
+			medianMv = (buffers[ch][sampleCount / 2] * inputRanges[unit->channelSettings[ch].range]) / unit->maxValue;
+
+			if (abs(buffers[ch][sampleCount / 2]) >= unit->maxValue - 1)
+			{
+				clipped = 1;
+			}
+
+			unit->channelSettings[ch].requestedOffset = unit->channelSettings[ch].analogueOffset - medianMv / 1000.0f;
+			unit->channelSettings[ch].analogueOffset = ClampAnalogueOffset(unit, (PS2000A_RANGE) unit->channelSettings[ch].range,
+				(PS2000A_COUPLING) unit->channelSettings[ch].DCcoupled, unit->channelSettings[ch].requestedOffset);
+		}
+
+		ps2000aStop(unit->handle);
+		SetDefaults(unit);
+	}
+
+	printf(status?"EstimateBaseline ------ 0x%08lx \n":"", status);
+
+	for (ch = 0; ch < unit->channelCount; ch++)
+	{
+		if (buffers[ch] != NULL)
+		{
+			printf("Channel %c: baseline %+d mV, analogue offset %+.3f V\n", 'A' + ch,
+				-offset_mv(ch, unit), unit->channelSettings[ch].analogueOffset);
+			free(buffers[ch]);
+		}
+	}
+
+	ClearDataBuffers(unit);
+	RestoreTrigger(unit);
+	return status;
+}
+
+/****************************************************************************
+* Немедленный сбор блока
+* эта функция демонстрирует, как собирать отдельный блок данных
+* из модуля (начать сбор немедленно)
+****************************************************************************/
+void CollectBlockImmediate(UNIT * unit)
+{
+	PWQ pulseWidth;
+	TRIGGER_DIRECTIONS directions;
+
+	memset(&directions, 0, sizeof(TRIGGER_DIRECTIONS));
+	memset(&pulseWidth, 0, sizeof(PWQ));
+
+	printf("Collect block immediate\n");
+	printf("Data is written to disk file (%s)\n", BlockFile);
+	printf("Press a key to start...\n");
+	_getch();
+
+	SetDefaults(unit);
+
+	/* Триггер отключен	*/
+	SetTrigger(unit, NULL, 0, NULL, 0, &directions, &pulseWidth, 0, 0, 0, 0, 0);
+
+	BlockDataHandler(unit, "\nFirst 10 readings:\n", 0, ANALOGUE, FALSE);
+}
+
+/****************************************************************************
+* Собирать блоки данных
+* эта функция демонстрирует, как собирать блок
+данных с использованием эквивалентной временной выборки (ETS).
+****************************************************************************/
+void CollectBlockEts(UNIT * unit)
+{
+	PICO_STATUS status;
+	int32_t		ets_sampletime;
+	int16_t		triggerVoltage = mv_to_adc(1000, PS2000A_CHANNEL_A, unit);
+	uint32_t	delay = 0;
+	int16_t		etsModeSet = FALSE;
+
+	struct tPwq pulseWidth;
+	struct tTriggerDirections directions;
+
+	PS2000A_TRIGGER_CHANNEL_PROPERTIES sourceDetails = {	triggerVoltage,
+		256 * 10,
+		triggerVoltage,
+		256 * 10,
+		PS2000A_CHANNEL_A,
+		PS2000A_LEVEL};
+
+	PS2000A_TRIGGER_CONDITIONS conditions = {	PS2000A_CONDITION_TRUE,
+		PS2000A_CONDITION_DONT_CARE,
+		PS2000A_CONDITION_DONT_CARE,
+		PS2000A_CONDITION_DONT_CARE,
+		PS2000A_CONDITION_DONT_CARE,
+		PS2000A_CONDITION_DONT_CARE,
+		PS2000A_CONDITION_DONT_CARE,
+		PS2000A_CONDITION_DONT_CARE};
+
+
+	memset(&pulseWidth, 0, sizeof(struct tPwq));
+	memset(&directions, 0, sizeof(struct tTriggerDirections));
+	directions.channelA = PS2000A_RISING;
+
+	printf("Collect ETS block...\n");
+	printf("Collects when value rises past %d", scaleVoltages? 
+		adc_to_mv(sourceDetails.thresholdUpper,	PS2000A_CHANNEL_A, unit)	// Если требуется масштабировать напряжения, выведите значение mV
+		: sourceDetails.thresholdUpper);																	// в противном случае выведите количество АЦП
+	
 	printf(scaleVoltages? "mV\n" : "ADC Counts\n");
 	printf("Press a key to start...\n");
 	_getch();
 
-	SetDefaults(unit);
+	SetDefaults(unit);
+
+	// Активирован триггер
+	// Нарастающий фронт
+	// Порог = 1000 мВ
+	status = SetTrigger(unit, &sourceDetails, 1, &conditions, 1, &directions, &pulseWidth, delay, 0, 0, 0, 0);
+
+	status = ps2000aSetEts(unit->handle, PS2000A_ETS_FAST, 20, 4, &ets_sampletime);
+
+	if (status == PICO_OK)
+	{
+		etsModeSet = TRUE;
+	}
+	else
+	{
+		printf("CollectBlockEts:ps2000aSetEts ------ 0x%08lx \n", status);
+	}
+
+	printf("ETS Sample Time is: %ld picoseconds\n", ets_sampletime);
+
+	BlockDataHandler(unit, "Ten readings after trigger\n", BUFFER_SIZE / 10 - 5, ANALOGUE, etsModeSet); // 10% данных предварительно обработаны
+
+	status = ps2000aSetEts(unit->handle, PS2000A_ETS_OFF, 20, 4, &ets_sampletime);
+
+	etsModeSet = FALSE;
+}
+
+/****************************************************************************
+* CollectBlockTriggered
+* эта функция демонстрирует, как собирать отдельный блок данных из блока
+* когда происходит запускающее событие.
+****************************************************************************/
+void CollectBlockTriggered(UNIT * unit)
+{
+	int16_t	triggerVoltage = mv_to_adc(1000, PS2000A_CHANNEL_A, unit);
+
+	PS2000A_TRIGGER_CHANNEL_PROPERTIES sourceDetails = {	triggerVoltage,
+		256 * 10,
+		triggerVoltage,
+		256 * 10,
+		PS2000A_CHANNEL_A,
+		PS2000A_LEVEL};
+
+	PS2000A_TRIGGER_CONDITIONS conditions = {	PS2000A_CONDITION_TRUE,				// Канал А
+		PS2000A_CONDITION_DONT_CARE,		// Канал B 
+		PS2000A_CONDITION_DONT_CARE,		// Канал C
+		PS2000A_CONDITION_DONT_CARE,		// Канал D
+		PS2000A_CONDITION_DONT_CARE,		// Внешний
+		PS2000A_CONDITION_DONT_CARE,		// Вспомогательный
+		PS2000A_CONDITION_DONT_CARE,		// PWQ
+		PS2000A_CONDITION_DONT_CARE};		// Цифровой
+
+
+
+	TRIGGER_DIRECTIONS directions = {	PS2000A_RISING,			// Канал А
+		PS2000A_NONE,			// Канал B
+		PS2000A_NONE,			// Канал C
+		PS2000A_NONE,			// Канал D
+		PS2000A_NONE,			// Внутренний
+		PS2000A_NONE };			// Вспомогательный
+
+	PWQ pulseWidth;
+	memset(&pulseWidth, 0, sizeof(PWQ));
+
+	printf("Collect block triggered\n");
+	printf("Data is written to disk file (%s)\n", BlockFile);
+	printf("Collects when value rises past %d", scaleVoltages?
+		adc_to_mv(sourceDetails.thresholdUpper, PS2000A_CHANNEL_A, unit)	// При масштабировании напряжений выведите значение в мВ
+		: sourceDetails.thresholdUpper);																// в противном случае выведите количество АЦП
+	printf(scaleVoltages?"mV\n" : "ADC Counts\n");
+
+	printf("Press a key to start...\n");
+	_getch();
+
+	SetDefaults(unit);
+
+	/* Активирован триггер
+	 * Нарастающий фронт
+	 * Порог = 1000 мВ */
+	SetTrigger(unit, &sourceDetails, 1, &conditions, 1, &directions, &pulseWidth, 0, 0, 0, 0, 0);
+
+	BlockDataHandler(unit, "Ten readings after trigger\n", 0, ANALOGUE, FALSE);
+}
+
+/****************************************************************************
+* CollectRapidBlock
+* эта функция демонстрирует, как собирать набор снимков, используя
+* режим быстрого блока.
+****************************************************************************/
+void CollectRapidBlock(UNIT * unit)
+{
+	int16_t i;
+	int16_t channel;
+	int16_t ***rapidBuffers;
+	int16_t *overflow;
+	
+	uint32_t nCaptures;
+	uint32_t capture;
+	uint32_t maxSegments = 0;
+	
+	int32_t nMaxSamples;
+	int32_t timeIndisposed;
+	
+	uint32_t nSamples = 1000;
+	uint32_t nCompletedCaptures;
+
+	SESSION session;
+	PICO_STATUS status;
+
+	// Преобразовать пороговое значение в значения АЦП
+	int16_t	triggerVoltage = mv_to_adc(100, PS2000A_CHANNEL_A, unit);
+
+	struct tPS2000ATriggerChannelProperties sourceDetails = {	triggerVoltage,
+																256,
+																triggerVoltage,
+																256,
+																PS2000A_CHANNEL_A,
+																PS2000A_LEVEL};
+
+	struct tPS2000ATriggerConditions conditions = {	PS2000A_CONDITION_TRUE,				// Канал А
+													PS2000A_CONDITION_DONT_CARE,		// Канал B
+													PS2000A_CONDITION_DONT_CARE,		// Канал C
+													PS2000A_CONDITION_DONT_CARE,		// Канал D
+													PS2000A_CONDITION_DONT_CARE,		// Внешний
+													PS2000A_CONDITION_DONT_CARE,		// Вспомогательный
+													PS2000A_CONDITION_DONT_CARE,		// PWQ
+													PS2000A_CONDITION_DONT_CARE};		// Цифровой
+
+	struct tPwq pulseWidth;
+
+	struct tTriggerDirections directions = {	PS2000A_RISING,			// Канал А
+												PS2000A_NONE,			// Канал B
+												PS2000A_NONE,			// Канал C
+												PS2000A_NONE,			// Канал D
+												PS2000A_NONE,			// Внутренний
+												PS2000A_NONE };			// Вспомогательный
+
+	memset(&pulseWidth, 0, sizeof(struct tPwq));
+
+	printf("Collect rapid block triggered...\n");
+	printf("Collects when value rises past %d",	scaleVoltages?
+		adc_to_mv(sourceDetails.thresholdUpper, PS2000A_CHANNEL_A, unit)	// При масштабировании напряжений выведите значение в мВ
+		: sourceDetails.thresholdUpper);																    // в противном случае выведите количество АЦП
+	
+	printf(scaleVoltages?"mV\n" : "ADC Counts\n");
+	printf("Press any key to abort\n");
+
+	SetDefaults(unit);
+
+	// Активирован триггер
+	SetTrigger(unit, &sourceDetails, 1, &conditions, 1, &directions, &pulseWidth, 0, 0, 0, 0, 0);
+
+	// Установите количество снимков
+	nCaptures = 10;
+
+	// Найдите максимальное количество сегментов для устройства
+	status = ps2000aGetMaxSegments(unit->handle, &maxSegments);
+
+	if (nCaptures > maxSegments)
+	{
+		nCaptures = maxSegments;
+	}
+
+	// Сегментировать память
+	status = ps2000aMemorySegments(unit->handle, nCaptures, &nMaxSamples);
+
+	// Установите количество снимков
+	status = ps2000aSetNoOfCaptures(unit->handle, nCaptures);
+
+	// Запустить
+	SessionInit(&session, unit, NULL);
+	session.timebase = 160;		// Обратитесь к разделу Временных баз Руководства программиста
+	status = ps2000aRunBlock(unit->handle, 0, nSamples, session.timebase, 1, &timeIndisposed, 0, CallBackBlock, &session);
+
+	// Подождите, пока данные не будут готовы
+
+	while(!session.ready.load(std::memory_order_acquire) && !_kbhit())
+	{
+		Sleep(0);
+	}
+
+	if (!session.ready.load(std::memory_order_acquire))
+	{
+		_getch();
+		status = ps2000aStop(unit->handle);
+		status = ps2000aGetNoOfCaptures(unit->handle, &nCompletedCaptures);
+		
+		printf("Rapid capture aborted. %lu complete blocks were captured\n", nCompletedCaptures);
+		printf("\nPress any key...\n\n");
+		_getch();
+
+		if (nCompletedCaptures == 0)
+		{
+			return;
+		}
+
+		// Отображать только те блоки, которые были захвачены
+		nCaptures = (uint16_t) nCompletedCaptures;
+	}
+
+	// Выделить память
+	rapidBuffers = (int16_t ***) calloc(unit->channelCount, sizeof(int16_t*));
+	overflow = (int16_t *) calloc(unit->channelCount * nCaptures, sizeof(int16_t));
+
+	for (channel = 0; channel < unit->channelCount; channel++) 
+	{
+		rapidBuffers[channel] = (int16_t**) calloc(nCaptures, sizeof(int16_t*));
+	}
+
+	for (channel = 0; channel < unit->channelCount; channel++) 
+	{	
+		if (unit->channelSettings[channel].enabled)
+		{
+			for (capture = 0; capture < nCaptures; capture++) 
+			{
+				rapidBuffers[channel][capture] = (int16_t *) BufferAlloc(nSamples * sizeof(int16_t), bufferAllocFlags);
+			}
+		}
+	}
+
+	for (channel = 0; channel < unit->channelCount; channel++) 
+	{
+		if (unit->channelSettings[channel].enabled)
+		{
+			for (capture = 0; capture < nCaptures; capture++) 
+			{
+				status = ps2000aSetDataBuffer(unit->handle, channel, rapidBuffers[channel][capture], nSamples, capture, PS2000A_RATIO_MODE_NONE);
+			}
+		}
+	}
+
+	// Получить данные
+	status = ps2000aGetValuesBulk(unit->handle, &nSamples, 0, nCaptures - 1, 1, PS2000A_RATIO_MODE_NONE, overflow);
+
+	// Остановить
+	status = ps2000aStop(unit->handle);
+
+	// Распечатайте первые 10 образцов из каждого снимка
+	for (capture = 0; capture < nCaptures; capture++)
+	{
+		printf("\nCapture %d:\n\n", capture + 1);
+
+		for (channel = 0; channel < unit->channelCount; channel++) 
+		{
+			printf("Channel %c\t", 'A' + channel);
+		}
+
+		printf("\n");
+
+		for(i = 0; i < 10; i++)
+		{
+			for (channel = 0; channel < unit->channelCount; channel++) 
+			{
+				if (unit->channelSettings[channel].enabled)
+				{
+					printf("%d\t\t", rapidBuffers[channel][capture][i]);
+				}
+			}
+
+			printf("\n");
+		}
+	}
+
+	// Свободная память
+	free(overflow);
+
+	for (channel = 0; channel < unit->channelCount; channel++) 
+	{	
+		if (unit->channelSettings[channel].enabled)
+		{
+			for (capture = 0; capture < nCaptures; capture++) 
+			{
+				BufferFree(rapidBuffers[channel][capture]);
+			}
+		}
+	}
+
+	for (channel = 0; channel < unit->channelCount; channel++) 
+	{
+		free(rapidBuffers[channel]);
+	}
+
+	free(rapidBuffers);
+
+	// Установите количество сегментов и сохраните значение 1
+    // status = ps2000aMemorySegments(единица измерения->дескриптор, 1, &nMaxSamples);
+	// статус = ps2000aSetNoOfCaptures(модуль->ручка, 1);
+
+}
+
+/****************************************************************************
+* Инициализируйте структуру модуля с помощью настроек по умолчанию для конкретных вариантов
+****************************************************************************/
+void get_info(UNIT * unit)
+{
+	int8_t description [11][25]= { "Driver Version",
+									"USB Version",
+									"Hardware Version",
+									"Variant Info",
+									"Serial",
+									"Cal Date",
+									"Kernel",
+									"Digital H/W",
+									"Analogue H/W",
+									"Firmware 1",
+									"Firmware 2"};
+
+	int16_t i, r = 0;
+	int8_t * line;
+	UNIT_INFO info;
+	PICO_STATUS status = PICO_OK;
+	int16_t numChannels = DUAL_SCOPE;
+	int8_t channelNum = 0; 
+	int8_t character = 'A';
+
+	unit->signalGenerator	= TRUE;
+	unit->ETS				= FALSE;
+	unit->firstRange		= PS2000A_20MV; // Это для новых моделей PicoScope 220X B, B MSO, 2405A и 2205A MSO, более старые устройства будут иметь первый диапазон 50 мВ
+	unit->lastRange			= PS2000A_20V; 
+	unit->channelCount		= DUAL_SCOPE;
+	unit->digitalPorts      = 0;
+	unit->awgBufferSize		= PS2000A_MAX_SIG_GEN_BUFFER_SIZE;
+
+	if (unit->handle) 
+	{
+		// Версия драйвера и серийный номер запрашиваются всегда, остальные сведения
+		// и maxValue для уже открывавшегося устройства берутся из кэша
+		memset(&info, 0, sizeof(UNIT_INFO));
+
+		status = ps2000aGetUnitInfo(unit->handle, (int8_t *) info.lines[PICO_DRIVER_VERSION], UNIT_INFO_LENGTH, &r, PICO_DRIVER_VERSION);
+		status = ps2000aGetUnitInfo(unit->handle, (int8_t *) info.lines[PICO_BATCH_AND_SERIAL], UNIT_INFO_LENGTH, &r, PICO_BATCH_AND_SERIAL);
+
+		if (!unitInfoCache || !UnitCacheFind(&unitCache, info.lines[PICO_BATCH_AND_SERIAL], info.lines[PICO_DRIVER_VERSION], &info))
+		{
+			for (i = 0; i < 11; i++) 
+			{
+				if (i != PICO_DRIVER_VERSION && i != PICO_BATCH_AND_SERIAL)
+				{
+					status = ps2000aGetUnitInfo(unit->handle, (int8_t *) info.lines[i], UNIT_INFO_LENGTH, &r, i);
+				}
+			}
+
+			ps2000aMaximumValue(unit->handle, &info.maxValue);
+
+			if (unitInfoCache)
+			{
+				UnitCacheStore(&unitCache, &info);
+			}
+		}
+		else
+		{
+			// Версия USB зависит от порта, к которому подключено устройство
+			status = ps2000aGetUnitInfo(unit->handle, (int8_t *) info.lines[PICO_USB_VERSION], UNIT_INFO_LENGTH, &r, PICO_USB_VERSION);
+		}
+
+		unit->maxValue = info.maxValue;
+		memcpy(unit->serial, info.lines[PICO_BATCH_AND_SERIAL], sizeof(unit->serial) - 1);
+		unit->serial[sizeof(unit->serial) - 1] = 0;
+
+		for (i = 0; i < 11; i++) 
+		{
+			line = (int8_t *) info.lines[i];
+			
+			if (i == PICO_VARIANT_INFO) 
+			{
+				// Проверьте, имеет ли устройство четыре канала
+
+				channelNum = line[1];
+				numChannels = atoi((char*)  & channelNum);
+
+				if (numChannels == QUAD_SCOPE)
+				{
+					unit->channelCount = QUAD_SCOPE;
+				}
+
+				// Установите первый диапазон напряжения, если устройство представляет собой 2206/7/8, 2206/7/8A или 2205 MSO
+				if (numChannels == DUAL_SCOPE)
+				{
+					if (strlen((char*)line) == 4 || (strlen((char*)line) == 5 && _strcmpi((char*)&line[4], "A") == 0) || (_strcmpi((char*)line, "2205MSO")) == 0)
+					{
+						unit->firstRange = PS2000A_50MV;
+					}
+				}
+
+				// Проверьте, является ли устройство MSO 
+				if (strstr((char*)line, "MSO"))
+				{
+					unit->digitalPorts = 2;
+				}
+
+			}
+			printf("%s: %s\n", description[i], line);
+		}
+	}
+}
+
+/****************************************************************************
+* Выберите диапазоны входного напряжения для каналов
+****************************************************************************/
+void SetVoltages(UNIT * unit)
+{
+	int32_t i, ch;
+	int32_t count = 0;
+
+	/* See what ranges are available... */
+	for (i = unit->firstRange; i <= unit->lastRange; i++) 
+	{
+		printf("%d -> %d mV\n", i, inputRanges[i]);
+	}
+
+	do
+	{
+		/* Попросите пользователя выбрать диапазон */
+		printf(u8"Укажите диапазон напряжений (%d..%d)\n", unit->firstRange, unit->lastRange);
+		printf(u8"99 - выключает канал\n");
+		for (ch = 0; ch < unit->channelCount; ch++) 
+		{
+			printf("\n");
+			do 
+			{
+				printf(u8"Канал %c: ", 'A' + ch);
+				fflush(stdin);
+				scanf_s("%hd", &unit->channelSettings[ch].range);
+			} while (unit->channelSettings[ch].range != 99 && (unit->channelSettings[ch].range < unit->firstRange || unit->channelSettings[ch].range > unit->lastRange));
+
+			if (unit->channelSettings[ch].range != 99) 
+			{
+				printf(u8" - %d мВ\n", inputRanges[unit->channelSettings[ch].range]);
+				unit->channelSettings[ch].enabled = TRUE;
+				count++;
+			} 
+			else 
+			{
+				printf(u8"Канал выключен\n");
+				unit->channelSettings[ch].enabled = FALSE;
+				unit->channelSettings[ch].range = PS2000A_MAX_RANGES-1;
+			}
+		}
+		printf(count == 0? u8"\n** Должен быть включен как минимум 1 канал **\n\n":"");
+	}
+	while(count == 0);	// должен быть включен хотя бы один канал
+
+	for (ch = 0; ch < unit->channelCount; ch++)		// Пределы смещения зависят от диапазона
+	{
+		unit->channelSettings[ch].analogueOffset = ClampAnalogueOffset(unit, (PS2000A_RANGE) unit->channelSettings[ch].range,
+			(PS2000A_COUPLING) unit->channelSettings[ch].DCcoupled, unit->channelSettings[ch].requestedOffset);
+	}
+
+	SetDefaults(unit);	// Ввести эти изменения в действие
+}
+
+/****************************************************************************
+*
+* Выберите временную базу, установите для избыточной выборки значение вкл., а единицы измерения времени - наносекунды
+*
+****************************************************************************/
+void SetTimebase(UNIT unit)
+{
+	int32_t timeInterval;
+	int32_t maxSamples;
+
+	printf(u8"Укажите желаемый временной интервал: ");
+	fflush(stdin);
+	scanf_s("%lud", &timebase);
+
+	while (ps2000aGetTimebase(unit.handle, timebase, BUFFER_SIZE, &timeInterval, 1, &maxSamples, 0))
+	{
+		timebase++;  // Увеличьте временную базу, если указанная не может быть использована.
+	}
+
+	printf(u8"Базовый показатель времени, %lu использованный  = %ld ns\n", timebase, timeInterval);
+	oversample = TRUE;
+}
+
+
+
+/****************************************************************************
+* SynthesizeWaveform
+* запрашивает форму сигнала и строит его в buffer синтезатором waveSynth
+* (см. WaveSynth.h); сигнал, уже построенный ранее, берётся из кэша
+*
+* Возвращает число отсчётов, 0 - сигнал не построен
+****************************************************************************/
+int16_t SynthesizeWaveform(UNIT * unit, int16_t * buffer)
+{
+	WAVE_PARAMS params;
+	int32_t repeats = 0;
+	int32_t size;
+	char ch;
+
+	if (!WaveSynthAttach(&waveSynth, unit->handle))
+	{
+		printf("This device has no arbitrary waveform generator\n");
+		return 0;
+	}
+
+	do
+	{
+		printf("\nSynthesized waveform\n====================\n");
+		printf("P - PULSES       C - CHIRP\n");
+		printf("R - PRBS         M - MULTI-TONE\n");
+		printf("E - SCINTILLATION DECAY\n\n");
+
+		ch = toupper(_getch());
+	}
+	while (ch != 'P' && ch != 'C' && ch != 'R' && ch != 'M' && ch != 'E');
+
+	switch (ch)
+	{
+		case 'P':
+			WaveParamsInit(&params, WAVE_PULSES);
+			break;
+
+		case 'C':
+			WaveParamsInit(&params, WAVE_CHIRP);
+			break;
+
+		case 'R':
+			WaveParamsInit(&params, WAVE_PRBS);
+			break;
+
+		case 'M':
+			WaveParamsInit(&params, WAVE_MULTITONE);
+			break;
+
+		default:
+			WaveParamsInit(&params, WAVE_DECAY);
+			break;
+	}
+
+	if (ch == 'P' || ch == 'E')
+	{
+		printf("\nEnter pulses per waveform: (1 to 1000)\n");
+		scanf_s("%d", &repeats);
+		params.repeats = repeats;
+	}
+
+	if ((size = WaveSynthGenerate(&waveSynth, &params, buffer)) == 0)
+	{
+		printf("Invalid waveform parameters\n");
+		return 0;
+	}
+
+	printf("Waveform synthesized: %d samples (%lu built, %lu taken from the cache)\n", size, waveSynth.misses, waveSynth.hits);
+
+	return (int16_t) size;
+}
+
+/****************************************************************************
+* SetSignalGenerator
+* - позволяет пользователю задавать частоту и форму сигнала
+* - позволяет загружать форму сигнала из файла (см. WaveFile.h) или синтезировать её (см. WaveSynth.h)
+***************************************************************************/
+void SetSignalGenerator(UNIT unit)
+{
+	PICO_STATUS status;
+	int16_t waveform;
+	int32_t frequency;
+	char fileName [128];
+	int64_t fileSamples = 0;
+	int16_t arbitraryWaveform [PS2000A_MAX_SIG_GEN_BUFFER_SIZE];
+	int16_t waveformSize = 0;
+	uint32_t pkpk = 2000000;
+	int32_t offset = 0;
+	uint32_t delta =0;
+	char ch;
+	int16_t choice;
+
+	memset(&arbitraryWaveform, 0, PS2000A_MAX_SIG_GEN_BUFFER_SIZE);
+
+	while (_kbhit())			// используйте максимальное нажатие клавиши
+	{
+		_getch();
+	}
+
+	do
+	{
+		printf("\nSignal Generator\n================\n");
+		printf("0 - SINE         1 - SQUARE\n");
+		printf("2 - TRIANGLE     3 - DC VOLTAGE\n");
+		printf("4 - RAMP UP      5 - RAMP DOWN\n");
+		printf("6 - SINC         7 - GAUSSIAN\n");
+		printf("8 - HALF SINE    A - AWG WAVEFORM\n");
+		printf("S - SYNTHESIZED  F - SigGen Off\n\n");
+
+		ch = _getch();
+
+		if (ch >= '0' && ch <='9')
+			choice = ch -'0';
+		else
+			ch = toupper(ch);
+	}
+	while(ch != 'A' && ch != 'S' && ch != 'F' && (ch < '0' || ch > '8')  );
+
+
+
+
+	if (ch == 'F')				// Если мы собираемся отключить siggen
+	{
+		printf("Signal generator Off\n");
+		waveform = 8;		// Напряжение постоянного тока
+		pkpk = 0;			// 0В
+		waveformSize = 0;
+	}
+	else
+		if (ch == 'A' )		// Установите AWG
+		{
+			waveformSize = 0;
+
+			printf("Select a waveform file to load: ");
+			scanf_s("%s", fileName, 128);
+
+			if (!WaveSynthAttach(&waveSynth, unit.handle))
+			{
+				printf("This device has no arbitrary waveform generator\n");
+				return;
+			}
+
+			// Двоичный int16 (.bin, .raw, .dat), CSV (последний столбец) или текст со значениями -32768..32767 либо -1..1;
+			// сигнал любой длины пересчитывается в размер буфера устройства (см. WaveFile.h)
+			if ((waveformSize = (int16_t) WaveFileLoad(&waveLoader, fileName, WAVE_FILE_AUTO, -1, &waveSynth.limits, arbitraryWaveform, &fileSamples)) > 0)
+			{
+				printf("File successfully loaded: %lld samples -> %d\n", fileSamples, waveformSize);
+			} 
+			else 
+			{
+				printf("Invalid filename\n");
+				return;
+			}
+		}
+		else
+		if (ch == 'S')		// Синтезировать сигнал для AWG
+		{
+			if ((waveformSize = SynthesizeWaveform(&unit, arbitraryWaveform)) == 0)
+			{
+				return;
+			}
+		}
+		else			// Установите одну из встроенных форм сигнала
+		{
+			switch (choice)
+			{
+				case 0:
+					waveform = PS2000A_SINE;
+					break;
+
+				case 1:
+					waveform = PS2000A_SQUARE;
+					break;
+
+				case 2:
+					waveform = PS2000A_TRIANGLE;
+					break;
+
+				case 3:
+					waveform = PS2000A_DC_VOLTAGE;
+					do 
+					{
+						printf("\nEnter offset in uV: (0 to 2500000)\n"); // Попросите пользователя ввести уровень смещения по постоянному току
+						scanf_s("%lu", &offset);
+					} while (offset < 0 || offset > 10000000);
+					break;
+
+				case 4:
+					waveform = PS2000A_RAMP_UP;
+					break;
+
+				case 5:
+					waveform = PS2000A_RAMP_DOWN;
+					break;
+
+				case 6:
+					waveform = PS2000A_SINC;
+					break;
+
+				case 7:
+					waveform = PS2000A_GAUSSIAN;
+					break;
+
+				case 8:
+					waveform = PS2000A_HALF_SINE;
+					break;
+
+				default:
+					waveform = PS2000A_SINE;
+					break;
+			}
+		}
+
+		if (waveform < 8 || ch == 'A' || ch == 'S')				// При необходимости уточните частоту
+		{
+			do 
+			{
+				printf("\nEnter frequency in Hz: (1 to 1000000)\n"); // Попросите пользователя ввести частоту сигнала
+				scanf_s("%lu", &frequency);
+			} while (frequency <= 0 || frequency > 1000000);
+		}
+
+		if (waveformSize > 0)		
+		{
+			ps2000aSigGenFrequencyToPhase(unit.handle, frequency, PS2000A_SINGLE, waveformSize, &delta);
+
+			status = ps2000aSetSigGenArbitrary(	unit.handle, 
+				0, 
+				pkpk, 
+				(uint32_t) delta, 
+				(uint32_t) delta, 
+				0, 
+				0, 
+				arbitraryWaveform, 
+				waveformSize, 
+				(PS2000A_SWEEP_TYPE) 0,
+				(PS2000A_EXTRA_OPERATIONS) 0, 
+				PS2000A_SINGLE, 
+				0, 
+				0, 
+				PS2000A_SIGGEN_RISING,
+				PS2000A_SIGGEN_NONE, 
+				0);
+
+			printf(status?"\nps2000aSetSigGenArbitrary: Status Error 0x%x \n":"", (uint32_t)status);		// Если status != 0, выводится сообщение об ошибке
+		} 
+		else 
+		{
+			status = ps2000aSetSigGenBuiltIn(unit.handle, offset, pkpk, waveform, (float)frequency, (float)frequency, 0, 0, 
+				(PS2000A_SWEEP_TYPE) 0, (PS2000A_EXTRA_OPERATIONS) 0, 0, 0, (PS2000A_SIGGEN_TRIG_TYPE) 0, (PS2000A_SIGGEN_TRIG_SOURCE) 0, 0);
+
+			printf(status?"\nps2000aSetSigGenBuiltIn: Status Error 0x%x \n":"", (uint32_t)status);		// Если status != 0, выводится сообщение об ошибке
+		}
+}
+
+/****************************************************************************
+* CollectStreamingImmediate
+* эта функция демонстрирует, как собирать поток данных
+* с устройства (начать сбор немедленно)
+***************************************************************************/
+void CollectStreamingImmediate(UNIT * unit)
+{
+	struct tPwq pulseWidth;
+	struct tTriggerDirections directions;
+
+	memset(&pulseWidth, 0, sizeof(struct tPwq));
+	memset(&directions, 0, sizeof(struct tTriggerDirections));
+
+	SetDefaults(unit);
+
+	printf("Collect streaming...\n");
+	printf("Data is written to disk file (%s)\n", StreamFile);
+	printf("Press a key to start...\n");
+	_getch();
+
+	/* Триггер отключен	*/
+	SetTrigger(unit, NULL, 0, NULL, 0, &directions, &pulseWidth, 0, 0, 0, 0, 0);
+
+	StreamDataHandler(unit, 0, ANALOGUE);
+}
+
+/****************************************************************************
+* CollectStreamingTriggered
+* эта функция демонстрирует, как собирать поток данных
+* с устройства (начать сбор при запуске)
+***************************************************************************/
+void CollectStreamingTriggered(UNIT * unit)
+{
+	int16_t triggerVoltage = mv_to_adc(1000,	PS2000A_CHANNEL_A, unit); // КаналInfo хранит количество АЦП
+	struct tPwq pulseWidth;
+
+	struct tPS2000ATriggerChannelProperties sourceDetails = {	triggerVoltage,
+		256 * 10,
+		triggerVoltage,
+		256 * 10,
+		PS2000A_CHANNEL_A,
+		PS2000A_LEVEL };
+
+	struct tPS2000ATriggerConditions conditions = {	PS2000A_CONDITION_TRUE,				// Канал А
+		PS2000A_CONDITION_DONT_CARE,		// Канал B
+		PS2000A_CONDITION_DONT_CARE,		// Канал C
+		PS2000A_CONDITION_DONT_CARE,		// Канал D
+		PS2000A_CONDITION_DONT_CARE,		// Внешний
+		PS2000A_CONDITION_DONT_CARE,		// Вспомогательный
+		PS2000A_CONDITION_DONT_CARE,		// PWQ
+		PS2000A_CONDITION_DONT_CARE };		// Цифровой
+
+	struct tTriggerDirections directions = {	PS2000A_RISING,			// Канал А
+		PS2000A_NONE,			// Канал B
+		PS2000A_NONE,			// Канал C
+		PS2000A_NONE,			// Канал D
+		PS2000A_NONE,			// Внешний
+		PS2000A_NONE };			// Вспомогательный
+
+	memset(&pulseWidth, 0, sizeof(struct tPwq));
+	/*
+	printf("Collect streaming triggered...\n");
+	printf("Data is written to disk file (%s)\n", StreamFile);
+	printf("Indicates when value rises past %d", scaleVoltages?
+		adc_to_mv(sourceDetails.thresholdUpper, PS2000A_CHANNEL_A, unit)		// При масштабировании напряжений выведите значение в мВ
+		: sourceDetails.thresholdUpper);																        // в противном случае выведите количество АЦП
+	printf(scaleVoltages?"mV\n" : "ADC Counts\n");
+	printf("Press a key to start...\n");
+	_getch();*/
+
+	SetDefaults(unit);
+
+	/* Активирован триггер
+	 * Нарастающий фронт
+	 * Порог = 1000 мВ */
+	SetTrigger(unit, &sourceDetails, 1, &conditions, 1, &directions, &pulseWidth, 0, 0, 0, 0, 0);
+
+	StreamDataHandler(unit, 0, ANALOGUE);
+}
+
+
+/****************************************************************************
+* SetupDevice
+* Настраивает только что открытое устройство: сведения о модели,
+* каналы по умолчанию, триггер отключен
+* Параметры
+* - указатель на структуру устройства с действительным дескриптором
+***************************************************************************/
+void SetupDevice(UNIT *unit)
+{
+	int32_t i;
+	PWQ pulseWidth;
+	TRIGGER_DIRECTIONS directions;
+
+	// настройка устройств
+	memset(unit->conversion, 0, sizeof(unit->conversion));
+	unit->blockPool = NULL;
+	get_info(unit);		// заполняет и maxValue
+	timebase = 1;
+
+	for ( i = 0; i < unit->channelCount; i++) {
+		unit->channelSettings[i].enabled = TRUE;
+		unit->channelSettings[i].DCcoupled = TRUE;
+		unit->channelSettings[i].range = PS2000A_5V;
+		unit->channelSettings[i].analogueOffset = 0.0f;
+		unit->channelSettings[i].requestedOffset = 0.0f;
+	}
+
+	for (i = 1; i < unit->channelCount; i++) {
+		unit->channelSettings[i].enabled = FALSE;
+	}
+
+	memset(&directions, 0, sizeof(TRIGGER_DIRECTIONS));
+	memset(&pulseWidth, 0, sizeof(PWQ));
 
-	// Активирован триггер
-	// Нарастающий фронт
-	// Порог = 1000 мВ
-	status = SetTrigger(unit, &sourceDetails, 1, &conditions, 1, &directions, &pulseWidth, delay, 0, 0, 0, 0);
+	SetDefaults(unit);
 
-	status = ps2000aSetEts(unit->handle, PS2000A_ETS_FAST, 20, 4, &ets_sampletime);
+	/* Триггер отключен	*/
+	SetTrigger(unit, NULL, 0, NULL, 0, &directions, &pulseWidth, 0, 0, 0, 0, 0);
 
-	if (status == PICO_OK)
+	if (autoOffset)
 	{
-		etsModeSet = TRUE;
+		EstimateBaseline(unit);
 	}
-	else
+
+	AutoRangeInit(&autoRange, inputRanges, unit->firstRange, unit->lastRange, unit->maxValue, autoRangeUpper, autoRangeLower, autoRangeHold);
+	SyncAutoRange(unit, &autoRange);
+}
+
+/****************************************************************************
+* OpenDevice
+* Параметры
+* - указатель единицы измерения на структуру единицы измерения, в которой будет сохранен дескриптор
+*
+* Возвращает
+* - PICO_STATUS для указания на успешное выполнение или в случае возникновения ошибки
+***************************************************************************/
+PICO_STATUS OpenDevice(UNIT *unit)
+{
+	DEVICE_ENTRY device;
+	PICO_STATUS status;
+
+	memset(&device, 0, sizeof(DEVICE_ENTRY));
+
+	if (unitInfoCache && !unitCache.loaded)
 	{
-		printf("CollectBlockEts:ps2000aSetEts ------ 0x%08lx \n", status);
+		UnitCacheLoad(&unitCache, UnitCacheFile);
 	}
 
-	printf("ETS Sample Time is: %ld picoseconds\n", ets_sampletime);
+	status = DeviceOpen(&device, openRetries, openRetryDelay);
 
-	BlockDataHandler(unit, "Ten readings after trigger\n", BUFFER_SIZE / 10 - 5, ANALOGUE, etsModeSet); // 10% данных предварительно обработаны
+	unit->handle = device.handle;
+	printf(u8"Ручка: %d\n", unit->handle);
 
-	status = ps2000aSetEts(unit->handle, PS2000A_ETS_OFF, 20, 4, &ets_sampletime);
+	if (status != PICO_OK) 
+	{
+		printf(u8"Не удается открыть устройство\n");
+		printf(u8"Код ошибки : %d\n", (int32_t)status);
+		return status;
+	}
 
-	etsModeSet = FALSE;
+	printf(u8"Устройство успешно открыто, цикл %d\n\n", ++cycles);
+
+	SetupDevice(unit);
+
+	return status;
 }
 
 /****************************************************************************
-* CollectBlockTriggered
-* эта функция демонстрирует, как собирать отдельный блок данных из блока
-* когда происходит запускающее событие.
-****************************************************************************/
-void CollectBlockTriggered(UNIT * unit)
+* PrefixFileName
+* Добавляет приставку к имени выходного файла текущего потока
+***************************************************************************/
+void PrefixFileName(char * fileName, size_t size, const char * prefix)
 {
-	int16_t	triggerVoltage = mv_to_adc(1000, unit->channelSettings[PS2000A_CHANNEL_A].range, unit);
-
-	PS2000A_TRIGGER_CHANNEL_PROPERTIES sourceDetails = {	triggerVoltage,
-		256 * 10,
-		triggerVoltage,
-		256 * 10,
-		PS2000A_CHANNEL_A,
-		PS2000A_LEVEL};
+	char name[32];
 
-	PS2000A_TRIGGER_CONDITIONS conditions = {	PS2000A_CONDITION_TRUE,				// Канал А
-		PS2000A_CONDITION_DONT_CARE,		// Канал B 
-		PS2000A_CONDITION_DONT_CARE,		// Канал C
-		PS2000A_CONDITION_DONT_CARE,		// Канал D
-		PS2000A_CONDITION_DONT_CARE,		// Внешний
-		PS2000A_CONDITION_DONT_CARE,		// Вспомогательный
-		PS2000A_CONDITION_DONT_CARE,		// PWQ
-		PS2000A_CONDITION_DONT_CARE};		// Цифровой
+	sprintf_s(name, sizeof(name), "%s", fileName);
+	sprintf_s(fileName, size, "%s%s", prefix, name);
+}
 
+/****************************************************************************
+* SetOutputPrefix
+* Делает имена всех выходных файлов текущего потока уникальными для устройства
+***************************************************************************/
+void SetOutputPrefix(const char * prefix)
+{
+	int16_t o;
 
+	PrefixFileName(BlockFile, sizeof(BlockFile), prefix);
+	PrefixFileName(DigiBlockFile, sizeof(DigiBlockFile), prefix);
+	PrefixFileName(StreamFile, sizeof(StreamFile), prefix);
+	PrefixFileName(DigiStreamFile, sizeof(DigiStreamFile), prefix);
+	PrefixFileName(CaptureFile, sizeof(CaptureFile), prefix);
+	PrefixFileName(ProtocolFile, sizeof(ProtocolFile), prefix);
+	PrefixFileName(SweepFile, sizeof(SweepFile), prefix);
 
-	TRIGGER_DIRECTIONS directions = {	PS2000A_RISING,			// Канал А
-		PS2000A_NONE,			// Канал B
-		PS2000A_NONE,			// Канал C
-		PS2000A_NONE,			// Канал D
-		PS2000A_NONE,			// Внутренний
-		PS2000A_NONE };			// Вспомогательный
+	for (o = 0; o < (int16_t) (sizeof(decimationFiles) / sizeof(DECIMATION_FILE)); o++)
+	{
+		PrefixFileName(decimationFiles[o].fileName, sizeof(decimationFiles[o].fileName), prefix);
+	}
+}
 
+/****************************************************************************
+* DeviceWorker
+* Рабочий поток одного устройства при сборе со всех устройств:
+* настройка и сбор блока без триггера или потоковый сбор (multiDeviceBlock)
+* с записью в файлы с приставкой devN_
+***************************************************************************/
+int16_t DeviceWorker(DEVICE_ENTRY * device, void * context)
+{
+	UNIT unit;
+	char prefix[8];
 	PWQ pulseWidth;
-	memset(&pulseWidth, 0, sizeof(PWQ));
+	TRIGGER_DIRECTIONS directions;
 
-	printf("Collect block triggered\n");
-	printf("Data is written to disk file (%s)\n", BlockFile);
-	printf("Collects when value rises past %d", scaleVoltages?
-		adc_to_mv(sourceDetails.thresholdUpper, unit->channelSettings[PS2000A_CHANNEL_A].range, unit)	// При масштабировании напряжений выведите значение в мВ
-		: sourceDetails.thresholdUpper);																// в противном случае выведите количество АЦП
-	printf(scaleVoltages?"mV\n" : "ADC Counts\n");
+	memset(&unit, 0, sizeof(UNIT));
+	unit.handle = device->handle;
 
-	printf("Press a key to start...\n");
-	_getch();
+	sprintf_s(prefix, sizeof(prefix), "dev%d_", device->index + 1);
+	SetOutputPrefix(prefix);
 
-	SetDefaults(unit);
+	SetupDevice(&unit);
 
-	/* Активирован триггер
-	 * Нарастающий фронт
-	 * Порог = 1000 мВ */
-	SetTrigger(unit, &sourceDetails, 1, &conditions, 1, &directions, &pulseWidth, 0, 0, 0, 0, 0);
+	if (multiDeviceBlock)
+	{
+		memset(&directions, 0, sizeof(TRIGGER_DIRECTIONS));
+		memset(&pulseWidth, 0, sizeof(PWQ));
 
-	BlockDataHandler(unit, "Ten readings after trigger\n", 0, ANALOGUE, FALSE);
+		SetDefaults(&unit);
+		SetTrigger(&unit, NULL, 0, NULL, 0, &directions, &pulseWidth, 0, 0, 0, 0, 0);
+		BlockDataHandler(&unit, "\nFirst 10 readings:\n", 0, ANALOGUE, FALSE);
+	}
+	else
+	{
+		CollectStreamingTriggered(&unit);
+	}
+
+	ReleaseBlockPool(&unit);
+	ReleaseConversion(&unit);
+
+	return 1;
 }
 
 /****************************************************************************
-* CollectRapidBlock
-* эта функция демонстрирует, как собирать набор снимков, используя
-* режим быстрого блока.
-****************************************************************************/
-void CollectRapidBlock(UNIT * unit)
+* AlignDeviceCaptures
+* Привязывает файлы захвата всех устройств к шкале отсчётов первого
+* открытого устройства и выводит смещения и уход частоты
+***************************************************************************/
+void AlignDeviceCaptures(DEVICE_MANAGER * manager)
 {
+	char names[DEVICE_MAX_UNITS][32];
+	const char * fileNames[DEVICE_MAX_UNITS];
+	int16_t devices[DEVICE_MAX_UNITS];
+	CAPTURE_ALIGNMENT alignment[DEVICE_MAX_UNITS];
+	int16_t nFiles = 0;
 	int16_t i;
-	int16_t channel;
-	int16_t ***rapidBuffers;
-	int16_t *overflow;
-	
-	uint32_t nCaptures;
-	uint32_t capture;
-	uint32_t maxSegments = 0;
-	
-	int32_t nMaxSamples;
-	int32_t timeIndisposed;
-	
-	uint32_t nSamples = 1000;
-	uint32_t nCompletedCaptures;
 
-	PICO_STATUS status;
+	memset(alignment, 0, sizeof(alignment));
 
-	// Преобразовать пороговое значение в значения АЦП
-	int16_t	triggerVoltage = mv_to_adc(100, unit->channelSettings[PS2000A_CHANNEL_A].range, unit);
+	for (i = 0; i < manager->count; i++)
+	{
+		if (manager->devices[i].status == PICO_OK)
+		{
+			sprintf_s(names[nFiles], sizeof(names[nFiles]), "dev%d_%s", i + 1, CaptureFile);
+			fileNames[nFiles] = names[nFiles];
+			devices[nFiles++] = i;
+		}
+	}
 
-	struct tPS2000ATriggerChannelProperties sourceDetails = {	triggerVoltage,
-																256,
-																triggerVoltage,
-																256,
-																PS2000A_CHANNEL_A,
-																PS2000A_LEVEL};
+	if (TimeAlignCaptures(fileNames, nFiles, 0, syncBuffer, syncThreshold, alignment) == 0)
+	{
+		printf("AlignDeviceCaptures:TimeAlignCaptures ------ no timestamps in %s\n", fileNames[0]);
+		return;
+	}
 
-	struct tPS2000ATriggerConditions conditions = {	PS2000A_CONDITION_TRUE,				// Канал А
-													PS2000A_CONDITION_DONT_CARE,		// Канал B
-													PS2000A_CONDITION_DONT_CARE,		// Канал C
-													PS2000A_CONDITION_DONT_CARE,		// Канал D
-													PS2000A_CONDITION_DONT_CARE,		// Внешний
-													PS2000A_CONDITION_DONT_CARE,		// Вспомогательный
-													PS2000A_CONDITION_DONT_CARE,		// PWQ
-													PS2000A_CONDITION_DONT_CARE};		// Цифровой
+	printf("\nAlignment to dev%d:\n", devices[0] + 1);
 
-	struct tPwq pulseWidth;
+	for (i = 0; i < nFiles; i++)
+	{
+		printf("dev%d: offset %.3f samples, scale %.9f, drift %.1f ppm, sync pulses %d, error %.0f ns\n",
+			devices[i] + 1, alignment[i].offset, alignment[i].scale, alignment[i].drift, alignment[i].syncPulses, alignment[i].error);
+	}
+}
 
-	struct tTriggerDirections directions = {	PS2000A_RISING,			// Канал А
-												PS2000A_NONE,			// Канал B
-												PS2000A_NONE,			// Канал C
-												PS2000A_NONE,			// Канал D
-												PS2000A_NONE,			// Внутренний
-												PS2000A_NONE };			// Вспомогательный
+/****************************************************************************
+* CollectAllDevices
+* Находит все подключённые устройства, открывает их и собирает данные
+* со всех одновременно, по рабочему потоку на устройство
+***************************************************************************/
+void CollectAllDevices(void)
+{
+	DEVICE_MANAGER manager;
+	int16_t started;
+	int16_t i;
 
-	memset(&pulseWidth, 0, sizeof(struct tPwq));
+	if (DeviceEnumerate(&manager) == 0)
+	{
+		printf(u8"Устройства не найдены\n");
+		return;
+	}
 
-	printf("Collect rapid block triggered...\n");
-	printf("Collects when value rises past %d",	scaleVoltages?
-		adc_to_mv(sourceDetails.thresholdUpper, unit->channelSettings[PS2000A_CHANNEL_A].range, unit)	// При масштабировании напряжений выведите значение в мВ
-		: sourceDetails.thresholdUpper);																    // в противном случае выведите количество АЦП
-	
-	printf(scaleVoltages?"mV\n" : "ADC Counts\n");
-	printf("Press any key to abort\n");
+	for (i = 0; i < manager.count; i++)
+	{
+		printf("dev%d: %s\n", i + 1, (char *) manager.devices[i].serial);
+	}
 
-	SetDefaults(unit);
+	if (unitInfoCache && !unitCache.loaded)
+	{
+		UnitCacheLoad(&unitCache, UnitCacheFile);
+	}
 
-	// Активирован триггер
-	SetTrigger(unit, &sourceDetails, 1, &conditions, 1, &directions, &pulseWidth, 0, 0, 0, 0, 0);
+	manager.retries = openRetries;
+	manager.retryDelay = openRetryDelay;
 
-	// Установите количество снимков
-	nCaptures = 10;
+	started = DeviceStartAll(&manager, DeviceWorker, NULL);
+	printf("Collecting from %d of %d devices\n", started, manager.count);
 
-	// Найдите максимальное количество сегментов для устройства
-	status = ps2000aGetMaxSegments(unit->handle, &maxSegments);
+	DeviceWaitAll(&manager);
+	DeviceCloseAll(&manager);
 
-	if (nCaptures > maxSegments)
+	for (i = 0; i < manager.count; i++)
 	{
-		nCaptures = maxSegments;
+		printf(manager.devices[i].status?"dev%d: %s ------ 0x%08lx \n":"", i + 1, (char *) manager.devices[i].serial, manager.devices[i].status);
 	}
 
-	// Сегментировать память
-	status = ps2000aMemorySegments(unit->handle, nCaptures, &nMaxSamples);
-
-	// Установите количество снимков
-	status = ps2000aSetNoOfCaptures(unit->handle, nCaptures);
+	if (binaryCapture && timeAlignment && started > 1)
+	{
+		AlignDeviceCaptures(&manager);
+	}
+}
 
-	// Запустить
-	timebase = 160;		// Обратитесь к разделу Временных баз Руководства программиста
-	status = ps2000aRunBlock(unit->handle, 0, nSamples, timebase, 1, &timeIndisposed, 0, CallBackBlock, NULL);
 
-	// Подождите, пока данные не будут готовы
-	g_ready = 0;
+/****************************************************************************
+* CoBlockRanging
+* сопрограмма: собирает blocks блоков и после каждого подбирает диапазоны
+* каналов контроллером controller - сбор, анализ, смена диапазона, повтор
+****************************************************************************/
+CO_TASK CoBlockRanging(CO_SCHEDULER * scheduler, UNIT * unit, uint32_t timebase, int16_t oversample, AUTO_RANGE * controller, int32_t blocks)
+{
+	int16_t * buffers[PS2000A_MAX_CHANNELS];
+	uint32_t nValues;
+	int32_t block;
+	int16_t overflow = 0;
+	int16_t ch;
+	PICO_STATUS status = PICO_OK;
 
-	while(!g_ready && !_kbhit())
+	for (ch = 0; ch < unit->channelCount; ch++)
 	{
-		Sleep(0);
+		buffers[ch] = NULL;
+
+		if (unit->channelSettings[ch].enabled)
+		{
+			buffers[ch] = (int16_t *) BufferAlloc(BUFFER_SIZE * sizeof(int16_t), bufferAllocFlags);
+			status = ps2000aSetDataBuffer(unit->handle, (int32_t) ch, buffers[ch], BUFFER_SIZE, 0, PS2000A_RATIO_MODE_NONE);
+			printf(status?"CoBlockRanging:ps2000aSetDataBuffer(channel %d) ------ 0x%08lx \n":"", ch, status);
+		}
 	}
 
-	if (!g_ready)
+	for (block = 0; block < blocks && status == PICO_OK; block++)
 	{
-		_getch();
-		status = ps2000aStop(unit->handle);
-		status = ps2000aGetNoOfCaptures(unit->handle, &nCompletedCaptures);
-		
-		printf("Rapid capture aborted. %lu complete blocks were captured\n", nCompletedCaptures);
-		printf("\nPress any key...\n\n");
-		_getch();
-
-		if (nCompletedCaptures == 0)
+		if ((status = co_await CoRunBlock(scheduler, unit->handle, 0, BUFFER_SIZE, timebase, oversample, 0)) != PICO_OK)
 		{
-			return;
+			printf("CoBlockRanging:block %d ------ 0x%08lx \n", block + 1, status);
+			break;
 		}
 
-		// Отображать только те блоки, которые были захвачены
-		nCaptures = (uint16_t) nCompletedCaptures;
-	}
-
-	// Выделить память
-	rapidBuffers = (int16_t ***) calloc(unit->channelCount, sizeof(int16_t*));
-	overflow = (int16_t *) calloc(unit->channelCount * nCaptures, sizeof(int16_t));
+		nValues = BUFFER_SIZE;
+		status = ps2000aGetValues(unit->handle, 0, &nValues, 1, PS2000A_RATIO_MODE_NONE, 0, &overflow);
+		printf(status?"CoBlockRanging:ps2000aGetValues ------ 0x%08lx \n":"", status);
 
-	for (channel = 0; channel < unit->channelCount; channel++) 
-	{
-		rapidBuffers[channel] = (int16_t**) calloc(nCaptures, sizeof(int16_t*));
-	}
+		SyncAutoRange(unit, controller);
+		printf("Block %d:", block + 1);
 
-	for (channel = 0; channel < unit->channelCount; channel++) 
-	{	
-		if (unit->channelSettings[channel].enabled)
+		for (ch = 0; ch < unit->channelCount; ch++)
 		{
-			for (capture = 0; capture < nCaptures; capture++) 
+			if (unit->channelSettings[ch].enabled)
 			{
-				rapidBuffers[channel][capture] = (int16_t *) calloc(nSamples, sizeof(int16_t));
+				AutoRangeObserve(controller, ch, buffers[ch], (int32_t) nValues);
+				printf("  Ch%c %+d .. %+d mV", 'A' + ch,
+					adc_to_mv(controller->channels[ch].minValue, PS2000A_CHANNEL_A + ch, unit),
+					adc_to_mv(controller->channels[ch].maxValue, PS2000A_CHANNEL_A + ch, unit));
 			}
 		}
+
+		AutoRangeOverflow(controller, overflow);
+		ApplyAutoRange(unit, controller);
+		printf("\n");
 	}
 
-	for (channel = 0; channel < unit->channelCount; channel++) 
+	ps2000aStop(unit->handle);
+	ClearDataBuffers(unit);
+
+	for (ch = 0; ch < unit->channelCount; ch++)
 	{
-		if (unit->channelSettings[channel].enabled)
-		{
-			for (capture = 0; capture < nCaptures; capture++) 
-			{
-				status = ps2000aSetDataBuffer(unit->handle, channel, rapidBuffers[channel][capture], nSamples, capture, PS2000A_RATIO_MODE_NONE);
-			}
-		}
+		BufferFree(buffers[ch]);
 	}
 
-	// Получить данные
-	status = ps2000aGetValuesBulk(unit->handle, &nSamples, 0, nCaptures - 1, 1, PS2000A_RATIO_MODE_NONE, overflow);
+	co_return status;
+}
 
-	// Остановить
-	status = ps2000aStop(unit->handle);
+/****************************************************************************
+* CoStreamPeaks
+* сопрограмма: потоковый сбор nSamples отсчётов; пики каналов по фрагментам
+* накапливаются в controller
+****************************************************************************/
+CO_TASK CoStreamPeaks(CO_SCHEDULER * scheduler, UNIT * unit, AUTO_RANGE * controller, uint32_t nSamples)
+{
+	CO_STREAM stream;
+	int16_t * buffers[PS2000A_MAX_CHANNELS];
+	uint32_t sampleInterval = 1;
+	uint64_t received = 0;
+	int32_t chunks = 0;
+	int16_t overflow = 0;
+	int16_t ch;
+	PICO_STATUS status = PICO_OK;
+
+	CoStreamInit(&stream, scheduler, unit->handle);
+	SyncAutoRange(unit, controller);
 
-	// Распечатайте первые 10 образцов из каждого снимка
-	for (capture = 0; capture < nCaptures; capture++)
+	for (ch = 0; ch < unit->channelCount; ch++)
 	{
-		printf("\nCapture %d:\n\n", capture + 1);
+		buffers[ch] = NULL;
 
-		for (channel = 0; channel < unit->channelCount; channel++) 
+		if (unit->channelSettings[ch].enabled)
 		{
-			printf("Channel %c\t", 'A' + channel);
+			buffers[ch] = (int16_t *) BufferAlloc(BUFFER_SIZE * sizeof(int16_t), bufferAllocFlags);
+			status = ps2000aSetDataBuffer(unit->handle, (int32_t) ch, buffers[ch], BUFFER_SIZE, 0, PS2000A_RATIO_MODE_NONE);
+			printf(status?"CoStreamPeaks:ps2000aSetDataBuffer(channel %d) ------ 0x%08lx \n":"", ch, status);
 		}
+	}
 
-		printf("\n");
+	if (status == PICO_OK)
+	{
+		status = ps2000aRunStreaming(unit->handle, &sampleInterval, PS2000A_US, 0, nSamples, TRUE, 1, PS2000A_RATIO_MODE_NONE, BUFFER_SIZE);
+		printf(status?"CoStreamPeaks:ps2000aRunStreaming ------ 0x%08lx \n":"", status);
+	}
 
-		for(i = 0; i < 10; i++)
+	while (status == PICO_OK && !stream.autoStop)
+	{
+		if ((status = co_await CoNextChunk(&stream)) != PICO_OK)
 		{
-			for (channel = 0; channel < unit->channelCount; channel++) 
-			{
-				if (unit->channelSettings[channel].enabled)
-				{
-					printf("%d\t\t", rapidBuffers[channel][capture][i]);
-				}
-			}
-
-			printf("\n");
+			printf("CoStreamPeaks:ps2000aGetStreamingLatestValues ------ 0x%08lx \n", status);
+			break;
 		}
-	}
 
-	// Свободная память
-	free(overflow);
-
-	for (channel = 0; channel < unit->channelCount; channel++) 
-	{	
-		if (unit->channelSettings[channel].enabled)
+		// Отсчёты фрагмента остаются в буферах до следующего co_await CoNextChunk
+		for (ch = 0; ch < unit->channelCount && stream.noOfSamples > 0; ch++)
 		{
-			for (capture = 0; capture < nCaptures; capture++) 
+			if (unit->channelSettings[ch].enabled)
 			{
-				free(rapidBuffers[channel][capture]);
+				AutoRangeObserve(controller, ch, &buffers[ch][stream.startIndex], stream.noOfSamples);
 			}
 		}
+
+		received += stream.noOfSamples;
+		overflow |= stream.overflow;
+		chunks++;
 	}
 
-	for (channel = 0; channel < unit->channelCount; channel++) 
+	printf("Streamed %llu samples in %d chunks:", received, chunks);
+
+	for (ch = 0; ch < unit->channelCount; ch++)
 	{
-		free(rapidBuffers[channel]);
+		if (unit->channelSettings[ch].enabled)
+		{
+			printf("  Ch%c %+d .. %+d mV%s", 'A' + ch,
+				adc_to_mv(controller->channels[ch].minValue, PS2000A_CHANNEL_A + ch, unit),
+				adc_to_mv(controller->channels[ch].maxValue, PS2000A_CHANNEL_A + ch, unit),
+				overflow & (1 << ch) ? " (overflow)" : "");
+		}
 	}
 
-	free(rapidBuffers);
+	printf("\n");
 
-	// Установите количество сегментов и сохраните значение 1
-    // status = ps2000aMemorySegments(единица измерения->дескриптор, 1, &nMaxSamples);
-	// статус = ps2000aSetNoOfCaptures(модуль->ручка, 1);
+	ps2000aStop(unit->handle);
+	ClearDataBuffers(unit);
+
+	for (ch = 0; ch < unit->channelCount; ch++)
+	{
+		BufferFree(buffers[ch]);
+	}
 
+	co_return status;
 }
 
 /****************************************************************************
-* Инициализируйте структуру модуля с помощью настроек по умолчанию для конкретных вариантов
+* CoRangeAndStream
+* сопрограмма: подбор диапазонов по блокам, затем потоковый сбор с ними
+* (controller - копия контроллера диапазонов потока, создавшего сопрограмму)
 ****************************************************************************/
-void get_info(UNIT * unit)
+CO_TASK CoRangeAndStream(CO_SCHEDULER * scheduler, UNIT * unit, uint32_t timebase, int16_t oversample, AUTO_RANGE controller,
+	int32_t blocks, uint32_t nSamples)
 {
-	int8_t description [11][25]= { "Driver Version",
-									"USB Version",
-									"Hardware Version",
-									"Variant Info",
-									"Serial",
-									"Cal Date",
-									"Kernel",
-									"Digital H/W",
-									"Analogue H/W",
-									"Firmware 1",
-									"Firmware 2"};
+	PICO_STATUS status;
 
-	int16_t i, r = 0;
-	int8_t line [80];
-	PICO_STATUS status = PICO_OK;
-	int16_t numChannels = DUAL_SCOPE;
-	int8_t channelNum = 0; 
-	int8_t character = 'A';
+	if ((status = co_await CoBlockRanging(scheduler, unit, timebase, oversample, &controller, blocks)) == PICO_OK)
+	{
+		status = co_await CoStreamPeaks(scheduler, unit, &controller, nSamples);
+	}
 
-	unit->signalGenerator	= TRUE;
-	unit->ETS				= FALSE;
-	unit->firstRange		= PS2000A_20MV; // Это для новых моделей PicoScope 220X B, B MSO, 2405A и 2205A MSO, более старые устройства будут иметь первый диапазон 50 мВ
-	unit->lastRange			= PS2000A_20V; 
-	unit->channelCount		= DUAL_SCOPE;
-	unit->digitalPorts      = 0;
-	unit->awgBufferSize		= PS2000A_MAX_SIG_GEN_BUFFER_SIZE;
+	co_return status;
+}
 
-	if (unit->handle) 
-	{
-		for (i = 0; i < 11; i++) 
-		{
-			status = ps2000aGetUnitInfo(unit->handle, (int8_t *) line, sizeof (line), &r, i);
-			
-			if (i == PICO_VARIANT_INFO) 
-			{
-				// Проверьте, имеет ли устройство четыре канала
+/****************************************************************************
+* CollectCoroutine
+* сбор сопрограммой CoRangeAndStream (см. CoAcquire.h): ни один поток не ждёт
+* устройство в цикле, планировщик может вести так же сопрограммы других устройств
+****************************************************************************/
+void CollectCoroutine(UNIT * unit)
+{
+	CO_SCHEDULER scheduler;
+	PWQ pulseWidth;
+	TRIGGER_DIRECTIONS directions;
 
-				channelNum = line[1];
-				numChannels = atoi((char*)  & channelNum);
+	memset(&directions, 0, sizeof(TRIGGER_DIRECTIONS));
+	memset(&pulseWidth, 0, sizeof(PWQ));
 
-				if (numChannels == QUAD_SCOPE)
-				{
-					unit->channelCount = QUAD_SCOPE;
-				}
+	printf("Collect with coroutines: %d ranging blocks, then %lu streamed samples\n", coroutineBlocks, coroutineSamples);
 
-				// Установите первый диапазон напряжения, если устройство представляет собой 2206/7/8, 2206/7/8A или 2205 MSO
-				if (numChannels == DUAL_SCOPE)
-				{
-					if (strlen((char*)line) == 4 || (strlen((char*)line) == 5 && _strcmpi((char*)&line[4], "A") == 0) || (_strcmpi((char*)line, "2205MSO")) == 0)
-					{
-						unit->firstRange = PS2000A_50MV;
-					}
-				}
+	SetDefaults(unit);
 
-				// Проверьте, является ли устройство MSO 
-				if (strstr((char*)line, "MSO"))
-				{
-					unit->digitalPorts = 2;
-				}
+	/* Триггер отключен	*/
+	SetTrigger(unit, NULL, 0, NULL, 0, &directions, &pulseWidth, 0, 0, 0, 0, 0);
+	SyncAutoRange(unit, &autoRange);
 
-			}
-			printf("%s: %s\n", description[i], line);
-		}
+	if (!CoSchedulerInit(&scheduler, blockWorkers))
+	{
+		printf("CollectCoroutine: cannot start the scheduler\n");
+		return;
 	}
+
+	// Параметры вычисляются в этом потоке, поэтому сопрограмма получает его timebase и контроллер диапазонов
+	CoSpawn(&scheduler, CoRangeAndStream(&scheduler, unit, timebase, oversample, autoRange, coroutineBlocks, coroutineSamples));
+	CoSchedulerWait(&scheduler);
+	CoSchedulerFree(&scheduler);
 }
 
+#define SWEEP_MAX_CAPTURES		64			// Наибольшее число захватов быстрого блока на точку развёртки
+#define SWEEP_MAX_TIMEBASE		100000000	// Граница поиска временной базы (интервал в нс должен помещаться в int32_t)
+#define SWEEP_RANGE_ATTEMPTS	4			// Повторов точки после смены диапазона при autoRanging
+
+// Точка частотной характеристики
+typedef struct tSweepResult
+{
+	uint32_t	timebase;
+	int32_t		interval;		// Интервал отсчётов, нс
+	double		reference;		// Амплитуда на канале генератора, мВ
+	double		response;		// Амплитуда на канале датчика, мВ
+	double		gain;			// Усиление датчика, дБ
+	double		phase;			// Сдвиг фазы датчика относительно генератора, градусы
+	int16_t		overflow;		// Перегрузка каналов хотя бы в одном захвате точки
+	int32_t		captures;		// Захватов, по которым усреднён отклик
+}SWEEP_RESULT;
+
 /****************************************************************************
-* Выберите диапазоны входного напряжения для каналов
+* SweepTimebase
+* подбирает наименьшую временную базу с интервалом отсчётов не меньше interval нс
+* для захвата nSamples отсчётов (двоичным поиском по ps2000aGetTimebase)
+*
+* Возвращает 0, если подходящей временной базы нет
 ****************************************************************************/
-void SetVoltages(UNIT * unit)
+int16_t SweepTimebase(UNIT * unit, double interval, int32_t nSamples, uint32_t * selected, int32_t * timeInterval)
 {
-	int32_t i, ch;
-	int32_t count = 0;
+	uint32_t low = 0;
+	uint32_t high = SWEEP_MAX_TIMEBASE;
+	uint32_t middle;
+	int32_t candidate;
+	int32_t maxSamples;
+	int16_t found = 0;
 
-	/* See what ranges are available... */
-	for (i = unit->firstRange; i <= unit->lastRange; i++) 
+	while (low <= high)
 	{
-		printf("%d -> %d mV\n", i, inputRanges[i]);
-	}
+		middle = low + (high - low) / 2;
 
-	do
-	{
-		/* Попросите пользователя выбрать диапазон */
-		printf(u8"Укажите диапазон напряжений (%d..%d)\n", unit->firstRange, unit->lastRange);
-		printf(u8"99 - выключает канал\n");
-		for (ch = 0; ch < unit->channelCount; ch++) 
+		if (ps2000aGetTimebase(unit->handle, middle, nSamples, &candidate, 1, &maxSamples, 0) == PICO_OK && candidate >= interval)
 		{
-			printf("\n");
-			do 
-			{
-				printf(u8"Канал %c: ", 'A' + ch);
-				fflush(stdin);
-				scanf_s("%hd", &unit->channelSettings[ch].range);
-			} while (unit->channelSettings[ch].range != 99 && (unit->channelSettings[ch].range < unit->firstRange || unit->channelSettings[ch].range > unit->lastRange));
+			*selected = middle;
+			*timeInterval = candidate;
+			found = 1;
 
-			if (unit->channelSettings[ch].range != 99) 
-			{
-				printf(u8" - %d мВ\n", inputRanges[unit->channelSettings[ch].range]);
-				unit->channelSettings[ch].enabled = TRUE;
-				count++;
-			} 
-			else 
+			if (middle == 0)
 			{
-				printf(u8"Канал выключен\n");
-				unit->channelSettings[ch].enabled = FALSE;
-				unit->channelSettings[ch].range = PS2000A_MAX_RANGES-1;
+				break;
 			}
+
+			high = middle - 1;
+		}
+		else
+		{
+			low = middle + 1;
 		}
-		printf(count == 0? u8"\n** Должен быть включен как минимум 1 канал **\n\n":"");
 	}
-	while(count == 0);	// должен быть включен хотя бы один канал
 
-	SetDefaults(unit);	// Ввести эти изменения в действие
+	return found;
 }
 
 /****************************************************************************
-*
-* Выберите временную базу, установите для избыточной выборки значение вкл., а единицы измерения времени - наносекунды
-*
+* SweepMvPerCount
+* мВ на отсчёт АЦП канала ch в текущем диапазоне (с учётом калибровки).
+* Считается по коэффициентам таблицы преобразования, а не по округлённым
+* до целых мВ значениям adc_to_mv
 ****************************************************************************/
-void SetTimebase(UNIT unit)
+double SweepMvPerCount(UNIT * unit, int16_t ch)
 {
-	int32_t timeInterval;
-	int32_t maxSamples;
-
-	printf(u8"Укажите желаемый временной интервал: ");
-	fflush(stdin);
-	scanf_s("%lud", &timebase);
+	const CONVERSION_TABLE * table = &unit->conversion[ch];
 
-	while (ps2000aGetTimebase(unit.handle, timebase, BUFFER_SIZE, &timeInterval, 1, &maxSamples, 0))
+	if (table->mv == NULL)
 	{
-		timebase++;  // Увеличьте временную базу, если указанная не может быть использована.
+		return (double) inputRanges[unit->channelSettings[ch].range] / unit->maxValue;
 	}
 
-	printf(u8"Базовый показатель времени, %lu использованный  = %ld ns\n", timebase, timeInterval);
-	oversample = TRUE;
+	return table->gain * (table->mvPerCountPositive + table->mvPerCountNegative) / 2.0;
 }
 
-
-
 /****************************************************************************
-* SetSignalGenerator
-* - позволяет пользователю задавать частоту и форму сигнала
-* - позволяет настраивать форму сигнала (значения -32768..32767) до 8192 выборок int32_t
-***************************************************************************/
-void SetSignalGenerator(UNIT unit)
+* SweepSetGenerator
+* устанавливает синус частоты frequency с размахом pkpk (мкВ): встроенным
+* генератором или, если задана таблица table, генератором произвольной формы
+****************************************************************************/
+PICO_STATUS SweepSetGenerator(UNIT * unit, double frequency, uint32_t pkpk, int16_t * table, int32_t tableSize)
 {
 	PICO_STATUS status;
-	int16_t waveform;
-	int32_t frequency;
-	char fileName [128];
-	FILE * fp = NULL;
-	int16_t arbitraryWaveform [PS2000A_MAX_SIG_GEN_BUFFER_SIZE];
-	int16_t waveformSize = 0;
-	uint32_t pkpk = 2000000;
-	int32_t offset = 0;
-	uint32_t delta =0;
-	char ch;
-	int16_t choice;
+	uint32_t delta = 0;
 
-	memset(&arbitraryWaveform, 0, PS2000A_MAX_SIG_GEN_BUFFER_SIZE);
-
-	while (_kbhit())			// используйте максимальное нажатие клавиши
+	if (table == NULL)
 	{
-		_getch();
+		status = ps2000aSetSigGenBuiltIn(unit->handle, 0, pkpk, PS2000A_SINE, (float) frequency, (float) frequency, 0, 0,
+			(PS2000A_SWEEP_TYPE) 0, (PS2000A_EXTRA_OPERATIONS) 0, 0, 0, (PS2000A_SIGGEN_TRIG_TYPE) 0, (PS2000A_SIGGEN_TRIG_SOURCE) 0, 0);
+		printf(status?"SweepSetGenerator:ps2000aSetSigGenBuiltIn ------ 0x%08lx \n":"", status);
+		return status;
 	}
 
-	do
-	{
-		printf("\nSignal Generator\n================\n");
-		printf("0 - SINE         1 - SQUARE\n");
-		printf("2 - TRIANGLE     3 - DC VOLTAGE\n");
-		printf("4 - RAMP UP      5 - RAMP DOWN\n");
-		printf("6 - SINC         7 - GAUSSIAN\n");
-		printf("8 - HALF SINE    A - AWG WAVEFORM\n");
-		printf("F - SigGen Off\n\n");
-
-		ch = _getch();
+	status = ps2000aSigGenFrequencyToPhase(unit->handle, frequency, PS2000A_SINGLE, (uint32_t) tableSize, &delta);
+	printf(status?"SweepSetGenerator:ps2000aSigGenFrequencyToPhase ------ 0x%08lx \n":"", status);
 
-		if (ch >= '0' && ch <='9')
-			choice = ch -'0';
-		else
-			ch = toupper(ch);
+	if (status != PICO_OK)
+	{
+		return status;
 	}
-	while(ch != 'A' && ch != 'F' && (ch < '0' || ch > '8')  );
 
+	status = ps2000aSetSigGenArbitrary(unit->handle, 0, pkpk, delta, delta, 0, 0, table, tableSize,
+		(PS2000A_SWEEP_TYPE) 0, (PS2000A_EXTRA_OPERATIONS) 0, PS2000A_SINGLE, 0, 0, PS2000A_SIGGEN_RISING, PS2000A_SIGGEN_NONE, 0);
+	printf(status?"SweepSetGenerator:ps2000aSetSigGenArbitrary ------ 0x%08lx \n":"", status);
 
+	return status;
+}
 
+/****************************************************************************
+* SweepPoint
+* снимает одну точку частотной характеристики на частоте frequency: подбирает
+* временную базу под sweepCycles периодов, собирает nCaptures блоков быстрым
+* блоком в буферы reference/response (зарегистрированы по сегментам) и
+* усредняет отклик. При autoRanging после смены диапазона точка снимается заново
+*
+* Возвращает PICO_STATUS (PICO_CANCELLED - прервано клавишей)
+****************************************************************************/
+PICO_STATUS SweepPoint(UNIT * unit, int16_t ** reference, int16_t ** response, int16_t * overflow, uint32_t nCaptures,
+	double frequency, SWEEP_RESULT * result)
+{
+	SESSION session;
+	TONE_RESPONSE accumulated;
+	TONE referenceTone;
+	TONE responseTone;
+	PICO_STATUS status;
+	uint32_t capture;
+	uint32_t nValues;
+	int32_t timeIndisposed;
+	int16_t attempt;
 
-	if (ch == 'F')				// Если мы собираемся отключить siggen
+	if (!SweepTimebase(unit, sweepCycles / frequency / sweepSamples * 1e9, sweepSamples, &result->timebase, &result->interval))
 	{
-		printf("Signal generator Off\n");
-		waveform = 8;		// Напряжение постоянного тока
-		pkpk = 0;			// 0В
-		waveformSize = 0;
+		return PICO_INVALID_TIMEBASE;
 	}
-	else
-		if (ch == 'A' )		// Установите AWG
-		{
-			waveformSize = 0;
-
-			printf("Select a waveform file to load: ");
-			scanf_s("%s", fileName, 128);
-			if (fopen_s(&fp, fileName, "r") == 0) 
-			{ 
-				// Открыв файл, введите данные - по одному числу в строке (максимум 8192 строки), со значениями от (-32768 до 32767)
-				while (EOF != fscanf_s(fp, "%hi", (arbitraryWaveform + waveformSize))&& waveformSize++ < (PS2000A_MAX_SIG_GEN_BUFFER_SIZE - 1));
-				fclose(fp);
-				printf("File successfully loaded\n");
-			} 
-			else 
-			{
-				printf("Invalid filename\n");
-				return;
-			}
-		}
-		else			// Установите одну из встроенных форм сигнала
-		{
-			switch (choice)
-			{
-				case 0:
-					waveform = PS2000A_SINE;
-					break;
 
-				case 1:
-					waveform = PS2000A_SQUARE;
-					break;
+	for (attempt = 0; attempt < SWEEP_RANGE_ATTEMPTS; attempt++)
+	{
+		SessionInit(&session, unit, NULL);
+		session.timebase = result->timebase;
+		status = ps2000aRunBlock(unit->handle, 0, sweepSamples, result->timebase, 1, &timeIndisposed, 0, CallBackBlock, &session);
 
-				case 2:
-					waveform = PS2000A_TRIANGLE;
-					break;
+		if (status != PICO_OK)
+		{
+			printf("SweepPoint:ps2000aRunBlock ------ 0x%08lx \n", status);
+			return status;
+		}
 
-				case 3:
-					waveform = PS2000A_DC_VOLTAGE;
-					do 
-					{
-						printf("\nEnter offset in uV: (0 to 2500000)\n"); // Попросите пользователя ввести уровень смещения по постоянному току
-						scanf_s("%lu", &offset);
-					} while (offset < 0 || offset > 10000000);
-					break;
+		while (!session.ready.load(std::memory_order_acquire) && !_kbhit())
+		{
+			Sleep(0);
+		}
 
-				case 4:
-					waveform = PS2000A_RAMP_UP;
-					break;
+		if (!session.ready.load(std::memory_order_acquire))
+		{
+			_getch();
+			ps2000aStop(unit->handle);
+			return PICO_CANCELLED;
+		}
 
-				case 5:
-					waveform = PS2000A_RAMP_DOWN;
-					break;
+		if (session.status != PICO_OK)
+		{
+			return session.status;
+		}
 
-				case 6:
-					waveform = PS2000A_SINC;
-					break;
+		nValues = (uint32_t) sweepSamples;
+		status = ps2000aGetValuesBulk(unit->handle, &nValues, 0, nCaptures - 1, 1, PS2000A_RATIO_MODE_NONE, overflow);
 
-				case 7:
-					waveform = PS2000A_GAUSSIAN;
-					break;
+		if (status != PICO_OK)
+		{
+			printf("SweepPoint:ps2000aGetValuesBulk ------ 0x%08lx \n", status);
+			return status;
+		}
 
-				case 8:
-					waveform = PS2000A_HALF_SINE;
-					break;
+		ToneResponseInit(&accumulated);
+		result->overflow = 0;
 
-				default:
-					waveform = PS2000A_SINE;
-					break;
+		for (capture = 0; capture < nCaptures; capture++)
+		{
+			result->overflow |= overflow[capture];
+
+			if (ToneMeasure(reference[capture], (int32_t) nValues, frequency * result->interval * 1e-9, &referenceTone) &&
+				ToneMeasure(response[capture], (int32_t) nValues, frequency * result->interval * 1e-9, &responseTone))
+			{
+				ToneResponseAdd(&accumulated, &referenceTone, SweepMvPerCount(unit, sweepReference),
+					&responseTone, SweepMvPerCount(unit, sweepResponse));
 			}
 		}
 
-		if (waveform < 8 || ch == 'A' )				// При необходимости уточните частоту
+		if (!ToneResponseResult(&accumulated, &result->reference, &result->response, &result->gain, &result->phase))
 		{
-			do 
-			{
-				printf("\nEnter frequency in Hz: (1 to 1000000)\n"); // Попросите пользователя ввести частоту сигнала
-				scanf_s("%lu", &frequency);
-			} while (frequency <= 0 || frequency > 1000000);
+			return PICO_SIGGEN_FREQUENCY_OUT_OF_RANGE;
 		}
 
-		if (waveformSize > 0)		
+		result->captures = accumulated.count;
+
+		if (!autoRanging)
 		{
-			ps2000aSigGenFrequencyToPhase(unit.handle, frequency, PS2000A_SINGLE, waveformSize, &delta);
+			break;
+		}
 
-			status = ps2000aSetSigGenArbitrary(	unit.handle, 
-				0, 
-				pkpk, 
-				(uint32_t) delta, 
-				(uint32_t) delta, 
-				0, 
-				0, 
-				arbitraryWaveform, 
-				waveformSize, 
-				(PS2000A_SWEEP_TYPE) 0,
-				(PS2000A_EXTRA_OPERATIONS) 0, 
-				PS2000A_SINGLE, 
-				0, 
-				0, 
-				PS2000A_SIGGEN_RISING,
-				PS2000A_SIGGEN_NONE, 
-				0);
+		SyncAutoRange(unit, &autoRange);
 
-			printf(status?"\nps2000aSetSigGenArbitrary: Status Error 0x%x \n":"", (uint32_t)status);		// Если status != 0, выводится сообщение об ошибке
-		} 
-		else 
+		for (capture = 0; capture < nCaptures; capture++)
 		{
-			status = ps2000aSetSigGenBuiltIn(unit.handle, offset, pkpk, waveform, (float)frequency, (float)frequency, 0, 0, 
-				(PS2000A_SWEEP_TYPE) 0, (PS2000A_EXTRA_OPERATIONS) 0, 0, 0, (PS2000A_SIGGEN_TRIG_TYPE) 0, (PS2000A_SIGGEN_TRIG_SOURCE) 0, 0);
+			AutoRangeObserve(&autoRange, sweepReference, reference[capture], (int32_t) nValues);
+			AutoRangeObserve(&autoRange, sweepResponse, response[capture], (int32_t) nValues);
+			AutoRangeOverflow(&autoRange, overflow[capture]);
+		}
 
-			printf(status?"\nps2000aSetSigGenBuiltIn: Status Error 0x%x \n":"", (uint32_t)status);		// Если status != 0, выводится сообщение об ошибке
+		// Диапазон не изменился - измерение в нём окончательное
+		if (!ApplyAutoRange(unit, &autoRange))
+		{
+			break;
 		}
+	}
+
+	return PICO_OK;
 }
 
 /****************************************************************************
-* CollectStreamingImmediate
-* эта функция демонстрирует, как собирать поток данных
-* с устройства (начать сбор немедленно)
-***************************************************************************/
-void CollectStreamingImmediate(UNIT * unit)
+* CollectSweep
+* снимает частотную характеристику: генератор проходит sweepPoints частот
+* от sweepStart до sweepStop для каждого размаха sweepAmplitudes, на каждой
+* точке собирается блок (или sweepCaptures блоков быстрым блоком) и измеряются
+* амплитуды и сдвиг фазы канала датчика sweepResponse относительно канала
+* генератора sweepReference. Таблица записывается в SweepFile
+****************************************************************************/
+void CollectSweep(UNIT * unit)
 {
-	struct tPwq pulseWidth;
-	struct tTriggerDirections directions;
-
-	memset(&pulseWidth, 0, sizeof(struct tPwq));
-	memset(&directions, 0, sizeof(struct tTriggerDirections));
+	int16_t * reference[SWEEP_MAX_CAPTURES];
+	int16_t * response[SWEEP_MAX_CAPTURES];
+	int16_t overflow[SWEEP_MAX_CAPTURES];
+	int16_t * table = NULL;
+	int32_t tableSize = 0;
+	WAVE_PARAMS sine;
+	double * frequencies;
+	int16_t nPoints;
+	int16_t point;
+	uint32_t amplitude;
+	uint32_t nCaptures = sweepCaptures;
+	uint32_t maxSegments = 0;
+	uint32_t capture;
+	int32_t maxSamples;
+	SWEEP_RESULT result;
+	PWQ pulseWidth;
+	TRIGGER_DIRECTIONS directions;
+	FILE * fp = NULL;
+	PICO_STATUS status = PICO_OK;
 
-	SetDefaults(unit);
+	if (sweepReference >= unit->channelCount || sweepResponse >= unit->channelCount ||
+		!unit->channelSettings[sweepReference].enabled || !unit->channelSettings[sweepResponse].enabled)
+	{
+		printf("CollectSweep: enable channels %c (generator) and %c (sensor)\n", 'A' + sweepReference, 'A' + sweepResponse);
+		return;
+	}
 
-	printf("Collect streaming...\n");
-	printf("Data is written to disk file (%s)\n", StreamFile);
-	printf("Press a key to start...\n");
-	_getch();
+	if ((frequencies = (double *) calloc(sweepPoints > 0 ? sweepPoints : 1, sizeof(double))) == NULL)
+	{
+		return;
+	}
 
-	/* Триггер отключен	*/
-	SetTrigger(unit, NULL, 0, NULL, 0, &directions, &pulseWidth, 0, 0, 0, 0, 0);
+	nPoints = ToneFrequencies(frequencies, sweepPoints, sweepStart, sweepStop, (int16_t) sweepLogarithmic);
 
-	StreamDataHandler(unit, 0, ANALOGUE);
-}
+	memset(&directions, 0, sizeof(TRIGGER_DIRECTIONS));
+	memset(&pulseWidth, 0, sizeof(PWQ));
 
-/****************************************************************************
-* CollectStreamingTriggered
-* эта функция демонстрирует, как собирать поток данных
-* с устройства (начать сбор при запуске)
-***************************************************************************/
-void CollectStreamingTriggered(UNIT * unit)
-{
-	int16_t triggerVoltage = mv_to_adc(1000,	unit->channelSettings[PS2000A_CHANNEL_A].range, unit); // КаналInfo хранит количество АЦП
-	struct tPwq pulseWidth;
+	printf("Frequency sweep: %d points %.3f .. %.3f Hz, generator on channel %c, sensor on channel %c\n",
+		nPoints, sweepStart, sweepStop, 'A' + sweepReference, 'A' + sweepResponse);
+	printf("Press any key to abort\n\n");
 
-	struct tPS2000ATriggerChannelProperties sourceDetails = {	triggerVoltage,
-		256 * 10,
-		triggerVoltage,
-		256 * 10,
-		PS2000A_CHANNEL_A,
-		PS2000A_LEVEL };
+	SetDefaults(unit);
 
-	struct tPS2000ATriggerConditions conditions = {	PS2000A_CONDITION_TRUE,				// Канал А
-		PS2000A_CONDITION_DONT_CARE,		// Канал B
-		PS2000A_CONDITION_DONT_CARE,		// Канал C
-		PS2000A_CONDITION_DONT_CARE,		// Канал D
-		PS2000A_CONDITION_DONT_CARE,		// Внешний
-		PS2000A_CONDITION_DONT_CARE,		// Вспомогательный
-		PS2000A_CONDITION_DONT_CARE,		// PWQ
-		PS2000A_CONDITION_DONT_CARE };		// Цифровой
+	/* Триггер отключен: оба канала собираются одновременно, фаза считается по их разности	*/
+	SetTrigger(unit, NULL, 0, NULL, 0, &directions, &pulseWidth, 0, 0, 0, 0, 0);
 
-	struct tTriggerDirections directions = {	PS2000A_RISING,			// Канал А
-		PS2000A_NONE,			// Канал B
-		PS2000A_NONE,			// Канал C
-		PS2000A_NONE,			// Канал D
-		PS2000A_NONE,			// Внешний
-		PS2000A_NONE };			// Вспомогательный
+	if (sweepArbitrary)
+	{
+		// Один период синуса на весь буфер наибольшего размера, допустимого устройством
+		WaveParamsInit(&sine, WAVE_MULTITONE);
+		sine.nTones = 1;
 
-	memset(&pulseWidth, 0, sizeof(struct tPwq));
-	/*
-	printf("Collect streaming triggered...\n");
-	printf("Data is written to disk file (%s)\n", StreamFile);
-	printf("Indicates when value rises past %d", scaleVoltages?
-		adc_to_mv(sourceDetails.thresholdUpper, unit->channelSettings[PS2000A_CHANNEL_A].range, unit)		// При масштабировании напряжений выведите значение в мВ
-		: sourceDetails.thresholdUpper);																        // в противном случае выведите количество АЦП
-	printf(scaleVoltages?"mV\n" : "ADC Counts\n");
-	printf("Press a key to start...\n");
-	_getch();*/
+		if ((table = (int16_t *) malloc(PS2000A_MAX_SIG_GEN_BUFFER_SIZE * sizeof(int16_t))) != NULL && WaveSynthAttach(&waveSynth, unit->handle))
+		{
+			tableSize = WaveSynthGenerate(&waveSynth, &sine, table);
+		}
 
-	SetDefaults(unit);
+		if (tableSize == 0)
+		{
+			printf("CollectSweep: no arbitrary waveform generator, using the built-in sine\n");
+			free(table);
+			table = NULL;
+		}
+	}
 
-	/* Активирован триггер
-	 * Нарастающий фронт
-	 * Порог = 1000 мВ */
-	SetTrigger(unit, &sourceDetails, 1, &conditions, 1, &directions, &pulseWidth, 0, 0, 0, 0, 0);
+	nCaptures = nCaptures < 1 ? 1 : nCaptures > SWEEP_MAX_CAPTURES ? SWEEP_MAX_CAPTURES : nCaptures;
 
-	StreamDataHandler(unit, 0, ANALOGUE);
-}
+	if (ps2000aGetMaxSegments(unit->handle, &maxSegments) == PICO_OK && nCaptures > maxSegments)
+	{
+		nCaptures = maxSegments;
+	}
 
+	status = ps2000aMemorySegments(unit->handle, nCaptures, &maxSamples);
+	printf(status?"CollectSweep:ps2000aMemorySegments ------ 0x%08lx \n":"", status);
+	status = ps2000aSetNoOfCaptures(unit->handle, nCaptures);
+	printf(status?"CollectSweep:ps2000aSetNoOfCaptures ------ 0x%08lx \n":"", status);
 
-/****************************************************************************
-* OpenDevice
-* Параметры
-* - указатель единицы измерения на структуру единицы измерения, в которой будет сохранен дескриптор
-*
-* Возвращает
-* - PICO_STATUS для указания на успешное выполнение или в случае возникновения ошибки
-***************************************************************************/
-PICO_STATUS OpenDevice(UNIT *unit)
-{
-	int16_t value = 0;
-	int32_t i;
-	PWQ pulseWidth;
-	TRIGGER_DIRECTIONS directions;
+	for (capture = 0; capture < nCaptures; capture++)
+	{
+		reference[capture] = (int16_t *) BufferAlloc(sweepSamples * sizeof(int16_t), bufferAllocFlags);
+		response[capture] = (int16_t *) BufferAlloc(sweepSamples * sizeof(int16_t), bufferAllocFlags);
 
-	PICO_STATUS status = ps2000aOpenUnit(&(unit->handle), NULL);
+		status = ps2000aSetDataBuffer(unit->handle, sweepReference, reference[capture], sweepSamples, capture, PS2000A_RATIO_MODE_NONE);
+		printf(status?"CollectSweep:ps2000aSetDataBuffer(channel %d) ------ 0x%08lx \n":"", sweepReference, status);
+		status = ps2000aSetDataBuffer(unit->handle, sweepResponse, response[capture], sweepSamples, capture, PS2000A_RATIO_MODE_NONE);
+		printf(status?"CollectSweep:ps2000aSetDataBuffer(channel %d) ------ 0x%08lx \n":"", sweepResponse, status);
+	}
 
-	printf(u8"Ручка: %d\n", unit->handle);
+	fopen_s(&fp, SweepFile, "w");
 
-	if (status != PICO_OK) 
+	if (fp != NULL)
 	{
-		printf(u8"Не удается открыть устройство\n");
-		printf(u8"Код ошибки : %d\n", (int32_t)status);
-		while(!_kbhit());
-		exit(99); // выход из программы
+		fprintf(fp, "Frequency response: generator channel %c, sensor channel %c, %s sine, %lu captures per point\n\n",
+			'A' + sweepReference, 'A' + sweepResponse, table != NULL ? "arbitrary" : "built-in", nCaptures);
+		fprintf(fp, "Frequency (Hz)   Pk-pk (uV)  Interval (ns)  Reference (mV)  Response (mV)  Gain (dB)  Phase (deg)  Captures\n");
 	}
 
-	printf(u8"Устройство успешно открыто, цикл %d\n\n", ++cycles);
+	for (amplitude = 0; amplitude < sizeof(sweepAmplitudes) / sizeof(sweepAmplitudes[0]) && status != PICO_CANCELLED; amplitude++)
+	{
+		for (point = 0; point < nPoints; point++)
+		{
+			if ((status = SweepSetGenerator(unit, frequencies[point], sweepAmplitudes[amplitude], table, tableSize)) != PICO_OK)
+			{
+				continue;
+			}
 
-	// настройка устройств
-	get_info(unit);
-	timebase = 1;
+			Sleep(sweepSettle);
 
-	ps2000aMaximumValue(unit->handle, &value);
-	unit->maxValue = value;
+			if ((status = SweepPoint(unit, reference, response, overflow, nCaptures, frequencies[point], &result)) != PICO_OK)
+			{
+				if (status == PICO_CANCELLED)
+				{
+					printf("Sweep aborted\n");
+					break;
+				}
 
-	for ( i = 0; i < unit->channelCount; i++) {
-		unit->channelSettings[i].enabled = TRUE;
-		unit->channelSettings[i].DCcoupled = TRUE;
-		unit->channelSettings[i].range = PS2000A_5V;
-	}
+				printf("%12.3f Hz: no measurement ------ 0x%08lx \n", frequencies[point], status);
+				continue;
+			}
 
-	for (i = 1; i < unit->channelCount; i++) {
-		unit->channelSettings[i].enabled = FALSE;
+			printf("%12.3f Hz  %8lu uV  %9.3f -> %9.3f mV  %8.3f dB  %8.2f deg%s\n", frequencies[point], sweepAmplitudes[amplitude],
+				result.reference, result.response, result.gain, result.phase, result.overflow ? "  overflow" : "");
+
+			if (fp != NULL)
+			{
+				fprintf(fp, "%14.3f %12lu %14d %15.4f %14.4f %10.3f %12.2f %9d%s\n", frequencies[point], sweepAmplitudes[amplitude],
+					result.interval, result.reference, result.response, result.gain, result.phase, result.captures,
+					result.overflow ? "  overflow" : "");
+			}
+		}
 	}
 
-	memset(&directions, 0, sizeof(TRIGGER_DIRECTIONS));
-	memset(&pulseWidth, 0, sizeof(PWQ));
+	if (fp != NULL)
+	{
+		fclose(fp);
+	}
 
-	SetDefaults(unit);
+	// Выключить генератор и вернуть один сегмент памяти
+	ps2000aSetSigGenBuiltIn(unit->handle, 0, 0, PS2000A_DC_VOLTAGE, 0.0f, 0.0f, 0, 0,
+		(PS2000A_SWEEP_TYPE) 0, (PS2000A_EXTRA_OPERATIONS) 0, 0, 0, (PS2000A_SIGGEN_TRIG_TYPE) 0, (PS2000A_SIGGEN_TRIG_SOURCE) 0, 0);
+	ps2000aStop(unit->handle);
+	ClearDataBuffers(unit);
+	ps2000aMemorySegments(unit->handle, 1, &maxSamples);
+	ps2000aSetNoOfCaptures(unit->handle, 1);
 
-	/* Триггер отключен	*/
-	SetTrigger(unit, NULL, 0, NULL, 0, &directions, &pulseWidth, 0, 0, 0, 0, 0);
+	for (capture = 0; capture < nCaptures; capture++)
+	{
+		BufferFree(reference[capture]);
+		BufferFree(response[capture]);
+	}
 
-	return status;
+	free(table);
+	free(frequencies);
 }
 
-
 /****************************************************************************
 * DisplaySettings
 * В этом примере отображается информация о настраиваемых пользователем параметрах
@@ -2043,12 +4799,19 @@ void DisplaySettings(UNIT *unit)
 
 			if (voltage < 1000)
 			{
-				printf("%dmV\n", voltage);
+				printf("%dmV", voltage);
 			}
 			else
 			{
-				printf("%dV\n", voltage / 1000);
+				printf("%dV", voltage / 1000);
+			}
+
+			if (unit->channelSettings[ch].analogueOffset != 0.0f)
+			{
+				printf(u8", смещение %+.3f В", unit->channelSettings[ch].analogueOffset);
 			}
+
+			printf("\n");
 		}
 	}
 	printf("\n");
@@ -2073,7 +4836,7 @@ void ANDAnalogueDigitalTriggered(UNIT * unit)
 	int32_t channel = 0;
 	PICO_STATUS status = PICO_OK;
 
-	int16_t	triggerVoltage = mv_to_adc(1000, unit->channelSettings[PS2000A_CHANNEL_A].range, unit);
+	int16_t	triggerVoltage = mv_to_adc(1000, PS2000A_CHANNEL_A, unit);
 
 
 	PS2000A_TRIGGER_CHANNEL_PROPERTIES sourceDetails = {	triggerVoltage,			// Установщик порогового значения
@@ -2115,7 +4878,7 @@ void ANDAnalogueDigitalTriggered(UNIT * unit)
 
 	printf("\nCombination Block Triggered\n");
 	printf("Collects when value is above %d", scaleVoltages?
-		adc_to_mv(sourceDetails.thresholdUpper, unit->channelSettings[PS2000A_CHANNEL_A].range, unit)	// При масштабировании напряжений выведите значение в мВ
+		adc_to_mv(sourceDetails.thresholdUpper, PS2000A_CHANNEL_A, unit)	// При масштабировании напряжений выведите значение в мВ
 		: sourceDetails.thresholdUpper);																    // в противном случае выведите количество АЦП
 	
 	printf(scaleVoltages?"mV\n" : "ADC Counts\n");
@@ -2164,7 +4927,7 @@ void ORAnalogueDigitalTriggered(UNIT * unit)
 
 	PICO_STATUS status = PICO_OK;
 
-	int16_t	triggerVoltage = mv_to_adc(1000, unit->channelSettings[PS2000A_CHANNEL_A].range, unit);
+	int16_t	triggerVoltage = mv_to_adc(1000, PS2000A_CHANNEL_A, unit);
 
 	PS2000A_TRIGGER_CHANNEL_PROPERTIES sourceDetails = {	triggerVoltage,		// Установщик порогового значения
 															256 * 10,			// Установщик порогового значения Гистерезис
@@ -2221,7 +4984,7 @@ void ORAnalogueDigitalTriggered(UNIT * unit)
 
 	printf("\nCombination Block Triggered\n");
 	printf("Collects when value rises past %d", scaleVoltages?
-		adc_to_mv(sourceDetails.thresholdUpper, unit->channelSettings[PS2000A_CHANNEL_A].range, unit)	// При масштабировании напряжений выведите значение в мВ
+		adc_to_mv(sourceDetails.thresholdUpper, PS2000A_CHANNEL_A, unit)	// При масштабировании напряжений выведите значение в мВ
 		: sourceDetails.thresholdUpper);																	// в противном случае выведите количество АЦП
 	
 	printf(scaleVoltages?"mV\n" : "ADC Counts\n");
@@ -2470,8 +5233,40 @@ int32_t main(void) {
 	printf(u8"Версия 2.3\n\n");
 	printf(u8"\n\nОткрытие устройства...\n");
 
+	if (CalibrationLoad(&calibration, CalibrationFile))
+	{
+		printf(u8"Поправки калибровки: %d (%s)\n", calibration.count, CalibrationFile);
+	}
+
+	if (multiDevice)
+	{
+		CollectAllDevices();
+		UnitCacheFree(&unitCache);
+		CalibrationFree(&calibration);
+		WaveSynthFree(&waveSynth);
+		WaveLoaderFree(&waveLoader);
+		return 0;
+	}
+
 	status = OpenDevice(&unit);
-	CollectStreamingTriggered(&unit);
+
+	if (status != PICO_OK)
+	{
+		return 99;
+	}
+
+	if (coroutineCapture)
+	{
+		CollectCoroutine(&unit);
+	}
+	else if (sweepCapture)
+	{
+		CollectSweep(&unit);
+	}
+	else
+	{
+		CollectStreamingTriggered(&unit);
+	}
 	/*
 	ch = ' ';
 
@@ -2551,6 +5346,10 @@ int32_t main(void) {
 	}
 	*/
 	CloseDevice(&unit);
+	UnitCacheFree(&unitCache);
+	CalibrationFree(&calibration);
+	WaveSynthFree(&waveSynth);
+	WaveLoaderFree(&waveLoader);
 
 	return 0;
 }